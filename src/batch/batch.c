@@ -0,0 +1,423 @@
+#include <string.h>
+#include "batch.h"
+#include "calc.h"
+#include "radix_format.h"
+#include "word.h"
+#include "pico/stdlib.h"
+
+// Expressions from the host over USB stdio, evaluated by the keypad's engine
+// in a context of their own, so the screen and the expression being typed are
+// left alone. The host does not wait for each answer: requests are read as
+// they arrive and answered in order, and the answers collect in a buffer that
+// goes out when the input runs dry, so a stream costs a USB packet per buffer
+// rather than per request.
+//
+// Text lines, one request each:
+//
+//   format [hex|dec|bin] [in hex|dec|bin] [out hex|dec|bin] [signed|unsigned] [bits N]
+//   =EXPRESSION
+//
+// format changes the radix digits are read in, the radix results are written
+// in, whether the arithmetic and decimal results are signed and the word
+// size, 8, 16, 32, 64 or 128 bits, and answers `ok`.
+// An expression is answered `=VALUE`, or `!` and the BatchStatus name.
+// VALUE has every digit of the word in hex and binary.
+//
+// Binary frames, which start with BATCH_MAGIC where a line would:
+//
+//   request   B5 flags bits tag_lo tag_hi length expression[length]
+//   response  B5 status tag_lo tag_hi length value[length]
+//
+// flags bits 0-1 are the input radix, 0 hex, 1 decimal, 2 binary, and bit 2
+// is signed. bits is the word size. The tag comes back unchanged. The value
+// is little endian, the word size long, and empty unless status is BATCH_OK.
+//
+// Expressions take the operators of the entry line, + - * / % & ~& | ~| ^ <<
+// >> <<< >>> with C precedence, parentheses, and ~ and - in front of an
+// operand. Spaces are ignored.
+
+#define FRAME_HEADER 6
+#define FLAG_RADIX_MASK 0x03
+#define FLAG_SIGNED 0x04
+
+struct BatchFormat
+{
+    uint8_t in_radix;
+    uint8_t out_radix;
+    uint8_t bits;
+    bool is_signed;
+};
+
+static const char *const status_name[BATCH_STATUS_COUNT] = {
+    [BATCH_OK] = "ok",
+    [BATCH_SYNTAX] = "syntax",
+    [BATCH_DIGIT] = "digit",
+    [BATCH_OVERFLOW] = "overflow",
+    [BATCH_DEPTH] = "depth",
+    [BATCH_DIV_ZERO] = "div0",
+    [BATCH_WORD_SIZE] = "bits",
+    [BATCH_TOO_LONG] = "long",
+    [BATCH_FORMAT] = "format",
+};
+
+static const uint8_t frame_radix[4] = {16, 10, 2, 0};
+
+static struct CalcContext context;
+static struct BatchFormat format = {.in_radix = 16, .out_radix = 16, .bits = 32};
+static struct BatchStats stats;
+
+static uint8_t frame[FRAME_HEADER + 255];
+static uint16_t frame_len; // bytes of the frame being received, 0 between frames
+
+static char out[BATCH_OUT_SIZE];
+static uint16_t out_len;
+
+/// @brief Send the answers held back. Call before printing anything else, and when the input runs dry.
+void batch_flush()
+{
+    if (out_len)
+        stdio_put_string(out, out_len, false, false);
+    out_len = 0;
+}
+
+static void put(const void *data, uint16_t len)
+{
+    if (out_len + len > sizeof(out))
+        batch_flush();
+    memcpy(out + out_len, data, len);
+    out_len += len;
+}
+
+static int digit_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+/// @brief Status for a key the engine did not take. Only an error or a full stack make it refuse what the parser sends.
+static enum BatchStatus refused()
+{
+    return calc_error() ? BATCH_DIV_ZERO : BATCH_DEPTH;
+}
+
+/// @brief The operator at text, and its length in *len. -1 if there is none.
+static int parse_operator(const char *text, const char *end, int *len)
+{
+    static const struct
+    {
+        char symbol[4];
+        uint8_t op;
+    } operators[] = {
+        // longest first, so << is not read as <
+        {"<<<", CALC_ROL}, {">>>", CALC_ROR}, {"<<", CALC_SHL}, {">>", CALC_SHR}, {"~&", CALC_NAND},
+        {"~|", CALC_NOR}, {"+", CALC_ADD}, {"-", CALC_SUB}, {"*", CALC_MUL}, {"/", CALC_DIV},
+        {"%", CALC_MOD}, {"&", CALC_AND}, {"|", CALC_OR}, {"^", CALC_XOR},
+    };
+
+    for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++)
+    {
+        int n = strlen(operators[i].symbol);
+        if (end - text >= n && !memcmp(text, operators[i].symbol, n))
+        {
+            *len = n;
+            return operators[i].op;
+        }
+    }
+    return -1;
+}
+
+/// @brief Feed an expression to the engine key by key, as typed on the keypad, and press =.
+/// @param value the result when BATCH_OK
+static enum BatchStatus evaluate(const char *text, size_t len, const struct BatchFormat *request_format,
+                                 struct Word *value)
+{
+    uint8_t radix = request_format->in_radix;
+    uint8_t bits = request_format->bits;
+    const char *end = text + len;
+    char unary[BATCH_UNARY_MAX]; // in front of the next operand, outermost first
+    int unary_count = 0;
+    uint8_t owed[CALC_DEPTH + 1]; // closes for the ~ and - wrapped round the group opened at each level
+    int level = 0;
+    bool operand_next = true;
+
+    calc_set_radix(radix);
+    calc_set_word(bits, request_format->is_signed);
+    calc_reset();
+
+    while (text < end)
+    {
+        char c = *text;
+        if (c == ' ')
+        {
+            text++;
+        }
+        else if (operand_next && (c == '~' || c == '-'))
+        {
+            if (unary_count == BATCH_UNARY_MAX)
+                return BATCH_DEPTH;
+            unary[unary_count++] = c;
+            text++;
+        }
+        else if (operand_next && c == '(')
+        {
+            // the keypad's NOT and ± act on the operand being typed, not on a group,
+            // so ~(x) goes in as (0 ~| (x)) and -(x) as (0 - (x))
+            for (int i = 0; i < unary_count; i++)
+                if (!calc_open() || !calc_digit(0) || !calc_operator(unary[i] == '~' ? CALC_NOR : CALC_SUB))
+                    return refused();
+            if (level == CALC_DEPTH || !calc_open())
+                return refused();
+            owed[++level] = unary_count;
+            unary_count = 0;
+            text++;
+        }
+        else if (operand_next && digit_value(c) >= 0)
+        {
+            const char *start = text;
+            struct Word number = {0};
+            for (; text < end && digit_value(*text) >= 0; text++)
+            {
+                int digit = digit_value(*text);
+                if (digit >= radix)
+                    return BATCH_DIGIT;
+                if (word_mul_small(&number, radix, digit, bits) & WORD_CARRY)
+                    return BATCH_OVERFLOW;
+            }
+            // signed decimals are typed as magnitudes, as on the keypad
+            if (radix == 10 && request_format->is_signed && word_bit(&number, bits - 1))
+                return BATCH_OVERFLOW;
+
+            for (; start < text; start++)
+                if (!calc_digit(digit_value(*start)))
+                    return refused();
+            while (unary_count > 0)
+                if (!(unary[--unary_count] == '~' ? calc_not() : calc_negate()))
+                    return refused();
+            operand_next = false;
+        }
+        else if (!operand_next && c == ')')
+        {
+            if (level == 0)
+                return BATCH_SYNTAX;
+            for (int i = 0; i <= owed[level]; i++)
+                if (!calc_close() || calc_error())
+                    return refused();
+            level--;
+            text++;
+        }
+        else
+        {
+            int op_len;
+            int op = operand_next ? -1 : parse_operator(text, end, &op_len);
+            if (op < 0)
+                return BATCH_SYNTAX;
+            if (!calc_operator(op))
+                return refused();
+            operand_next = true;
+            text += op_len;
+        }
+    }
+
+    if (operand_next || level > 0)
+        return BATCH_SYNTAX; // empty, a trailing operator, or an unclosed parenthesis
+    calc_equals();
+    if (calc_error())
+        return BATCH_DIV_ZERO;
+    *value = calc_result();
+    return BATCH_OK;
+}
+
+/// @brief Count a request turned down before it was evaluated.
+static enum BatchStatus reject(enum BatchStatus status)
+{
+    stats.requests++;
+    stats.errors++;
+    return status;
+}
+
+/// @brief Evaluate in the batch context and count the request.
+static enum BatchStatus request(const char *text, size_t len, const struct BatchFormat *request_format,
+                                struct Word *value)
+{
+    if (!request_format->in_radix)
+        return reject(BATCH_FORMAT);
+    if (!word_bits_valid(request_format->bits))
+        return reject(BATCH_WORD_SIZE);
+
+    uint64_t start = time_us_64();
+    struct CalcContext *keypad = calc_use(&context);
+    enum BatchStatus status = evaluate(text, len, request_format, value);
+    calc_use(keypad);
+    uint32_t us = time_us_64() - start;
+
+    stats.requests++;
+    stats.eval_us += us;
+    if (us > stats.eval_us_max)
+        stats.eval_us_max = us;
+    if (status != BATCH_OK)
+        stats.errors++;
+    return status;
+}
+
+static void put_status(enum BatchStatus status)
+{
+    put("!", 1);
+    put(status_name[status], strlen(status_name[status]));
+    put("\r\n", 2);
+}
+
+/// @brief Answer a text request, the part of the line after =.
+/// @param truncated the line did not fit the command buffer, so the expression is incomplete
+void batch_line(const char *text, bool truncated)
+{
+    struct Word value;
+    enum BatchStatus status = truncated ? reject(BATCH_TOO_LONG) : request(text, strlen(text), &format, &value);
+    if (status != BATCH_OK)
+    {
+        put_status(status);
+        return;
+    }
+
+    char digits[1 + WORD_BITS_MAX + 2];
+    int len = 0;
+    digits[len++] = '=';
+    switch (format.out_radix)
+    {
+    case 10:
+        len += radix_format_dec_word(digits + len, &value, format.bits, format.is_signed);
+        break;
+    case 2:
+        for (int bit = format.bits - 1; bit >= 0; bit--)
+            digits[len++] = '0' + word_bit(&value, bit);
+        break;
+    default:
+        len += radix_format_hex_word(digits + len, &value, format.bits);
+        break;
+    }
+    digits[len++] = '\r';
+    digits[len++] = '\n';
+    put(digits, len);
+}
+
+static uint8_t radix_named(const char *name, size_t len)
+{
+    if (len == 3 && !memcmp(name, "hex", 3))
+        return 16;
+    if (len == 3 && !memcmp(name, "dec", 3))
+        return 10;
+    if (len == 3 && !memcmp(name, "bin", 3))
+        return 2;
+    return 0;
+}
+
+/// @brief Change the format of text requests, the words after `format`. Answers ok, or !format and changes nothing.
+void batch_format(const char *args)
+{
+    struct BatchFormat next = format;
+    uint8_t *target = NULL; // radix an in or out before it applies to
+    bool want_bits = false;
+
+    while (*args)
+    {
+        while (*args == ' ')
+            args++;
+        size_t len = strcspn(args, " ");
+        if (!len)
+            break;
+
+        uint8_t radix = radix_named(args, len);
+        if (want_bits)
+        {
+            int bits = 0;
+            for (size_t i = 0; i < len && bits <= 255; i++)
+                bits = args[i] >= '0' && args[i] <= '9' ? bits * 10 + args[i] - '0' : 256;
+            if (bits > 128 || !word_bits_valid(bits))
+                break;
+            next.bits = bits;
+            want_bits = false;
+        }
+        else if (radix && target)
+        {
+            *target = radix;
+            target = NULL;
+        }
+        else if (radix)
+        {
+            next.in_radix = next.out_radix = radix;
+        }
+        else if (target)
+        {
+            break;
+        }
+        else if (len == 2 && !memcmp(args, "in", 2))
+            target = &next.in_radix;
+        else if (len == 3 && !memcmp(args, "out", 3))
+            target = &next.out_radix;
+        else if (len == 6 && !memcmp(args, "signed", 6))
+            next.is_signed = true;
+        else if (len == 8 && !memcmp(args, "unsigned", 8))
+            next.is_signed = false;
+        else if (len == 4 && !memcmp(args, "bits", 4))
+            want_bits = true;
+        else
+            break;
+        args += len;
+    }
+
+    if (*args || target || want_bits)
+    {
+        put_status(BATCH_FORMAT);
+        return;
+    }
+    format = next;
+    put("ok\r\n", 4);
+}
+
+static void frame_answer()
+{
+    struct BatchFormat frame_format = {
+        .in_radix = frame_radix[frame[1] & FLAG_RADIX_MASK],
+        .bits = frame[2],
+        .is_signed = frame[1] & FLAG_SIGNED,
+    };
+    struct Word value;
+    enum BatchStatus status = request((const char *)frame + FRAME_HEADER, frame[5], &frame_format, &value);
+    stats.frames++;
+
+    uint8_t response[5 + WORD_BITS_MAX / 8] = {BATCH_MAGIC, status, frame[3], frame[4], 0};
+    if (status == BATCH_OK)
+    {
+        response[4] = frame_format.bits / 8;
+        for (int i = 0; i < response[4]; i++)
+            response[5 + i] = value.limb[i / 4] >> (8 * (i % 4));
+    }
+    put(response, 5 + response[4]);
+}
+
+/// @brief Offer a byte from USB stdio to the binary frame reader.
+/// @param line_start nothing of a text line has been read yet, so BATCH_MAGIC starts a frame
+/// @return true if the byte belongs to a frame, false if it is text
+bool batch_frame_byte(uint8_t c, bool line_start)
+{
+    if (frame_len == 0 && (!line_start || c != BATCH_MAGIC))
+        return false;
+
+    frame[frame_len++] = c;
+    if (frame_len >= FRAME_HEADER && frame_len == FRAME_HEADER + frame[5])
+    {
+        frame_answer();
+        frame_len = 0;
+    }
+    return true;
+}
+
+/// @brief Copy the batch counters.
+void batch_get_stats(struct BatchStats *out)
+{
+    *out = stats;
+}
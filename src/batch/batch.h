@@ -0,0 +1,41 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BATCH_MAGIC 0xB5       // first byte of a binary frame, never the start of a text line
+#define BATCH_OUT_SIZE 512     // responses held back until the input runs dry or this fills
+#define BATCH_UNARY_MAX 16     // ~ and - in a row in front of one operand
+
+// Result of one request, sent back as a name on a text line or as a byte in a frame
+enum BatchStatus
+{
+    BATCH_OK,
+    BATCH_SYNTAX,    // not an expression, or unbalanced parentheses
+    BATCH_DIGIT,     // digit not in the input radix
+    BATCH_OVERFLOW,  // number does not fit the word
+    BATCH_DEPTH,     // nested deeper than the operator stack
+    BATCH_DIV_ZERO,  // division or modulo by zero
+    BATCH_WORD_SIZE, // word size the engine does not evaluate in
+    BATCH_TOO_LONG,  // line longer than the command buffer
+    BATCH_FORMAT,    // format command not understood
+    BATCH_STATUS_COUNT,
+};
+
+struct BatchStats
+{
+    uint32_t requests;    // expressions evaluated, from lines and frames
+    uint32_t frames;      // of them in binary frames
+    uint32_t errors;      // not BATCH_OK
+    uint32_t eval_us;     // total time spent evaluating
+    uint32_t eval_us_max; // longest single request
+};
+
+void batch_line(const char *text, bool truncated);
+void batch_format(const char *args);
+bool batch_frame_byte(uint8_t c, bool line_start);
+void batch_flush();
+void batch_get_stats(struct BatchStats *out);
+
+#endif
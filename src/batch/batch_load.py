@@ -0,0 +1,234 @@
+#!/usr/bin/env python3
+"""Load generator for the USB batch protocol, see batch.c.
+
+    batch_load.py DEVICE [--count N] [--window W] [--binary] [--bits B] [--seed S]
+    batch_load.py --script FILE [--count N] [--bits B] [--seed S]
+
+Streams random expressions to the calculator on its USB serial port, keeping
+up to W unanswered at once, and checks every answer against a reference
+evaluator, in unsigned words of B bits. Reports operations per second and the round trip time of each
+request, from writing it to reading its answer.
+
+--script writes the requests as a simulator key script instead, and prints
+the answers the firmware should give, so a run of the simulator can be
+compared against them.
+"""
+
+import argparse
+import os
+import random
+import selectors
+import sys
+import termios
+import time
+import tty
+
+BITS = 32  # word size, set by --bits
+MASK = (1 << BITS) - 1
+MAGIC = 0xB5
+STATUS = ["ok", "syntax", "digit", "overflow", "depth", "div0", "bits", "long", "format"]
+
+def rotation(b):
+    """Rotates take the low 32 bits of the count modulo the word size, as word.c."""
+    return (b & 0xFFFFFFFF) % BITS
+
+
+def rotate(a, b):
+    r = rotation(b)
+    return (a << r) | (a >> (BITS - r))
+
+
+# symbol: (precedence, function), as calc.c
+OPERATORS = {
+    "*": (10, lambda a, b: a * b),
+    "/": (10, lambda a, b: a // b),
+    "%": (10, lambda a, b: a % b),
+    "+": (9, lambda a, b: a + b),
+    "-": (9, lambda a, b: a - b),
+    "<<": (8, lambda a, b: a << b if b < BITS else 0),
+    ">>": (8, lambda a, b: a >> b if b < BITS else 0),
+    "<<<": (8, lambda a, b: rotate(a, b)),
+    ">>>": (8, lambda a, b: rotate(a, BITS - rotation(b))),
+    "&": (7, lambda a, b: a & b),
+    "~&": (7, lambda a, b: ~(a & b)),
+    "^": (6, lambda a, b: a ^ b),
+    "|": (5, lambda a, b: a | b),
+    "~|": (5, lambda a, b: ~(a | b)),
+}
+
+
+def generate(rng, depth):
+    """A random expression as text, with its precedence, and its value or None on division by zero."""
+    if depth == 0 or rng.random() < 0.3:
+        value = rng.choice([rng.getrandbits(BITS), rng.getrandbits(8), rng.randrange(40)])
+        text, prec = "%X" % value, 99
+    else:
+        op = rng.choice(list(OPERATORS))
+        prec, fn = OPERATORS[op]
+        left, lprec, lvalue = generate(rng, depth - 1)
+        right, rprec, rvalue = generate(rng, depth - 1)
+        # left associative, so the right side needs parentheses at equal precedence
+        if lprec < prec:
+            left = "(%s)" % left
+        if rprec <= prec:
+            right = "(%s)" % right
+        text = "%s %s %s" % (left, op, right)
+        if lvalue is None or rvalue is None or (op in "/%" and rvalue == 0):
+            value = None
+        else:
+            value = fn(lvalue, rvalue) & MASK
+
+    if rng.random() < 0.15:
+        unary = rng.choice("~-")
+        if prec != 99:
+            text = "(%s)" % text
+        text, prec = unary + text, 99
+        if value is not None:
+            value = (~value if unary == "~" else -value) & MASK
+    return text, prec, value
+
+
+def expected(value):
+    return "!div0" if value is None else "=%0*X" % (BITS // 4, value)
+
+
+def open_port(path):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+    tty.setraw(fd)
+    attrs = termios.tcgetattr(fd)
+    attrs[3] &= ~termios.ECHO
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    termios.tcflush(fd, termios.TCIOFLUSH)
+    return fd
+
+
+def encode(index, text, binary):
+    if binary:
+        data = text.encode()
+        return bytes([MAGIC, 0, BITS, index & 0xFF, (index >> 8) & 0xFF, len(data)]) + data
+    return ("=%s\n" % text).encode()
+
+
+def decode(buffer, binary):
+    """Answers complete in buffer, as (tag or None, answer text), and the bytes left over."""
+    answers = []
+    while True:
+        if binary:
+            start = buffer.find(bytes([MAGIC]))
+            if start < 0 or len(buffer) < start + 5 or len(buffer) < start + 5 + buffer[start + 4]:
+                return answers, buffer[max(start, 0):] if start >= 0 else b""
+            status, tag, length = buffer[start + 1], buffer[start + 2] | buffer[start + 3] << 8, buffer[start + 4]
+            value = int.from_bytes(buffer[start + 5:start + 5 + length], "little")
+            text = "=%0*X" % (BITS // 4, value) if status == 0 else "!" + STATUS[status] if status < len(STATUS) else "!?"
+            answers.append((tag, text))
+            buffer = buffer[start + 5 + length:]
+        else:
+            end = buffer.find(b"\n")
+            if end < 0:
+                return answers, buffer
+            line = buffer[:end].strip().decode(errors="replace")
+            buffer = buffer[end + 1:]
+            if line[:1] in ("=", "!"):
+                answers.append((None, line))  # other lines are debug output
+
+
+def run(args, requests):
+    fd = open_port(args.device)
+    selector = selectors.DefaultSelector()
+    sent_at = {}
+    latencies = []
+    mismatches = 0
+    next_send = 0
+    answered = 0
+    pending = b"" if args.binary else b"format hex bits %d\n" % BITS  # its ok is not an answer
+    received = b""
+    start = time.perf_counter()
+
+    while answered < len(requests):
+        want_write = next_send < len(requests) and next_send - answered < args.window
+        selector.register(fd, selectors.EVENT_READ | (selectors.EVENT_WRITE if want_write or pending else 0))
+        events = selector.select(timeout=2.0)
+        selector.unregister(fd)
+        if not events:
+            sys.exit("batch_load: no answer for 2 s after %d of %d" % (answered, len(requests)))
+
+        if want_write and not pending:
+            now = time.perf_counter()
+            while next_send < len(requests) and next_send - answered < args.window:
+                pending += encode(next_send, requests[next_send][0], args.binary)
+                sent_at[next_send] = now
+                next_send += 1
+        if pending:
+            try:
+                pending = pending[os.write(fd, pending):]
+            except BlockingIOError:
+                pass
+
+        try:
+            received += os.read(fd, 65536)
+        except BlockingIOError:
+            continue
+        now = time.perf_counter()
+        answers, received = decode(received, args.binary)
+        for tag, text in answers:
+            index = answered
+            if tag is not None and tag != index & 0xFFFF:
+                mismatches += 1
+            latencies.append(now - sent_at.pop(index))
+            if text != expected(requests[index][1]):
+                mismatches += 1
+                if mismatches <= 5:
+                    print("mismatch: %s gave %s, expected %s" % (requests[index][0], text, expected(requests[index][1])))
+            answered += 1
+
+    elapsed = time.perf_counter() - start
+    latencies.sort()
+    print("%d requests in %.3f s, %.0f ops/s, window %d, %s" %
+          (len(requests), elapsed, len(requests) / elapsed, args.window, "binary" if args.binary else "text"))
+    print("round trip: p50 %.3f ms, p99 %.3f ms, max %.3f ms" %
+          (latencies[len(latencies) // 2] * 1e3, latencies[len(latencies) * 99 // 100] * 1e3, latencies[-1] * 1e3))
+    print("mismatches: %d" % mismatches)
+    return 1 if mismatches else 0
+
+
+def write_script(path, requests):
+    with open(path, "w") as f:
+        f.write("# generated by batch_load.py --script\nwait 100\ntype format hex bits %d\n" % BITS)
+        for text, _ in requests:
+            f.write("type =%s\nwait 1\n" % text)
+        f.write("wait 50\n")
+    for _, value in requests:
+        print(expected(value))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("device", nargs="?", help="USB serial port of the calculator, e.g. /dev/ttyACM0")
+    parser.add_argument("--count", type=int, default=10000, help="requests to send")
+    parser.add_argument("--window", type=int, default=64, help="requests in flight at once")
+    parser.add_argument("--binary", action="store_true", help="binary frames instead of text lines")
+    parser.add_argument("--bits", type=int, default=32, choices=[8, 16, 32, 64, 128], help="word size")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--script", help="write a simulator key script instead of using a device")
+    args = parser.parse_args()
+
+    global BITS, MASK
+    BITS, MASK = args.bits, (1 << args.bits) - 1
+
+    rng = random.Random(args.seed)
+    requests = []
+    while len(requests) < args.count:
+        text, _, value = generate(rng, 3)
+        if len(text) <= 120:  # COMMAND_MAX, and the frame length byte
+            requests.append((text, value))
+
+    if args.script:
+        return write_script(args.script, requests)
+    if not args.device:
+        parser.error("a device or --script is needed")
+    return run(args, requests)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,249 @@
+#include "battery.h"
+#include "peripherals.h"
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/gpio.h"
+
+// Battery measurement, entirely in interrupts on core 0. An alarm switches
+// the divider on with BAT_ADC_EN and, once it has settled, starts a burst
+// of conversions that DMA moves out of the ADC FIFO. The DMA interrupt
+// switches the divider off again, filters the burst and publishes the
+// result, so the divider draws nothing between measurements and nobody ever
+// waits on a conversion.
+
+#define BATTERY_ADC_INPUT (BAT_ADC - 26) // ADC inputs 0-3 are GPIO 26-29
+#define BATTERY_ADC_VREF_MV 3300
+
+enum BatteryPhase
+{
+    BATTERY_IDLE,      // divider off, alarm set for the next measurement
+    BATTERY_SETTLING,  // divider on, alarm set for the burst
+    BATTERY_MEASURING, // ADC running, DMA filling samples
+    BATTERY_SUSPENDED, // no alarm, see battery_suspend()
+};
+
+// Open-circuit voltage of a Li-ion cell against state of charge, at rest and room temperature
+static const struct
+{
+    uint16_t mv;
+    uint8_t percent;
+} discharge_curve[] = {
+    {3300, 0}, {3450, 5}, {3550, 10}, {3620, 20}, {3670, 30}, {3710, 40}, {3750, 50},
+    {3790, 60}, {3840, 70}, {3910, 80}, {3990, 90}, {4080, 95}, {4180, 100},
+};
+
+static volatile enum BatteryPhase phase;
+static alarm_id_t alarm;
+static int dma_chan;
+static uint16_t samples[BATTERY_BURST];
+static int32_t filtered_mv_q4; // mV << 4, 0 until the first measurement
+static struct BatteryState state;
+static void (*changed_callback)(void);
+
+/// @brief Map a cell voltage onto the discharge curve, interpolating between its points.
+static uint8_t battery_percent(uint16_t mv)
+{
+    const uint32_t points = sizeof(discharge_curve) / sizeof(discharge_curve[0]);
+
+    if (mv <= discharge_curve[0].mv)
+        return 0;
+    for (uint32_t i = 1; i < points; i++)
+    {
+        if (mv < discharge_curve[i].mv)
+        {
+            uint32_t span_mv = discharge_curve[i].mv - discharge_curve[i - 1].mv;
+            uint32_t span_percent = discharge_curve[i].percent - discharge_curve[i - 1].percent;
+            return discharge_curve[i - 1].percent + (mv - discharge_curve[i - 1].mv) * span_percent / span_mv;
+        }
+    }
+    return 100;
+}
+
+/// @brief Mean of the burst without its highest and lowest sample, in millivolts at the cell.
+static uint16_t burst_mv()
+{
+    uint32_t sum = 0;
+    uint16_t lo = 0xFFFF;
+    uint16_t hi = 0;
+    for (uint32_t i = 0; i < BATTERY_BURST; i++)
+    {
+        uint16_t s = samples[i] & 0x0FFF;
+        sum += s;
+        lo = s < lo ? s : lo;
+        hi = s > hi ? s : hi;
+    }
+    sum -= lo + hi;
+
+    return (uint64_t)sum * BATTERY_ADC_VREF_MV * BAT_ADC_DIVIDER / (4096 * (BATTERY_BURST - 2));
+}
+
+static int64_t battery_alarm(alarm_id_t id, void *user_data);
+
+/// @brief Filter a finished burst into the published state. Runs in the DMA interrupt.
+static void battery_update()
+{
+    bool charging = !gpio_get(CHARGER_CHRG); // both charger outputs are open drain, active low
+    bool full = !gpio_get(CHARGER_STDBY);
+    int32_t mv_q4 = (int32_t)burst_mv() << 4;
+
+    // the charger steps the cell voltage when it starts or stops, so start the filter over
+    if (!filtered_mv_q4 || charging != state.charging)
+        filtered_mv_q4 = mv_q4;
+    else
+        filtered_mv_q4 += (mv_q4 - filtered_mv_q4) >> BATTERY_FILTER_SHIFT;
+
+    uint16_t mv = (filtered_mv_q4 + 8) >> 4;
+    uint8_t percent = battery_percent(mv);
+
+    // a point or two of noise against the direction of charge is not shown
+    if (state.samples && charging == state.charging)
+    {
+        if (!charging && percent > state.percent && percent < state.percent + 3)
+            percent = state.percent;
+        if (charging && percent < state.percent && percent + 3 > state.percent)
+            percent = state.percent;
+    }
+
+    bool notify = !state.samples || percent != state.percent || charging != state.charging || full != state.full;
+    state.mv = mv;
+    state.percent = percent;
+    state.charging = charging;
+    state.full = full;
+    state.samples++;
+
+    if (notify && changed_callback)
+        changed_callback();
+}
+
+static void battery_dma_handler()
+{
+    if (!dma_channel_get_irq1_status(dma_chan))
+        return;
+    dma_channel_acknowledge_irq1(dma_chan);
+
+    if (phase != BATTERY_MEASURING)
+        return; // aborted by battery_suspend()
+
+    adc_run(false);
+    adc_fifo_drain();
+    gpio_put(BAT_ADC_EN, 0);
+
+    battery_update();
+
+    phase = BATTERY_IDLE;
+    alarm = add_alarm_in_ms(BATTERY_PERIOD_MS, battery_alarm, NULL, true);
+}
+
+/// @brief Divider on, then after BATTERY_SETTLE_US the burst. Runs in the timer interrupt.
+static int64_t battery_alarm(alarm_id_t id, void *user_data)
+{
+    if (phase == BATTERY_IDLE)
+    {
+        gpio_put(BAT_ADC_EN, 1);
+        phase = BATTERY_SETTLING;
+        return BATTERY_SETTLE_US; // fire again once the divider has settled
+    }
+
+    if (phase == BATTERY_SETTLING)
+    {
+        adc_select_input(BATTERY_ADC_INPUT);
+        adc_fifo_drain();
+
+        dma_channel_config config = dma_channel_get_default_config(dma_chan);
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+        channel_config_set_read_increment(&config, false);
+        channel_config_set_write_increment(&config, true);
+        channel_config_set_dreq(&config, DREQ_ADC);
+        dma_channel_configure(dma_chan, &config, samples, &adc_hw->fifo, BATTERY_BURST, true);
+
+        phase = BATTERY_MEASURING;
+        adc_run(true);
+    }
+    return 0;
+}
+
+/// @brief Divider on and a burst once it has settled. Call with the DMA and timer interrupts masked.
+static void battery_start()
+{
+    gpio_put(BAT_ADC_EN, 1);
+    phase = BATTERY_SETTLING;
+    alarm = add_alarm_in_us(BATTERY_SETTLE_US, battery_alarm, NULL, true);
+}
+
+/// @brief Set up the ADC, its DMA channel and the charger inputs, and take the first measurement at once.
+/// @param changed called in interrupt context when the percentage or charger state changes
+void battery_init(void (*changed)(void))
+{
+    changed_callback = changed;
+
+    gpio_init(BAT_ADC_EN);
+    gpio_set_dir(BAT_ADC_EN, GPIO_OUT);
+    gpio_put(BAT_ADC_EN, 0);
+
+    gpio_init(CHARGER_CHRG);
+    gpio_set_dir(CHARGER_CHRG, GPIO_IN);
+    gpio_pull_up(CHARGER_CHRG);
+    gpio_init(CHARGER_STDBY);
+    gpio_set_dir(CHARGER_STDBY, GPIO_IN);
+    gpio_pull_up(CHARGER_STDBY);
+
+    adc_init();
+    adc_gpio_init(BAT_ADC);
+    adc_set_clkdiv(0); // back to back conversions, 2 us each
+    adc_fifo_setup(true, true, 1, false, false); // FIFO on, DREQ at one sample, 12-bit results
+
+    dma_chan = dma_claim_unused_channel(true);
+    dma_channel_set_irq1_enabled(dma_chan, true);
+    irq_add_shared_handler(DMA_IRQ_1, battery_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+
+    uint32_t status = save_and_disable_interrupts();
+    battery_start();
+    restore_interrupts(status);
+}
+
+/// @brief Copy the latest measurement. Never waits on the ADC.
+/// @param out state, samples is 0 until the first measurement completes
+void battery_get(struct BatteryState *out)
+{
+    uint32_t status = save_and_disable_interrupts();
+    *out = state;
+    restore_interrupts(status);
+}
+
+/// @brief Stop measuring, e.g. before the ADC clock is gated. A measurement in progress is abandoned.
+void battery_suspend()
+{
+    uint32_t status = save_and_disable_interrupts();
+
+    if (phase == BATTERY_MEASURING)
+    {
+        // with its interrupt masked, so the abort does not raise a spurious one
+        dma_channel_set_irq1_enabled(dma_chan, false);
+        dma_channel_abort(dma_chan);
+        dma_channel_acknowledge_irq1(dma_chan);
+        dma_channel_set_irq1_enabled(dma_chan, true);
+        adc_run(false);
+        adc_fifo_drain();
+    }
+    else if (phase != BATTERY_SUSPENDED)
+    {
+        cancel_alarm(alarm);
+    }
+
+    gpio_put(BAT_ADC_EN, 0);
+    phase = BATTERY_SUSPENDED;
+    restore_interrupts(status);
+}
+
+/// @brief Measure again at once, then every BATTERY_PERIOD_MS.
+void battery_resume()
+{
+    uint32_t status = save_and_disable_interrupts();
+    if (phase == BATTERY_SUSPENDED)
+        battery_start();
+    restore_interrupts(status);
+}
@@ -0,0 +1,26 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BATTERY_PERIOD_MS 5000 // between measurements
+#define BATTERY_SETTLE_US 1000 // BAT_ADC_EN on to first sample, for the divider and its filter capacitor
+#define BATTERY_BURST 32       // ADC samples per measurement, taken back to back at 500 kS/s
+#define BATTERY_FILTER_SHIFT 2 // measurements are blended into the filtered voltage at 1/4 weight
+
+struct BatteryState
+{
+    uint16_t mv;      // filtered cell voltage
+    uint8_t percent;  // state of charge from the Li-ion discharge curve
+    bool charging;    // CHARGER_CHRG is asserted
+    bool full;        // CHARGER_STDBY is asserted, charge complete
+    uint32_t samples; // measurements taken since boot, 0 until the first completes
+};
+
+void battery_init(void (*changed)(void));
+void battery_get(struct BatteryState *out);
+void battery_suspend();
+void battery_resume();
+
+#endif
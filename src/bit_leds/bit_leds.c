@@ -2,6 +2,187 @@
 #include "peripherals.h"
 #include "hardware/gpio.h"
 #include "pico/stdlib.h"
+#include "trace.h"
+#include "hot_path.h"
+
+#if BIT_LEDS_PIO
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "bit_leds.pio.h"
+
+// The PIO program shifts out one word per bit plane and shows plane k for
+// (BIT_LEDS_UNIT_CYCLES << k) state machine cycles, so a LED at level L is lit
+// for a time proportional to L. A DMA pair replays the plane table forever:
+// the data channel feeds the table to the TX FIFO and chains to the control
+// channel, which points it back at the start of whichever table is active.
+//
+// The control channel only reads active_table once per refresh, so two
+// updates within a refresh can leave the channel playing a table that is no
+// longer the active one. There are three tables, and an update rebuilds the
+// one that is neither active nor being played.
+#define BIT_LEDS_SM_HZ 10000000     // 100 ns per state machine cycle, one bit takes two
+#define BIT_LEDS_UNIT_CYCLES 640    // 64 us for the least significant plane, ~1 kHz refresh with 4 planes
+#define BIT_LEDS_TABLE_WORDS (2 * BIT_LEDS_PLANES)
+#define BIT_LEDS_TABLES 3
+
+static PIO pio = pio0;
+static uint sm;
+static int data_chan = -1;
+static int ctrl_chan;
+
+// Plane tables, (word, on time) pairs. The spare word keeps the end of one
+// table from being the start of the next, so the read address tells them apart.
+static uint32_t tables[BIT_LEDS_TABLES][BIT_LEDS_TABLE_WORDS + 1];
+static uint32_t *volatile active_table;
+
+static uint32_t shown_value;
+static uint32_t plane_mask[BIT_LEDS_PLANES]; // LEDs whose level has bit k set
+static uint8_t global_brightness = 255;
+
+/// @brief The plane table the data channel is replaying, up to its reload, or NULL before the loop starts.
+static const uint32_t *HOT_FUNC(playing_table)()
+{
+    if (data_chan < 0)
+        return NULL;
+
+    uintptr_t addr = dma_hw->ch[data_chan].read_addr; // past the last word read, the end once it is done
+    for (int i = 0; i < BIT_LEDS_TABLES; i++)
+        if (addr >= (uintptr_t)tables[i] && addr <= (uintptr_t)(tables[i] + BIT_LEDS_TABLE_WORDS))
+            return tables[i];
+    return NULL;
+}
+
+/// @brief Rebuild a free plane table from the current value, levels and brightness, then make it active.
+static void HOT_FUNC(bit_leds_update)()
+{
+    // active first: the channel only loads what was active, so it cannot
+    // move on to a table other than these two meanwhile
+    const uint32_t *active = active_table;
+    const uint32_t *playing = playing_table();
+    uint32_t *table = tables[0];
+    for (int i = 0; i < BIT_LEDS_TABLES; i++)
+    {
+        if (tables[i] != active && tables[i] != playing)
+        {
+            table = tables[i];
+            break;
+        }
+    }
+
+    for (int k = 0; k < BIT_LEDS_PLANES; k++)
+    {
+        uint32_t on_cycles = ((BIT_LEDS_UNIT_CYCLES << k) * global_brightness + 127) / 255;
+
+        table[2 * k] = on_cycles ? shown_value & plane_mask[k] : 0;
+        table[2 * k + 1] = on_cycles ? on_cycles - 1 : 0; // `jmp y--` runs y + 1 times
+    }
+
+    // the control channel picks this up at the start of the next refresh
+    active_table = table;
+}
+
+/// @brief Init the bit LEDs, loading the PIO program and starting the DMA loop that refreshes them.
+void bit_leds_init()
+{
+    // SRCLR is not driven by the PIO program, hold it inactive
+    gpio_init(LED_SRCLR);
+    gpio_set_dir(LED_SRCLR, true);
+    gpio_put(LED_SRCLR, true);
+
+    bit_leds_set_levels(NULL);
+
+    uint offset = pio_add_program(pio, &bit_leds_program);
+    sm = pio_claim_unused_sm(pio, true);
+    bit_leds_program_init(pio, sm, offset, LED_SER, LED_SRCLK, LED_RCLK,
+                          (float)clock_get_hz(clk_sys) / BIT_LEDS_SM_HZ);
+
+    data_chan = dma_claim_unused_channel(true);
+    ctrl_chan = dma_claim_unused_channel(true);
+
+    dma_channel_config config = dma_channel_get_default_config(data_chan);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    channel_config_set_dreq(&config, pio_get_dreq(pio, sm, true));
+    channel_config_set_chain_to(&config, ctrl_chan);
+    dma_channel_configure(data_chan, &config, &pio->txf[sm], NULL, BIT_LEDS_TABLE_WORDS, false);
+
+    config = dma_channel_get_default_config(ctrl_chan);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, false);
+    dma_channel_configure(ctrl_chan, &config, &dma_hw->ch[data_chan].al3_read_addr_trig, &active_table, 1, true);
+}
+
+/// @brief Enable or disable the LED outputs. Disabling stops the refresh loop and blanks the LEDs immediately.
+/// @param enable true to show the LEDs
+void bit_leds_enable(bool enable)
+{
+    if (!enable)
+    {
+        pio_sm_set_enabled(pio, sm, false);
+        pio_sm_exec(pio, sm, pio_encode_set(pio_pins, 0b10)); // OE high
+    }
+    else
+    {
+        pio_sm_set_enabled(pio, sm, true);
+    }
+}
+
+/// @brief Turn off all LEDs.
+void bit_leds_clear()
+{
+    bit_leds_set(0);
+}
+
+/// @brief Nothing to do, every plane is latched by the state machine as it is shifted in. Kept for API compatibility.
+void bit_leds_latch()
+{
+}
+
+/// @brief Lights the LEDs corresponding to the provided 32-bit value. Returns immediately, the LEDs follow within one refresh (~1 ms).
+/// @param value The number to display in binary on the LEDs
+void HOT_FUNC(bit_leds_set)(uint32_t value)
+{
+    // Same wiring caveat as the bit-banged version below: byte 3 goes out
+    // first, MSB first, which is just the whole word MSB first.
+    shown_value = value;
+    bit_leds_update();
+    trace_mark(TRACE_LED_LATCH, trace_last_key()); // the state machine latches it at the next refresh
+}
+
+/// @brief Set the brightness of all LEDs together, by scaling the on time of every bit plane.
+/// @param brightness 0 (off) to 255 (full)
+void bit_leds_set_brightness(uint8_t brightness)
+{
+    global_brightness = brightness;
+    bit_leds_update();
+}
+
+/// @brief Set the brightness of each LED individually.
+/// @param levels 32 levels from 0 to BIT_LEDS_LEVELS - 1, indexed by bit number, or NULL for all at full
+void bit_leds_set_levels(const uint8_t *levels)
+{
+    for (int k = 0; k < BIT_LEDS_PLANES; k++)
+    {
+        uint32_t mask = 0;
+        for (int i = 0; i < 32; i++)
+        {
+            uint8_t level = levels ? levels[i] : BIT_LEDS_LEVELS - 1;
+            if ((level >> k) & 1)
+                mask |= 1u << i;
+        }
+        plane_mask[k] = mask;
+    }
+    bit_leds_update();
+}
+
+/// @brief Keep the state machine at BIT_LEDS_SM_HZ after clk_sys changed, so the refresh rate and levels stay the same.
+void bit_leds_clock_changed()
+{
+    pio_sm_set_clkdiv(pio, sm, (float)clock_get_hz(clk_sys) / BIT_LEDS_SM_HZ);
+}
+
+#else
 
 /// @brief Init the bit LEDs, setting up the GPIOs for shift register control lines and clearing the LEDs.
 void bit_leds_init()
@@ -47,7 +228,7 @@ void bit_leds_clear()
 }
 
 /// @brief Latch shift register to storage register for output
-void bit_leds_latch()
+void HOT_FUNC(bit_leds_latch)()
 {
     gpio_put(LED_RCLK, false);
     sleep_us(1);
@@ -59,7 +240,7 @@ void bit_leds_latch()
 
 /// @brief Lights the LEDs corresponding to the provided 32-bit value
 /// @param value The number to display in binary on the LEDs
-void bit_leds_set(uint32_t value)
+void HOT_FUNC(bit_leds_set)(uint32_t value)
 {
     // The LEDs are wired kind of funny. In hindsight not very smart.
     // Each shift register QA is the MSB, and QG is the LSB. Then QH wraps
@@ -89,4 +270,26 @@ void bit_leds_set(uint32_t value)
     }
 
     bit_leds_latch(); // latch shifted data for output
+    trace_mark(TRACE_LED_LATCH, trace_last_key());
 }
+
+/// @brief Without the PIO there is no modulation, any brightness above 0 is full on.
+/// @param brightness 0 (off) to 255 (full)
+void bit_leds_set_brightness(uint8_t brightness)
+{
+    bit_leds_enable(brightness > 0);
+}
+
+/// @brief Without the PIO per-LED levels are not supported.
+/// @param levels ignored
+void bit_leds_set_levels(const uint8_t *levels)
+{
+    (void)levels;
+}
+
+/// @brief Nothing to do, the bit-banged timing is in microseconds.
+void bit_leds_clock_changed()
+{
+}
+
+#endif
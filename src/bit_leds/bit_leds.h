@@ -4,10 +4,16 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#define BIT_LEDS_PLANES 4                       // bit planes of per-LED brightness
+#define BIT_LEDS_LEVELS (1 << BIT_LEDS_PLANES) // brightness levels per LED
+
 void bit_leds_init();
 void bit_leds_enable(bool enable);
 void bit_leds_clear();
 void bit_leds_latch();
 void bit_leds_set(uint32_t value);
+void bit_leds_set_brightness(uint8_t brightness);
+void bit_leds_set_levels(const uint8_t *levels);
+void bit_leds_clock_changed();
 
-#endif
\ No newline at end of file
+#endif
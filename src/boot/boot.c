@@ -0,0 +1,58 @@
+#include "boot.h"
+#include "pico/stdlib.h"
+
+// Each stage is written by the one core that runs it, so no lock is needed.
+// done is set last, so a reader on the other core sees a stage whole or as
+// not finished yet.
+
+static volatile uint32_t main_us;
+static volatile uint32_t begin_us[BOOT_STAGES];
+static volatile uint32_t end_us[BOOT_STAGES];
+static volatile bool done[BOOT_STAGES];
+
+static const char *const names[BOOT_STAGES] = {
+    [BOOT_POWER] = "power latch",
+    [BOOT_LEDS] = "bit leds",
+    [BOOT_RESTORE] = "restore",
+    [BOOT_USB] = "usb",
+    [BOOT_KEYPAD] = "keypad",
+    [BOOT_BATTERY] = "battery",
+    [BOOT_PANEL] = "panel init",
+    [BOOT_FIRST_FRAME] = "first frame",
+};
+
+/// @brief Note when main() started. Call first thing in main().
+void boot_init()
+{
+    main_us = time_us_32();
+}
+
+void boot_begin(enum BootStage stage)
+{
+    begin_us[stage] = time_us_32();
+}
+
+void boot_end(enum BootStage stage)
+{
+    end_us[stage] = time_us_32();
+    done[stage] = true;
+}
+
+/// @brief Copy the stage times.
+void boot_get_report(struct BootReport *out)
+{
+    out->main_us = main_us;
+    out->done = 0;
+    for (int i = 0; i < BOOT_STAGES; i++)
+    {
+        out->begin_us[i] = begin_us[i];
+        out->end_us[i] = end_us[i];
+        if (done[i])
+            out->done |= 1u << i;
+    }
+}
+
+const char *boot_stage_name(enum BootStage stage)
+{
+    return stage < BOOT_STAGES ? names[stage] : "?";
+}
@@ -0,0 +1,38 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Boot stages, in the order they start. Core 1 brings the panel up while
+// core 0 does the rest.
+enum BootStage
+{
+    BOOT_POWER,       // latch POWER_EN
+    BOOT_LEDS,        // bit LED shift registers
+    BOOT_RESTORE,     // replay the journal and submit the first frame
+    BOOT_USB,         // USB stdio
+    BOOT_KEYPAD,      // TCA8418 setup over I2C
+    BOOT_BATTERY,     // start the background measurement
+    BOOT_PANEL,       // core 1: SSD1322 reset and init sequence
+    BOOT_FIRST_FRAME, // core 1: the first frame drawn and on the panel
+    BOOT_STAGES,
+};
+
+// Microseconds since reset. The timer starts counting when the chip comes out
+// of reset, shortly after the power button, so this includes the boot ROM.
+struct BootReport
+{
+    uint32_t main_us; // main() entered
+    uint32_t begin_us[BOOT_STAGES];
+    uint32_t end_us[BOOT_STAGES];
+    uint32_t done; // bit per stage that has finished
+};
+
+void boot_init();
+void boot_begin(enum BootStage stage);
+void boot_end(enum BootStage stage);
+void boot_get_report(struct BootReport *out);
+const char *boot_stage_name(enum BootStage stage);
+
+#endif
@@ -0,0 +1,568 @@
+#include <string.h>
+#include "calc.h"
+#include "radix_format.h"
+
+// Incremental evaluator for the entry line. Keys are folded in as they
+// arrive with an operator precedence stack, so no key ever re-reads the
+// entry: a digit updates the operand, and once the operand after an operator
+// starts, the operator reduces whatever binds at least as tightly and is
+// pushed. Until then another operator can replace it. The live result folds
+// the stack once more without changing it. The stack is at most CALC_DEPTH deep, so every
+// key costs a bounded amount of work however long the expression gets.
+//
+// The entry line is drawn from the last CALC_TOKENS operands and operators,
+// which is more than fits on the panel.
+//
+// Values are words of the context's size, see word.h. The carry and overflow
+// flags of every operation that went into the live result are kept, so the
+// flags shown cover the whole expression and not just its last operator.
+
+#define CALC_PAREN CALC_OP_COUNT // stack marker for an open parenthesis
+
+enum CalcState
+{
+    CALC_RESULT,       // operand is a result, or 0 at reset. A digit starts over, an operator continues from it
+    CALC_OPERAND,      // digits are going into operand
+    CALC_OPERAND_NEXT, // after an operator or an open parenthesis
+    CALC_CLOSED,       // operand is a closed parenthesis group, only an operator or ')' can follow
+    CALC_ERROR,        // division by zero, cleared by calc_reset()
+};
+
+enum CalcTokenKind
+{
+    TOKEN_VALUE,
+    TOKEN_OP,
+    TOKEN_OPEN,
+    TOKEN_CLOSE,
+};
+
+static struct CalcContext keypad = {.radix = 16, .bits = 32}; // zeroed state is CALC_RESULT with 0
+static struct CalcContext *ctx = &keypad;          // the one keys go to
+
+static const uint8_t precedence[CALC_OP_COUNT] = {
+    [CALC_MUL] = 10, [CALC_DIV] = 10, [CALC_MOD] = 10,
+    [CALC_ADD] = 9, [CALC_SUB] = 9,
+    [CALC_SHL] = 8, [CALC_SHR] = 8, [CALC_ROL] = 8, [CALC_ROR] = 8,
+    [CALC_AND] = 7, [CALC_NAND] = 7,
+    [CALC_XOR] = 6,
+    [CALC_OR] = 5, [CALC_NOR] = 5,
+};
+
+// as drawn on the entry line, in characters both display fonts have
+static const char *const op_symbol[CALC_OP_COUNT] = {
+    [CALC_ADD] = "+", [CALC_SUB] = "-", [CALC_MUL] = "*", [CALC_DIV] = "/", [CALC_MOD] = "%",
+    [CALC_AND] = "&", [CALC_NAND] = "~&", [CALC_OR] = "|", [CALC_NOR] = "~|", [CALC_XOR] = "^",
+    [CALC_SHL] = "<<", [CALC_SHR] = ">>", [CALC_ROL] = "<<<", [CALC_ROR] = ">>>",
+};
+
+/// @brief a op b in a word of the given size, as the evaluator applies it. For the program VM too.
+/// @return the operation's flags, WORD_DIV_ZERO on division by zero
+uint8_t calc_apply(enum CalcOp op, const struct Word *a, const struct Word *b, struct Word *out, uint8_t bits,
+                   bool is_signed)
+{
+    uint8_t flags;
+
+    switch (op)
+    {
+    case CALC_ADD:
+        return word_add(out, a, b, bits);
+    case CALC_SUB:
+        return word_sub(out, a, b, bits);
+    case CALC_MUL:
+        return word_mul(out, a, b, bits);
+    case CALC_DIV:
+        return word_div(out, NULL, a, b, bits, is_signed);
+    case CALC_MOD:
+        flags = word_div(NULL, out, a, b, bits, is_signed);
+        return (flags & WORD_DIV_ZERO) | word_flags(out, bits); // the quotient's overflow is not the remainder's
+    case CALC_AND:
+        return word_and(out, a, b, bits);
+    case CALC_NAND:
+        word_and(out, a, b, bits);
+        return word_not(out, out, bits);
+    case CALC_OR:
+        return word_or(out, a, b, bits);
+    case CALC_NOR:
+        word_or(out, a, b, bits);
+        return word_not(out, out, bits);
+    case CALC_XOR:
+        return word_xor(out, a, b, bits);
+    case CALC_SHL:
+        return word_shl(out, a, word_shift_count(b), bits);
+    case CALC_SHR:
+        return word_shr(out, a, word_shift_count(b), bits, is_signed);
+    case CALC_ROL:
+        return word_rol(out, a, b->limb[0], bits); // modulo the word size, which the low limb decides
+    case CALC_ROR:
+        return word_ror(out, a, b->limb[0], bits);
+    default:
+        *out = *b;
+        return word_flags(out, bits);
+    }
+}
+
+/// @brief Binding strength of an operator, higher binds tighter. Operators of equal strength associate left.
+uint8_t calc_precedence(enum CalcOp op)
+{
+    return precedence[op];
+}
+
+/// @brief a op b in the context's word.
+/// @return the operation's flags, WORD_DIV_ZERO on division by zero
+static uint8_t apply(uint8_t op, const struct Word *a, const struct Word *b, struct Word *out)
+{
+    return calc_apply(op, a, b, out, ctx->bits, ctx->is_signed);
+}
+
+/// @brief Value of the expression if it ended here. A trailing operator or open parenthesis is left out.
+/// @param flags the flags of every operation applied are added
+static struct Word fold(uint8_t *flags)
+{
+    int i = ctx->depth;
+    struct Word x = ctx->operand;
+
+    if (ctx->state == CALC_OPERAND_NEXT && !ctx->waiting)
+    {
+        while (i > 0 && ctx->stack[i - 1].op == CALC_PAREN)
+            i--;
+        if (i == 0)
+            return (struct Word){0};
+        x = ctx->stack[--i].value;
+    }
+
+    // precedence only rises towards the top within a group, so folding down is in order
+    for (; i > 0; i--)
+        if (ctx->stack[i - 1].op != CALC_PAREN)
+            *flags |= apply(ctx->stack[i - 1].op, &ctx->stack[i - 1].value, &x, &x);
+    return x;
+}
+
+static void update()
+{
+    uint8_t flags = 0;
+    ctx->result = fold(&flags);
+    if (flags & WORD_DIV_ZERO)
+    {
+        ctx->result = (struct Word){0}; // a division by zero is only an error once it is evaluated
+        flags = 0;
+    }
+    ctx->flags = ((ctx->carried | flags) & (WORD_CARRY | WORD_OVERFLOW)) | word_flags(&ctx->result, ctx->bits);
+}
+
+static void token_add(uint8_t kind, const struct Word *value, uint8_t op)
+{
+    struct CalcToken *token = &ctx->tokens[ctx->token_count++ % CALC_TOKENS];
+    token->kind = kind;
+    token->op = op;
+    if (value)
+        token->value = *value;
+}
+
+static void expression_clear()
+{
+    ctx->waiting = false;
+    ctx->depth = 0;
+    ctx->open_parens = 0;
+    ctx->token_count = 0;
+    ctx->carried = 0;
+}
+
+/// @brief Push the waiting operator, reducing what binds at least as tightly first.
+static bool commit()
+{
+    uint8_t flags = 0;
+    struct Word x = ctx->operand;
+
+    while (ctx->depth > 0 && ctx->stack[ctx->depth - 1].op != CALC_PAREN &&
+           precedence[ctx->stack[ctx->depth - 1].op] >= precedence[ctx->waiting_op])
+    {
+        ctx->depth--;
+        flags |= apply(ctx->stack[ctx->depth].op, &ctx->stack[ctx->depth].value, &x, &x);
+    }
+    ctx->carried |= flags;
+    if (flags & WORD_DIV_ZERO)
+    {
+        ctx->state = CALC_ERROR;
+        return false;
+    }
+
+    ctx->stack[ctx->depth++] = (struct CalcPending){x, ctx->waiting_op}; // at most 6 per group, calc_open() keeps the room
+    ctx->waiting = false;
+    return true;
+}
+
+/// @brief Start an operand for a key that sets or modifies it. False if one cannot go here.
+static bool operand_begin(bool digit)
+{
+    switch (ctx->state)
+    {
+    case CALC_RESULT:
+        if (digit)
+        {
+            expression_clear();
+            ctx->operand = (struct Word){0};
+            ctx->state = CALC_OPERAND;
+        }
+        return true;
+    case CALC_OPERAND_NEXT:
+        if (ctx->waiting && !commit())
+            return false;
+        ctx->operand = (struct Word){0};
+        ctx->state = CALC_OPERAND;
+        return true;
+    case CALC_OPERAND:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// @brief Send the calls that follow to another evaluator, keeping this one as it is.
+/// @param context a zeroed context starts cleared in hex with 32-bit words, NULL goes back to the keypad's
+/// @return the one in use before, to hand back when done
+struct CalcContext *calc_use(struct CalcContext *context)
+{
+    struct CalcContext *previous = ctx;
+    ctx = context ? context : &keypad;
+    if (!ctx->radix)
+        ctx->radix = 16;
+    if (!ctx->bits)
+        ctx->bits = 32;
+    return previous;
+}
+
+/// @brief Clear the expression and any error. The radix is kept.
+void calc_reset()
+{
+    expression_clear();
+    ctx->operand = (struct Word){0};
+    ctx->state = CALC_RESULT;
+    update();
+}
+
+/// @brief Start over from value, as if it were the result of =. For restoring a saved state.
+/// @param value in the current word size
+void calc_load(const struct Word *value)
+{
+    expression_clear();
+    ctx->operand = *value;
+    ctx->state = CALC_RESULT;
+    update();
+}
+
+/// @brief Whether the operand is shown with a minus sign, which digits and backspace then act on the size of.
+static bool operand_negative()
+{
+    return ctx->radix == 10 && ctx->is_signed && word_bit(&ctx->operand, ctx->bits - 1);
+}
+
+/// @brief Append a digit to the operand. Digits outside the radix, or that would overflow the word, are
+/// ignored. Signed decimals stop at the largest positive value, ± gives the negative ones.
+/// @param digit 0-15
+/// @return false if the digit was ignored
+bool calc_digit(uint8_t digit)
+{
+    struct Word next = {0};
+    if (ctx->state == CALC_OPERAND)
+        next = ctx->operand;
+    bool negative = ctx->state == CALC_OPERAND && operand_negative();
+    if (negative)
+        word_neg(&next, &next, ctx->bits);
+
+    if (digit >= ctx->radix || word_mul_small(&next, ctx->radix, digit, ctx->bits) & WORD_CARRY)
+        return false;
+    if (ctx->radix == 10 && ctx->is_signed && word_bit(&next, ctx->bits - 1))
+        return false;
+    if (!operand_begin(true))
+        return false;
+
+    if (negative)
+        word_neg(&next, &next, ctx->bits);
+    ctx->operand = next;
+    update();
+    return true;
+}
+
+/// @brief Apply a binary operator. Pressed right after another operator, it replaces that one.
+/// @return false if there is no left operand
+bool calc_operator(enum CalcOp op)
+{
+    switch (ctx->state)
+    {
+    case CALC_OPERAND_NEXT:
+        if (!ctx->waiting)
+            return false; // nothing on the left
+        ctx->tokens[(ctx->token_count - 1) % CALC_TOKENS].op = op;
+        ctx->waiting_op = op;
+        return true;
+    case CALC_RESULT:
+    case CALC_OPERAND:
+        token_add(TOKEN_VALUE, &ctx->operand, 0);
+        break;
+    case CALC_CLOSED:
+        break; // the group is already on the entry line
+    default:
+        return false;
+    }
+
+    ctx->waiting = true;
+    ctx->waiting_op = op;
+    token_add(TOKEN_OP, NULL, op);
+    ctx->state = CALC_OPERAND_NEXT;
+    update();
+    return true;
+}
+
+/// @brief Open a parenthesis where an operand can start.
+/// @return false if one cannot start here, or the stack has no room for another group
+bool calc_open()
+{
+    if (ctx->state == CALC_RESULT)
+    {
+        expression_clear();
+        ctx->state = CALC_OPERAND_NEXT;
+    }
+    // room for the waiting operator, the parenthesis and a full group of operators after it
+    if (ctx->state != CALC_OPERAND_NEXT || ctx->depth + 1 + 1 + 6 > CALC_DEPTH)
+        return false;
+    if (ctx->waiting && !commit())
+        return false;
+
+    ctx->stack[ctx->depth++] = (struct CalcPending){.op = CALC_PAREN};
+    ctx->open_parens++;
+    token_add(TOKEN_OPEN, NULL, 0);
+    update();
+    return true;
+}
+
+/// @brief Close the innermost open parenthesis, its group becomes the operand.
+/// @return false if none is open or the group has no operand yet. Division by zero is taken, and sets the error.
+bool calc_close()
+{
+    if (!ctx->open_parens || (ctx->state != CALC_OPERAND && ctx->state != CALC_CLOSED))
+        return false;
+    if (ctx->state == CALC_OPERAND)
+        token_add(TOKEN_VALUE, &ctx->operand, 0);
+
+    uint8_t flags = 0;
+    struct Word x = ctx->operand;
+    while (ctx->stack[ctx->depth - 1].op != CALC_PAREN)
+    {
+        ctx->depth--;
+        flags |= apply(ctx->stack[ctx->depth].op, &ctx->stack[ctx->depth].value, &x, &x);
+    }
+    ctx->depth--;
+    ctx->open_parens--;
+    ctx->carried |= flags;
+    if (flags & WORD_DIV_ZERO)
+    {
+        ctx->state = CALC_ERROR;
+        return true;
+    }
+
+    ctx->operand = x;
+    token_add(TOKEN_CLOSE, NULL, 0);
+    ctx->state = CALC_CLOSED;
+    update();
+    return true;
+}
+
+/// @brief Evaluate the whole expression, closing any open parentheses. The result starts the next one.
+void calc_equals()
+{
+    if (ctx->state == CALC_ERROR)
+        return;
+
+    uint8_t flags = ctx->carried;
+    struct Word x = fold(&flags);
+    expression_clear();
+    if (flags & WORD_DIV_ZERO)
+    {
+        ctx->state = CALC_ERROR;
+        return;
+    }
+
+    ctx->operand = x;
+    ctx->carried = flags & (WORD_CARRY | WORD_OVERFLOW); // shown with the result until the next expression
+    ctx->state = CALC_RESULT;
+    update();
+}
+
+/// @brief Invert every bit of the operand.
+/// @return false where no operand can go, such as after a closed group
+bool calc_not()
+{
+    if (!operand_begin(false))
+        return false;
+    word_not(&ctx->operand, &ctx->operand, ctx->bits);
+    update();
+    return true;
+}
+
+/// @brief Two's complement negation of the operand.
+/// @return false where no operand can go, such as after a closed group
+bool calc_negate()
+{
+    if (!operand_begin(false))
+        return false;
+    word_neg(&ctx->operand, &ctx->operand, ctx->bits);
+    update();
+    return true;
+}
+
+/// @brief Flip one bit of the operand, from the bit buttons.
+/// @param bit below the word size
+void calc_toggle_bit(uint8_t bit)
+{
+    if (bit >= ctx->bits || !operand_begin(false))
+        return;
+    ctx->operand.limb[bit / 32] ^= 1u << (bit % 32);
+    update();
+}
+
+/// @brief Remove the last digit of the operand, leaving 0 after the last one.
+void calc_backspace()
+{
+    if (ctx->state != CALC_OPERAND && ctx->state != CALC_RESULT)
+        return;
+    bool negative = operand_negative();
+    if (negative)
+        word_neg(&ctx->operand, &ctx->operand, ctx->bits);
+    word_div_small(&ctx->operand, ctx->radix, ctx->bits);
+    if (negative)
+        word_neg(&ctx->operand, &ctx->operand, ctx->bits);
+    update();
+}
+
+/// @brief Radix for digit entry and the entry line. Earlier operands are redrawn in it.
+/// @param new_radix 2, 10 or 16
+void calc_set_radix(uint8_t new_radix)
+{
+    ctx->radix = new_radix;
+}
+
+uint8_t calc_radix()
+{
+    return ctx->radix;
+}
+
+/// @brief Change the word size and signedness. A new size evaluates the expression as = does, and carries the
+/// result over: truncated when narrower, sign extended when wider and the old size was signed. A change of
+/// signedness alone keeps the expression, and what is still pending is evaluated the new way.
+/// @param bits 8, 16, 32, 64 or 128
+void calc_set_word(uint8_t bits, bool is_signed)
+{
+    if (!word_bits_valid(bits))
+        return;
+
+    if (bits != ctx->bits)
+    {
+        calc_equals();
+        if (ctx->state == CALC_ERROR)
+            calc_reset();
+        word_resize(&ctx->operand, ctx->bits, bits, ctx->is_signed);
+        ctx->bits = bits;
+    }
+    ctx->is_signed = is_signed;
+    update();
+}
+
+uint8_t calc_bits()
+{
+    return ctx->bits;
+}
+
+bool calc_signed()
+{
+    return ctx->is_signed;
+}
+
+/// @brief Value of the expression so far, 0 on error.
+struct Word calc_result()
+{
+    return ctx->state == CALC_ERROR ? (struct Word){0} : ctx->result;
+}
+
+/// @brief WordFlag of the value of the expression so far. Carry and overflow are set if any operation in it set them.
+uint8_t calc_flags()
+{
+    return ctx->state == CALC_ERROR ? 0 : ctx->flags;
+}
+
+bool calc_error()
+{
+    return ctx->state == CALC_ERROR;
+}
+
+/// @brief Format a value in the current radix without leading zeros, decimals signed in a signed context.
+/// @param out at least WORD_BITS_MAX + 1 characters
+/// @return length
+static int format_value(char *out, const struct Word *value)
+{
+    if (ctx->radix == 10)
+        return radix_format_dec_word(out, value, ctx->bits, ctx->is_signed);
+
+    uint8_t shift = ctx->radix == 16 ? 4 : 1;
+    int len = (ctx->bits - word_clz(value, ctx->bits) + shift - 1) / shift;
+    if (len == 0)
+        len = 1;
+
+    for (int i = 0; i < len; i++)
+    {
+        int bit = (len - 1 - i) * shift; // digits never straddle limbs
+        out[i] = "0123456789ABCDEF"[(value->limb[bit / 32] >> (bit % 32)) & (ctx->radix - 1)];
+    }
+    out[len] = '\0';
+    return len;
+}
+
+/// @brief Copy the end of text in front of what is already at out[*pos..], as far as it fits.
+static void prepend(char *out, size_t *pos, const char *text, size_t len)
+{
+    size_t n = len < *pos ? len : *pos;
+    *pos -= n;
+    memcpy(out + *pos, text + len - n, n);
+}
+
+/// @brief Write the end of the entry line, as much as fits in width characters.
+/// @param out at least width + 1 bytes
+/// @param width characters available
+void calc_entry(char *out, size_t width)
+{
+    size_t pos = width; // filled from the end, then moved to the front
+    char text[WORD_BITS_MAX + 1];
+
+    if (ctx->state == CALC_ERROR)
+    {
+        strncpy(out, "ERROR", width);
+        out[width] = '\0';
+        return;
+    }
+
+    if (ctx->state == CALC_OPERAND || ctx->state == CALC_RESULT)
+        prepend(out, &pos, text, format_value(text, &ctx->operand));
+
+    uint32_t oldest = ctx->token_count > CALC_TOKENS ? ctx->token_count - CALC_TOKENS : 0;
+    for (uint32_t i = ctx->token_count; i > oldest && pos > 0; i--)
+    {
+        const struct CalcToken *token = &ctx->tokens[(i - 1) % CALC_TOKENS];
+        switch (token->kind)
+        {
+        case TOKEN_VALUE:
+            prepend(out, &pos, text, format_value(text, &token->value));
+            break;
+        case TOKEN_OP:
+            prepend(out, &pos, op_symbol[token->op], strlen(op_symbol[token->op]));
+            break;
+        case TOKEN_OPEN:
+            prepend(out, &pos, "(", 1);
+            break;
+        case TOKEN_CLOSE:
+            prepend(out, &pos, ")", 1);
+            break;
+        }
+    }
+
+    memmove(out, out + pos, width - pos);
+    out[width - pos] = '\0';
+}
@@ -0,0 +1,94 @@
+#ifndef CALC_H
+#define CALC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "word.h"
+
+#define CALC_DEPTH 32  // pending operators and open parentheses
+#define CALC_TOKENS 24 // recent operands and operators, at least a character each, more than the entry line shows
+
+// Binary operators, C precedence and left associative. ROL/ROR rotate within
+// the word, and / % and >> are signed in a signed context.
+enum CalcOp
+{
+    CALC_ADD,
+    CALC_SUB,
+    CALC_MUL,
+    CALC_DIV,
+    CALC_MOD,
+    CALC_AND,
+    CALC_NAND,
+    CALC_OR,
+    CALC_NOR,
+    CALC_XOR,
+    CALC_SHL,
+    CALC_SHR,
+    CALC_ROL,
+    CALC_ROR,
+    CALC_OP_COUNT,
+};
+
+// Left operand and operator waiting for their right operand
+struct CalcPending
+{
+    struct Word value;
+    uint8_t op; // CalcOp, or the open parenthesis marker
+};
+
+struct CalcToken
+{
+    struct Word value; // operand
+    uint8_t kind;
+    uint8_t op; // CalcOp of an operator
+};
+
+// Everything the evaluator keeps between keys. The keypad has its own, and
+// the USB batch mode evaluates in another, see calc_use().
+struct CalcContext
+{
+    struct CalcPending stack[CALC_DEPTH];
+    uint8_t depth;
+    uint8_t open_parens;
+    struct Word operand;
+    uint8_t state; // CalcState, see calc.c
+    bool waiting; // after an operator, operand is still its left side
+    uint8_t waiting_op;
+    uint8_t radix;
+    uint8_t bits;    // word size, 8 to 128
+    bool is_signed;  // two's complement: signed / % >>, and signed decimals
+    uint8_t carried; // WORD_CARRY and WORD_OVERFLOW of the operations already reduced
+    uint8_t flags;   // WordFlag of the live result, covering every operation in it
+    struct Word result; // live result, refreshed after every key
+
+    struct CalcToken tokens[CALC_TOKENS];
+    uint32_t token_count; // tokens ever added since the last reset, the ring holds the newest
+};
+
+struct CalcContext *calc_use(struct CalcContext *context);
+void calc_reset();
+void calc_load(const struct Word *value);
+bool calc_digit(uint8_t digit);
+bool calc_operator(enum CalcOp op);
+bool calc_open();
+bool calc_close();
+void calc_equals();
+bool calc_not();
+bool calc_negate();
+void calc_toggle_bit(uint8_t bit);
+void calc_backspace();
+void calc_set_radix(uint8_t radix);
+uint8_t calc_radix();
+void calc_set_word(uint8_t bits, bool is_signed);
+uint8_t calc_bits();
+bool calc_signed();
+struct Word calc_result();
+uint8_t calc_flags();
+bool calc_error();
+void calc_entry(char *out, size_t width);
+uint8_t calc_apply(enum CalcOp op, const struct Word *a, const struct Word *b, struct Word *out, uint8_t bits,
+                   bool is_signed);
+uint8_t calc_precedence(enum CalcOp op);
+
+#endif
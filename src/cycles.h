@@ -0,0 +1,46 @@
+#ifndef CYCLES_H
+#define CYCLES_H
+
+#include <stdint.h>
+#include "pico/platform.h"
+#include "hardware/structs/systick.h"
+#include "hardware/clocks.h"
+
+// The M0+ has no DWT cycle counter, so SysTick is used instead as a free
+// running 24-bit down counter at clk_sys. Each core has its own SysTick, so
+// call cycles_init() on every core that measures. Spans must be shorter than
+// 2^24 cycles (~134 ms at 125 MHz).
+
+static inline void cycles_init(void)
+{
+  systick_hw->rvr = 0x00FFFFFF;
+  systick_hw->cvr = 0;
+  systick_hw->csr = 0x5; // enable, clocked from the processor clock, no interrupt
+}
+
+static inline uint32_t cycles_now(void)
+{
+  return systick_hw->cvr;
+}
+
+// cycles elapsed since `start`, a value from cycles_now()
+static inline uint32_t cycles_since(uint32_t start)
+{
+  return (start - systick_hw->cvr) & 0x00FFFFFF;
+}
+
+// clk_sys cycles per nanosecond in 16.16 fixed point, rounded up, for
+// cycles_delay_ns(). Take it again after changing clk_sys.
+static inline uint32_t cycles_ns_scale(void)
+{
+  return (uint32_t)((((uint64_t)clock_get_hz(clk_sys) << 16) + 999999999u) / 1000000000u);
+}
+
+// busy wait at least `ns` nanoseconds, `scale` from cycles_ns_scale(). For
+// delays where sleep_us() would round up to a whole microsecond.
+static inline void cycles_delay_ns(uint32_t ns, uint32_t scale)
+{
+  busy_wait_at_least_cycles((uint32_t)(((uint64_t)ns * scale + 0xFFFF) >> 16));
+}
+
+#endif
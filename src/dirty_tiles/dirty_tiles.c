@@ -0,0 +1,72 @@
+#include "dirty_tiles.h"
+#include "oled_spi.h"
+#include "hot_path.h"
+
+// Dirty column range [first, end) for each tile row. end == 0 means the row is clean.
+static uint8_t row_first[DIRTY_TILES_ROWS];
+static uint8_t row_end[DIRTY_TILES_ROWS];
+static uint32_t last_bytes;
+
+/// @brief Record that a pixel rectangle of the u8g2 buffer has been drawn to. Clipped to the panel.
+/// @param x left edge in pixels
+/// @param y top edge in pixels
+/// @param w width in pixels
+/// @param h height in pixels
+void HOT_FUNC(dirty_tiles_mark)(int x, int y, int w, int h)
+{
+    if (w <= 0 || h <= 0)
+        return;
+
+    int x1 = x + w - 1;
+    int y1 = y + h - 1;
+    if (x < 0)
+        x = 0;
+    if (y < 0)
+        y = 0;
+    if (x1 >= DIRTY_TILES_COLS * 8)
+        x1 = DIRTY_TILES_COLS * 8 - 1;
+    if (y1 >= DIRTY_TILES_ROWS * 8)
+        y1 = DIRTY_TILES_ROWS * 8 - 1;
+    if (x > x1 || y > y1)
+        return;
+
+    uint8_t col_first = x >> 3;
+    uint8_t col_end = (x1 >> 3) + 1;
+    for (int row = y >> 3; row <= (y1 >> 3); row++)
+    {
+        if (row_end[row] == 0 || col_first < row_first[row])
+            row_first[row] = col_first;
+        if (col_end > row_end[row])
+            row_end[row] = col_end;
+    }
+}
+
+/// @brief Mark the whole panel dirty, e.g. after clearing the buffer.
+void dirty_tiles_mark_all()
+{
+    dirty_tiles_mark(0, 0, DIRTY_TILES_COLS * 8, DIRTY_TILES_ROWS * 8);
+}
+
+/// @brief Send only the dirty tiles of the u8g2 full buffer to the display, then mark everything clean.
+/// @param u8g2 display whose buffer was drawn to
+void HOT_FUNC(dirty_tiles_flush)(u8g2_t *u8g2)
+{
+    uint32_t bytes_before = oled_spi_bytes_total();
+
+    for (uint8_t row = 0; row < DIRTY_TILES_ROWS; row++)
+    {
+        if (row_end[row] == 0)
+            continue;
+
+        u8g2_UpdateDisplayArea(u8g2, row_first[row], row, row_end[row] - row_first[row], 1);
+        row_end[row] = 0;
+    }
+
+    last_bytes = oled_spi_bytes_total() - bytes_before;
+}
+
+/// @brief Bytes (commands and pixel data) that the last dirty_tiles_flush() put on the SPI bus. A full frame is 9240.
+uint32_t dirty_tiles_last_bytes()
+{
+    return last_bytes;
+}
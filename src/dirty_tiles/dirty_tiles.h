@@ -0,0 +1,16 @@
+#ifndef DIRTY_TILES_H
+#define DIRTY_TILES_H
+
+#include <stdint.h>
+#include <u8g2.h>
+
+// SSD1322 256x64 in 8x8 pixel tiles
+#define DIRTY_TILES_COLS 32
+#define DIRTY_TILES_ROWS 8
+
+void dirty_tiles_mark(int x, int y, int w, int h);
+void dirty_tiles_mark_all();
+void dirty_tiles_flush(u8g2_t *u8g2);
+uint32_t dirty_tiles_last_bytes();
+
+#endif
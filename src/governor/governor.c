@@ -0,0 +1,158 @@
+#include "governor.h"
+#include "peripherals.h"
+#include "hot_path.h"
+#include "render.h"
+#include "bit_leds.h"
+#include "i2c_async.h"
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/vreg.h"
+#include "hardware/i2c.h"
+
+// clk_sys governor, on core 0. A key or a USB command asks for boost from its
+// interrupt, the run loop switches before it handles the work, and idle
+// follows once GOVERNOR_HOLD_US pass with no request and no frame pending on
+// core 1.
+//
+// Everything that counts clk_sys is kept right across a switch:
+//   clk_peri, and with it the SSD1322 SPI, moves to PLL_USB at init, so the
+//   SPI divider never needs to change. I2C runs from clk_sys, so its baud
+//   rate is set again after every switch; switches happen between work
+//   items, so no transfer is in flight. The bit LED state machine divider
+//   and the render's nanosecond delays are recomputed too. USB, the ADC and
+//   the RTC already run from PLL_USB, which is never touched.
+
+#define GOVERNOR_OVERCLOCK_KHZ 133000 // above this the core voltage is raised
+
+static uint32_t step_khz[GOVERNOR_STEPS] = {[GOVERNOR_IDLE] = GOVERNOR_IDLE_KHZ, [GOVERNOR_BOOST] = GOVERNOR_BOOST_KHZ};
+static uint boost_vco;
+static uint boost_post_div1;
+static uint boost_post_div2;
+
+static uint8_t step = GOVERNOR_STEPS; // the boot clock until the first switch
+static uint64_t step_since_us;
+static uint64_t busy_us; // last boost request or pending frame
+static volatile uint32_t boost_requests; // counted by interrupts
+static uint32_t boosts_seen;
+static struct GovernorStats stats;
+
+/// @brief Move clk_peri off clk_sys and get the boost PLL settings. Call before render_init(), which sets up the SPI on core 1.
+void governor_init()
+{
+    if (!check_sys_clock_khz(step_khz[GOVERNOR_BOOST], &boost_vco, &boost_post_div1, &boost_post_div2))
+    {
+        // not a frequency PLL_SYS can make, boost to the boot clock instead
+        step_khz[GOVERNOR_BOOST] = clock_get_hz(clk_sys) / KHZ;
+        check_sys_clock_khz(step_khz[GOVERNOR_BOOST], &boost_vco, &boost_post_div1, &boost_post_div2);
+    }
+
+    // the regulator has settled long before the run loop first boosts
+    if (step_khz[GOVERNOR_BOOST] > GOVERNOR_OVERCLOCK_KHZ)
+        vreg_set_voltage(VREG_VOLTAGE_1_15);
+
+    clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, 48 * MHZ, 48 * MHZ);
+
+    busy_us = time_us_64(); // boot work runs boosted
+}
+
+/// @brief Put clk_sys on a step, with everything derived from it following.
+static void governor_apply(uint8_t to)
+{
+    i2c_async_acquire(); // no transfer may run across the switch, the I2C block is disabled to set its divider
+
+    // PLL_SYS can only be set up again once nothing runs from it
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                    CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, 48 * MHZ, step_khz[GOVERNOR_IDLE] * KHZ);
+
+    if (to == GOVERNOR_BOOST)
+    {
+        pll_init(pll_sys, 1, boost_vco, boost_post_div1, boost_post_div2); // returns once locked
+        clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                        CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, step_khz[GOVERNOR_BOOST] * KHZ,
+                        step_khz[GOVERNOR_BOOST] * KHZ);
+    }
+    else
+    {
+        pll_deinit(pll_sys);
+    }
+
+    i2c_set_baudrate(TCA8418_I2C_PORT, TCA8418_I2C_SPEED);
+    i2c_async_release();
+    bit_leds_clock_changed();
+    render_clock_changed();
+}
+
+static void governor_switch(uint8_t to, uint64_t now)
+{
+    if (step < GOVERNOR_STEPS)
+        stats.step_us[step] += now - step_since_us;
+
+    governor_apply(to);
+
+    uint64_t done = time_us_64(); // the timer runs from clk_ref, unaffected by the switch
+    uint32_t us = done - now;
+    stats.switches[to]++;
+    stats.switch_us[to] = us;
+    if (us > stats.switch_max_us[to])
+        stats.switch_max_us[to] = us;
+
+    step = to;
+    step_since_us = done;
+}
+
+/// @brief Ask for full speed. Safe from interrupts, the switch happens on the next governor_update().
+void HOT_FUNC(governor_boost)()
+{
+    boost_requests++; // interrupts on core 0 only, so the increment cannot race
+}
+
+/// @brief Switch to the step the work calls for. Called by the run loop before it handles work.
+void governor_update()
+{
+    uint64_t now = time_us_64();
+    uint32_t requests = boost_requests;
+
+    if (requests != boosts_seen || render_pending())
+    {
+        stats.boosts += requests - boosts_seen;
+        boosts_seen = requests;
+        busy_us = now;
+    }
+
+    // A switch waits for the I2C transfer on the bus, so it is left until the
+    // keypad drain is over. The drain ends by posting work, which comes back here.
+    uint8_t target = now - busy_us < GOVERNOR_HOLD_US ? GOVERNOR_BOOST : GOVERNOR_IDLE;
+    if (target != step && i2c_async_idle())
+        governor_switch(target, now);
+}
+
+/// @brief When governor_update() next has something to do, for the run loop's sleep.
+uint64_t governor_deadline()
+{
+    return step == GOVERNOR_IDLE ? UINT64_MAX : busy_us + GOVERNOR_HOLD_US;
+}
+
+/// @brief Set the clocks up again after dormant, which left clk_sys and clk_peri on the crystal and PLL_SYS stopped. PLL_USB must be running.
+void governor_restore()
+{
+    clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, 48 * MHZ, 48 * MHZ);
+    if (step == GOVERNOR_STEPS)
+        step = GOVERNOR_BOOST;
+    governor_apply(step); // the timer stood still while dormant, so the time at the step carries on
+}
+
+/// @brief clk_sys of a step, in kHz.
+uint32_t governor_step_khz(uint8_t index)
+{
+    return step_khz[index];
+}
+
+/// @brief Copy the governor counters, with the time at the current step up to now.
+/// @param out counters
+void governor_get_stats(struct GovernorStats *out)
+{
+    *out = stats;
+    if (step < GOVERNOR_STEPS)
+        out->step_us[step] += time_us_64() - step_since_us;
+}
@@ -0,0 +1,37 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// clk_sys steps. Idle runs straight from PLL_USB with PLL_SYS stopped; boost
+// is overclocked from PLL_SYS, with the core voltage raised for it at init.
+#define GOVERNOR_IDLE_KHZ 48000
+#define GOVERNOR_BOOST_KHZ 200000
+#define GOVERNOR_HOLD_US 50000 // boost kept this long after the last key, command or frame
+
+enum GovernorStep
+{
+    GOVERNOR_IDLE,
+    GOVERNOR_BOOST,
+    GOVERNOR_STEPS,
+};
+
+struct GovernorStats
+{
+    uint64_t step_us[GOVERNOR_STEPS];       // time spent at each step, not counting dormant
+    uint32_t switches[GOVERNOR_STEPS];      // switches to each step
+    uint32_t switch_us[GOVERNOR_STEPS];     // last switch to each step, until clk_sys runs at it and the dividers follow
+    uint32_t switch_max_us[GOVERNOR_STEPS]; // worst switch to each step
+    uint32_t boosts;                        // boost requests from interrupts
+};
+
+void governor_init();
+void governor_boost();
+void governor_update();
+uint64_t governor_deadline();
+void governor_restore();
+uint32_t governor_step_khz(uint8_t step);
+void governor_get_stats(struct GovernorStats *out);
+
+#endif
@@ -0,0 +1,226 @@
+#include <string.h>
+#include "gray4.h"
+#include "oled_spi.h"
+#include "hot_path.h"
+
+#define GRAY4_COL_OFFSET 28 // first SSD1322 column address wired to the panel, 4 pixels per column
+
+#define SSD1322_CMD_SET_COLUMN 0x15
+#define SSD1322_CMD_WRITE_RAM 0x5C
+#define SSD1322_CMD_SET_ROW 0x75
+
+static uint8_t fb[GRAY4_HEIGHT][GRAY4_ROW_BYTES];
+
+// Dirty column range [first, end) of each row, in SSD1322 columns. end == 0 means the row is clean.
+static uint8_t row_first[GRAY4_HEIGHT];
+static uint8_t row_end[GRAY4_HEIGHT];
+static uint32_t last_bytes;
+
+// clip a rectangle to the panel, false if nothing is left
+static bool HOT_FUNC(clip)(int *x, int *y, int *w, int *h)
+{
+    if (*x < 0)
+    {
+        *w += *x;
+        *x = 0;
+    }
+    if (*y < 0)
+    {
+        *h += *y;
+        *y = 0;
+    }
+    if (*x + *w > GRAY4_WIDTH)
+        *w = GRAY4_WIDTH - *x;
+    if (*y + *h > GRAY4_HEIGHT)
+        *h = GRAY4_HEIGHT - *y;
+    return *w > 0 && *h > 0;
+}
+
+// record that a clipped rectangle changed
+static void HOT_FUNC(mark)(int x, int y, int w, int h)
+{
+    uint8_t first = x / 4;
+    uint8_t end = (x + w + 3) / 4;
+    for (int row = y; row < y + h; row++)
+    {
+        if (row_end[row] == 0 || first < row_first[row])
+            row_first[row] = first;
+        if (end > row_end[row])
+            row_end[row] = end;
+    }
+}
+
+static inline void put_pixel(int x, int y, uint8_t level)
+{
+    uint8_t *byte = &fb[y][x / 2];
+    *byte = x & 1 ? (*byte & 0xF0) | level : (*byte & 0x0F) | (level << 4);
+}
+
+/// @brief Clear the framebuffer to black and mark all of it for sending.
+void gray4_clear()
+{
+    memset(fb, 0, sizeof(fb));
+    mark(0, 0, GRAY4_WIDTH, GRAY4_HEIGHT);
+}
+
+/// @brief Fill a rectangle with one gray level. Clipped to the panel.
+/// @param level 0 (off) to GRAY4_MAX
+void HOT_FUNC(gray4_fill)(int x, int y, int w, int h, uint8_t level)
+{
+    if (!clip(&x, &y, &w, &h))
+        return;
+    mark(x, y, w, h);
+
+    uint8_t pair = level * 0x11;
+    int x_end = x + w;
+    for (int row = y; row < y + h; row++)
+    {
+        int col = x;
+        if (col & 1)
+            put_pixel(col++, row, level);
+        int whole = (x_end - col) / 2;
+        memset(&fb[row][col / 2], pair, whole);
+        col += whole * 2;
+        if (col < x_end)
+            put_pixel(col, row, level);
+    }
+}
+
+/// @brief Draw the set bits of an XBM image at one gray level, leaving the clear bits untouched.
+/// @param bits XBM data, rows padded to whole bytes, LSB is the leftmost pixel
+void HOT_FUNC(gray4_xbm)(int x, int y, int w, int h, const uint8_t *bits, uint8_t level)
+{
+    int stride = (w + 7) / 8;
+    for (int j = 0; j < h; j++)
+        for (int i = 0; i < w; i++)
+            if ((bits[j * stride + i / 8] >> (i % 8)) & 1 && x + i >= 0 && x + i < GRAY4_WIDTH && y + j >= 0 &&
+                y + j < GRAY4_HEIGHT)
+                put_pixel(x + i, y + j, level);
+
+    if (clip(&x, &y, &w, &h))
+        mark(x, y, w, h);
+}
+
+/// @brief Draw text as whole cells, background included, so it overwrites what was there. Clipped to the panel.
+/// @param font e.g. gray4_font_small
+/// @param x left edge of the first cell
+/// @param top top of the cells
+/// @param fg level of full coverage
+/// @param bg level of no coverage
+void HOT_FUNC(gray4_text)(const struct Gray4Font *font, int x, int top, const char *text, uint8_t fg, uint8_t bg)
+{
+    // coverage to level, partial coverage blends between bg and fg
+    uint8_t lut[16];
+    for (int c = 0; c < 16; c++)
+        lut[c] = bg + ((fg - bg) * c + (fg > bg ? 7 : -7)) / GRAY4_MAX;
+    bool direct = fg == GRAY4_MAX && bg == 0;
+
+    static const uint8_t blank[GRAY4_CELL_MAX_H * GRAY4_CELL_MAX_W / 2];
+    int cell_bytes = font->cell_w / 2;
+    int len = strlen(text);
+
+    int y0 = top < 0 ? 0 : top;
+    int y1 = top + font->cell_h > GRAY4_HEIGHT ? GRAY4_HEIGHT : top + font->cell_h;
+
+    for (int i = 0; i < len; i++, x += font->cell_w)
+    {
+        if (x < 0 || x + font->cell_w > GRAY4_WIDTH)
+            continue; // partly off the panel
+
+        uint8_t index = font->index[text[i] & 0x7F];
+        const uint8_t *cell = index < GRAY4_FONT_CHARS ? &font->glyphs[index * font->cell_h * cell_bytes] : blank;
+
+        for (int y = y0; y < y1; y++)
+        {
+            const uint8_t *src = &cell[(y - top) * cell_bytes];
+            uint8_t *dst = &fb[y][x / 2];
+
+            if (x % 2 == 0)
+            {
+                // byte aligned, the common case
+                if (direct)
+                    memcpy(dst, src, cell_bytes);
+                else
+                    for (int b = 0; b < cell_bytes; b++)
+                        dst[b] = (lut[src[b] >> 4] << 4) | lut[src[b] & 0x0F];
+            }
+            else
+            {
+                // odd x, every pixel moves half a byte right
+                uint8_t carry = dst[0] >> 4; // pixel left of the cell, kept
+                for (int b = 0; b < cell_bytes; b++)
+                {
+                    dst[b] = (carry << 4) | lut[src[b] >> 4];
+                    carry = lut[src[b] & 0x0F];
+                }
+                dst[cell_bytes] = (carry << 4) | (dst[cell_bytes] & 0x0F);
+            }
+        }
+    }
+
+    // the whole run of cells, clipped
+    int w = len * font->cell_w;
+    int h = font->cell_h;
+    x -= w;
+    if (clip(&x, &top, &w, &h))
+        mark(x, top, w, h);
+}
+
+/// @brief Queue the changed parts of the framebuffer for the display, then mark everything clean.
+void HOT_FUNC(gray4_flush)()
+{
+    uint32_t bytes_before = oled_spi_bytes_total();
+
+    // runs of rows with the same dirty columns go out as one RAM window
+
+    int y = 0;
+    while (y < GRAY4_HEIGHT)
+    {
+        if (row_end[y] == 0)
+        {
+            y++;
+            continue;
+        }
+
+        uint8_t first = row_first[y];
+        uint8_t end = row_end[y];
+        int y_end = y + 1;
+        while (y_end < GRAY4_HEIGHT && row_first[y_end] == first && row_end[y_end] == end)
+            y_end++;
+
+        const uint8_t set_column[] = {GRAY4_COL_OFFSET + first, GRAY4_COL_OFFSET + end - 1};
+        const uint8_t set_row[] = {y, y_end - 1};
+        uint8_t command;
+
+        oled_spi_set_dc(0);
+        command = SSD1322_CMD_SET_COLUMN;
+        oled_spi_write(&command, 1);
+        oled_spi_set_dc(1);
+        oled_spi_write(set_column, sizeof(set_column));
+        oled_spi_set_dc(0);
+        command = SSD1322_CMD_SET_ROW;
+        oled_spi_write(&command, 1);
+        oled_spi_set_dc(1);
+        oled_spi_write(set_row, sizeof(set_row));
+        oled_spi_set_dc(0);
+        command = SSD1322_CMD_WRITE_RAM;
+        oled_spi_write(&command, 1);
+        oled_spi_set_dc(1);
+        for (int row = y; row < y_end; row++)
+        {
+            oled_spi_write(&fb[row][first * 2], (end - first) * 2);
+            row_end[row] = 0;
+        }
+        oled_spi_end_transfer();
+
+        y = y_end;
+    }
+
+    last_bytes = oled_spi_bytes_total() - bytes_before;
+}
+
+/// @brief Bytes (commands and pixel data) that the last gray4_flush() put on the SPI bus. A full frame is 8199.
+uint32_t gray4_last_bytes()
+{
+    return last_bytes;
+}
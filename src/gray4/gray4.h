@@ -0,0 +1,40 @@
+#ifndef GRAY4_H
+#define GRAY4_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// 4 bits per pixel framebuffer in the SSD1322's own RAM layout: two pixels a
+// byte, left pixel in the high nibble, so rows go to the panel unconverted.
+#define GRAY4_WIDTH 256
+#define GRAY4_HEIGHT 64
+#define GRAY4_ROW_BYTES (GRAY4_WIDTH / 2)
+#define GRAY4_MAX 15 // full brightness
+
+#define GRAY4_FONT_CHARS 40     // glyphs kept per font
+#define GRAY4_CELL_MAX_W 12     // pixels, must be even
+#define GRAY4_CELL_MAX_H 24
+
+// Glyphs pre-rendered into fixed size cells of coverage nibbles, in the same
+// layout as the framebuffer, so drawing text is a row copy per glyph. The
+// fonts are rendered from u8g2's at build time, see gray4_fonts.txt.
+struct Gray4Font
+{
+    uint8_t cell_w;   // glyph advance in pixels, even
+    uint8_t cell_h;   // rows in a cell
+    uint8_t baseline; // cell row the font baseline falls on
+    uint8_t index[128]; // ASCII to glyph, GRAY4_FONT_CHARS for a blank cell
+    const uint8_t *glyphs; // cell_h * cell_w / 2 bytes a glyph
+};
+
+extern const struct Gray4Font gray4_font_small; // profont11, 9 row cells with the baseline on row 8
+extern const struct Gray4Font gray4_font_large; // profont22, 24 row cells with the baseline on row 16, smoothed
+
+void gray4_clear();
+void gray4_fill(int x, int y, int w, int h, uint8_t level);
+void gray4_xbm(int x, int y, int w, int h, const uint8_t *bits, uint8_t level);
+void gray4_text(const struct Gray4Font *font, int x, int top, const char *text, uint8_t fg, uint8_t bg);
+void gray4_flush();
+uint32_t gray4_last_bytes();
+
+#endif
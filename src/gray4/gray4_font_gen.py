@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+"""Pre-render the gray4 fonts listed in gray4_fonts.txt from the u8g2 fonts.
+
+    gray4_font_gen.py gray4_fonts.txt u8g2_fonts.c gray4_fonts.c
+
+Each glyph becomes a cell of coverage nibbles in the framebuffer layout of
+gray4.h, so the firmware blits text from constant tables and never decodes
+a u8g2 font. The build fails here if a font is missing from u8g2_fonts.c or
+a cell does not fit the limits in gray4.h.
+"""
+
+import re
+import shlex
+import sys
+
+FONT_CHARS = 40  # GRAY4_FONT_CHARS
+CELL_MAX_W = 12  # GRAY4_CELL_MAX_W
+CELL_MAX_H = 24  # GRAY4_CELL_MAX_H
+LEVEL_MAX = 15  # GRAY4_MAX
+SMOOTH_LEVEL = 5  # coverage added in the inner corners of a smoothed font
+
+# u8g2 fonts, see u8g2_font.c. A 23 byte header, then glyphs each starting
+# with their encoding and the offset to the next glyph, then a bit stream:
+# the glyph box and its offset from the origin, followed by run lengths of
+# background and foreground pixels.
+FONT_HEADER = 23
+
+ESCAPES = {"n": 10, "t": 9, "r": 13, "a": 7, "b": 8, "f": 12, "v": 11, "\\": 92, '"': 34, "'": 39, "?": 63}
+
+
+def fail(message):
+    sys.exit("gray4_font_gen: " + message)
+
+
+def read_specs(path):
+    specs = []
+    with open(path, encoding="utf-8") as f:
+        for line_no, line in enumerate(f, 1):
+            fields = shlex.split(line, comments=True)
+            if not fields:
+                continue
+            where = "%s:%d" % (path, line_no)
+            if len(fields) != 7 or not all(field.isdigit() for field in fields[2:5]) or fields[5] not in ("sharp", "smooth"):
+                fail("%s: expected name u8g2_font cell_w cell_h baseline sharp|smooth chars" % where)
+
+            name, u8g2_font, chars = fields[0], fields[1], fields[6]
+            cell_w, cell_h, baseline = (int(field) for field in fields[2:5])
+            if cell_w % 2 or cell_w > CELL_MAX_W or cell_h > CELL_MAX_H or baseline >= cell_h:
+                fail("%s: a %dx%d cell with the baseline on row %d does not fit" % (where, cell_w, cell_h, baseline))
+            if len(chars) > FONT_CHARS or len(set(chars)) != len(chars) or any(ord(c) > 127 for c in chars):
+                fail("%s: at most %d different ASCII characters" % (where, FONT_CHARS))
+            specs.append((name, u8g2_font, cell_w, cell_h, baseline, fields[5] == "smooth", chars))
+    return specs
+
+
+def c_string(literals):
+    """The bytes of adjacent C string literals, with the terminating NUL."""
+    data = bytearray()
+    for literal in literals:
+        i = 0
+        while i < len(literal):
+            c = literal[i]
+            i += 1
+            if c != "\\":
+                data += c.encode("latin-1")
+                continue
+            octal = re.match(r"[0-7]{1,3}", literal[i:])
+            hexa = re.match(r"x([0-9a-fA-F]+)", literal[i:])
+            if octal:
+                data.append(int(octal.group(0), 8) & 0xFF)
+                i += len(octal.group(0))
+            elif hexa:
+                data.append(int(hexa.group(1), 16) & 0xFF)
+                i += len(hexa.group(0))
+            else:
+                data.append(ESCAPES[literal[i]])
+                i += 1
+    return bytes(data + b"\0")
+
+
+def read_u8g2_font(source, name):
+    match = re.search(r"\b%s\s*\[\s*\d*\s*\][^=;]*=\s*((?:\"(?:[^\"\\]|\\.)*\"\s*)+);" % re.escape(name), source)
+    if not match:
+        fail("%s is not in u8g2_fonts.c" % name)
+    return c_string(re.findall(r"\"((?:[^\"\\]|\\.)*)\"", match.group(1)))
+
+
+class FontBits:
+    def __init__(self, data, start):
+        self.data = data
+        self.ptr = start
+        self.pos = 0
+
+    def unsigned(self, count):
+        value = self.data[self.ptr] >> self.pos
+        end = self.pos + count
+        if end >= 8:
+            self.ptr += 1
+            value |= self.data[self.ptr] << (8 - self.pos)
+            end -= 8
+        self.pos = end
+        return value & ((1 << count) - 1)
+
+    def signed(self, count):
+        return self.unsigned(count) - (1 << (count - 1))
+
+
+def find_glyph(font, c):
+    glyph = FONT_HEADER
+    if c >= ord("a"):
+        glyph += (font[19] << 8) | font[20]
+    elif c >= ord("A"):
+        glyph += (font[17] << 8) | font[18]
+
+    while font[glyph + 1] != 0:
+        if font[glyph] == c:
+            return glyph
+        glyph += font[glyph + 1]
+    return None
+
+
+def decode_glyph(font, glyph, cell, cell_w, cell_h, baseline):
+    bits = FontBits(font, glyph + 2)
+    w = bits.unsigned(font[4])
+    h = bits.unsigned(font[5])
+    x = bits.signed(font[6])
+    y = bits.signed(font[7])
+    bits.signed(font[8])  # advance, the cell width is used instead
+
+    if w == 0:
+        return
+
+    # top left of the glyph box within the cell
+    left = x
+    top = baseline - (h + y)
+
+    px = py = 0
+    while py < h:
+        zeros = bits.unsigned(font[2])
+        ones = bits.unsigned(font[3])
+        while True:
+            n = 0
+            while n < zeros + ones and py < h:
+                cx, cy = left + px, top + py
+                if n >= zeros and 0 <= cx < cell_w and 0 <= cy < cell_h:
+                    cell[cy * (cell_w // 2) + cx // 2] |= LEVEL_MAX if cx & 1 else LEVEL_MAX << 4
+                px += 1
+                if px == w:
+                    px = 0
+                    py += 1
+                n += 1
+            if bits.unsigned(1) == 0:
+                break
+
+
+def cell_get(cell, cell_w, cell_h, x, y):
+    if x < 0 or y < 0 or x >= cell_w or y >= cell_h:
+        return 0
+    byte = cell[y * (cell_w // 2) + x // 2]
+    return byte & 0x0F if x & 1 else byte >> 4
+
+
+def smooth_cell(cell, cell_w, cell_h):
+    """Fill both sides of each diagonal step at partial coverage, which takes
+    the stair steps off the slopes and curves of a bitmap font. Square
+    corners, where the pixel between the two neighbours is set, stay sharp."""
+    source = bytes(cell)
+    for y in range(cell_h):
+        for x in range(cell_w):
+            if cell_get(source, cell_w, cell_h, x, y):
+                continue
+            step = any(cell_get(source, cell_w, cell_h, x + dx, y) and cell_get(source, cell_w, cell_h, x, y + dy) and
+                       not cell_get(source, cell_w, cell_h, x + dx, y + dy) for dx in (-1, 1) for dy in (-1, 1))
+            if step:
+                cell[y * (cell_w // 2) + x // 2] |= SMOOTH_LEVEL if x & 1 else SMOOTH_LEVEL << 4
+
+
+def render(spec, u8g2_source):
+    name, u8g2_font, cell_w, cell_h, baseline, smooth, chars = spec
+    font = read_u8g2_font(u8g2_source, u8g2_font)
+    out = ["// %s, %dx%d cells with the baseline on row %d%s" %
+           (u8g2_font, cell_w, cell_h, baseline, ", smoothed" if smooth else ""),
+           "static const uint8_t HOT_DATA(%s_glyphs)[%d * %d] = {" % (name, len(chars), cell_h * cell_w // 2)]
+
+    for c in chars:
+        cell = bytearray(cell_h * cell_w // 2)
+        glyph = find_glyph(font, ord(c))
+        if glyph is not None:
+            decode_glyph(font, glyph, cell, cell_w, cell_h, baseline)
+        if smooth:
+            smooth_cell(cell, cell_w, cell_h)
+        out.append("    // %s" % repr(c))
+        for row in range(cell_h):
+            bytes_row = cell[row * (cell_w // 2):(row + 1) * (cell_w // 2)]
+            out.append("    " + " ".join("0x%02X," % b for b in bytes_row))
+    out.append("};")
+
+    index = [FONT_CHARS] * 128
+    for i, c in enumerate(chars):
+        index[ord(c)] = i
+    out += ["",
+            "const struct Gray4Font HOT_DATA(gray4_font_%s) = {" % name,
+            "    .cell_w = %d," % cell_w,
+            "    .cell_h = %d," % cell_h,
+            "    .baseline = %d," % baseline,
+            "    .index = {"]
+    for row in range(0, 128, 16):
+        out.append("        " + " ".join("%d," % i for i in index[row:row + 16]))
+    out += ["    },", "    .glyphs = %s_glyphs," % name, "};", ""]
+    return out
+
+
+def main():
+    if len(sys.argv) != 4:
+        fail("usage: gray4_font_gen.py gray4_fonts.txt u8g2_fonts.c gray4_fonts.c")
+    specs = read_specs(sys.argv[1])
+    with open(sys.argv[2], encoding="latin-1") as f:
+        u8g2_source = f.read()
+
+    out = ["// Generated by gray4_font_gen.py from gray4_fonts.txt and u8g2_fonts.c, do not edit", "",
+           '#include "gray4.h"', '#include "hot_path.h"', ""]
+    for spec in specs:
+        out += render(spec, u8g2_source)
+
+    with open(sys.argv[3], "w", encoding="utf-8") as f:
+        f.write("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,23 @@
+#ifndef HOT_PATH_H
+#define HOT_PATH_H
+
+#include "pico/platform.h"
+
+// Code runs in place from QSPI flash through a 16 kB cache, and a miss
+// stalls the core for the whole flash read. Functions on the key-to-photon
+// path, and the constant tables they read, are marked with these so a build
+// with CALC_HOT_SRAM copies them into SRAM at boot instead. Without it they
+// stay in flash like everything else, for comparing the two.
+//
+//   void HOT_FUNC(keypad_drain)()
+//   static const char HOT_DATA(hex_digits)[16] = {...};
+
+#if CALC_HOT_SRAM
+#define HOT_FUNC(name) __not_in_flash_func(name)
+#define HOT_DATA(name) __not_in_flash(#name) name
+#else
+#define HOT_FUNC(name) name
+#define HOT_DATA(name) name
+#endif
+
+#endif
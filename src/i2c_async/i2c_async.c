@@ -0,0 +1,286 @@
+#include "i2c_async.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "pico/stdlib.h"
+#include "cycles.h"
+#include "hot_path.h"
+
+// Register transfers to one I2C device without the CPU waiting on the bus.
+// A transfer is a list of I2C controller command words: the TX DMA channel
+// feeds them to IC_DATA_CMD paced by the TX DREQ, and the RX DMA channel
+// collects the bytes they read. The RX channel's completion on DMA_IRQ_1 is
+// the end of the transfer, which is why every transfer reads something. An
+// abort, such as a NACK, raises the I2C interrupt instead and ends the
+// transfer with an error.
+//
+// Transfers queue and run in order, each one's callback before the next
+// starts. Submit from core 0 only, the interrupts are taken there.
+//
+// The blocking SDK calls still work on the same block, between
+// i2c_async_acquire() and i2c_async_release(). The queue holds off until
+// the last release, and the abort interrupt is masked meanwhile, because the
+// SDK clears the abort itself.
+
+static i2c_inst_t *port;
+static uint8_t target;
+static int tx_chan;
+static int rx_chan;
+static uint8_t rx_buf[I2C_ASYNC_READ_MAX];
+
+static struct I2cAsyncTransfer queue[I2C_ASYNC_QUEUE];
+static uint32_t queue_head;    // next free slot
+static uint32_t queue_tail;    // transfer on the bus, or next to go out
+static volatile bool running;  // queue_tail is on the bus or in its callback
+static volatile uint8_t holds; // blocking users between acquire and release
+static bool in_handler;        // a callback is running, so a submit is counted as part of it
+static uint64_t started_us;
+
+static struct I2cAsyncStats stats;
+
+/// @brief CPU time of a handler or submit, in ns at the current clk_sys.
+static void HOT_FUNC(account_cpu)(uint32_t start)
+{
+    uint32_t cycles = cycles_since(start);
+    stats.cpu_ns += (uint64_t)cycles * 1000u / (clock_get_hz(clk_sys) / 1000000u);
+}
+
+/// @brief Put the transfer at queue_tail on the bus if nothing else is. Must run with interrupts masked.
+static void HOT_FUNC(queue_start)()
+{
+    if (running || holds || queue_tail == queue_head)
+        return;
+
+    const struct I2cAsyncTransfer *t = &queue[queue_tail % I2C_ASYNC_QUEUE];
+    running = true;
+    started_us = time_us_64();
+
+    dma_channel_set_write_addr(rx_chan, rx_buf, false);
+    dma_channel_set_trans_count(rx_chan, t->reads, false);
+    dma_channel_set_read_addr(tx_chan, t->commands, false);
+    dma_channel_set_trans_count(tx_chan, t->count, false);
+    dma_start_channel_mask((1u << tx_chan) | (1u << rx_chan));
+}
+
+/// @brief Retire the transfer at queue_tail and start the next. Runs in the DMA or abort interrupt.
+/// @param result bytes read, or a PICO_ERROR_ code
+static void HOT_FUNC(transfer_done)(int result)
+{
+    struct I2cAsyncTransfer *t = &queue[queue_tail % I2C_ASYNC_QUEUE];
+
+    stats.transfers++;
+    stats.bus_us += time_us_64() - started_us;
+
+    // running stays set through the callback, so a transfer it submits waits
+    // until it has finished with rx_buf
+    in_handler = true;
+    if (t->callback)
+        t->callback(result, rx_buf, t->arg);
+    in_handler = false;
+
+    queue_tail++;
+    running = false;
+    queue_start();
+}
+
+static void HOT_FUNC(i2c_async_dma_handler)()
+{
+    if (!dma_channel_get_irq1_status(rx_chan))
+        return; // shared IRQ, not ours
+
+    uint32_t start = cycles_now();
+    dma_channel_acknowledge_irq1(rx_chan);
+    transfer_done(queue[queue_tail % I2C_ASYNC_QUEUE].reads);
+    account_cpu(start);
+}
+
+static void i2c_async_abort_handler()
+{
+    i2c_hw_t *hw = i2c_get_hw(port);
+    if (!(hw->intr_stat & I2C_IC_INTR_STAT_R_TX_ABRT_BITS))
+        return;
+
+    uint32_t start = cycles_now();
+
+    // The controller flushed its TX FIFO and holds it flushed until the abort
+    // is cleared, so stop the channels first or the rest of the commands go
+    // out as a new transaction. The abort can raise a spurious completion
+    // interrupt (RP2040-E13), so it is masked meanwhile.
+    dma_channel_set_irq1_enabled(rx_chan, false);
+    dma_channel_abort(tx_chan);
+    dma_channel_abort(rx_chan);
+    dma_channel_acknowledge_irq1(rx_chan);
+    dma_channel_set_irq1_enabled(rx_chan, true);
+
+    (void)hw->clr_tx_abrt; // read to clear
+    while (hw->rxflr)
+        (void)hw->data_cmd; // bytes read before the abort
+
+    stats.aborts++;
+    transfer_done(PICO_ERROR_GENERIC);
+    account_cpu(start);
+}
+
+/// @brief Claim the DMA channels and interrupts for transfers to one device. Call after i2c_init(), from core 0.
+/// @param i2c the I2C block
+/// @param addr 7-bit device address
+void i2c_async_init(i2c_inst_t *i2c, uint8_t addr)
+{
+    port = i2c;
+    target = addr;
+
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+    hw->enable = 0; // the target address can only be changed while disabled
+    hw->tar = addr;
+    hw->enable = 1;
+    hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+    hw->intr_mask = I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+
+    tx_chan = dma_claim_unused_channel(true);
+    rx_chan = dma_claim_unused_channel(true);
+
+    dma_channel_config config = dma_channel_get_default_config(tx_chan);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_dreq(&config, i2c_get_dreq(i2c, true));
+    dma_channel_configure(tx_chan, &config, &hw->data_cmd, queue[0].commands, 0, false);
+
+    config = dma_channel_get_default_config(rx_chan);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_dreq(&config, i2c_get_dreq(i2c, false));
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    dma_channel_configure(rx_chan, &config, rx_buf, &hw->data_cmd, 0, false);
+
+    dma_channel_set_irq1_enabled(rx_chan, true);
+    irq_add_shared_handler(DMA_IRQ_1, i2c_async_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+
+    uint irq = I2C0_IRQ + i2c_get_index(i2c);
+    irq_set_exclusive_handler(irq, i2c_async_abort_handler);
+    irq_set_enabled(irq, true);
+}
+
+/// @brief Start building a transfer.
+/// @param t transfer to fill
+/// @param callback called with the bytes read once it is over, may be NULL
+/// @param arg passed to the callback
+void HOT_FUNC(i2c_async_begin)(struct I2cAsyncTransfer *t, i2c_async_callback_t callback, void *arg)
+{
+    t->count = 0;
+    t->reads = 0;
+    t->callback = callback;
+    t->arg = arg;
+}
+
+/// @brief Add a register write: the register address, then the bytes, then STOP.
+/// @param reg register address
+/// @param src bytes to write, len may be 0 to only set the address
+/// @return false if the transfer has no room left, leaving it unchanged
+bool HOT_FUNC(i2c_async_write_reg)(struct I2cAsyncTransfer *t, uint8_t reg, const uint8_t *src, size_t len)
+{
+    if (t->count + 1 + len > I2C_ASYNC_COMMANDS)
+        return false;
+
+    t->commands[t->count++] = reg;
+    for (size_t i = 0; i < len; i++)
+        t->commands[t->count++] = src[i];
+    t->commands[t->count - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+    return true;
+}
+
+/// @brief Add a register read: the register address, a repeated start, len bytes read, then STOP.
+/// @param reg register address
+/// @param len bytes to read, at least 1
+/// @return false if the transfer has no room left, leaving it unchanged
+bool HOT_FUNC(i2c_async_read_reg)(struct I2cAsyncTransfer *t, uint8_t reg, size_t len)
+{
+    if (len == 0 || t->count + 1 + len > I2C_ASYNC_COMMANDS || t->reads + len > I2C_ASYNC_READ_MAX)
+        return false;
+
+    t->commands[t->count++] = reg;
+    for (size_t i = 0; i < len; i++)
+        t->commands[t->count++] = I2C_IC_DATA_CMD_CMD_BITS | (i == 0 ? I2C_IC_DATA_CMD_RESTART_BITS : 0);
+    t->commands[t->count - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+    t->reads += len;
+    return true;
+}
+
+/// @brief Queue a transfer, copying it. Safe from interrupts and callbacks on core 0.
+/// @return false if the queue is full or the transfer reads nothing
+bool HOT_FUNC(i2c_async_submit)(const struct I2cAsyncTransfer *t)
+{
+    if (t->reads == 0)
+        return false;
+
+    uint32_t start = cycles_now();
+    uint32_t save = save_and_disable_interrupts();
+    bool room = queue_head - queue_tail < I2C_ASYNC_QUEUE;
+    if (room)
+    {
+        queue[queue_head % I2C_ASYNC_QUEUE] = *t;
+        queue_head++;
+        queue_start();
+    }
+    if (!in_handler)
+        account_cpu(start); // otherwise counted with the handler
+    restore_interrupts(save);
+    return room;
+}
+
+/// @brief Whether the queue is empty and the bus is free of transfers.
+bool HOT_FUNC(i2c_async_idle)()
+{
+    return !running && queue_tail == queue_head;
+}
+
+/// @brief Take the block for blocking SDK calls. Waits for the transfer on the bus; queued ones wait for the release. Not from an interrupt.
+void i2c_async_acquire()
+{
+    if (!port)
+        return; // not set up yet, nothing can be running
+
+    uint32_t save = save_and_disable_interrupts();
+    holds++;
+    restore_interrupts(save);
+
+    if (running)
+    {
+        stats.waits++;
+        while (running)
+            tight_loop_contents();
+    }
+    i2c_get_hw(port)->intr_mask = 0;
+}
+
+/// @brief Give the block back after i2c_async_acquire(), starting any queued transfer.
+void i2c_async_release()
+{
+    if (!port)
+        return;
+
+    uint32_t save = save_and_disable_interrupts();
+    if (--holds == 0)
+    {
+        i2c_hw_t *hw = i2c_get_hw(port);
+        if (hw->tar != target)
+        {
+            // the SDK calls set it for their own address
+            hw->enable = 0;
+            hw->tar = target;
+            hw->enable = 1;
+        }
+        hw->intr_mask = I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+        queue_start();
+    }
+    restore_interrupts(save);
+}
+
+/// @brief Copy the transfer counters.
+/// @param out counters
+void i2c_async_get_stats(struct I2cAsyncStats *out)
+{
+    uint32_t save = save_and_disable_interrupts();
+    *out = stats;
+    restore_interrupts(save);
+}
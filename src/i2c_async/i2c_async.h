@@ -0,0 +1,51 @@
+#ifndef I2C_ASYNC_H
+#define I2C_ASYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "hardware/i2c.h"
+
+#define I2C_ASYNC_QUEUE 4     // transfers waiting for the bus, must be a power of 2
+#define I2C_ASYNC_COMMANDS 16 // command words in one transfer, the I2C TX FIFO depth
+#define I2C_ASYNC_READ_MAX 16 // bytes read by one transfer, the I2C RX FIFO depth
+
+// Called from the DMA interrupt once a transfer is over. result is the
+// number of bytes read, or PICO_ERROR_GENERIC if the device did not answer;
+// data holds them until the callback returns. It may submit the next transfer.
+typedef void (*i2c_async_callback_t)(int result, const uint8_t *data, void *arg);
+
+// A run of register accesses to one device, sent as I2C controller command
+// words in one DMA burst. Built with i2c_async_begin() and the
+// i2c_async_*_reg() calls; each access is a transaction of its own, ended by
+// a STOP. A transfer must read at least one byte, because the end of the
+// read is what marks the end of the transfer.
+struct I2cAsyncTransfer
+{
+    uint16_t commands[I2C_ASYNC_COMMANDS];
+    uint8_t count; // command words used
+    uint8_t reads; // bytes the commands read
+    i2c_async_callback_t callback;
+    void *arg;
+};
+
+struct I2cAsyncStats
+{
+    uint32_t transfers; // completed, aborted ones included
+    uint32_t aborts;    // NACKs and other controller aborts
+    uint32_t waits;     // blocking users that waited for the queue to empty
+    uint64_t bus_us;    // from each transfer starting to its last byte read
+    uint64_t cpu_ns;    // in the interrupt handlers, callbacks included, and in i2c_async_submit()
+};
+
+void i2c_async_init(i2c_inst_t *i2c, uint8_t addr);
+void i2c_async_begin(struct I2cAsyncTransfer *t, i2c_async_callback_t callback, void *arg);
+bool i2c_async_write_reg(struct I2cAsyncTransfer *t, uint8_t reg, const uint8_t *src, size_t len);
+bool i2c_async_read_reg(struct I2cAsyncTransfer *t, uint8_t reg, size_t len);
+bool i2c_async_submit(const struct I2cAsyncTransfer *t);
+bool i2c_async_idle();
+void i2c_async_acquire();
+void i2c_async_release();
+void i2c_async_get_stats(struct I2cAsyncStats *out);
+
+#endif
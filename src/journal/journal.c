@@ -0,0 +1,443 @@
+#include <stddef.h>
+#include <string.h>
+#include "journal.h"
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+#include "hardware/regs/addressmap.h"
+
+// Append-only journal of the calculator state in the last JOURNAL_SECTORS
+// sectors of flash. Records are 16 bytes with a CRC. Each sector starts
+// with a snapshot of the whole state and continues with deltas, so a boot
+// replays one sector at most. Changes collect in RAM and go out together,
+// several records per page program. Flash bits only go from 1 to 0, so a
+// page that already holds records is programmed again with 0xFF over them.
+//
+// When a sector fills up, the next one in turn is erased and starts with a
+// fresh snapshot. Erases rotate over every sector, and the old sector stays
+// intact until its turn comes round again, so a power loss while compacting
+// falls back to it. A snapshot spans several records and pages, so its first
+// record says how many it takes, and a sector only counts once all of them
+// are in flash. A compaction that fails is retried in the same sector, so
+// failures never erase the last complete snapshot.
+//
+// A value takes one record per 32-bit limb that changed, so typing into a
+// 32-bit word writes no more than it did before words grew wider. Journals
+// from before then replay as 32-bit unsigned words.
+
+#define JOURNAL_RECORDS (FLASH_SECTOR_SIZE / sizeof(struct JournalRecord))
+#define JOURNAL_FLASH_TIMEOUT_MS 10 // for core 1 to pause
+
+enum RecordType
+{
+    RECORD_SNAPSHOT = 0x5A, // radix and limb 0 of the value, the rest of the state follows as other records
+    RECORD_VALUE,           // a limb of the value, arg is its index
+    RECORD_RADIX,
+    RECORD_RESULT,      // a result added to the history, arg is its word size and value its limb 0
+    RECORD_WORD,        // arg is the word size, value 1 when signed
+    RECORD_RESULT_LIMB, // a further limb of the newest result, arg is its index
+};
+
+struct JournalRecord
+{
+    uint32_t sequence; // one more than the record before, across sectors
+    uint8_t type;      // RecordType, 0xFF where the flash is erased
+    uint8_t arg;       // see RecordType
+    uint16_t snapshot_records; // of a RECORD_SNAPSHOT, itself included. 0xFFFF otherwise and in older journals
+    uint32_t value;
+    uint32_t crc; // CRC-32 of the fields above
+};
+
+_Static_assert(FLASH_PAGE_SIZE % sizeof(struct JournalRecord) == 0, "records must not straddle pages");
+
+static struct JournalState state; // as of the newest change, written or not
+static struct JournalRecord batch[JOURNAL_BATCH];
+static uint8_t batch_count;
+static uint8_t sector;
+static uint32_t head;     // records in sector
+static uint32_t sequence; // of the next record
+static alarm_id_t alarm;
+static void (*due_callback)(void);
+static struct JournalStats stats;
+
+static uint8_t page[FLASH_PAGE_SIZE];
+
+static uint32_t crc32(const void *data, size_t len)
+{
+    // reflected 0xEDB88320, a nibble at a time
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    const uint8_t *p = data;
+    uint32_t crc = ~0u;
+
+    while (len--)
+    {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ table[crc & 15];
+        crc = (crc >> 4) ^ table[crc & 15];
+    }
+    return ~crc;
+}
+
+static uint32_t record_crc(const struct JournalRecord *record)
+{
+    return crc32(record, offsetof(struct JournalRecord, crc));
+}
+
+/// @brief A sector through the XIP window, bypassing the cache so replay does not evict code.
+static const struct JournalRecord *sector_records(uint8_t n)
+{
+    return (const struct JournalRecord *)(XIP_NOCACHE_NOALLOC_BASE + JOURNAL_OFFSET + n * FLASH_SECTOR_SIZE);
+}
+
+static bool record_valid(const struct JournalRecord *record)
+{
+    return record->type >= RECORD_SNAPSHOT && record->type <= RECORD_RESULT_LIMB && record->crc == record_crc(record);
+}
+
+static bool record_erased(const struct JournalRecord *record)
+{
+    const uint8_t *p = (const uint8_t *)record;
+    for (size_t i = 0; i < sizeof(*record); i++)
+        if (p[i] != 0xFF)
+            return false;
+    return true;
+}
+
+/// @brief Whether a sector starts with a snapshot that reached flash in full.
+static bool snapshot_complete(const struct JournalRecord *records)
+{
+    if (!record_valid(&records[0]) || records[0].type != RECORD_SNAPSHOT)
+        return false;
+
+    uint32_t count = records[0].snapshot_records;
+    if (count == 0xFFFF)
+        return true; // written before the count was kept, trusted as it was then
+    if (count == 0 || count > JOURNAL_RECORDS)
+        return false;
+    for (uint32_t n = 1; n < count; n++)
+        if (!record_valid(&records[n]) || records[n].sequence != records[0].sequence + n)
+            return false;
+    return true;
+}
+
+static void history_add(const struct Word *value, uint8_t bits)
+{
+    if (state.history_count == JOURNAL_HISTORY)
+    {
+        memmove(state.history, state.history + 1, (JOURNAL_HISTORY - 1) * sizeof(state.history[0]));
+        memmove(state.history_bits, state.history_bits + 1, JOURNAL_HISTORY - 1);
+        state.history_count--;
+    }
+    state.history[state.history_count] = *value;
+    state.history_bits[state.history_count++] = bits;
+}
+
+static void replay(const struct JournalRecord *record)
+{
+    switch (record->type)
+    {
+    case RECORD_SNAPSHOT:
+        state.value = (struct Word){{record->value}};
+        state.radix = record->arg;
+        state.bits = 32; // until a RECORD_WORD says otherwise
+        state.is_signed = false;
+        state.history_count = 0;
+        break;
+    case RECORD_VALUE:
+        if (record->arg < WORD_LIMBS)
+            state.value.limb[record->arg] = record->value;
+        break;
+    case RECORD_RADIX:
+        state.radix = record->arg;
+        break;
+    case RECORD_RESULT:
+        history_add(&(struct Word){{record->value}}, record->arg ? record->arg : 32);
+        break;
+    case RECORD_WORD:
+        state.bits = record->arg;
+        state.is_signed = record->value;
+        break;
+    case RECORD_RESULT_LIMB:
+        if (state.history_count && record->arg < WORD_LIMBS)
+            state.history[state.history_count - 1].limb[record->arg] = record->value;
+        break;
+    }
+}
+
+/// @brief Replay the newest snapshot and the records after it. Call once at boot, before the first change.
+/// @param out the state at the last write, untouched if there is none
+/// @param due called in IRQ context when batched changes are ready to be written, see journal_flush()
+/// @return false if nothing was saved
+bool journal_init(struct JournalState *out, void (*due)(void))
+{
+    uint64_t start = time_us_64();
+    due_callback = due;
+
+    // the sector whose complete snapshot is newest, a compaction cut short falls back to the one before
+    int newest = -1;
+    for (int n = 0; n < JOURNAL_SECTORS; n++)
+    {
+        const struct JournalRecord *first = sector_records(n);
+        if (snapshot_complete(first) &&
+            (newest < 0 || (int32_t)(first->sequence - sector_records(newest)->sequence) > 0))
+            newest = n;
+    }
+
+    if (newest < 0)
+    {
+        // the first flush compacts into sector 0
+        sector = JOURNAL_SECTORS - 1;
+        head = JOURNAL_RECORDS;
+        stats.replay_us = time_us_64() - start;
+        return false;
+    }
+
+    const struct JournalRecord *records = sector_records(newest);
+    uint32_t n = 0;
+    while (n < JOURNAL_RECORDS && record_valid(&records[n]) && records[n].sequence == records[0].sequence + n)
+        replay(&records[n++]);
+
+    sector = newest;
+    sequence = records[0].sequence + n;
+    // a record torn by a power loss cannot be programmed over, start the next sector instead
+    head = n == JOURNAL_RECORDS || record_erased(&records[n]) ? n : JOURNAL_RECORDS;
+
+    stats.replayed = n;
+    stats.replay_us = time_us_64() - start;
+    *out = state;
+    return true;
+}
+
+static int64_t due_alarm(alarm_id_t id, void *user_data)
+{
+    (void)id;
+    (void)user_data;
+    alarm = 0;
+    if (due_callback)
+        due_callback();
+    return 0;
+}
+
+static void schedule(uint32_t ms)
+{
+    if (alarm > 0)
+        cancel_alarm(alarm);
+    alarm = add_alarm_in_ms(ms, due_alarm, NULL, true);
+}
+
+static void append(uint8_t type, uint8_t arg, uint32_t value)
+{
+    // a newer value limb, radix or word size replaces the one still waiting
+    for (int i = 0; i < batch_count && type != RECORD_RESULT && type != RECORD_RESULT_LIMB; i++)
+    {
+        if (batch[i].type == type && (type != RECORD_VALUE || batch[i].arg == arg))
+        {
+            batch[i].arg = arg;
+            batch[i].value = value;
+            schedule(JOURNAL_DELAY_MS);
+            return;
+        }
+    }
+
+    if (batch_count == JOURNAL_BATCH)
+        journal_flush(); // results faster than the delay, not from typing
+    if (batch_count == JOURNAL_BATCH)
+    {
+        head = JOURNAL_RECORDS; // flash busy, the next snapshot covers what does not fit
+        schedule(JOURNAL_RETRY_MS);
+        return;
+    }
+
+    batch[batch_count++] = (struct JournalRecord){.type = type, .arg = arg, .value = value};
+    schedule(JOURNAL_DELAY_MS);
+}
+
+/// @brief Record the value, radix and word shown. Only what changed is queued.
+void journal_set(const struct Word *value, uint8_t radix, uint8_t bits, bool is_signed)
+{
+    for (uint8_t i = 0; i < WORD_LIMBS; i++)
+    {
+        if (value->limb[i] != state.value.limb[i])
+        {
+            state.value.limb[i] = value->limb[i];
+            append(RECORD_VALUE, i, value->limb[i]);
+        }
+    }
+    if (radix != state.radix)
+    {
+        state.radix = radix;
+        append(RECORD_RADIX, radix, 0);
+    }
+    if (bits != state.bits || is_signed != state.is_signed)
+    {
+        state.bits = bits;
+        state.is_signed = is_signed;
+        append(RECORD_WORD, bits, is_signed);
+    }
+}
+
+/// @brief Add a result to the history.
+/// @param bits its word size
+void journal_history(const struct Word *value, uint8_t bits)
+{
+    history_add(value, bits);
+    append(RECORD_RESULT, bits, value->limb[0]);
+    for (uint8_t i = 1; i < bits / 32; i++)
+        if (value->limb[i])
+            append(RECORD_RESULT_LIMB, i, value->limb[i]);
+}
+
+/// @brief Copy the state as of the newest change, including changes not written yet.
+void journal_get(struct JournalState *out)
+{
+    *out = state;
+}
+
+static void program_page(void *param)
+{
+    flash_range_program(*(const uint32_t *)param, page, FLASH_PAGE_SIZE);
+}
+
+static void erase_sector(void *param)
+{
+    flash_range_erase(*(const uint32_t *)param, FLASH_SECTOR_SIZE);
+}
+
+/// @brief Number, seal and program records at index first of sector n.
+/// @return the records programmed, fewer than count if core 1 could not be paused. Those are in flash
+/// for good, so the caller moves past them and numbers the rest again when it retries.
+static uint32_t write_records(uint8_t n, uint32_t first, struct JournalRecord *records, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        records[i].sequence = sequence + i;
+        if (records[i].type != RECORD_SNAPSHOT)
+            records[i].snapshot_records = 0xFFFF;
+        records[i].crc = record_crc(&records[i]);
+    }
+
+    const uint32_t per_page = FLASH_PAGE_SIZE / sizeof(struct JournalRecord);
+    uint32_t i = 0;
+    while (i < count)
+    {
+        uint32_t index = first + i;
+        uint32_t offset = JOURNAL_OFFSET + n * FLASH_SECTOR_SIZE + (index / per_page) * FLASH_PAGE_SIZE;
+        uint32_t n = per_page - index % per_page;
+        if (n > count - i)
+            n = count - i;
+
+        memset(page, 0xFF, sizeof(page)); // leaves the records already there as they are
+        memcpy(page + (index % per_page) * sizeof(struct JournalRecord), &records[i], n * sizeof(struct JournalRecord));
+        if (flash_safe_execute(program_page, &offset, JOURNAL_FLASH_TIMEOUT_MS) != PICO_OK)
+            break;
+
+        stats.pages++;
+        i += n;
+    }
+
+    sequence += i;
+    stats.records += i;
+    return i;
+}
+
+/// @brief Start the next sector with a snapshot, which also covers everything batched. The current
+/// sector only moves on once the whole snapshot is in flash, so a failure retries the same sector.
+static bool compact()
+{
+    struct JournalRecord snapshot[1 + WORD_LIMBS + JOURNAL_HISTORY * WORD_LIMBS];
+    uint8_t next = (sector + 1) % JOURNAL_SECTORS;
+    uint32_t offset = JOURNAL_OFFSET + next * FLASH_SECTOR_SIZE;
+
+    if (flash_safe_execute(erase_sector, &offset, JOURNAL_FLASH_TIMEOUT_MS) != PICO_OK)
+        return false;
+    stats.erases++;
+
+    uint32_t count = 0;
+    snapshot[count++] = (struct JournalRecord){.type = RECORD_SNAPSHOT, .arg = state.radix, .value = state.value.limb[0]};
+    for (uint8_t i = 1; i < WORD_LIMBS; i++)
+        if (state.value.limb[i])
+            snapshot[count++] = (struct JournalRecord){.type = RECORD_VALUE, .arg = i, .value = state.value.limb[i]};
+    snapshot[count++] = (struct JournalRecord){.type = RECORD_WORD, .arg = state.bits, .value = state.is_signed};
+    for (int i = 0; i < state.history_count; i++)
+    {
+        snapshot[count++] =
+            (struct JournalRecord){.type = RECORD_RESULT, .arg = state.history_bits[i], .value = state.history[i].limb[0]};
+        for (uint8_t j = 1; j < WORD_LIMBS; j++)
+            if (state.history[i].limb[j])
+                snapshot[count++] =
+                    (struct JournalRecord){.type = RECORD_RESULT_LIMB, .arg = j, .value = state.history[i].limb[j]};
+    }
+
+    snapshot[0].snapshot_records = count;
+
+    if (write_records(next, 0, snapshot, count) < count)
+    {
+        // the sequence has moved past the records that landed, so no more deltas go to the old sector
+        head = JOURNAL_RECORDS;
+        return false;
+    }
+    sector = next;
+    head = count;
+    return true;
+}
+
+/// @brief Write the batched changes. Interrupts are off and core 1 is paused while flash is busy,
+/// about a millisecond per page and tens of milliseconds for the erase when a sector fills, so call
+/// it when the display has nothing to draw.
+void journal_flush()
+{
+    if (batch_count == 0)
+        return;
+
+    uint64_t start = time_us_64();
+    if (alarm > 0)
+        cancel_alarm(alarm);
+    alarm = 0;
+
+    bool ok;
+    if (head + batch_count > JOURNAL_RECORDS)
+    {
+        ok = compact();
+    }
+    else
+    {
+        // drop what reached flash, so a later change is not merged into a record already programmed
+        uint32_t written = write_records(sector, head, batch, batch_count);
+        head += written;
+        batch_count -= written;
+        memmove(batch, batch + written, batch_count * sizeof(batch[0]));
+        ok = batch_count == 0;
+    }
+
+    if (ok)
+    {
+        batch_count = 0;
+    }
+    else
+    {
+        stats.failures++;
+        schedule(JOURNAL_RETRY_MS);
+    }
+
+    uint32_t us = time_us_64() - start;
+    if (us > stats.flush_us_max)
+        stats.flush_us_max = us;
+}
+
+/// @brief Try again shortly, for when the write is due but the display is busy.
+void journal_defer()
+{
+    if (batch_count)
+        schedule(JOURNAL_RETRY_MS);
+}
+
+/// @brief Copy the journal counters.
+void journal_get_stats(struct JournalStats *out)
+{
+    *out = stats;
+    out->sequence = sequence;
+    out->sector = sector;
+}
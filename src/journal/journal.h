@@ -0,0 +1,49 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/flash.h"
+#include "word.h"
+
+#define JOURNAL_SECTORS 4     // at the very end of flash, written in turn, journal.ld keeps the image out of them
+#define JOURNAL_OFFSET (PICO_FLASH_SIZE_BYTES - JOURNAL_SECTORS * FLASH_SECTOR_SIZE)
+#define JOURNAL_HISTORY 8     // results of = kept
+#define JOURNAL_BATCH 16      // records held in RAM until they are written
+#define JOURNAL_DELAY_MS 2000 // quiet time after the last change before it is written
+#define JOURNAL_RETRY_MS 50   // wait when the display is busy
+
+// State that survives power-off
+struct JournalState
+{
+    struct Word value;
+    uint8_t radix;
+    uint8_t bits; // word size, see word.h
+    bool is_signed;
+    uint8_t history_count;
+    struct Word history[JOURNAL_HISTORY]; // oldest first
+    uint8_t history_bits[JOURNAL_HISTORY];
+};
+
+struct JournalStats
+{
+    uint32_t replayed;     // records replayed at boot
+    uint32_t replay_us;    // time to find and replay them
+    uint32_t records;      // records written since boot
+    uint32_t pages;        // page programs
+    uint32_t erases;       // sector erases, one per compaction
+    uint32_t failures;     // flushes that could not pause core 1, retried later
+    uint32_t flush_us_max; // longest flush, interrupts are off for most of it
+    uint32_t sequence;     // of the next record
+    uint8_t sector;        // being appended to
+};
+
+bool journal_init(struct JournalState *out, void (*due)(void));
+void journal_set(const struct Word *value, uint8_t radix, uint8_t bits, bool is_signed);
+void journal_history(const struct Word *value, uint8_t bits);
+void journal_get(struct JournalState *out);
+void journal_flush();
+void journal_defer();
+void journal_get_stats(struct JournalStats *out);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <stdint.h>
+
+#define KEYMAP_CODES 128 // TCA8418 key event codes, the event without its direction bit
+
+// What a key does. The table is generated from keymap.txt by keymap_gen.py.
+enum KeyActionType
+{
+    KEY_NONE,      // no key has this code
+    KEY_DIGIT,     // arg is the digit
+    KEY_OPERATOR,  // arg is the CalcOp
+    KEY_OPEN,
+    KEY_CLOSE,
+    KEY_EQUALS,
+    KEY_NOT,
+    KEY_NEGATE,
+    KEY_BACKSPACE,
+    KEY_CLEAR,
+    KEY_MODE,      // cycle HEX, DEC, BIN
+    KEY_SHIFT,     // the next key uses its shifted action
+    KEY_BIT,       // arg is the bit to toggle, within the page shown
+    KEY_WORD,      // cycle the word size 8, 16, 32, 64, 128
+    KEY_SIGN,      // toggle signed and unsigned
+    KEY_PAGE,      // arg 1 shows the next 32 bits of a wide word, 0 the previous
+    KEY_RECORD,    // start or stop recording a program, see program.h
+    KEY_RUN,       // run the program on the value
+    KEY_ACTION_COUNT,
+};
+
+struct KeyAction
+{
+    uint8_t type; // KeyActionType
+    uint8_t arg;
+};
+
+// Indexed by shift state, then directly by the TCA8418 key code. Keys
+// without a shifted action repeat their plain one in the shifted half.
+extern const struct KeyAction keymap[2][KEYMAP_CODES];
+
+#endif
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Generate the key dispatch table from keymap.txt and the keycaps on keys.svg.
+
+    keymap_gen.py keymap.txt keys.svg keymap_table.c
+
+The table is indexed by the raw TCA8418 key code, row * 10 + col + 1, so
+the firmware dispatches a key without decoding it. The build fails here if
+a key on the board is missing or listed twice, a legend is unknown, or a
+keycap on keys.svg has no key.
+"""
+
+import re
+import sys
+import xml.etree.ElementTree as ET
+
+CODES = 128
+COLS = 10  # TCA8418_matrix(8, 10)
+
+# keys wired on the board, (row, col)
+PHYSICAL = {(r, c) for r in range(6) for c in range(5)} | {(r, c) for r in range(8) for c in range(5, 9)}
+
+# keycaps on keys.svg without a function yet
+PLACEHOLDERS = {"stuff"}
+
+ACTIONS = {
+    "±": ("KEY_NEGATE", 0),
+    ".": ("KEY_MODE", 0),
+    "=": ("KEY_EQUALS", 0),
+    "+": ("KEY_OPERATOR", "CALC_ADD"),
+    "-": ("KEY_OPERATOR", "CALC_SUB"),
+    "×": ("KEY_OPERATOR", "CALC_MUL"),
+    "÷": ("KEY_OPERATOR", "CALC_DIV"),
+    "%": ("KEY_OPERATOR", "CALC_MOD"),
+    "AND": ("KEY_OPERATOR", "CALC_AND"),
+    "NAND": ("KEY_OPERATOR", "CALC_NAND"),
+    "OR": ("KEY_OPERATOR", "CALC_OR"),
+    "NOR": ("KEY_OPERATOR", "CALC_NOR"),
+    "XOR": ("KEY_OPERATOR", "CALC_XOR"),
+    "<<": ("KEY_OPERATOR", "CALC_SHL"),
+    ">>": ("KEY_OPERATOR", "CALC_SHR"),
+    "<<<": ("KEY_OPERATOR", "CALC_ROL"),
+    ">>>": ("KEY_OPERATOR", "CALC_ROR"),
+    "NOT": ("KEY_NOT", 0),
+    "(": ("KEY_OPEN", 0),
+    ")": ("KEY_CLOSE", 0),
+    "←": ("KEY_BACKSPACE", 0),
+    "CLR": ("KEY_CLEAR", 0),
+    "↑": ("KEY_SHIFT", 0),
+    "WORD": ("KEY_WORD", 0),
+    "SIGN": ("KEY_SIGN", 0),
+    "PG-": ("KEY_PAGE", 0),
+    "PG+": ("KEY_PAGE", 1),
+    "REC": ("KEY_RECORD", 0),
+    "RUN": ("KEY_RUN", 0),
+}
+ACTIONS.update({"0123456789ABCDEF"[d]: ("KEY_DIGIT", d) for d in range(16)})
+ACTIONS.update({"BIT%d" % b: ("KEY_BIT", b) for b in range(32)})
+
+
+def fail(message):
+    sys.exit("keymap_gen: " + message)
+
+
+def svg_legends(path):
+    """Every legend printed on the keycap sheet."""
+    legends = set()
+    for element in ET.parse(path).iter():
+        if element.tag.endswith("}tspan") and element.text and element.text.strip():
+            legends.add(element.text.strip())
+    return legends - PLACEHOLDERS
+
+
+def read_keymap(path):
+    keys = {}
+    with open(path, encoding="utf-8") as f:
+        for line_no, line in enumerate(f, 1):
+            fields = line.split("#")[0].split()
+            if not fields:
+                continue
+            where = "%s:%d" % (path, line_no)
+            if len(fields) not in (3, 4) or not fields[0].isdigit() or not fields[1].isdigit():
+                fail("%s: expected row col legend [shifted]" % where)
+
+            position = (int(fields[0]), int(fields[1]))
+            if position not in PHYSICAL:
+                fail("%s: no key at row %d col %d" % ((where,) + position))
+            if position in keys:
+                fail("%s: row %d col %d is already %s" % ((where,) + position + (keys[position][0],)))
+            for legend in fields[2:]:
+                if legend not in ACTIONS:
+                    fail("%s: unknown legend %s" % (where, legend))
+            keys[position] = fields[2:]
+    return keys
+
+
+def main():
+    if len(sys.argv) != 4:
+        fail("usage: keymap_gen.py keymap.txt keys.svg keymap_table.c")
+    keys = read_keymap(sys.argv[1])
+
+    missing = sorted(PHYSICAL - keys.keys())
+    if missing:
+        fail("no action for " + ", ".join("row %d col %d" % p for p in missing))
+    used = {legend for legends in keys.values() for legend in legends}
+    unused = sorted(svg_legends(sys.argv[2]) - used)
+    if unused:
+        fail("keycaps on %s with no key: %s" % (sys.argv[2], " ".join(unused)))
+
+    rows = [["{KEY_NONE, 0}"] * CODES for _ in range(2)]
+    comments = [[""] * CODES for _ in range(2)]
+    for (row, col), legends in keys.items():
+        code = row * COLS + col + 1
+        for shift in range(2):
+            legend = legends[min(shift, len(legends) - 1)]
+            rows[shift][code] = "{%s, %s}" % ACTIONS[legend]
+            comments[shift][code] = "row %d col %d %s" % (row, col, legend)
+
+    out = ["// Generated by keymap_gen.py from keymap.txt and keys.svg, do not edit", "",
+           '#include "keymap.h"', '#include "calc.h"', "",
+           "const struct KeyAction keymap[2][KEYMAP_CODES] = {"]
+    for shift in range(2):
+        out.append("    {")
+        for code in range(CODES):
+            if comments[shift][code]:
+                out.append("        [%d] = %s, // %s" % (code, rows[shift][code], comments[shift][code]))
+        out.append("    },")
+    out.append("};")
+
+    with open(sys.argv[3], "w", encoding="utf-8") as f:
+        f.write("\n".join(out) + "\n")
+
+
+if __name__ == "__main__":
+    main()
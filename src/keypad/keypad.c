@@ -0,0 +1,212 @@
+#include "keypad.h"
+#include "peripherals.h"
+#include "tca8418.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "pico/stdlib.h"
+#include "i2c_async.h"
+#include "trace.h"
+#include "xip_profile.h"
+#include "hot_path.h"
+
+#define KEYPAD_FIFO_DEPTH 10 // TCA8418 key event FIFO
+#define KEYPAD_MAX_PASSES 4  // bound on re-draining while INT stays low
+#define KEYPAD_STAT_ALL 0x1F // every INT_STAT bit, cleared together
+#define KEYPAD_RETRY_US 500  // a drain that stopped with INT still low starts again after this
+
+// Single producer (the drain) / single consumer (keypad_pop) ring. Indices
+// run freely and are only written by their own side, so no locking is needed.
+static struct KeyPressEvent ring[KEYPAD_RING_SIZE];
+static volatile uint32_t ring_head; // written by the producer
+static volatile uint32_t ring_tail; // written by the consumer
+
+static struct KeypadStats stats;
+
+static void HOT_FUNC(keypad_push)(const struct KeyPressEvent *event)
+{
+    if (ring_head - ring_tail == KEYPAD_RING_SIZE)
+    {
+        stats.dropped++;
+        return;
+    }
+
+    ring[ring_head % KEYPAD_RING_SIZE] = *event;
+    __dmb(); // event must be visible before the index that publishes it
+    ring_head++;
+}
+
+/// @brief Decode a raw TCA8418 key event.
+/// @param event event byte from the TCA8418 FIFO
+/// @param out decoded event
+void HOT_FUNC(interpret_key_event)(uint8_t event, struct KeyPressEvent *out)
+{
+    out->pressed = event >> 7; // direction in bit 7 of event
+    out->code = event & 0x7F;  // kept as is, the keymap is indexed by it so nothing is divided
+}
+
+// The FIFO is read by a chain of i2c_async transfers, each started from
+// the completion of the one before, so the CPU only runs between them:
+//   status: read INT_STAT, clear it, read the event count
+//   events: read that many events from KEY_EVENT_A
+// Status is cleared before the FIFO is read, so an event that arrives
+// meanwhile raises INT again instead of being missed. While INT stays low
+// after a pass, the chain goes round again, up to KEYPAD_MAX_PASSES.
+//
+// TCA8418_INT only interrupts on its falling edge, so a drain that stops
+// with the pin still low would leave the keypad silent for good. Such a
+// drain hands over what it read and starts again from an alarm. So does
+// one whose transfer was refused or not answered.
+
+static keypad_callback_t drained_callback;
+static volatile bool draining;
+static uint16_t drain_key;
+static uint8_t drain_passes;
+static uint64_t drain_since_us;
+static uint64_t drain_trace;
+static alarm_id_t retry_alarm;
+
+static void drain_status();
+
+static void HOT_FUNC(drain_end)()
+{
+    trace_end(TRACE_DRAIN, drain_trace, drain_key);
+    stats.drain_us += time_us_64() - drain_since_us;
+    draining = false;
+    if (drained_callback)
+        drained_callback(drain_key);
+}
+
+static int64_t retry_due(alarm_id_t id, void *user_data)
+{
+    (void)id;
+    retry_alarm = 0;
+    if (!gpio_get(TCA8418_INT))
+        keypad_drain_start((uint16_t)(uintptr_t)user_data);
+    return 0;
+}
+
+/// @brief End a drain that has to stop before INT is released, and drain again shortly.
+static void drain_end_retry()
+{
+    uint16_t key = drain_key;
+    drain_end();
+    if (retry_alarm <= 0)
+        retry_alarm = add_alarm_in_us(KEYPAD_RETRY_US, retry_due, (void *)(uintptr_t)key, true);
+}
+
+/// @brief End of a pass, go round again while INT is still low.
+static void HOT_FUNC(drain_pass_done)()
+{
+    if (gpio_get(TCA8418_INT))
+        drain_end(); // INT released, nothing left
+    else if (++drain_passes == KEYPAD_MAX_PASSES)
+        drain_end_retry(); // more keys keep coming, let the run loop have these first
+    else
+        drain_status();
+}
+
+static void HOT_FUNC(events_done)(int result, const uint8_t *data, void *arg)
+{
+    (void)arg;
+    struct XipProfileMark xip_start = xip_profile_begin();
+
+    for (int i = 0; i < result; i++)
+    {
+        struct KeyPressEvent keypress;
+        interpret_key_event(data[i], &keypress);
+        keypad_push(&keypress);
+    }
+    if (result > 0)
+        stats.events += result;
+
+    drain_pass_done();
+    xip_profile_end(XIP_PROFILE_DRAIN, xip_start);
+}
+
+static void HOT_FUNC(status_done)(int result, const uint8_t *data, void *arg)
+{
+    (void)arg;
+    struct XipProfileMark xip_start = xip_profile_begin();
+
+    if (result < 0)
+    {
+        drain_end_retry(); // the chip did not answer
+    }
+    else
+    {
+        if (data[0] & TCA8418_REG_STAT_OVR_FLOW_INT)
+            stats.overflows++;
+
+        uint8_t count = data[1] & 0x0F; // event count is in lower 4 bits
+        if (count > KEYPAD_FIFO_DEPTH)
+            count = KEYPAD_FIFO_DEPTH;
+
+        struct I2cAsyncTransfer t;
+        i2c_async_begin(&t, events_done, NULL);
+        if (count == 0 || !i2c_async_read_reg(&t, TCA8418_REG_KEY_EVENT_A, count) || !i2c_async_submit(&t))
+            drain_pass_done();
+    }
+    xip_profile_end(XIP_PROFILE_DRAIN, xip_start);
+}
+
+static void HOT_FUNC(drain_status)()
+{
+    uint8_t clear = KEYPAD_STAT_ALL; // write 1 to clear
+
+    struct I2cAsyncTransfer t;
+    i2c_async_begin(&t, status_done, NULL);
+    i2c_async_read_reg(&t, TCA8418_REG_INT_STAT, 1);
+    i2c_async_write_reg(&t, TCA8418_REG_INT_STAT, &clear, 1);
+    i2c_async_read_reg(&t, TCA8418_REG_KEY_LCK_EC, 1);
+    if (!i2c_async_submit(&t))
+        drain_end_retry(); // queue full
+}
+
+/// @brief Set up draining. Call after TCA8418_init().
+/// @param drained called from the DMA interrupt once a drain has finished, with the key it was started for
+void keypad_init(keypad_callback_t drained)
+{
+    drained_callback = drained;
+}
+
+/// @brief Start moving every pending event from the TCA8418 FIFO into the ring, and return without waiting for the bus. Call on a TCA8418_INT falling edge; safe from interrupts on core 0.
+/// @param key trace id of the key interrupt, handed to the drained callback
+void HOT_FUNC(keypad_drain_start)(uint16_t key)
+{
+    uint32_t save = save_and_disable_interrupts();
+    if (!draining)
+    {
+        // an edge during a drain needs nothing, the drain reads INT before it ends
+        draining = true;
+        drain_key = key;
+        drain_passes = 0;
+        drain_since_us = time_us_64();
+        drain_trace = trace_begin();
+        stats.drains++;
+        drain_status();
+    }
+    restore_interrupts(save);
+}
+
+/// @brief Take the oldest event out of the ring.
+/// @param out the event, if there was one
+/// @return false if the ring is empty
+bool HOT_FUNC(keypad_pop)(struct KeyPressEvent *out)
+{
+    if (ring_tail == ring_head)
+        return false;
+
+    *out = ring[ring_tail % KEYPAD_RING_SIZE];
+    __dmb(); // finish reading the slot before handing it back to the producer
+    ring_tail++;
+    return true;
+}
+
+/// @brief Copy the event counters.
+/// @param out counters
+void keypad_get_stats(struct KeypadStats *out)
+{
+    uint32_t save = save_and_disable_interrupts();
+    *out = stats;
+    restore_interrupts(save);
+}
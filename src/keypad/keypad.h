@@ -0,0 +1,32 @@
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define KEYPAD_RING_SIZE 32 // decoded events buffered until they are handled, must be a power of 2
+
+struct KeyPressEvent
+{
+    uint8_t pressed; // 1 if pressed, 0 if released
+    uint8_t code;    // TCA8418 key number, row * 10 + col + 1, indexes keymap
+};
+
+struct KeypadStats
+{
+    uint32_t events;    // events read from the TCA8418
+    uint32_t drains;    // drains started by keypad_drain_start()
+    uint32_t overflows; // times the TCA8418 FIFO overflowed, losing its oldest event
+    uint32_t dropped;   // events lost because the ring was full
+    uint64_t drain_us;  // from each drain starting to its last event read, mostly waiting on the bus
+};
+
+typedef void (*keypad_callback_t)(uint16_t key);
+
+void interpret_key_event(uint8_t event, struct KeyPressEvent *out);
+void keypad_init(keypad_callback_t drained);
+void keypad_drain_start(uint16_t key);
+bool keypad_pop(struct KeyPressEvent *out);
+void keypad_get_stats(struct KeypadStats *out);
+
+#endif
@@ -0,0 +1,264 @@
+#include "oled_spi.h"
+#include "peripherals.h"
+#include "hardware/spi.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/gpio.h"
+#include "pico/stdlib.h"
+#include "hot_path.h"
+
+// A run of bytes sent with the same DC level. Chunks are immutable once
+// published; the DMA handler consumes them in order and switches DC/CS
+// between them.
+struct oled_spi_chunk
+{
+    uint16_t offset;    // start in queue_buf
+    uint16_t len;       // may be 0 for a chunk that only releases CS
+    uint8_t dc;         // DC level for the whole chunk
+    uint8_t release_cs; // deassert CS once this chunk is on the wire
+};
+
+static uint8_t queue_buf[OLED_SPI_QUEUE_BYTES];
+static struct oled_spi_chunk chunks[OLED_SPI_QUEUE_CHUNKS];
+
+// Producer side (u8x8 byte callback)
+static volatile uint16_t chunk_head; // next chunk slot to publish
+static uint16_t buf_head;            // next free byte in queue_buf
+static uint16_t open_offset;         // chunk being filled, not yet visible to the DMA handler
+static uint16_t open_len;
+static uint8_t open_dc;
+static uint32_t bytes_total; // every byte ever queued, for measuring update cost
+
+// Consumer side (DMA handler)
+static volatile uint16_t chunk_tail; // chunk on the bus, or next to go out
+static volatile bool in_flight;      // a DMA transfer is running
+static bool cs_asserted;
+
+static int tx_chan;
+static int rx_chan;
+static uint8_t rx_dummy;
+static oled_spi_callback_t complete_callback;
+
+/// @brief Put the chunk at chunk_tail on the bus, skipping empty chunks. Must run with the DMA IRQ masked.
+/// @param retired whether the caller just retired a chunk, so an empty queue means a frame completed
+static void HOT_FUNC(queue_advance)(bool retired)
+{
+    while (chunk_tail != chunk_head)
+    {
+        struct oled_spi_chunk *chunk = &chunks[chunk_tail];
+
+        if (chunk->len > 0)
+        {
+            gpio_put(OLED_DC, chunk->dc);
+            if (!cs_asserted)
+            {
+                gpio_put(OLED_CS, false); // SSD1322 CS is active low
+                cs_asserted = true;
+            }
+
+            // RX is drained into a dummy byte so its completion marks the point where
+            // the last bit has actually left the shifter, not just entered the TX FIFO.
+            dma_channel_set_trans_count(rx_chan, chunk->len, false);
+            dma_channel_set_read_addr(tx_chan, &queue_buf[chunk->offset], false);
+            dma_channel_set_trans_count(tx_chan, chunk->len, false);
+            in_flight = true;
+            dma_start_channel_mask((1u << tx_chan) | (1u << rx_chan));
+            return;
+        }
+
+        if (chunk->release_cs && cs_asserted)
+        {
+            gpio_put(OLED_CS, true);
+            cs_asserted = false;
+        }
+        chunk_tail = (chunk_tail + 1) % OLED_SPI_QUEUE_CHUNKS;
+        retired = true;
+    }
+
+    in_flight = false;
+    if (retired && complete_callback)
+        complete_callback();
+}
+
+static void HOT_FUNC(oled_spi_dma_handler)()
+{
+    if (!dma_channel_get_irq0_status(rx_chan))
+        return; // shared IRQ, not ours
+
+    dma_channel_acknowledge_irq0(rx_chan);
+
+    if (chunks[chunk_tail].release_cs)
+    {
+        gpio_put(OLED_CS, true);
+        cs_asserted = false;
+    }
+    chunk_tail = (chunk_tail + 1) % OLED_SPI_QUEUE_CHUNKS;
+
+    queue_advance(true);
+}
+
+/// @brief Start the DMA handler on newly published chunks if it is idle.
+static void HOT_FUNC(queue_kick)()
+{
+    uint32_t save = save_and_disable_interrupts();
+    if (!in_flight)
+        queue_advance(false);
+    restore_interrupts(save);
+}
+
+/// @brief Make the chunk being filled visible to the DMA handler.
+static void HOT_FUNC(queue_publish)(bool release_cs)
+{
+    if (open_len == 0 && !release_cs)
+        return;
+
+    while ((chunk_head + 1) % OLED_SPI_QUEUE_CHUNKS == chunk_tail)
+    {
+        queue_kick(); // chunk ring full, wait for the bus to retire one
+        tight_loop_contents();
+    }
+
+    chunks[chunk_head] = (struct oled_spi_chunk){
+        .offset = open_offset,
+        .len = open_len,
+        .dc = open_dc,
+        .release_cs = release_cs,
+    };
+    __dmb();
+    chunk_head = (chunk_head + 1) % OLED_SPI_QUEUE_CHUNKS;
+
+    open_offset = buf_head;
+    open_len = 0;
+}
+
+/// @brief Number of bytes that can be appended contiguously at buf_head without overwriting queued data.
+static uint32_t HOT_FUNC(queue_room)()
+{
+    uint16_t tail = chunk_tail; // snapshot, the DMA handler only ever moves it forward
+    bool published = tail != chunk_head;
+    uint32_t first = published ? chunks[tail].offset : open_offset;
+
+    if (!published && open_len == 0)
+    {
+        // nothing queued at all, restart at the beginning of the buffer
+        buf_head = 0;
+        open_offset = 0;
+        return OLED_SPI_QUEUE_BYTES;
+    }
+
+    if (first > buf_head)
+        return first - buf_head; // queued data wraps past the end of the buffer
+    if (first == buf_head)
+        return 0; // queued data fills the whole buffer
+
+    if (buf_head < OLED_SPI_QUEUE_BYTES)
+        return OLED_SPI_QUEUE_BYTES - buf_head;
+
+    // at the end of the buffer, wrap if the start has been retired. Chunks
+    // never straddle the end, so close the one being filled first.
+    if (first == 0)
+        return 0;
+    queue_publish(false);
+    buf_head = 0;
+    open_offset = 0;
+    return first;
+}
+
+/// @brief Claim DMA channels and set up the queue. Expects spi_init() and the OLED GPIOs to be set up already.
+void oled_spi_init()
+{
+    gpio_put(OLED_CS, true);
+    cs_asserted = false;
+
+    tx_chan = dma_claim_unused_channel(true);
+    rx_chan = dma_claim_unused_channel(true);
+
+    dma_channel_config config = dma_channel_get_default_config(tx_chan);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_dreq(&config, spi_get_dreq(OLED_SPI_PORT, true));
+    dma_channel_configure(tx_chan, &config, &spi_get_hw(OLED_SPI_PORT)->dr, queue_buf, 0, false);
+
+    config = dma_channel_get_default_config(rx_chan);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_dreq(&config, spi_get_dreq(OLED_SPI_PORT, false));
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, false);
+    dma_channel_configure(rx_chan, &config, &rx_dummy, &spi_get_hw(OLED_SPI_PORT)->dr, 0, false);
+
+    dma_channel_set_irq0_enabled(rx_chan, true);
+    irq_add_shared_handler(DMA_IRQ_0, oled_spi_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
+
+/// @brief Set the DC level for the following bytes. A change closes the current chunk.
+/// @param dc 0 for command, 1 for data
+void HOT_FUNC(oled_spi_set_dc)(bool dc)
+{
+    if (dc != open_dc && open_len > 0)
+        queue_publish(false);
+    open_dc = dc;
+}
+
+/// @brief Queue bytes for the display and return without waiting for them to be sent. The data is copied.
+/// @param data bytes to send
+/// @param len number of bytes
+void HOT_FUNC(oled_spi_write)(const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        uint32_t room = queue_room();
+        if (room == 0)
+        {
+            queue_publish(false); // let the bus drain what we have so far
+            queue_kick();
+            tight_loop_contents();
+            continue;
+        }
+
+        uint32_t n = len < room ? len : room;
+        for (uint32_t i = 0; i < n; i++)
+            queue_buf[buf_head + i] = data[i];
+
+        buf_head += n;
+        open_len += n;
+        bytes_total += n;
+        data += n;
+        len -= n;
+    }
+}
+
+/// @brief End the current transfer. CS is released once its last byte has been clocked out.
+void HOT_FUNC(oled_spi_end_transfer)()
+{
+    queue_publish(true);
+    queue_kick();
+}
+
+/// @brief Whether a frame is still in flight, i.e. queued bytes have not all reached the display.
+bool HOT_FUNC(oled_spi_busy)()
+{
+    return in_flight || chunk_tail != chunk_head || open_len > 0;
+}
+
+/// @brief Block until everything queued so far has been sent.
+void oled_spi_wait()
+{
+    queue_publish(false);
+    queue_kick();
+    while (in_flight || chunk_tail != chunk_head)
+        tight_loop_contents();
+}
+
+/// @brief Set a function to call (from the DMA interrupt) whenever the queue drains completely.
+/// @param callback function to call, or NULL
+void oled_spi_set_callback(oled_spi_callback_t callback)
+{
+    complete_callback = callback;
+}
+
+/// @brief Total number of bytes queued for the display since boot. Diff two readings to get the cost of an update.
+uint32_t HOT_FUNC(oled_spi_bytes_total)()
+{
+    return bytes_total;
+}
@@ -0,0 +1,26 @@
+#ifndef OLED_SPI_H
+#define OLED_SPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Staging space for queued bytes. A full 256x64 4bpp frame is 8192 data bytes
+// plus ~1 KB of column/row addressing commands, so one whole frame fits.
+#define OLED_SPI_QUEUE_BYTES 10240
+// DC-tagged chunks. u8g2 emits ~4 chunks per tile (cmd, args, cmd, data),
+// so a full frame of 256 tiles needs a little over 1024.
+#define OLED_SPI_QUEUE_CHUNKS 1536
+
+typedef void (*oled_spi_callback_t)(void);
+
+void oled_spi_init();
+void oled_spi_set_dc(bool dc);
+void oled_spi_write(const uint8_t *data, size_t len);
+void oled_spi_end_transfer();
+bool oled_spi_busy();
+void oled_spi_wait();
+void oled_spi_set_callback(oled_spi_callback_t callback);
+uint32_t oled_spi_bytes_total();
+
+#endif
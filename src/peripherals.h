@@ -35,6 +35,7 @@
 // 24 reserved
 #define BAT_ADC_EN 25
 #define BAT_ADC 26
+#define BAT_ADC_DIVIDER 2 // BAT_ADC sees the cell voltage through a 1:2 divider
 // 27-29 spare GPIO connected to header
 
 #endif
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include "power.h"
+#include "peripherals.h"
+#include "render.h"
+#include "bit_leds.h"
+#include "battery.h"
+#include "journal.h"
+#include "governor.h"
+#include "i2c_async.h"
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/xosc.h"
+#include "hardware/sync.h"
+#include "hardware/structs/clocks.h"
+#include "hardware/structs/scb.h"
+
+// Idle power management, on core 0. Three stages after the last key, power
+// button press or command:
+//
+//   POWER_SLEEP_MS  display in power save, LEDs off, the clocks of idle
+//                   peripherals gated and both cores in deep sleep on WFE.
+//                   Any interrupt wakes the board within microseconds.
+//   POWER_OFF_MS    POWER_EN released, which cuts the battery supply. On USB
+//                   power the board keeps running, so it goes dormant instead:
+//                   crystal and PLLs stopped until a key or the power button.
+//
+// The run loop calls power_activity() for every piece of work and
+// power_idle() whenever it has run out.
+
+// Peripheral clocks nothing needs while both cores sleep. The timer, IO bank,
+// USB, XIP and SRAM keep their clocks so an alarm, a key, the power button or
+// the USB host can wake the board.
+#define POWER_GATED_EN0                                                                              \
+    (CLOCKS_SLEEP_EN0_CLK_SYS_SPI1_BITS | CLOCKS_SLEEP_EN0_CLK_PERI_SPI1_BITS |                       \
+     CLOCKS_SLEEP_EN0_CLK_SYS_SPI0_BITS | CLOCKS_SLEEP_EN0_CLK_PERI_SPI0_BITS |                       \
+     CLOCKS_SLEEP_EN0_CLK_SYS_RTC_BITS | CLOCKS_SLEEP_EN0_CLK_RTC_RTC_BITS |                          \
+     CLOCKS_SLEEP_EN0_CLK_SYS_PWM_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_PIO1_BITS |                         \
+     CLOCKS_SLEEP_EN0_CLK_SYS_PIO0_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_JTAG_BITS |                        \
+     CLOCKS_SLEEP_EN0_CLK_SYS_I2C1_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_I2C0_BITS |                        \
+     CLOCKS_SLEEP_EN0_CLK_SYS_DMA_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_ADC_BITS |                          \
+     CLOCKS_SLEEP_EN0_CLK_ADC_ADC_BITS)
+#define POWER_GATED_EN1                                                                              \
+    (CLOCKS_SLEEP_EN1_CLK_SYS_UART1_BITS | CLOCKS_SLEEP_EN1_CLK_PERI_UART1_BITS |                     \
+     CLOCKS_SLEEP_EN1_CLK_SYS_UART0_BITS | CLOCKS_SLEEP_EN1_CLK_PERI_UART0_BITS)
+
+static void (*wake_callback)(void);
+static uint64_t last_activity_us;
+static bool asleep;
+static uint64_t asleep_since_us;
+static uint64_t state_since_us; // start of the current active or asleep stretch
+static uint32_t saved_sleep_en0;
+static uint32_t saved_sleep_en1;
+static struct PowerStats stats;
+
+/// @brief Add the time since the last change of state to active_us or sleep_us.
+static void power_account(uint64_t now)
+{
+    if (asleep)
+        stats.sleep_us += now - state_since_us;
+    else
+        stats.active_us += now - state_since_us;
+    state_since_us = now;
+}
+
+/// @brief Latch the soft power switch on. Call first thing at boot.
+/// @param wake called after a dormant wake-up, which loses the interrupt edge that caused it
+void power_init(void (*wake)(void))
+{
+    gpio_init(POWER_EN);
+    gpio_set_dir(POWER_EN, GPIO_OUT);
+    gpio_put(POWER_EN, 1);
+
+    wake_callback = wake;
+    last_activity_us = time_us_64();
+    state_since_us = last_activity_us;
+}
+
+/// @brief Restart the idle timeouts. Called by the run loop for each piece of work.
+void power_activity()
+{
+    last_activity_us = time_us_64();
+}
+
+/// @brief Display and LEDs off, idle peripheral clocks gated and deep sleep on both cores.
+void power_sleep()
+{
+    if (asleep)
+        return;
+
+    render_sleep(); // returns with the panel off, the SPI bus drained and core 1 in deep sleep
+    journal_flush(); // while the display is idle, and before a power-off can lose it
+    bit_leds_enable(false);
+    battery_suspend(); // its ADC and DMA clocks are gated below
+    while (!i2c_async_idle())
+        tight_loop_contents(); // and the I2C and DMA clocks of a keypad drain
+
+    saved_sleep_en0 = clocks_hw->sleep_en0;
+    saved_sleep_en1 = clocks_hw->sleep_en1;
+    clocks_hw->sleep_en0 = saved_sleep_en0 & ~POWER_GATED_EN0;
+    clocks_hw->sleep_en1 = saved_sleep_en1 & ~POWER_GATED_EN1;
+    scb_hw->scr |= M0PLUS_SCR_SLEEPDEEP_BITS;
+
+    power_account(time_us_64());
+    asleep = true;
+    asleep_since_us = state_since_us;
+    stats.sleeps++;
+}
+
+/// @brief Undo power_sleep(). The first frame is timed from the activity that woke the board.
+static void power_wake()
+{
+    scb_hw->scr &= ~M0PLUS_SCR_SLEEPDEEP_BITS;
+    clocks_hw->sleep_en0 = saved_sleep_en0;
+    clocks_hw->sleep_en1 = saved_sleep_en1;
+
+    power_account(time_us_64());
+    asleep = false;
+
+    bit_leds_enable(true);
+    battery_resume(); // the charger may have been plugged in meanwhile
+    render_wake(last_activity_us);
+}
+
+/// @brief Stop the crystal until a key or the power button. The governor sets the clocks up again on return.
+static void power_dormant()
+{
+    uint32_t xosc_hz = clock_get_hz(clk_ref); // clk_ref already runs from the crystal
+
+    i2c_async_acquire(); // a drain started by a key meanwhile waits for the clocks to return
+    // everything onto the crystal, then the PLLs can go
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF, 0, xosc_hz, xosc_hz);
+    clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS, xosc_hz, xosc_hz);
+    clock_stop(clk_usb);
+    clock_stop(clk_adc);
+    clock_stop(clk_rtc);
+    pll_deinit(pll_sys);
+    pll_deinit(pll_usb);
+
+    // INT is level triggered so keys already waiting in the FIFO wake at once
+    gpio_set_dormant_irq_enabled(TCA8418_INT, GPIO_IRQ_LEVEL_LOW, true);
+    gpio_set_dormant_irq_enabled(POWER_BTN, GPIO_IRQ_EDGE_FALL, true);
+
+    stats.dormants++;
+    xosc_dormant(); // returns once the crystal is stable again
+
+    gpio_set_dormant_irq_enabled(TCA8418_INT, GPIO_IRQ_LEVEL_LOW, false);
+    gpio_set_dormant_irq_enabled(POWER_BTN, GPIO_IRQ_EDGE_FALL, false);
+    gpio_acknowledge_irq(POWER_BTN, GPIO_IRQ_EDGE_FALL);
+
+    pll_init(pll_usb, 1, 1200 * MHZ, 5, 5);
+    clock_configure(clk_usb, 0, CLOCKS_CLK_USB_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, 48 * MHZ, 48 * MHZ);
+    clock_configure(clk_adc, 0, CLOCKS_CLK_ADC_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, 48 * MHZ, 48 * MHZ);
+    clock_configure(clk_rtc, 0, CLOCKS_CLK_RTC_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, 48 * MHZ, 46875);
+    governor_restore(); // clk_sys and clk_peri back as they were
+    i2c_async_release();
+}
+
+/// @brief Turn the calculator off by releasing the soft power latch. On USB power, go dormant until a key or the power button.
+void power_off()
+{
+    power_sleep();
+    gpio_put(POWER_EN, 0);
+    sleep_ms(POWER_OFF_SETTLE_MS); // on battery the supply is gone before this returns
+
+    power_dormant();
+    gpio_put(POWER_EN, 1);
+
+    // the timer stood still while dormant, so this wakes the board on the next power_idle()
+    power_activity();
+    if (wake_callback)
+        wake_callback();
+}
+
+/// @brief Sleep until there is work, moving through the idle stages as their timeouts pass. Call from the run loop when it has run out of work.
+void power_idle()
+{
+    uint64_t now = time_us_64();
+    uint64_t idle_us = now - last_activity_us;
+
+    if (asleep && last_activity_us > asleep_since_us)
+    {
+        power_wake();
+        return;
+    }
+
+    if (idle_us >= POWER_OFF_MS * 1000ull)
+    {
+        power_off();
+        return;
+    }
+
+    if (idle_us >= POWER_SLEEP_MS * 1000ull)
+        power_sleep();
+
+    if (asleep && !i2c_async_idle())
+    {
+        // deep sleep would gate the clocks of a keypad drain, so wait for it awake
+        while (!i2c_async_idle())
+            tight_loop_contents();
+        return;
+    }
+
+    uint64_t deadline = last_activity_us + (asleep ? POWER_OFF_MS : POWER_SLEEP_MS) * 1000ull;
+    if (governor_deadline() < deadline)
+        deadline = governor_deadline(); // back in time to drop the clock
+    best_effort_wfe_or_timeout(from_us_since_boot(deadline)); // work_queue_post() sends the event
+}
+
+/// @brief Copy the power counters and work out the average current budget.
+/// @param out counters
+void power_get_stats(struct PowerStats *out)
+{
+    power_account(time_us_64());
+    *out = stats;
+
+    uint64_t total_us = stats.active_us + stats.sleep_us;
+    if (total_us)
+        out->budget_ua = (stats.active_us * POWER_ACTIVE_UA + stats.sleep_us * POWER_SLEEP_UA) / total_us;
+}
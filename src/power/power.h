@@ -0,0 +1,34 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define POWER_SLEEP_MS 30000    // idle time before the display and LEDs go off and the clocks are gated
+#define POWER_OFF_MS 600000     // idle time before the calculator turns itself off
+#define POWER_OFF_SETTLE_MS 100 // time for the supply to collapse once POWER_EN is released
+
+// Board current in each state, used for the idle budget in PowerStats. These
+// are estimates from the RP2040 and SSD1322 datasheets, to be replaced with
+// bench measurements.
+#define POWER_ACTIVE_UA 45000 // 125 MHz, display on
+#define POWER_SLEEP_UA 1800   // display in power save, both cores in deep sleep, peripheral clocks gated
+#define POWER_DORMANT_UA 500  // crystal stopped, display in power save
+
+struct PowerStats
+{
+    uint32_t sleeps;    // times the idle timeout put the board to sleep
+    uint32_t dormants;  // auto power-offs that found the board still powered, from USB, and went dormant
+    uint64_t active_us; // time awake
+    uint64_t sleep_us;  // time asleep, not counting dormant, the timer stops with the crystal
+    uint32_t budget_ua; // average current over active_us and sleep_us, from the estimates above
+};
+
+void power_init(void (*wake)(void));
+void power_activity();
+void power_idle();
+void power_sleep();
+void power_off();
+void power_get_stats(struct PowerStats *out);
+
+#endif
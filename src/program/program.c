@@ -0,0 +1,875 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "program.h"
+#include "calc.h"
+#include "keymap.h"
+#include "radix_format.h"
+#include "pico/stdlib.h"
+
+// Key sequences recorded on the keypad and compiled to bytecode for the
+// integer engine, so a conversion typed once runs again in one keypress.
+//
+// Recording starts from the live result, which becomes the program's input,
+// and the keys act on the keypad as usual while they are captured. Stopping
+// compiles them. The compiler walks the keys through the same precedence
+// algorithm as calc.c, but settles everything that depends only on the keys:
+// which operators reduce when, where each pending value sits, and the value
+// of every operand typed as digits, which becomes a constant. What is left is
+// a straight run of word operations on a register file, one register per
+// pending value and one for the operand, which the VM runs without the
+// keymap, the entry line or the fold for the live result after every key.
+//
+// Division by zero is the one thing that depends on the values. Like the
+// keypad, the VM then ignores everything up to the next CLR or word size
+// change, so the two agree on every input. The program is checked against the
+// keypad's own result when the recording stops, and dropped if they differ.
+//
+// Bytecode, an opcode byte and its operands:
+//
+//   CONST r n b[n]  reg[r] = n bytes, little endian
+//   APPLY op r      reg[r] = reg[r] op reg[r + 1], stopping at a division by zero
+//   FOLD op r       the same for the live result, which is 0 after a division by zero
+//   NOT r, NEG r    invert or negate reg[r]
+//   BIT r b         flip bit b of reg[r]
+//   BACK r radix    drop the last digit of reg[r]
+//   CLEAR           go on after a division by zero
+//   RESIZE bits     change the word size of reg[0], the value of = before it
+//   SIGN s          change signedness
+//   END r           reg[r] is the result
+//
+// Programs live in RAM, so they survive sleep but not power-off.
+
+#define PROGRAM_REGS (CALC_DEPTH + 1) // a value per pending operator, and the operand
+#define PAREN CALC_OP_COUNT           // open parenthesis on the compiler's stack
+#define BENCH_RUNS 1000
+
+enum ProgramOp
+{
+    PROG_CONST,
+    PROG_APPLY,
+    PROG_FOLD,
+    PROG_NOT,
+    PROG_NEG,
+    PROG_BIT,
+    PROG_BACK,
+    PROG_CLEAR,
+    PROG_RESIZE,
+    PROG_SIGN,
+    PROG_END,
+    PROG_OP_COUNT,
+};
+
+// bytes of each instruction, CONST adds its n
+static const uint8_t op_length[PROG_OP_COUNT] = {
+    [PROG_CONST] = 3, [PROG_APPLY] = 3, [PROG_FOLD] = 3, [PROG_NOT] = 2, [PROG_NEG] = 2, [PROG_BIT] = 3,
+    [PROG_BACK] = 3, [PROG_CLEAR] = 1, [PROG_RESIZE] = 2, [PROG_SIGN] = 2, [PROG_END] = 2,
+};
+
+static const char *const op_name[PROG_OP_COUNT] = {
+    [PROG_CONST] = "const", [PROG_APPLY] = "apply", [PROG_FOLD] = "fold", [PROG_NOT] = "not",
+    [PROG_NEG] = "neg", [PROG_BIT] = "bit", [PROG_BACK] = "back", [PROG_CLEAR] = "clear",
+    [PROG_RESIZE] = "resize", [PROG_SIGN] = "sign", [PROG_END] = "end",
+};
+
+static const char *const calc_op_name[CALC_OP_COUNT] = {
+    [CALC_ADD] = "+", [CALC_SUB] = "-", [CALC_MUL] = "*", [CALC_DIV] = "/", [CALC_MOD] = "%",
+    [CALC_AND] = "&", [CALC_NAND] = "~&", [CALC_OR] = "|", [CALC_NOR] = "~|", [CALC_XOR] = "^",
+    [CALC_SHL] = "<<", [CALC_SHR] = ">>", [CALC_ROL] = "<<<", [CALC_ROR] = ">>>",
+};
+
+struct Program
+{
+    struct KeyAction keys[PROGRAM_KEYS];
+    uint8_t key_count;
+    bool overflowed; // more keys than fit, so the recording is dropped
+    uint8_t radix;   // of the keypad when recording started
+    uint8_t bits;
+    bool is_signed;
+    uint8_t end_bits;
+    bool end_signed;
+    uint8_t code[PROGRAM_CODE];
+    uint16_t length; // 0 until one is compiled
+};
+
+// Mirrors the evaluator's state while compiling, calc.c's CalcState without the error
+enum CompileState
+{
+    STATE_RESULT,
+    STATE_OPERAND,
+    STATE_OPERAND_NEXT,
+    STATE_CLOSED,
+};
+
+struct Compiler
+{
+    struct Program *program;
+    bool full; // the bytecode did not fit
+    uint8_t state;
+    uint8_t ops[CALC_DEPTH]; // pending operators and parentheses, as on the evaluator's stack
+    uint8_t depth;
+    uint8_t values; // pending values, in reg[0] up, so the operand goes in reg[values]
+    uint8_t open_parens;
+    bool waiting;
+    uint8_t waiting_op;
+    bool constant;       // the operand is known now, otherwise it is in reg[values]
+    struct Word operand; // when constant
+    uint8_t radix;
+    uint8_t bits;
+    bool is_signed;
+};
+
+static struct Program program; // what RUN executes
+static struct Program draft;   // being recorded
+static bool recording;
+static struct Word recorded_input;
+static uint32_t runs;
+static struct CalcContext replay_context;
+
+/// @brief Drop the last digit as calc_backspace() does, from the magnitude of a negative signed decimal.
+static void backspace(struct Word *value, uint8_t radix, uint8_t bits, bool is_signed)
+{
+    bool negative = radix == 10 && is_signed && word_bit(value, bits - 1);
+    if (negative)
+        word_neg(value, value, bits);
+    word_div_small(value, radix, bits);
+    if (negative)
+        word_neg(value, value, bits);
+}
+
+/// @brief The keys that change the operand in place: NOT, NEG, BIT and BACK.
+static void unary(uint8_t op, struct Word *value, uint8_t arg, uint8_t bits, bool is_signed)
+{
+    switch (op)
+    {
+    case PROG_NOT:
+        word_not(value, value, bits);
+        break;
+    case PROG_NEG:
+        word_neg(value, value, bits);
+        break;
+    case PROG_BIT:
+        value->limb[arg / 32] ^= 1u << (arg % 32);
+        break;
+    case PROG_BACK:
+        backspace(value, arg, bits, is_signed);
+        break;
+    }
+}
+
+/// @brief Run a program.
+/// @param input in the word size it starts in
+/// @param out the result, in the word size it ends in
+/// @return false if it divided by zero, where the keypad shows ERROR
+static bool execute(const struct Program *p, const struct Word *input, struct Word *out)
+{
+    static struct Word reg[PROGRAM_REGS]; // off the 2 kB stack, programs only run on core 0
+    uint8_t bits = p->bits;
+    bool is_signed = p->is_signed;
+    bool error = false;
+    bool zero = false; // the live result divided by zero
+    const uint8_t *pc = p->code;
+
+    reg[0] = *input;
+    for (;;)
+    {
+        uint8_t op = pc[0];
+        if (!error || op == PROG_CLEAR || op == PROG_RESIZE || op == PROG_SIGN || op == PROG_END)
+        {
+            switch (op)
+            {
+            case PROG_CONST:
+                reg[pc[1]] = (struct Word){0};
+                for (int i = 0; i < pc[2]; i++)
+                    reg[pc[1]].limb[i / 4] |= (uint32_t)pc[3 + i] << (i % 4 * 8);
+                break;
+            case PROG_APPLY:
+                if (calc_apply(pc[1], &reg[pc[2]], &reg[pc[2] + 1], &reg[pc[2]], bits, is_signed) & WORD_DIV_ZERO)
+                    error = true;
+                break;
+            case PROG_FOLD:
+                if (calc_apply(pc[1], &reg[pc[2]], &reg[pc[2] + 1], &reg[pc[2]], bits, is_signed) & WORD_DIV_ZERO)
+                    zero = true;
+                break;
+            case PROG_NOT:
+            case PROG_NEG:
+            case PROG_BIT:
+            case PROG_BACK:
+                unary(op, &reg[pc[1]], op_length[op] == 3 ? pc[2] : 0, bits, is_signed);
+                break;
+            case PROG_CLEAR:
+                error = false;
+                break;
+            case PROG_RESIZE:
+                if (error)
+                    reg[0] = (struct Word){0}; // calc_set_word() clears the error
+                error = false;
+                word_resize(&reg[0], bits, pc[1], is_signed);
+                bits = pc[1];
+                break;
+            case PROG_SIGN:
+                is_signed = pc[1];
+                break;
+            case PROG_END:
+                *out = zero ? (struct Word){0} : reg[pc[1]];
+                return !error;
+            }
+        }
+        pc += op_length[op] + (op == PROG_CONST ? pc[2] : 0);
+    }
+}
+
+static void emit(struct Compiler *c, uint8_t byte)
+{
+    struct Program *p = c->program;
+    if (p->length < PROGRAM_CODE)
+        p->code[p->length++] = byte;
+    else
+        c->full = true;
+}
+
+/// @brief Put a constant operand in its register, for an instruction that reads it.
+static void materialize(struct Compiler *c)
+{
+    if (!c->constant)
+        return;
+
+    uint8_t n = c->bits / 8;
+    while (n > 0 && !(c->operand.limb[(n - 1) / 4] >> ((n - 1) % 4 * 8) & 0xFF))
+        n--;
+    emit(c, PROG_CONST);
+    emit(c, c->values);
+    emit(c, n);
+    for (int i = 0; i < n; i++)
+        emit(c, c->operand.limb[i / 4] >> (i % 4 * 8));
+    c->constant = false;
+}
+
+static void set_constant(struct Compiler *c, const struct Word *value)
+{
+    c->constant = true;
+    c->operand = *value;
+}
+
+static void expression_clear(struct Compiler *c)
+{
+    c->waiting = false;
+    c->depth = 0;
+    c->values = 0;
+    c->open_parens = 0;
+}
+
+/// @brief Push the waiting operator, reducing what binds at least as tightly first, as calc.c's commit().
+static void commit(struct Compiler *c)
+{
+    materialize(c);
+    while (c->depth > 0 && c->ops[c->depth - 1] != PAREN &&
+           calc_precedence(c->ops[c->depth - 1]) >= calc_precedence(c->waiting_op))
+    {
+        c->depth--;
+        c->values--;
+        emit(c, PROG_APPLY);
+        emit(c, c->ops[c->depth]);
+        emit(c, c->values);
+    }
+    c->ops[c->depth++] = c->waiting_op;
+    c->values++;
+    c->waiting = false;
+}
+
+/// @brief Start an operand for a key that sets or modifies it, as calc.c's operand_begin().
+static bool operand_begin(struct Compiler *c, bool digit)
+{
+    static const struct Word zero = {0};
+
+    switch (c->state)
+    {
+    case STATE_RESULT:
+        if (digit)
+        {
+            expression_clear(c);
+            set_constant(c, &zero);
+            c->state = STATE_OPERAND;
+        }
+        return true;
+    case STATE_OPERAND_NEXT:
+        if (c->waiting)
+            commit(c);
+        set_constant(c, &zero);
+        c->state = STATE_OPERAND;
+        return true;
+    case STATE_OPERAND:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// @brief Reduce the expression into reg[0], or leave it constant, as calc.c's fold() evaluates it.
+/// @param op PROG_APPLY for =, which stops at a division by zero, PROG_FOLD for the live result
+static void fold(struct Compiler *c, uint8_t op)
+{
+    static const struct Word zero = {0};
+    int i = c->depth;
+    uint8_t r = c->values; // holds the value reduced so far
+
+    if (c->state == STATE_OPERAND_NEXT && !c->waiting)
+    {
+        while (i > 0 && c->ops[i - 1] == PAREN)
+            i--;
+        if (i == 0)
+        {
+            set_constant(c, &zero);
+            return;
+        }
+        i--;
+        r--;
+        c->constant = false;
+    }
+    else if (r > 0)
+    {
+        materialize(c);
+    }
+
+    for (; i > 0; i--)
+    {
+        if (c->ops[i - 1] == PAREN)
+            continue;
+        r--;
+        emit(c, op);
+        emit(c, c->ops[i - 1]);
+        emit(c, r);
+    }
+}
+
+static void compile_equals(struct Compiler *c)
+{
+    fold(c, PROG_APPLY);
+    expression_clear(c);
+    c->state = STATE_RESULT;
+}
+
+static void compile_digit(struct Compiler *c, uint8_t digit)
+{
+    struct Word next = {0};
+    if (c->state == STATE_OPERAND)
+        next = c->operand; // typed, so always constant
+    bool negative = c->state == STATE_OPERAND && c->radix == 10 && c->is_signed && word_bit(&next, c->bits - 1);
+    if (negative)
+        word_neg(&next, &next, c->bits);
+
+    if (digit >= c->radix || word_mul_small(&next, c->radix, digit, c->bits) & WORD_CARRY)
+        return;
+    if (c->radix == 10 && c->is_signed && word_bit(&next, c->bits - 1))
+        return;
+    if (!operand_begin(c, true))
+        return;
+
+    if (negative)
+        word_neg(&next, &next, c->bits);
+    set_constant(c, &next);
+}
+
+static void compile_operator(struct Compiler *c, uint8_t op)
+{
+    switch (c->state)
+    {
+    case STATE_OPERAND_NEXT:
+        if (c->waiting)
+            c->waiting_op = op; // replaces the one before
+        return;
+    default:
+        c->waiting = true;
+        c->waiting_op = op;
+        c->state = STATE_OPERAND_NEXT;
+        return;
+    }
+}
+
+static void compile_open(struct Compiler *c)
+{
+    if (c->state == STATE_RESULT)
+    {
+        expression_clear(c);
+        c->state = STATE_OPERAND_NEXT;
+    }
+    if (c->state != STATE_OPERAND_NEXT || c->depth + 1 + 1 + 6 > CALC_DEPTH)
+        return;
+    if (c->waiting)
+        commit(c);
+    c->ops[c->depth++] = PAREN;
+    c->open_parens++;
+}
+
+static void compile_close(struct Compiler *c)
+{
+    if (!c->open_parens || (c->state != STATE_OPERAND && c->state != STATE_CLOSED))
+        return;
+
+    materialize(c);
+    while (c->ops[c->depth - 1] != PAREN)
+    {
+        c->depth--;
+        c->values--;
+        emit(c, PROG_APPLY);
+        emit(c, c->ops[c->depth]);
+        emit(c, c->values);
+    }
+    c->depth--;
+    c->open_parens--;
+    c->state = STATE_CLOSED;
+}
+
+/// @brief NOT, NEG, BIT and BACK, folded into a constant operand or emitted for one computed at run time.
+static void compile_unary(struct Compiler *c, uint8_t op, uint8_t arg)
+{
+    if (op == PROG_BACK)
+    {
+        if (c->state != STATE_OPERAND && c->state != STATE_RESULT)
+            return;
+    }
+    else if ((op == PROG_BIT && arg >= c->bits) || !operand_begin(c, false))
+    {
+        return;
+    }
+
+    if (c->constant)
+    {
+        unary(op, &c->operand, arg, c->bits, c->is_signed);
+        return;
+    }
+    emit(c, op);
+    emit(c, c->values);
+    if (op_length[op] == 3)
+        emit(c, arg);
+}
+
+static void compile_clear(struct Compiler *c)
+{
+    static const struct Word zero = {0};
+
+    emit(c, PROG_CLEAR);
+    expression_clear(c);
+    set_constant(c, &zero);
+    c->state = STATE_RESULT;
+}
+
+/// @brief As calc_set_word(): a new size evaluates the expression first and carries the result over.
+static void compile_word(struct Compiler *c, uint8_t bits, bool is_signed)
+{
+    if (bits != c->bits)
+    {
+        compile_equals(c);
+        materialize(c); // in a register, which the division by zero path clears
+        emit(c, PROG_RESIZE);
+        emit(c, bits);
+        c->bits = bits;
+    }
+    if (is_signed != c->is_signed)
+    {
+        emit(c, PROG_SIGN);
+        emit(c, is_signed);
+        c->is_signed = is_signed;
+    }
+}
+
+static void compile_key(struct Compiler *c, const struct KeyAction *key)
+{
+    switch (key->type)
+    {
+    case KEY_DIGIT:
+        compile_digit(c, key->arg);
+        break;
+    case KEY_OPERATOR:
+        compile_operator(c, key->arg);
+        break;
+    case KEY_OPEN:
+        compile_open(c);
+        break;
+    case KEY_CLOSE:
+        compile_close(c);
+        break;
+    case KEY_EQUALS:
+        compile_equals(c);
+        break;
+    case KEY_NOT:
+        compile_unary(c, PROG_NOT, 0);
+        break;
+    case KEY_NEGATE:
+        compile_unary(c, PROG_NEG, 0);
+        break;
+    case KEY_BACKSPACE:
+        compile_unary(c, PROG_BACK, c->radix);
+        break;
+    case KEY_CLEAR:
+        compile_clear(c);
+        break;
+    case KEY_MODE:
+        c->radix = c->radix == 16 ? 10 : c->radix == 10 ? 2 : 16;
+        break;
+    case KEY_BIT:
+        compile_unary(c, PROG_BIT, key->arg);
+        break;
+    case KEY_WORD:
+        compile_word(c, c->bits == 128 ? 8 : c->bits * 2, c->is_signed);
+        break;
+    case KEY_SIGN:
+        compile_word(c, c->bits, !c->is_signed);
+        break;
+    }
+}
+
+/// @brief Compile the recorded keys, ending with the live result the keypad would show after the last one.
+/// @return false if the bytecode does not fit PROGRAM_CODE
+static bool compile(struct Program *p)
+{
+    struct Compiler c = {
+        .program = p,
+        .state = STATE_RESULT, // the input is in reg[0]
+        .radix = p->radix,
+        .bits = p->bits,
+        .is_signed = p->is_signed,
+    };
+
+    p->length = 0;
+    for (int i = 0; i < p->key_count; i++)
+        compile_key(&c, &p->keys[i]);
+    fold(&c, PROG_FOLD);
+    materialize(&c);
+    emit(&c, PROG_END);
+    emit(&c, 0);
+
+    p->end_bits = c.bits;
+    p->end_signed = c.is_signed;
+    return !c.full;
+}
+
+/// @brief Start recording keys. The live result becomes the input, and the keypad starts over from it as RUN will.
+void program_record_start()
+{
+    struct Word input = calc_result();
+    calc_load(&input);
+
+    draft.key_count = 0;
+    draft.overflowed = false;
+    draft.radix = calc_radix();
+    draft.bits = calc_bits();
+    draft.is_signed = calc_signed();
+    recorded_input = input;
+    recording = true;
+}
+
+/// @brief Stop recording and compile what was recorded, keeping the program before if that fails.
+/// @return false if no keys were recorded, too many were, or the program does not reach the keypad's result
+bool program_record_stop()
+{
+    recording = false;
+    if (draft.key_count == 0 || draft.overflowed || !compile(&draft))
+        return false;
+
+    struct Word result;
+    struct Word expected = calc_result();
+    bool ok = execute(&draft, &recorded_input, &result);
+    if (ok == calc_error() || draft.end_bits != calc_bits() || (ok && memcmp(&result, &expected, sizeof(result))))
+    {
+        printf("program: compiled keys do not match the keypad, dropped\n");
+        return false;
+    }
+
+    program = draft;
+    return true;
+}
+
+bool program_recording()
+{
+    return recording;
+}
+
+/// @brief Add a key the keypad has just acted on to the recording, if there is one.
+/// @param type KeyActionType
+/// @param arg as in the keymap, but a bit on the page shown is the bit in the word
+void program_record(uint8_t type, uint8_t arg)
+{
+    if (!recording || type == KEY_NONE || type == KEY_SHIFT || type == KEY_PAGE || type == KEY_RECORD ||
+        type == KEY_RUN)
+        return;
+
+    if (draft.key_count == PROGRAM_KEYS)
+        draft.overflowed = true;
+    else
+        draft.keys[draft.key_count++] = (struct KeyAction){type, arg};
+}
+
+/// @brief Run the program.
+/// @param input in the word size it was recorded at
+/// @param out the result, in the word size it leaves
+/// @return false if there is no program, or it divided by zero
+bool program_run(const struct Word *input, struct Word *out)
+{
+    if (!program.length)
+        return false;
+    runs++;
+    return execute(&program, input, out);
+}
+
+static void replay_key(const struct KeyAction *key)
+{
+    switch (key->type)
+    {
+    case KEY_DIGIT:
+        calc_digit(key->arg);
+        break;
+    case KEY_OPERATOR:
+        calc_operator(key->arg);
+        break;
+    case KEY_OPEN:
+        calc_open();
+        break;
+    case KEY_CLOSE:
+        calc_close();
+        break;
+    case KEY_EQUALS:
+        calc_equals();
+        break;
+    case KEY_NOT:
+        calc_not();
+        break;
+    case KEY_NEGATE:
+        calc_negate();
+        break;
+    case KEY_BACKSPACE:
+        calc_backspace();
+        break;
+    case KEY_CLEAR:
+        calc_reset();
+        break;
+    case KEY_MODE:
+        calc_set_radix(calc_radix() == 16 ? 10 : calc_radix() == 10 ? 2 : 16);
+        break;
+    case KEY_BIT:
+        calc_toggle_bit(key->arg);
+        break;
+    case KEY_WORD:
+        calc_set_word(calc_bits() == 128 ? 8 : calc_bits() * 2, calc_signed());
+        break;
+    case KEY_SIGN:
+        calc_set_word(calc_bits(), !calc_signed());
+        break;
+    }
+}
+
+/// @brief Feed the recorded keys to the evaluator one by one instead, in a context of its own. For comparison.
+/// @return false if there is no program, or the keys end in an error
+bool program_replay(const struct Word *input, struct Word *out)
+{
+    if (!program.length)
+        return false;
+
+    struct CalcContext *keypad = calc_use(&replay_context);
+    calc_reset();
+    calc_set_radix(program.radix);
+    calc_set_word(program.bits, program.is_signed);
+    calc_load(input);
+    for (int i = 0; i < program.key_count; i++)
+        replay_key(&program.keys[i]);
+    *out = calc_result();
+    bool ok = !calc_error();
+    calc_use(keypad);
+    return ok;
+}
+
+/// @brief Replace the keypad's live result with the program's result for it, from the RUN key.
+/// @return false if there is no program, one is being recorded, or it divided by zero, which leaves the keypad as it was
+bool program_execute()
+{
+    if (recording || !program.length)
+        return false;
+
+    struct Word input = calc_result();
+    word_resize(&input, calc_bits(), program.bits, calc_signed());
+    struct Word result;
+    if (!program_run(&input, &result))
+        return false;
+
+    calc_set_word(program.end_bits, program.end_signed);
+    calc_load(&result);
+    return true;
+}
+
+static void print_program()
+{
+    if (!program.length)
+    {
+        printf("no program, shift then %% records one\n");
+        return;
+    }
+
+    printf("program: %u keys, %u bytes, %c%u in, %c%u out, %lu runs\n", program.key_count, program.length,
+           program.is_signed ? 'S' : 'U', program.bits, program.end_signed ? 'S' : 'U', program.end_bits,
+           (unsigned long)runs);
+    for (const uint8_t *pc = program.code; pc < program.code + program.length;)
+    {
+        uint8_t op = pc[0];
+        printf("  %-6s", op_name[op]);
+        switch (op)
+        {
+        case PROG_CONST:
+            printf(" r%u 0x", pc[1]);
+            if (!pc[2])
+                printf("0");
+            for (int i = pc[2]; i > 0; i--)
+                printf("%02X", pc[2 + i]);
+            break;
+        case PROG_APPLY:
+        case PROG_FOLD:
+            printf(" r%u %s r%u", pc[2], calc_op_name[pc[1]], pc[2] + 1);
+            break;
+        case PROG_BIT:
+        case PROG_BACK:
+            printf(" r%u %u", pc[1], pc[2]);
+            break;
+        case PROG_NOT:
+        case PROG_NEG:
+        case PROG_RESIZE:
+        case PROG_SIGN:
+        case PROG_END:
+            printf(" %s%u", op == PROG_RESIZE || op == PROG_SIGN ? "" : "r", pc[1]);
+            break;
+        }
+        printf("\n");
+        pc += op_length[op] + (op == PROG_CONST ? pc[2] : 0);
+    }
+}
+
+/// @brief Parse a hex number and the spaces before it.
+/// @return false if there is none
+static bool parse_hex(const char **args, uint64_t *value)
+{
+    char *end;
+    while (**args == ' ')
+        (*args)++;
+    if (!**args)
+        return false;
+    *value = strtoull(*args, &end, 16);
+    if (end == *args || (*end && *end != ' '))
+        return false;
+    *args = end;
+    return true;
+}
+
+// prog sweep FROM TO [STEP], in hex, one line per input
+static void sweep(const char *args)
+{
+    uint64_t from, to, step = 1;
+    if (!parse_hex(&args, &from) || !parse_hex(&args, &to) || (*args && !parse_hex(&args, &step)) || *args ||
+        step == 0 || to < from || (to - from) / step >= PROGRAM_SWEEP_MAX)
+    {
+        printf("usage: prog sweep FROM TO [STEP], in hex, at most %u inputs\n", PROGRAM_SWEEP_MAX);
+        return;
+    }
+    if (!program.length)
+    {
+        printf("no program\n");
+        return;
+    }
+
+    char in[RADIX_FORMAT_WORD_HEX_MAX];
+    char out[RADIX_FORMAT_WORD_HEX_MAX];
+    for (uint64_t value = from;; value += step)
+    {
+        struct Word input, result;
+        word_set(&input, value, program.bits);
+        radix_format_hex_word(in, &input, program.bits);
+        if (program_run(&input, &result))
+        {
+            radix_format_hex_word(out, &result, program.end_bits);
+            printf("%s %s\n", in, out);
+        }
+        else
+        {
+            printf("%s ERROR\n", in);
+        }
+        if (to - value < step)
+            break;
+    }
+}
+
+// prog bench [RUNS], the bytecode against feeding the same keys to the evaluator
+static void bench(const char *args)
+{
+    uint64_t count = BENCH_RUNS;
+    while (*args == ' ')
+        args++;
+    if (*args)
+    {
+        char *end;
+        count = strtoull(args, &end, 10);
+        if (*end || count == 0 || count > 1000000)
+        {
+            printf("usage: prog bench [RUNS], at most 1000000\n");
+            return;
+        }
+    }
+    if (!program.length)
+    {
+        printf("no program\n");
+        return;
+    }
+
+    struct Word input, result;
+    uint64_t start = time_us_64();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        word_set(&input, i, program.bits);
+        execute(&program, &input, &result);
+    }
+    uint64_t vm_us = time_us_64() - start;
+
+    start = time_us_64();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        word_set(&input, i, program.bits);
+        program_replay(&input, &result);
+    }
+    uint64_t keys_us = time_us_64() - start;
+
+    if (!vm_us || !keys_us)
+    {
+        printf("program: %lu runs too quick to time, ask for more\n", (unsigned long)count);
+        return;
+    }
+    printf("program: %lu runs of %u keys\n", (unsigned long)count, program.key_count);
+    printf("  bytecode %lu ns per run, %lu runs per second\n", (unsigned long)(vm_us * 1000 / count),
+           (unsigned long)(count * 1000000 / vm_us));
+    printf("  keys one by one %lu ns per run, %lu runs per second\n", (unsigned long)(keys_us * 1000 / count),
+           (unsigned long)(count * 1000000 / keys_us));
+    printf("  %lu.%02lux faster\n", (unsigned long)(keys_us / vm_us), (unsigned long)(keys_us * 100 / vm_us % 100));
+}
+
+/// @brief The prog commands on the USB serial port.
+/// @param args what follows "prog"
+void program_command(const char *args)
+{
+    while (*args == ' ')
+        args++;
+    if (!*args)
+        print_program();
+    else if (!strncmp(args, "sweep", 5) && (args[5] == ' ' || args[5] == '\0'))
+        sweep(args + 5);
+    else if (!strncmp(args, "bench", 5) && (args[5] == ' ' || args[5] == '\0'))
+        bench(args + 5);
+    else
+        printf("prog commands: prog, prog sweep FROM TO [STEP], prog bench [RUNS]\n");
+}
+
+void program_get_info(struct ProgramInfo *out)
+{
+    out->ready = program.length != 0;
+    out->keys = program.key_count;
+    out->length = program.length;
+    out->bits = program.bits;
+    out->is_signed = program.is_signed;
+    out->end_bits = program.end_bits;
+    out->end_signed = program.end_signed;
+    out->runs = runs;
+}
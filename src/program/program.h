@@ -0,0 +1,34 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "word.h"
+
+#define PROGRAM_KEYS 64        // keys one recording can hold
+#define PROGRAM_CODE 256       // bytecode bytes, more than PROGRAM_KEYS keys can compile to
+#define PROGRAM_SWEEP_MAX 4096 // inputs one sweep command runs, each answered with a line
+
+struct ProgramInfo
+{
+    bool ready;       // a program is recorded
+    uint8_t keys;     // keys it was recorded from
+    uint16_t length;  // bytes of bytecode
+    uint8_t bits;     // word size it starts in
+    bool is_signed;
+    uint8_t end_bits; // word size it leaves, after any WORD and SIGN keys in it
+    bool end_signed;
+    uint32_t runs;    // from the RUN key and the sweep command
+};
+
+void program_record_start();
+bool program_record_stop();
+bool program_recording();
+void program_record(uint8_t type, uint8_t arg);
+bool program_run(const struct Word *input, struct Word *out);
+bool program_replay(const struct Word *input, struct Word *out);
+bool program_execute();
+void program_command(const char *args);
+void program_get_info(struct ProgramInfo *out);
+
+#endif
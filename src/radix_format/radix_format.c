@@ -0,0 +1,322 @@
+#include "radix_format.h"
+#include "pico/stdlib.h"
+#include "hot_path.h"
+
+#if PICO_ON_DEVICE
+#include "hardware/interp.h"
+#include "hardware/divider.h"
+#endif
+
+// Lookup tables, expanded by the preprocessor so nothing is built at runtime
+
+static const char HOT_DATA(hex_digits)[16] = {'0', '1', '2', '3', '4', '5', '6', '7',
+                                              '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+
+// "0000" to "1111", four characters per nibble, no terminators
+#define NIBBLE_BITS(n) '0' + ((n) >> 3 & 1), '0' + ((n) >> 2 & 1), '0' + ((n) >> 1 & 1), '0' + ((n) & 1)
+#define NIBBLE_BITS_4(n) NIBBLE_BITS(n), NIBBLE_BITS((n) + 1), NIBBLE_BITS((n) + 2), NIBBLE_BITS((n) + 3)
+static const char HOT_DATA(nibble_bits)[16 * 4] = {NIBBLE_BITS_4(0), NIBBLE_BITS_4(4), NIBBLE_BITS_4(8), NIBBLE_BITS_4(12)};
+
+// "00" to "99", two characters per entry, no terminators
+#define DIGIT_PAIR(n) '0' + (n) / 10, '0' + (n) % 10
+#define DIGIT_PAIRS_10(n) DIGIT_PAIR(n), DIGIT_PAIR((n) + 1), DIGIT_PAIR((n) + 2), DIGIT_PAIR((n) + 3), \
+                          DIGIT_PAIR((n) + 4), DIGIT_PAIR((n) + 5), DIGIT_PAIR((n) + 6), DIGIT_PAIR((n) + 7), \
+                          DIGIT_PAIR((n) + 8), DIGIT_PAIR((n) + 9)
+static const char HOT_DATA(digit_pairs)[100 * 2] = {DIGIT_PAIRS_10(0), DIGIT_PAIRS_10(10), DIGIT_PAIRS_10(20), DIGIT_PAIRS_10(30),
+                                                    DIGIT_PAIRS_10(40), DIGIT_PAIRS_10(50), DIGIT_PAIRS_10(60), DIGIT_PAIRS_10(70),
+                                                    DIGIT_PAIRS_10(80), DIGIT_PAIRS_10(90)};
+
+static inline uint64_t truncate_to(uint64_t value, uint8_t bits)
+{
+    return bits >= 64 ? value : value & ((1ull << bits) - 1);
+}
+
+#if PICO_ON_DEVICE
+/// @brief Set up interp0 so that writing a byte to the top of ACCUM0 gives table addresses for both its nibbles.
+/// @param table lookup table base
+/// @param stride_log2 log2 of the table entry size
+static void nibble_lookup_init(const char *table, uint stride_log2)
+{
+    // lane 0 takes the high nibble of ACCUM0's top byte, lane 1 (cross input,
+    // so also reading ACCUM0) the low nibble. Both are pre-scaled by the entry
+    // size and added to the table base, so PEEK0/PEEK1 are ready to use pointers.
+    interp_config config = interp_default_config();
+    interp_config_set_shift(&config, 28 - stride_log2);
+    interp_config_set_mask(&config, stride_log2, stride_log2 + 3);
+    interp_set_config(interp0, 0, &config);
+
+    interp_config_set_shift(&config, 24 - stride_log2);
+    interp_config_set_cross_input(&config, true);
+    interp_set_config(interp0, 1, &config);
+
+    interp0->base[0] = (uintptr_t)table;
+    interp0->base[1] = (uintptr_t)table;
+}
+#endif
+
+/// @brief Hex digits for the top `bytes` bytes of a word, MSB first.
+static char *HOT_FUNC(hex_word)(char *p, uint32_t word, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+#if PICO_ON_DEVICE
+        interp0->accum[0] = word;
+        *p++ = *(const char *)interp0->peek[0];
+        *p++ = *(const char *)interp0->peek[1];
+#else
+        *p++ = hex_digits[word >> 28];
+        *p++ = hex_digits[(word >> 24) & 0xF];
+#endif
+        word <<= 8;
+    }
+    return p;
+}
+
+/// @brief Binary digits for the top `bytes` bytes of a word, MSB first, a space after every byte.
+static char *HOT_FUNC(bin_word)(char *p, uint32_t word, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+#if PICO_ON_DEVICE
+        interp0->accum[0] = word;
+        const char *hi = (const char *)interp0->peek[0];
+        const char *lo = (const char *)interp0->peek[1];
+#else
+        const char *hi = &nibble_bits[(word >> 28) * 4];
+        const char *lo = &nibble_bits[((word >> 24) & 0xF) * 4];
+#endif
+        p[0] = hi[0];
+        p[1] = hi[1];
+        p[2] = hi[2];
+        p[3] = hi[3];
+        p[4] = lo[0];
+        p[5] = lo[1];
+        p[6] = lo[2];
+        p[7] = lo[3];
+        p[8] = ' ';
+        p += 9;
+        word <<= 8;
+    }
+    return p;
+}
+
+/// @brief 32-bit divide by 10000, quotient and remainder in one go.
+static inline uint32_t divmod_10000_u32(uint32_t value, uint32_t *remainder)
+{
+#if PICO_ON_DEVICE
+    divmod_result_t result = hw_divider_divmod_u32(value, 10000);
+    *remainder = to_remainder_u32(result);
+    return to_quotient_u32(result);
+#else
+    *remainder = value % 10000;
+    return value / 10000;
+#endif
+}
+
+/// @brief Divide a 64-bit value by 10000 in place, returning the remainder.
+static uint32_t HOT_FUNC(divmod_10000)(uint64_t *value)
+{
+    uint32_t hi = *value >> 32;
+    uint32_t lo = (uint32_t)*value;
+    uint32_t r;
+
+    if (hi == 0)
+    {
+        *value = divmod_10000_u32(lo, &r);
+        return r;
+    }
+
+    // The M0+ has no 64-bit divide. Long division in 16-bit digits keeps every
+    // partial dividend below 10000 << 16, so the 32-bit hardware divider does it.
+    uint32_t q3 = divmod_10000_u32(hi >> 16, &r);
+    uint32_t q2 = divmod_10000_u32((r << 16) | (hi & 0xFFFF), &r);
+    uint32_t q1 = divmod_10000_u32((r << 16) | (lo >> 16), &r);
+    uint32_t q0 = divmod_10000_u32((r << 16) | (lo & 0xFFFF), &r);
+
+    *value = ((uint64_t)((q3 << 16) | q2) << 32) | ((q1 << 16) | q0);
+    return r;
+}
+
+/// @brief Base 10000 chunks as decimal digits, the most significant without leading zeros.
+/// @param chunks least significant first
+static char *HOT_FUNC(dec_chunks)(char *p, const uint32_t *chunks, int n)
+{
+    // the most significant chunk without leading zeros
+    uint32_t chunk = chunks[--n];
+    uint32_t hi = (chunk * 5243) >> 19; // chunk / 100, exact below 43699
+    uint32_t lo = chunk - hi * 100;
+    if (chunk >= 1000)
+        *p++ = digit_pairs[hi * 2];
+    if (chunk >= 100)
+        *p++ = digit_pairs[hi * 2 + 1];
+    if (chunk >= 10)
+        *p++ = digit_pairs[lo * 2];
+    *p++ = digit_pairs[lo * 2 + 1];
+
+    // the rest zero padded to 4 digits
+    while (n > 0)
+    {
+        chunk = chunks[--n];
+        hi = (chunk * 5243) >> 19;
+        lo = chunk - hi * 100;
+        p[0] = digit_pairs[hi * 2];
+        p[1] = digit_pairs[hi * 2 + 1];
+        p[2] = digit_pairs[lo * 2];
+        p[3] = digit_pairs[lo * 2 + 1];
+        p += 4;
+    }
+    return p;
+}
+
+/// @brief Format a word as zero padded upper case hex, e.g. "0000BEEF" for 32 bits.
+/// @param out at least RADIX_FORMAT_HEX_MAX characters
+/// @param value word, bits above `bits` are ignored
+/// @param bits word size: 8, 16, 32 or 64
+/// @return length of the string written to out
+int HOT_FUNC(radix_format_hex)(char *out, uint64_t value, uint8_t bits)
+{
+    char *p = out;
+
+#if PICO_ON_DEVICE
+    nibble_lookup_init(hex_digits, 0);
+#endif
+    if (bits > 32)
+    {
+        p = hex_word(p, value >> 32, 4);
+        p = hex_word(p, (uint32_t)value, 4);
+    }
+    else
+    {
+        p = hex_word(p, (uint32_t)value << (32 - bits), bits / 8);
+    }
+
+    *p = '\0';
+    return p - out;
+}
+
+/// @brief Format a word in binary, in space separated groups of 8. 32 bits gives the 35 character BIN row.
+/// @param out at least RADIX_FORMAT_BIN_MAX characters
+/// @param value word, bits above `bits` are ignored
+/// @param bits word size: 8, 16, 32 or 64
+/// @return length of the string written to out
+int HOT_FUNC(radix_format_bin)(char *out, uint64_t value, uint8_t bits)
+{
+    char *p = out;
+
+#if PICO_ON_DEVICE
+    nibble_lookup_init(nibble_bits, 2);
+#endif
+    if (bits > 32)
+    {
+        p = bin_word(p, value >> 32, 4);
+        p = bin_word(p, (uint32_t)value, 4);
+    }
+    else
+    {
+        p = bin_word(p, (uint32_t)value << (32 - bits), bits / 8);
+    }
+
+    p--; // no space after the last group
+    *p = '\0';
+    return p - out;
+}
+
+/// @brief Format a word in decimal, without padding.
+/// @param out at least RADIX_FORMAT_DEC_MAX characters
+/// @param value word, bits above `bits` are ignored
+/// @param bits word size: 8, 16, 32 or 64
+/// @param is_signed treat the word as two's complement
+/// @return length of the string written to out
+int HOT_FUNC(radix_format_dec)(char *out, uint64_t value, uint8_t bits, bool is_signed)
+{
+    char *p = out;
+    uint32_t chunks[5]; // base 10000 digits, least significant first
+    int n = 0;
+
+    value = truncate_to(value, bits);
+    if (is_signed && (value >> (bits - 1)) & 1)
+    {
+        *p++ = '-';
+        value = truncate_to(~value + 1, bits);
+    }
+
+    do
+    {
+        chunks[n++] = divmod_10000(&value);
+    } while (value != 0);
+
+    p = dec_chunks(p, chunks, n);
+    *p = '\0';
+    return p - out;
+}
+
+static uint64_t HOT_FUNC(low_64)(const struct Word *value)
+{
+    return value->limb[0] | (uint64_t)value->limb[1] << 32;
+}
+
+/// @brief radix_format_hex() for words of up to 128 bits.
+/// @param out at least RADIX_FORMAT_WORD_HEX_MAX characters
+/// @param bits word size: 8, 16, 32, 64 or 128
+int HOT_FUNC(radix_format_hex_word)(char *out, const struct Word *value, uint8_t bits)
+{
+    if (bits <= 64)
+        return radix_format_hex(out, low_64(value), bits);
+
+    char *p = out;
+#if PICO_ON_DEVICE
+    nibble_lookup_init(hex_digits, 0);
+#endif
+    for (int i = bits / 32 - 1; i >= 0; i--)
+        p = hex_word(p, value->limb[i], 4);
+    *p = '\0';
+    return p - out;
+}
+
+/// @brief radix_format_bin() for words of up to 128 bits.
+/// @param out at least RADIX_FORMAT_WORD_BIN_MAX characters
+/// @param bits word size: 8, 16, 32, 64 or 128
+int HOT_FUNC(radix_format_bin_word)(char *out, const struct Word *value, uint8_t bits)
+{
+    if (bits <= 64)
+        return radix_format_bin(out, low_64(value), bits);
+
+    char *p = out;
+#if PICO_ON_DEVICE
+    nibble_lookup_init(nibble_bits, 2);
+#endif
+    for (int i = bits / 32 - 1; i >= 0; i--)
+        p = bin_word(p, value->limb[i], 4);
+    p--; // no space after the last group
+    *p = '\0';
+    return p - out;
+}
+
+/// @brief radix_format_dec() for words of up to 128 bits.
+/// @param out at least RADIX_FORMAT_WORD_DEC_MAX characters
+/// @param bits word size: 8, 16, 32, 64 or 128
+int HOT_FUNC(radix_format_dec_word)(char *out, const struct Word *value, uint8_t bits, bool is_signed)
+{
+    if (bits <= 64)
+        return radix_format_dec(out, low_64(value), bits, is_signed);
+
+    char *p = out;
+    uint32_t chunks[10]; // base 10000 digits, least significant first
+    int n = 0;
+    struct Word rest = *value;
+
+    if (is_signed && word_bit(&rest, bits - 1))
+    {
+        *p++ = '-';
+        word_neg(&rest, &rest, bits);
+    }
+
+    do
+    {
+        chunks[n++] = word_div_small(&rest, 10000, bits);
+    } while (!word_is_zero(&rest));
+
+    p = dec_chunks(p, chunks, n);
+    *p = '\0';
+    return p - out;
+}
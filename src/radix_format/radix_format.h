@@ -0,0 +1,26 @@
+#ifndef RADIX_FORMAT_H
+#define RADIX_FORMAT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "word.h"
+
+// Longest output of each formatter including the terminator, for 64-bit words
+#define RADIX_FORMAT_HEX_MAX (16 + 1)
+#define RADIX_FORMAT_DEC_MAX (20 + 1 + 1) // 20 digits or a sign and 19
+#define RADIX_FORMAT_BIN_MAX (64 + 7 + 1) // groups of 8 separated by spaces
+
+// The same for words of up to 128 bits
+#define RADIX_FORMAT_WORD_HEX_MAX (32 + 1)
+#define RADIX_FORMAT_WORD_DEC_MAX (39 + 1 + 1)
+#define RADIX_FORMAT_WORD_BIN_MAX (128 + 15 + 1)
+
+int radix_format_hex(char *out, uint64_t value, uint8_t bits);
+int radix_format_dec(char *out, uint64_t value, uint8_t bits, bool is_signed);
+int radix_format_bin(char *out, uint64_t value, uint8_t bits);
+int radix_format_hex_word(char *out, const struct Word *value, uint8_t bits);
+int radix_format_dec_word(char *out, const struct Word *value, uint8_t bits, bool is_signed);
+int radix_format_bin_word(char *out, const struct Word *value, uint8_t bits);
+void radix_format_benchmark();
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <string.h>
+#include "radix_format.h"
+#include "pico/stdlib.h"
+#include "cycles.h"
+
+// Cycle counts of the formatters against the straightforward snprintf and
+// shift/divide versions they replace, printed over stdio. Only built into the
+// firmware with CALC_BENCHMARKS.
+
+#define BENCH_ITERATIONS 256
+
+static int naive_hex(char *out, uint64_t value, uint8_t bits)
+{
+    return snprintf(out, RADIX_FORMAT_HEX_MAX, "%0*llX", bits / 4, (unsigned long long)value);
+}
+
+static int naive_bin(char *out, uint64_t value, uint8_t bits)
+{
+    char *p = out;
+    for (int i = bits - 1; i >= 0; i--)
+    {
+        *p++ = (value >> i) & 1 ? '1' : '0';
+        if (i % 8 == 0 && i > 0)
+            *p++ = ' ';
+    }
+    *p = '\0';
+    return p - out;
+}
+
+static int naive_dec(char *out, uint64_t value, uint8_t bits, bool is_signed)
+{
+    char digits[20];
+    char *p = out;
+    int n = 0;
+
+    if (is_signed && (value >> (bits - 1)) & 1)
+    {
+        *p++ = '-';
+        value = ~value + 1;
+    }
+    if (bits < 64)
+        value &= (1ull << bits) - 1;
+
+    do
+    {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+
+    while (n > 0)
+        *p++ = digits[--n];
+    *p = '\0';
+    return p - out;
+}
+
+static uint64_t bench_state = 0x9E3779B97F4A7C15ull;
+
+/// @brief xorshift64, so every width sees the same spread of magnitudes.
+static uint64_t bench_random()
+{
+    bench_state ^= bench_state << 13;
+    bench_state ^= bench_state >> 7;
+    bench_state ^= bench_state << 17;
+    return bench_state;
+}
+
+enum BenchFormat
+{
+    BENCH_HEX,
+    BENCH_DEC,
+    BENCH_SIGNED_DEC,
+    BENCH_BIN,
+};
+
+static const char *const bench_names[] = {"hex", "dec", "sdec", "bin"};
+
+static int bench_call(enum BenchFormat format, bool naive, char *out, uint64_t value, uint8_t bits)
+{
+    switch (format)
+    {
+    case BENCH_HEX:
+        return naive ? naive_hex(out, value, bits) : radix_format_hex(out, value, bits);
+    case BENCH_DEC:
+        return naive ? naive_dec(out, value, bits, false) : radix_format_dec(out, value, bits, false);
+    case BENCH_SIGNED_DEC:
+        return naive ? naive_dec(out, value, bits, true) : radix_format_dec(out, value, bits, true);
+    default:
+        return naive ? naive_bin(out, value, bits) : radix_format_bin(out, value, bits);
+    }
+}
+
+/// @brief Run every formatter over the same random words for 8, 16, 32 and 64 bits and print the average cycles per call.
+void radix_format_benchmark()
+{
+    static const uint8_t widths[] = {8, 16, 32, 64};
+    char fast[RADIX_FORMAT_BIN_MAX];
+    char naive[RADIX_FORMAT_BIN_MAX];
+
+    cycles_init();
+    printf("radix_format: average cycles per call over %d words\n", BENCH_ITERATIONS);
+    printf("format bits   fast  naive\n");
+
+    for (int format = BENCH_HEX; format <= BENCH_BIN; format++)
+    {
+        for (size_t w = 0; w < sizeof(widths); w++)
+        {
+            uint32_t fast_cycles = 0;
+            uint32_t naive_cycles = 0;
+            uint32_t mismatches = 0;
+
+            for (int i = 0; i < BENCH_ITERATIONS; i++)
+            {
+                uint64_t value = bench_random();
+                if (widths[w] < 64)
+                    value &= (1ull << widths[w]) - 1;
+
+                uint32_t start = cycles_now();
+                bench_call(format, false, fast, value, widths[w]);
+                fast_cycles += cycles_since(start);
+
+                start = cycles_now();
+                bench_call(format, true, naive, value, widths[w]);
+                naive_cycles += cycles_since(start);
+
+                if (strcmp(fast, naive) != 0)
+                    mismatches++;
+            }
+
+            printf("%-6s %4u %6lu %6lu", bench_names[format], widths[w],
+                   (unsigned long)(fast_cycles / BENCH_ITERATIONS),
+                   (unsigned long)(naive_cycles / BENCH_ITERATIONS));
+            if (mismatches)
+                printf("  %lu MISMATCHES", (unsigned long)mismatches);
+            printf("\n");
+        }
+    }
+}
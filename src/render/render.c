@@ -0,0 +1,832 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/flash.h"
+#include "pico/sync.h"
+#include "hardware/spi.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/structs/scb.h"
+#include <u8g2.h>
+#include "render.h"
+#include "peripherals.h"
+#include "images.h"
+#include "oled_spi.h"
+#include "dirty_tiles.h"
+#include "radix_format.h"
+#include "trace.h"
+#include "xip_profile.h"
+#include "gray4.h"
+#include "cycles.h"
+#include "hot_path.h"
+#include "boot.h"
+
+// Core 1 owns everything in this file: u8g2, its HAL and the SSD1322 transport.
+// Core 0 only calls render_submit(), which copies the state into a mailbox and
+// returns, so rendering never holds up key handling.
+
+static u8g2_t u8g2;
+static u8x8_display_info_t display_info; // u8g2's, with the reset timed to the SSD1322
+static volatile uint32_t ns_scale;       // for the sub-microsecond u8x8 delays, see cycles_ns_scale()
+
+// The u8g2 defaults hold reset for 100 ms, twice, with 100 ms waits around
+// it, for slow panels. The SSD1322 asks for a 100 us pulse, so these keep a
+// wide margin and bring the panel up in 22 ms instead of 400.
+#define OLED_RESET_PULSE_MS 1
+#define OLED_RESET_WAIT_MS 10
+
+// u8g2 HAL
+uint8_t u8x8_byte_pico_hw_spi(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+uint8_t u8x8_gpio_and_delay_pico(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+
+// graphics
+void init_oled();
+void draw_display();
+void draw_calculator_display(const struct CalculatorDisplay *state);
+void draw_calculator_display_gray4(const struct CalculatorDisplay *state);
+void render_benchmark();
+
+// Mailbox from core 0. Only the newest state is kept, so when input outruns
+// the panel the intermediate states are skipped rather than queued.
+static struct CalculatorDisplay mailbox;
+static bool mailbox_full;
+static bool drawing; // core 1 took a state and has not finished drawing it
+static uint16_t mailbox_key; // trace id of the newest key behind the state
+static uint64_t mailbox_since_us; // when the mailbox was filled, kept while newer states replace it
+static uint64_t next_frame_us;    // earliest start of the next frame, core 1 only
+static bool frame_paced;          // the state now in the mailbox has waited for the budget, core 1 only
+static critical_section_t mailbox_lock;
+static struct RenderStats stats;
+
+// Power save requests from core 0, also under mailbox_lock. display_asleep is
+// core 1's answer, set once the panel is off and the bus has drained.
+static bool sleep_requested;
+static volatile bool display_asleep;
+static uint64_t wake_since_us; // when the wake-up began, for wake_to_frame_us
+static bool wake_pending;      // first frame after a wake not on the panel yet
+
+// Frames whose bytes are still on the bus, for the trace. The transport
+// calls back when its queue drains, which ends all of them at once.
+#define RENDER_SPI_PENDING 4
+static uint64_t spi_start[RENDER_SPI_PENDING];
+static uint64_t spi_since[RENDER_SPI_PENDING];
+static uint16_t spi_key[RENDER_SPI_PENDING];
+static uint8_t spi_pending;
+static uint16_t frame_key;      // trace id of the state being drawn
+static uint64_t frame_since_us; // when the oldest state behind it was submitted
+
+// u8g2 and graphics
+uint8_t HOT_FUNC(u8x8_byte_pico_hw_spi)(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr)
+{
+  uint8_t *data;
+  switch (msg)
+  {
+  case U8X8_MSG_BYTE_SEND: // queued for DMA, returns before the bytes are on the wire
+    data = (uint8_t *)arg_ptr;
+    oled_spi_write(data, arg_int);
+    break;
+  case U8X8_MSG_BYTE_INIT:
+    oled_spi_init(); // also deasserts CS
+    break;
+  case U8X8_MSG_BYTE_SET_DC:
+    oled_spi_set_dc(arg_int);
+    break;
+  case U8X8_MSG_BYTE_START_TRANSFER:
+    break; // CS is asserted by the transport when the first queued byte goes out
+  case U8X8_MSG_BYTE_END_TRANSFER:
+    oled_spi_end_transfer(); // CS is released after the last byte of this transfer
+    break;
+  default:
+    return 0;
+  }
+  return 1;
+}
+
+uint8_t u8x8_gpio_and_delay_pico(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr)
+{
+  switch (msg)
+  {
+  case U8X8_MSG_GPIO_AND_DELAY_INIT:
+    spi_init(OLED_SPI_PORT, OLED_SPI_SPEED);
+    gpio_set_function(OLED_CS, GPIO_FUNC_SIO);
+    gpio_set_function(OLED_SPI_CLK, GPIO_FUNC_SPI);
+    gpio_set_function(OLED_SPI_DIN, GPIO_FUNC_SPI);
+    gpio_init(OLED_RESET);
+    gpio_init(OLED_DC);
+    gpio_init(OLED_CS);
+    gpio_set_dir(OLED_RESET, GPIO_OUT);
+    gpio_set_dir(OLED_DC, GPIO_OUT);
+    gpio_set_dir(OLED_CS, GPIO_OUT);
+    gpio_put(OLED_RESET, 1);
+    gpio_put(OLED_CS, 1);
+    gpio_put(OLED_DC, 0);
+    ns_scale = cycles_ns_scale();
+    break;
+  case U8X8_MSG_DELAY_NANO: // delay arg_int * 1 nano second
+    cycles_delay_ns(arg_int, ns_scale);
+    break;
+  case U8X8_MSG_DELAY_100NANO: // delay arg_int * 100 nano seconds
+    cycles_delay_ns(arg_int * 100u, ns_scale);
+    break;
+  case U8X8_MSG_DELAY_10MICRO: // delay arg_int * 10 micro seconds
+    oled_spi_wait();           // bytes go out asynchronously, delay from when the queued ones are sent
+    sleep_us(arg_int * 10);
+    break;
+  case U8X8_MSG_DELAY_MILLI: // delay arg_int * 1 milli second
+    oled_spi_wait();
+    sleep_ms(arg_int);
+    break;
+  case U8X8_MSG_GPIO_CS: // CS (chip select) pin: Output level in arg_int
+    gpio_put(OLED_CS, arg_int);
+    break;
+  case U8X8_MSG_GPIO_DC: // DC (data/cmd, A0, register select) pin: Output level
+    gpio_put(OLED_DC, arg_int);
+    break;
+  case U8X8_MSG_GPIO_RESET:        // Reset pin: Output level in arg_int
+    oled_spi_wait();
+    gpio_put(OLED_RESET, arg_int); // printf("U8X8_MSG_GPIO_RESET %d\n", arg_int);
+    break;
+  default:
+    u8x8_SetGPIOResult(u8x8, 1); // default return value
+    break;
+  }
+  return 1;
+}
+
+void draw_display()
+{
+  char message[] = "Hello, world!";
+  u8g2_ClearBuffer(&u8g2);
+  u8g2_ClearDisplay(&u8g2);
+  u8g2_SetDrawColor(&u8g2, 1);
+  u8g2_SetFont(&u8g2, u8g2_font_t0_11_te);
+  u8g2_DrawStr(&u8g2, 10, 10, message);
+  u8g2_UpdateDisplay(&u8g2);
+}
+
+// A monospace text field that only redraws the character cells that changed
+struct TextField
+{
+  int16_t x;        // left edge of the first character cell
+  int16_t top;      // top of the area cleared behind the text
+  uint8_t height;   // height of that area
+  uint8_t baseline; // y of the text baseline
+  uint8_t cell_w;   // glyph advance of the font
+  const uint8_t *font;
+  char shown[40]; // text currently in the buffer
+};
+
+static struct TextField field_battery = {21, 1, 8, 8, 6, u8g2_font_profont11_tr};
+static struct TextField field_word = {60, 1, 8, 8, 6, u8g2_font_profont11_tr};
+static struct TextField field_hex = {25, 35, 9, 43, 6, u8g2_font_profont11_tr};
+static struct TextField field_dec = {25, 45, 9, 53, 6, u8g2_font_profont11_tr};
+static struct TextField field_bin = {25, 55, 9, 63, 6, u8g2_font_profont11_tr};
+static struct TextField field_entry = {256 - ENTRY_CHARS * 12, 10, 24, 26, 12, u8g2_font_profont22_tr};
+
+#define VALUE_CELLS 38 // profont11 cells right of the mode labels
+
+// top of each number mode row, between the divider lines
+static const uint8_t mode_row_top[] = {[MODE_HEX] = 35, [MODE_DEC] = 45, [MODE_BIN] = 55};
+static const char *const mode_label[] = {[MODE_HEX] = "HEX:", [MODE_DEC] = "DEC:", [MODE_BIN] = "BIN:"};
+
+// Text of the value rows and the word status, shared by both paths. A
+// 128-bit word is too wide for the BIN row, which shows the 32 bits of the
+// selected page, the same ones as the LEDs; its longest decimals are cut
+// short with a '>'.
+struct ValueText
+{
+  char hex[RADIX_FORMAT_WORD_HEX_MAX];
+  char dec[RADIX_FORMAT_WORD_DEC_MAX];
+  char bin[RADIX_FORMAT_BIN_MAX];
+  char word[24]; // e.g. "S128 127:96 C V REC"
+};
+
+static void HOT_FUNC(value_text)(struct ValueText *out, const struct CalculatorDisplay *state)
+{
+  radix_format_hex_word(out->hex, &state->value, state->bits);
+  if (radix_format_dec_word(out->dec, &state->value, state->bits, state->is_signed) > VALUE_CELLS)
+  {
+    out->dec[VALUE_CELLS - 1] = '>';
+    out->dec[VALUE_CELLS] = '\0';
+  }
+
+  if (state->bits <= 32)
+    radix_format_bin(out->bin, state->value.limb[0], state->bits);
+  else
+    radix_format_bin(out->bin, state->value.limb[state->page], 32);
+
+  int len = snprintf(out->word, sizeof(out->word), "%c%u", state->is_signed ? 'S' : 'U', state->bits);
+  if (state->bits > 32)
+    len += snprintf(out->word + len, sizeof(out->word) - len, " %u:%u", state->page * 32 + 31, state->page * 32);
+  snprintf(out->word + len, sizeof(out->word) - len, "%s%s%s", state->flags & WORD_CARRY ? " C" : "",
+           state->flags & WORD_OVERFLOW ? " V" : "", state->recording ? " REC" : "");
+}
+
+// clear a rectangle of the buffer and mark it for sending
+static void HOT_FUNC(clear_area)(int x, int y, int w, int h)
+{
+  u8g2_SetDrawColor(&u8g2, 0);
+  u8g2_DrawBox(&u8g2, x, y, w, h);
+  u8g2_SetDrawColor(&u8g2, 1);
+  dirty_tiles_mark(x, y, w, h);
+}
+
+static void HOT_FUNC(text_field_update)(struct TextField *field, const char *text)
+{
+  int old_len = strlen(field->shown);
+  int new_len = strlen(text);
+  int first = -1;
+  int last = -1;
+
+  for (int i = 0; i < old_len || i < new_len; i++)
+  {
+    char old_c = i < old_len ? field->shown[i] : ' ';
+    char new_c = i < new_len ? text[i] : ' ';
+    if (old_c != new_c)
+    {
+      if (first < 0)
+        first = i;
+      last = i;
+    }
+  }
+  if (first < 0)
+    return; // unchanged
+
+  clear_area(field->x + first * field->cell_w, field->top, (last - first + 1) * field->cell_w, field->height);
+
+  if (first < new_len)
+  {
+    char cells[sizeof(field->shown)];
+    int n = (last < new_len ? last + 1 : new_len) - first;
+    memcpy(cells, text + first, n);
+    cells[n] = '\0';
+    u8g2_SetFont(&u8g2, field->font);
+    u8g2_DrawStr(&u8g2, field->x + first * field->cell_w, field->baseline, cells);
+  }
+
+  strncpy(field->shown, text, sizeof(field->shown) - 1);
+}
+
+// a frame is on the panel, count how long its state waited for it
+static void HOT_FUNC(frame_shown)(uint64_t since_us, uint64_t now_us)
+{
+  uint32_t us = now_us - since_us;
+  critical_section_enter_blocking(&mailbox_lock);
+  stats.latency_us = us;
+  if (us > stats.latency_max_us)
+    stats.latency_max_us = us;
+  critical_section_exit(&mailbox_lock);
+}
+
+// oled_spi drain callback, on core 1 in the DMA interrupt
+static void HOT_FUNC(render_spi_done)()
+{
+  uint64_t now = time_us_64();
+  for (uint8_t i = 0; i < spi_pending; i++)
+  {
+    trace_end(TRACE_SPI, spi_start[i], spi_key[i]);
+    frame_shown(spi_since[i], now);
+  }
+  spi_pending = 0;
+}
+
+// send what changed, tracing the transfer from here until the last byte is out
+static void HOT_FUNC(render_flush)(void (*flush)(void))
+{
+  uint64_t start = trace_begin();
+  uint32_t bytes_before = oled_spi_bytes_total();
+  struct XipProfileMark xip_start = xip_profile_begin();
+  flush();
+  xip_profile_end(XIP_PROFILE_FLUSH, xip_start);
+  if (oled_spi_bytes_total() == bytes_before)
+  {
+    frame_shown(frame_since_us, time_us_64()); // nothing changed on the panel
+    return;
+  }
+
+  uint32_t save = save_and_disable_interrupts();
+  if (spi_pending == RENDER_SPI_PENDING)
+    render_spi_done(); // more frames queued than slots, end the oldest early
+  spi_start[spi_pending] = start;
+  spi_key[spi_pending] = frame_key;
+  spi_since[spi_pending] = frame_since_us;
+  spi_pending++;
+  if (!oled_spi_busy())
+    render_spi_done(); // already drained before the frame was recorded
+  restore_interrupts(save);
+}
+
+static void HOT_FUNC(flush_u8g2)()
+{
+  dirty_tiles_flush(&u8g2);
+}
+
+// what the u8g2 path last drew
+static bool drawn = false;
+static struct CalculatorDisplay shown;
+
+// forget what is on the panel, so the next draw is a full one
+static void draw_reset()
+{
+  drawn = false;
+  field_battery.shown[0] = field_word.shown[0] = field_hex.shown[0] = field_dec.shown[0] = field_bin.shown[0] = field_entry.shown[0] = '\0';
+}
+
+// Draws the calculator screen for `state`. Only the parts that differ from
+// the previous call are redrawn and sent, see dirty_tiles.
+void HOT_FUNC(draw_calculator_display)(const struct CalculatorDisplay *state)
+{
+  char text[40];
+  struct ValueText values;
+
+  if (!drawn)
+  {
+    // static layout, only drawn once
+    u8g2_ClearBuffer(&u8g2);
+    u8g2_SetBitmapMode(&u8g2, 1);
+    u8g2_SetFontMode(&u8g2, 1);
+    u8g2_SetDrawColor(&u8g2, 1);
+
+    // divider lines
+    u8g2_DrawLine(&u8g2, 0, 54, 256, 54); // horizontal line above BIN
+    u8g2_DrawLine(&u8g2, 0, 44, 256, 44); // horizontal line above DEC
+    u8g2_DrawLine(&u8g2, 0, 34, 256, 34); // horizontal line above HEX
+
+    u8g2_DrawLine(&u8g2, 0, 9, 256, 9); // horizontal line below status bar (above entry)
+
+    // battery icon
+    u8g2_DrawXBM(&u8g2, 7, 1, 13, 7, image_status_battery_bits);
+
+    dirty_tiles_mark_all();
+  }
+
+  // status bar
+  if (!drawn || state->charging != shown.charging)
+  {
+    clear_area(1, 1, 5, 7);
+    if (state->charging)
+      u8g2_DrawXBM(&u8g2, 1, 1, 5, 7, image_status_charge_bits); // charging icon
+  }
+
+  if (!drawn || state->battery != shown.battery)
+  {
+    clear_area(8, 2, 10, 5);
+    u8g2_DrawBox(&u8g2, 8, 2, (state->battery * 10 + 50) / 100, 5); // battery fill
+  }
+  snprintf(text, sizeof(text), "%u%%", state->battery);
+  text_field_update(&field_battery, text); // battery percentage
+
+  if (!drawn || state->shift != shown.shift)
+  {
+    clear_area(248, 1, 7, 7);
+    if (state->shift)
+      u8g2_DrawXBM(&u8g2, 248, 1, 7, 7, image_status_shift_bits); // shift icon (top right)
+  }
+
+  // labels for each number mode, active one inverted
+  if (!drawn || state->mode != shown.mode)
+  {
+    u8g2_SetFont(&u8g2, u8g2_font_profont11_tr);
+    for (int mode = MODE_HEX; mode <= MODE_BIN; mode++)
+    {
+      clear_area(0, mode_row_top[mode], 24, 9);
+      u8g2_DrawStr(&u8g2, 1, mode_row_top[mode] + 8, mode_label[mode]);
+    }
+    u8g2_SetDrawColor(&u8g2, 2);
+    u8g2_DrawBox(&u8g2, 0, mode_row_top[state->mode], 24, 9);
+    u8g2_SetDrawColor(&u8g2, 1);
+  }
+
+  // value in each mode
+  value_text(&values, state);
+  text_field_update(&field_word, values.word);
+  text_field_update(&field_hex, values.hex);
+  text_field_update(&field_dec, values.dec);
+  text_field_update(&field_bin, values.bin);
+
+  // entry text, right aligned
+  snprintf(text, sizeof(text), "%*s", ENTRY_CHARS, state->entry);
+  text_field_update(&field_entry, text);
+
+  shown = *state;
+  drawn = true;
+
+  render_flush(flush_u8g2);
+}
+
+// Native 4bpp path, see gray4. Same layout as above, but drawn straight into
+// panel memory in gray levels, with text blitted from pre-rendered glyphs.
+#define LEVEL_DIVIDER 6 // divider lines
+#define LEVEL_LABEL 9   // inactive mode labels
+#define LEVEL_DIM 5     // values of the inactive modes
+
+// A monospace text field in the 4bpp framebuffer, redrawing only the cells that changed
+struct GrayField
+{
+  int16_t x;   // left edge of the first character cell
+  int16_t top; // top of the cells
+  const struct Gray4Font *font;
+  uint8_t level;  // level the text was drawn at
+  char shown[40]; // text currently in the framebuffer
+};
+
+static struct GrayField gray_battery = {21, 0, &gray4_font_small};
+static struct GrayField gray_word = {60, 0, &gray4_font_small};
+static struct GrayField gray_hex = {25, 35, &gray4_font_small};
+static struct GrayField gray_dec = {25, 45, &gray4_font_small};
+static struct GrayField gray_bin = {25, 55, &gray4_font_small};
+static struct GrayField gray_entry = {256 - ENTRY_CHARS * 12, 10, &gray4_font_large};
+
+// what the 4bpp path last drew
+static bool gray_drawn = false;
+static struct CalculatorDisplay gray_shown;
+
+static void HOT_FUNC(gray_field_update)(struct GrayField *field, const char *text, uint8_t level)
+{
+  char cells[sizeof(field->shown)];
+  int old_len = strlen(field->shown);
+  int new_len = strlen(text);
+  int first = -1;
+  int last = -1;
+
+  for (int i = 0; i < old_len || i < new_len; i++)
+  {
+    char old_c = i < old_len ? field->shown[i] : ' ';
+    cells[i] = i < new_len ? text[i] : ' '; // cells past the new text are blanked
+    if (cells[i] != old_c || level != field->level)
+    {
+      if (first < 0)
+        first = i;
+      last = i;
+    }
+  }
+  if (first < 0)
+    return; // unchanged
+
+  cells[last + 1] = '\0';
+  gray4_text(field->font, field->x + first * field->font->cell_w, field->top, cells + first, level, 0);
+
+  strncpy(field->shown, text, sizeof(field->shown) - 1);
+  field->level = level;
+}
+
+static void gray_reset()
+{
+  gray_drawn = false;
+  gray_battery.shown[0] = gray_word.shown[0] = gray_hex.shown[0] = gray_dec.shown[0] = gray_bin.shown[0] = gray_entry.shown[0] = '\0';
+}
+
+void HOT_FUNC(draw_calculator_display_gray4)(const struct CalculatorDisplay *state)
+{
+  char text[40];
+  struct ValueText values;
+
+  if (!gray_drawn)
+  {
+    // static layout, only drawn once
+    gray4_clear();
+    gray4_fill(0, 54, 256, 1, LEVEL_DIVIDER); // above BIN
+    gray4_fill(0, 44, 256, 1, LEVEL_DIVIDER); // above DEC
+    gray4_fill(0, 34, 256, 1, LEVEL_DIVIDER); // above HEX
+    gray4_fill(0, 9, 256, 1, LEVEL_DIVIDER);  // below status bar
+    gray4_xbm(7, 1, 13, 7, image_status_battery_bits, GRAY4_MAX);
+  }
+
+  // status bar
+  if (!gray_drawn || state->charging != gray_shown.charging)
+  {
+    gray4_fill(1, 1, 5, 7, 0);
+    if (state->charging)
+      gray4_xbm(1, 1, 5, 7, image_status_charge_bits, GRAY4_MAX);
+  }
+
+  if (!gray_drawn || state->battery != gray_shown.battery)
+  {
+    gray4_fill(8, 2, 10, 5, 0);
+    gray4_fill(8, 2, (state->battery * 10 + 50) / 100, 5, GRAY4_MAX);
+  }
+  snprintf(text, sizeof(text), "%u%%", state->battery);
+  gray_field_update(&gray_battery, text, GRAY4_MAX);
+
+  if (!gray_drawn || state->shift != gray_shown.shift)
+  {
+    gray4_fill(248, 1, 7, 7, 0);
+    if (state->shift)
+      gray4_xbm(248, 1, 7, 7, image_status_shift_bits, GRAY4_MAX);
+  }
+
+  // labels, the active one inverted and the others dimmed
+  if (!gray_drawn || state->mode != gray_shown.mode)
+  {
+    for (int mode = MODE_HEX; mode <= MODE_BIN; mode++)
+    {
+      bool active = mode == state->mode;
+      gray4_fill(0, mode_row_top[mode], 1, 9, active ? GRAY4_MAX : 0);
+      gray4_text(&gray4_font_small, 1, mode_row_top[mode], mode_label[mode], active ? 0 : LEVEL_LABEL,
+                 active ? GRAY4_MAX : 0);
+    }
+  }
+
+  // value in each mode, full brightness for the active one
+  value_text(&values, state);
+  gray_field_update(&gray_word, values.word, GRAY4_MAX);
+  gray_field_update(&gray_hex, values.hex, state->mode == MODE_HEX ? GRAY4_MAX : LEVEL_DIM);
+  gray_field_update(&gray_dec, values.dec, state->mode == MODE_DEC ? GRAY4_MAX : LEVEL_DIM);
+  gray_field_update(&gray_bin, values.bin, state->mode == MODE_BIN ? GRAY4_MAX : LEVEL_DIM);
+
+  // entry text, right aligned
+  snprintf(text, sizeof(text), "%*s", ENTRY_CHARS, state->entry);
+  gray_field_update(&gray_entry, text, GRAY4_MAX);
+
+  gray_shown = *state;
+  gray_drawn = true;
+
+  render_flush(gray4_flush);
+}
+
+// Cycles to draw and queue a frame on each path, on core 1 with the display
+// running. Bus time is not counted, every case waits for the bus to go idle
+// before it starts.
+#define BENCH_RUNS 8
+
+struct BenchCase
+{
+  const char *name;
+  struct CalculatorDisplay a, b; // drawn alternately, so every run has a change to send
+  bool full;                     // forget the panel contents before each run
+};
+
+static void bench_path(const char *path, void (*draw)(const struct CalculatorDisplay *), void (*reset)(),
+                       const struct BenchCase *bench)
+{
+  uint64_t cycles = 0;
+  uint32_t bytes = 0;
+
+  draw(&bench->b);
+  oled_spi_wait();
+  for (int run = 0; run < BENCH_RUNS; run++)
+  {
+    const struct CalculatorDisplay *state = run % 2 ? &bench->b : &bench->a;
+    if (bench->full)
+      reset();
+
+    uint32_t bytes_before = oled_spi_bytes_total();
+    uint32_t start = cycles_now();
+    draw(state);
+    cycles += cycles_since(start);
+    bytes += oled_spi_bytes_total() - bytes_before;
+    oled_spi_wait();
+  }
+
+  printf("  %-12s %-6s %9lu cycles %6lu bytes\n", bench->name, path, (unsigned long)(cycles / BENCH_RUNS),
+         (unsigned long)(bytes / BENCH_RUNS));
+}
+
+/// @brief Compare cycles per frame of the u8g2 and the native 4bpp paths, printed over stdio. Runs on core 1 after init_oled().
+void render_benchmark()
+{
+  const struct CalculatorDisplay base = {
+      .value = {{0x1234ABCD}}, .bits = 32, .entry = "1234ABCD", .mode = MODE_HEX, .battery = 87};
+  struct BenchCase cases[] = {
+      {"full frame", base, base, true},
+      {"digit", base, base, false},
+      {"mode", base, base, false},
+      {"entry", base, base, false},
+  };
+  cases[1].b.value.limb[0]++;
+  cases[2].b.mode = MODE_DEC;
+  strcpy(cases[3].b.entry, "1234ABCD+");
+
+  cycles_init(); // SysTick is per core
+
+  printf("render benchmark, mean of %d runs\n", BENCH_RUNS);
+  for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+  {
+    bench_path("u8g2", draw_calculator_display, draw_reset, &cases[i]);
+    bench_path("gray4", draw_calculator_display_gray4, gray_reset, &cases[i]);
+  }
+
+  // the live path starts over with a full frame
+  draw_reset();
+  gray_reset();
+  trace_clear();
+}
+
+// init
+void init_oled()
+{
+  u8g2_Setup_ssd1322_nhd_256x64_f(&u8g2, U8G2_R0, u8x8_byte_pico_hw_spi, u8x8_gpio_and_delay_pico); // or instead of nhd, zjy
+  display_info = *u8g2.u8x8.display_info;
+  display_info.reset_pulse_width_ms = OLED_RESET_PULSE_MS;
+  display_info.post_reset_wait_ms = OLED_RESET_WAIT_MS;
+  u8g2.u8x8.display_info = &display_info;
+  u8g2_InitDisplay(&u8g2);                                                                          // send init sequence to the display, display is in sleep mode after this,
+  u8g2_SetPowerSave(&u8g2, 0);
+}
+
+/// @brief Switch the panel in or out of power save. Asleep, core 1 also enters deep sleep on its WFE.
+static void display_power(bool sleep)
+{
+  u8g2_SetPowerSave(&u8g2, sleep); // the SSD1322 keeps its RAM, the frame comes back as it was
+  oled_spi_wait();
+
+  if (sleep)
+    scb_hw->scr |= M0PLUS_SCR_SLEEPDEEP_BITS;
+  else
+    scb_hw->scr &= ~M0PLUS_SCR_SLEEPDEEP_BITS;
+
+  wake_pending = !sleep;
+  display_asleep = sleep;
+  __sev(); // render_sleep() waits for this
+}
+
+/// @brief The first frame since the wake is on the panel, or there was none to draw.
+static void wake_done()
+{
+  oled_spi_wait();
+  uint32_t us = time_us_64() - wake_since_us;
+
+  critical_section_enter_blocking(&mailbox_lock);
+  stats.wakes++;
+  stats.wake_to_frame_us = us;
+  if (us > stats.wake_to_frame_max_us)
+    stats.wake_to_frame_max_us = us;
+  critical_section_exit(&mailbox_lock);
+
+  wake_pending = false;
+}
+
+static void render_core1_entry()
+{
+  bool first_frame = true; // boot report, until it is on the panel
+
+  flash_safe_execute_core_init(); // core 0 can pause this core while it writes flash
+  boot_begin(BOOT_PANEL);
+  init_oled(); // the DMA interrupt is enabled on this core
+  oled_spi_set_callback(render_spi_done);
+  boot_end(BOOT_PANEL);
+
+#if CALC_BENCHMARKS
+  while (!stdio_usb_connected())
+    sleep_ms(100); // core 0 brings USB up meanwhile, the results go over it
+  render_benchmark();
+#endif
+
+  while (true)
+  {
+    struct CalculatorDisplay state;
+    bool have_state;
+    bool waiting; // a state is ready but the frame budget is not spent
+    bool sleep;
+    uint64_t now = time_us_64();
+
+    critical_section_enter_blocking(&mailbox_lock);
+    sleep = sleep_requested;
+    have_state = mailbox_full && !sleep; // states submitted while asleep are drawn on wake
+    waiting = have_state && now < next_frame_us;
+    if (waiting)
+    {
+      have_state = false;
+      frame_paced = true;
+    }
+    if (have_state)
+    {
+      stats.paced += frame_paced;
+      frame_paced = false;
+      state = mailbox;
+      frame_key = mailbox_key;
+      frame_since_us = mailbox_since_us;
+      mailbox_full = false;
+      drawing = true;
+    }
+    critical_section_exit(&mailbox_lock);
+
+    if (sleep != display_asleep)
+    {
+      display_power(sleep);
+      continue;
+    }
+
+    if (!have_state)
+    {
+      if (waiting)
+        best_effort_wfe_or_timeout(from_us_since_boot(next_frame_us)); // newer states replace it meanwhile
+      else if (wake_pending)
+        wake_done(); // woken without a new state, the panel is back on as it was
+      else
+        __wfe(); // render_submit() sends the event
+      continue;
+    }
+    next_frame_us = now + RENDER_FRAME_US;
+
+    if (first_frame)
+      boot_begin(BOOT_FIRST_FRAME);
+
+    uint64_t start = trace_begin();
+    struct XipProfileMark xip_start = xip_profile_begin();
+#if RENDER_GRAY4
+    draw_calculator_display_gray4(&state);
+#else
+    draw_calculator_display(&state);
+#endif
+    trace_end(TRACE_RENDER, start, frame_key);
+    xip_profile_end(XIP_PROFILE_DRAW, xip_start);
+    critical_section_enter_blocking(&mailbox_lock);
+    drawing = false;
+    stats.rendered++;
+    critical_section_exit(&mailbox_lock);
+
+    if (wake_pending)
+      wake_done();
+    if (first_frame)
+    {
+      oled_spi_wait();
+      boot_end(BOOT_FIRST_FRAME);
+      first_frame = false;
+    }
+  }
+}
+
+/// @brief Start core 1, which initialises the display and then renders every submitted state.
+void render_init()
+{
+  critical_section_init(&mailbox_lock);
+  multicore_launch_core1(render_core1_entry);
+}
+
+/// @brief Hand a snapshot of the screen state to core 1 and return. Replaces any state not yet drawn,
+/// which is then drawn no sooner than RENDER_FRAME_US after the start of the previous frame.
+/// @param state state to draw, copied
+void render_submit(const struct CalculatorDisplay *state)
+{
+  critical_section_enter_blocking(&mailbox_lock);
+  if (mailbox_full)
+    stats.coalesced++;
+  else
+    mailbox_since_us = time_us_64();
+  mailbox = *state;
+  mailbox_key = trace_last_key();
+  mailbox_full = true;
+  stats.submitted++;
+  critical_section_exit(&mailbox_lock);
+
+  __sev(); // wake core 1
+}
+
+/// @brief Whether core 1 has nothing left to draw, for work that would hold it up such as flash writes.
+bool render_idle()
+{
+  critical_section_enter_blocking(&mailbox_lock);
+  bool idle = !mailbox_full && !drawing;
+  critical_section_exit(&mailbox_lock);
+  return idle;
+}
+
+/// @brief Whether core 1 has a frame to draw now, unlike render_idle() not counting states held for a sleeping panel.
+bool render_pending()
+{
+  critical_section_enter_blocking(&mailbox_lock);
+  bool pending = (mailbox_full && !sleep_requested) || drawing;
+  critical_section_exit(&mailbox_lock);
+  return pending;
+}
+
+/// @brief clk_sys changed, take the scale of the nanosecond delays again. Called from core 0.
+void render_clock_changed()
+{
+  ns_scale = cycles_ns_scale();
+}
+
+/// @brief Copy the render counters.
+/// @param out counters
+void render_get_stats(struct RenderStats *out)
+{
+  critical_section_enter_blocking(&mailbox_lock);
+  *out = stats;
+  critical_section_exit(&mailbox_lock);
+}
+
+/// @brief Put the panel in power save and core 1 into deep sleep. Returns once the panel is off and the SPI bus idle.
+void render_sleep()
+{
+  critical_section_enter_blocking(&mailbox_lock);
+  sleep_requested = true;
+  critical_section_exit(&mailbox_lock);
+
+  __sev();
+  while (!display_asleep)
+    __wfe(); // display_power() sends the event
+}
+
+/// @brief Bring the panel back and draw any state submitted meanwhile. Returns at once.
+/// @param since_us time of the interrupt that woke the board, wake_to_frame_us is measured from it
+void render_wake(uint64_t since_us)
+{
+  critical_section_enter_blocking(&mailbox_lock);
+  sleep_requested = false;
+  wake_since_us = since_us;
+  critical_section_exit(&mailbox_lock);
+
+  __sev(); // wake core 1
+}
@@ -0,0 +1,63 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "word.h"
+
+#define ENTRY_CHARS 21 // profont22 cells that fit across the panel
+
+// Shortest time from the start of one frame to the start of the next. States
+// submitted in between wait and only the newest is drawn, so a burst of keys
+// costs one frame per budget rather than one each.
+#ifndef RENDER_FRAME_US
+#define RENDER_FRAME_US 16667
+#endif
+
+enum NumberMode
+{
+  MODE_HEX,
+  MODE_DEC,
+  MODE_BIN,
+};
+
+// Everything the calculator screen shows. Core 0 builds one and hands a copy
+// to core 1 with render_submit(); it is never shared while being drawn.
+struct CalculatorDisplay
+{
+  struct Word value;           // shown in the HEX/DEC/BIN rows
+  uint8_t bits;                // word size, see word.h
+  bool is_signed;              // DEC row signed
+  uint8_t page;                // 32-bit page of the word on the BIN row and the LEDs
+  uint8_t flags;               // WordFlag of the value, carry and overflow shown in the status bar
+  char entry[ENTRY_CHARS + 1]; // entry line, right aligned
+  uint8_t mode;                // active number mode, see NumberMode
+  uint8_t battery;             // charge in percent
+  bool charging;
+  bool shift;
+  bool recording;               // a program is being recorded, see program.h
+};
+
+struct RenderStats
+{
+  uint32_t submitted;            // states handed over by render_submit()
+  uint32_t rendered;             // frames drawn
+  uint32_t coalesced;            // states replaced by a newer one before they were drawn
+  uint32_t paced;                // frames held back to keep to the frame budget
+  uint32_t latency_us;           // last frame, from the oldest state it stands for to its last byte on the panel
+  uint32_t latency_max_us;       // worst frame
+  uint32_t wakes;                // times the display came back from power save
+  uint32_t wake_to_frame_us;     // last wake, from the waking interrupt to the first frame on the panel
+  uint32_t wake_to_frame_max_us; // worst wake
+};
+
+void render_init();
+void render_submit(const struct CalculatorDisplay *state);
+void render_get_stats(struct RenderStats *out);
+bool render_idle();
+bool render_pending();
+void render_clock_changed();
+void render_sleep();
+void render_wake(uint64_t since_us);
+
+#endif
@@ -1,209 +1,419 @@
 #include <stdio.h>
+#include <string.h>
 #include "pico/stdlib.h"
-#include "hardware/spi.h"
 #include "hardware/i2c.h"
 #include "hardware/gpio.h"
 #include "hardware/irq.h"
-#include <u8g2.h>
 #include "peripherals.h"
 #include "tca8418.h"
-#include "images.h"
 #include "bit_leds.h"
-
-u8g2_t u8g2;
-
-// u8g2 HAL
-uint8_t u8x8_byte_pico_hw_spi(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
-uint8_t u8x8_gpio_and_delay_pico(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr);
+#include "keypad.h"
+#include "i2c_async.h"
+#include "render.h"
+#include "work_queue.h"
+#include "cycles.h"
+#include "hot_path.h"
+#include "radix_format.h"
+#include "word.h"
+#include "trace.h"
+#include "xip_profile.h"
+#include "power.h"
+#include "battery.h"
+#include "calc.h"
+#include "keymap.h"
+#include "journal.h"
+#include "boot.h"
+#include "batch.h"
+#include "governor.h"
+#include "program.h"
 
 // init
-void init_oled();
+void init_power();
 void init_matrix();
 void init_bit_leds();
-
-// graphics
-void draw_display();
+void power_wake_callback();
+void battery_changed();
+void restore_state();
+void journal_due();
 
 // matrix
 void gpio_callback(uint gpio, uint32_t events);
-void TCA8418_interrupt_handler(void);
+void keypad_drained(uint16_t key);
+void TCA8418_interrupt_handler(uint16_t key);
+void handle_key_event(const struct KeyPressEvent *keypress);
+void update_display();
 
-struct KeyPressEvent
+// run loop, interrupts post work and the loop runs it outside IRQ context
+enum WorkType
 {
-  uint8_t pressed; // 1 if pressed, 0 if released
-  uint8_t row;
-  uint8_t col;
+  WORK_KEYPAD,       // the key FIFO was drained into the ring, handle the keys
+  WORK_POWER_BUTTON, // POWER_BTN pressed
+  WORK_UNKNOWN_GPIO, // arg is the pin
+  WORK_STDIO,        // characters arrived on USB stdio
+  WORK_BATTERY,      // a new battery percentage or charger state
+  WORK_JOURNAL,      // batched state changes are due to be written to flash
 };
 
-void interpret_key_event(uint8_t event, struct KeyPressEvent *out);
+void run_pending_work();
+void update_battery();
+void print_stats();
+void print_history();
+void print_boot();
+
+// commands over USB stdio, one per line
+#define COMMAND_MAX 128 // long enough for a batch expression
+#define STDIO_SLICE 256 // bytes read per WORK_STDIO, so keys get a turn during a batch stream
+
+void stdio_callback(void *param);
+void read_commands();
+void run_command(const char *command);
+
+struct CalculatorDisplay display = {.bits = 32, .entry = "0", .mode = MODE_HEX, .battery = 100};
+
+volatile uint32_t gpio_callback_worst_cycles; // IRQ latency metric, longest time spent in gpio_callback
 
 int main()
 {
+  boot_init(); // the boot report counts from reset, see the boot command
+  work_queue_init(); // before any interrupt can post to it
+  trace_init();
+  xip_profile_init();
+  cycles_init();
+
+  boot_begin(BOOT_POWER);
   init_power(); // latch soft power on
+  governor_init(); // clk_peri off clk_sys before core 1 sets up the SPI
+  boot_end(BOOT_POWER);
+
+  // The panel reset is the slowest step, so core 1 starts on it straight
+  // away and draws the first frame the moment the panel is up. Core 0 brings
+  // up everything else meanwhile.
+  render_init();
+
+  boot_begin(BOOT_LEDS);
+  init_bit_leds(); // before update_display() latches the first value
+  boot_end(BOOT_LEDS);
 
+  boot_begin(BOOT_RESTORE);
+  restore_state(); // the previous screen, from the flash journal
+  update_display();
+  render_submit(&display);
+  boot_end(BOOT_RESTORE);
+
+  boot_begin(BOOT_USB);
   stdio_init_all();
+  stdio_set_chars_available_callback(stdio_callback, NULL);
+  boot_end(BOOT_USB);
 
+  boot_begin(BOOT_KEYPAD);
   init_matrix();
-  init_oled();
-  init_bit_leds();
+  boot_end(BOOT_KEYPAD);
 
-  draw_display();
-}
+  boot_begin(BOOT_BATTERY);
+  battery_init(battery_changed); // first measurement in the background, the status bar follows
+  boot_end(BOOT_BATTERY);
 
-// u8g2 and graphics
-uint8_t u8x8_byte_pico_hw_spi(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr)
-{
-  uint8_t *data;
-  switch (msg)
+#if CALC_BENCHMARKS
+  while (!stdio_usb_connected())
+    sleep_ms(100);
+  radix_format_benchmark();
+  word_benchmark();
+#endif
+
+  while (true)
   {
-  case U8X8_MSG_BYTE_SEND:
-    data = (uint8_t *)arg_ptr;
-    spi_write_blocking(OLED_SPI_PORT, data, arg_int);
-    break;
-  case U8X8_MSG_BYTE_INIT:
-    u8x8_gpio_SetCS(u8x8, u8x8->display_info->chip_disable_level);
-    break;
-  case U8X8_MSG_BYTE_SET_DC:
-    u8x8_gpio_SetDC(u8x8, arg_int);
-    break;
-  case U8X8_MSG_BYTE_START_TRANSFER:
-    u8x8_gpio_SetCS(u8x8, u8x8->display_info->chip_enable_level);
-    u8x8->gpio_and_delay_cb(u8x8, U8X8_MSG_DELAY_NANO, u8x8->display_info->post_chip_enable_wait_ns, NULL);
-    break;
-  case U8X8_MSG_BYTE_END_TRANSFER:
-    u8x8->gpio_and_delay_cb(u8x8, U8X8_MSG_DELAY_NANO,
-                            u8x8->display_info->pre_chip_disable_wait_ns, NULL);
-    u8x8_gpio_SetCS(u8x8, u8x8->display_info->chip_disable_level);
-    break;
-  default:
-    return 0;
+    governor_update(); // full speed for the work, or back to idle once it has stopped
+    run_pending_work();
+    power_idle(); // sleep until an interrupt posts more, powering down the longer nothing does
   }
-  return 1;
 }
 
-uint8_t u8x8_gpio_and_delay_pico(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr)
+void run_pending_work()
 {
-  switch (msg)
+  struct WorkItem work;
+  while (work_queue_pop(&work))
   {
-  case U8X8_MSG_GPIO_AND_DELAY_INIT:
-    spi_init(OLED_SPI_PORT, OLED_SPI_SPEED);
-    gpio_set_function(OLED_CS, GPIO_FUNC_SIO);
-    gpio_set_function(OLED_SPI_CLK, GPIO_FUNC_SPI);
-    gpio_set_function(OLED_SPI_DIN, GPIO_FUNC_SPI);
-    gpio_init(OLED_RESET);
-    gpio_init(OLED_DC);
-    gpio_init(OLED_CS);
-    gpio_set_dir(OLED_RESET, GPIO_OUT);
-    gpio_set_dir(OLED_DC, GPIO_OUT);
-    gpio_set_dir(OLED_CS, GPIO_OUT);
-    gpio_put(OLED_RESET, 1);
-    gpio_put(OLED_CS, 1);
-    gpio_put(OLED_DC, 0);
-    break;
-  case U8X8_MSG_DELAY_NANO: // delay arg_int * 1 nano second
-    sleep_us(arg_int);      // 1000 times slower, though generally fine in practice given rp2040 has no `sleep_ns()`
-    break;
-  case U8X8_MSG_DELAY_100NANO: // delay arg_int * 100 nano seconds
-    sleep_us(arg_int);
-    break;
-  case U8X8_MSG_DELAY_10MICRO: // delay arg_int * 10 micro seconds
-    sleep_us(arg_int * 10);
-    break;
-  case U8X8_MSG_DELAY_MILLI: // delay arg_int * 1 milli second
-    sleep_ms(arg_int);
-    break;
-  case U8X8_MSG_GPIO_CS: // CS (chip select) pin: Output level in arg_int
-    gpio_put(OLED_CS, arg_int);
-    break;
-  case U8X8_MSG_GPIO_DC: // DC (data/cmd, A0, register select) pin: Output level
-    gpio_put(OLED_DC, arg_int);
-    break;
-  case U8X8_MSG_GPIO_RESET:        // Reset pin: Output level in arg_int
-    gpio_put(OLED_RESET, arg_int); // printf("U8X8_MSG_GPIO_RESET %d\n", arg_int);
-    break;
-  default:
-    u8x8_SetGPIOResult(u8x8, 1); // default return value
-    break;
+    switch (work.type)
+    {
+    case WORK_KEYPAD:
+      power_activity(); // restarts the sleep and power-off timeouts
+      TCA8418_interrupt_handler(work.arg); // arg is the trace id of the key interrupt
+      break;
+    case WORK_POWER_BUTTON:
+      power_activity();
+      printf("Power button pressed\n");
+      print_stats();
+      break;
+    case WORK_UNKNOWN_GPIO:
+      printf("Unknown GPIO interrupt on pin %lu\n", (unsigned long)work.arg);
+      break;
+    case WORK_STDIO:
+      power_activity();
+      read_commands();
+      break;
+    case WORK_BATTERY:
+      update_battery();
+      break;
+    case WORK_JOURNAL:
+      if (render_idle())
+        journal_flush();
+      else
+        journal_defer(); // core 1 pauses while flash is written, do not hold up a frame
+      break;
+    }
   }
-  return 1;
 }
 
-void draw_display()
+// Copy the cached battery measurement into the status bar
+void update_battery()
 {
-  char message[] = "Hello, world!";
-  u8g2_ClearBuffer(&u8g2);
-  u8g2_ClearDisplay(&u8g2);
-  u8g2_SetDrawColor(&u8g2, 1);
-  u8g2_SetFont(&u8g2, u8g2_font_t0_11_te);
-  u8g2_DrawStr(&u8g2, 10, 10, message);
-  u8g2_UpdateDisplay(&u8g2);
+  struct BatteryState battery;
+  battery_get(&battery);
+
+  display.battery = battery.percent;
+  display.charging = battery.charging;
+  render_submit(&display);
 }
 
-void draw_calculator_display_example()
+// Runs in IRQ context when a measurement changes what the status bar shows
+void battery_changed()
 {
-  u8g2_ClearBuffer(&u8g2);
-  u8g2_SetBitmapMode(&u8g2, 1);
-  u8g2_SetFontMode(&u8g2, 1);
-
-  // divider lines
-  u8g2_DrawLine(&u8g2, 0, 54, 256, 54); // horizontal line above BIN
-  u8g2_DrawLine(&u8g2, 0, 44, 256, 44); // horizontal line above DEC
-  u8g2_DrawLine(&u8g2, 0, 34, 256, 34); // horizontal line above HEX
+  work_queue_post(WORK_BATTERY, 0);
+}
 
-  u8g2_DrawLine(&u8g2, 0, 9, 256, 9); // horizontal line below status bar (above entry)
+// Runs in IRQ context when batched state changes should go to flash
+void journal_due()
+{
+  work_queue_post(WORK_JOURNAL, 0);
+}
 
-  // status bar
-  u8g2_DrawXBM(&u8g2, 1, 1, 5, 7, image_status_charge_bits); // charging icon
+// Runs in IRQ context when USB stdio has input, the run loop reads it
+void stdio_callback(void *param)
+{
+  governor_boost();
+  work_queue_post(WORK_STDIO, 0);
+}
 
-  // battery icon
-  u8g2_DrawXBM(&u8g2, 7, 1, 13, 7, image_status_battery_bits);
-  u8g2_DrawBox(&u8g2, 8, 2, 10, 5); // battery fill, size must be adjusted based on charge levels
+// collect characters into a line, running each complete line as a command.
+// Lines starting with = and binary frames are batch requests, see batch.c.
+void read_commands()
+{
+  static char line[COMMAND_MAX + 1];
+  static uint8_t len;
+  static bool truncated;
+  char chunk[64];
+  int total = 0;
+  int n;
+
+  while (total < STDIO_SLICE && (n = stdio_get_until(chunk, sizeof(chunk), get_absolute_time())) > 0)
+  {
+    total += n;
+    for (int i = 0; i < n; i++)
+    {
+      char c = chunk[i];
+      if (batch_frame_byte(c, len == 0 && !truncated))
+        continue;
+
+      if (c == '\r' || c == '\n')
+      {
+        line[len] = '\0';
+        if (line[0] == '=')
+        {
+          batch_line(line + 1, truncated);
+        }
+        else if (len > 0)
+        {
+          batch_flush(); // answers before this command's output
+          if (truncated)
+            printf("command too long\n");
+          else
+            run_command(line);
+        }
+        len = 0;
+        truncated = false;
+      }
+      else if (len < COMMAND_MAX)
+      {
+        line[len++] = c;
+      }
+      else
+      {
+        truncated = true;
+      }
+    }
+  }
 
-  // battery percentage
-  u8g2_SetFont(&u8g2, u8g2_font_profont11_tr);
-  u8g2_DrawStr(&u8g2, 21, 8, "100%%");
+  batch_flush(); // the input ran dry, or the slice is used up
+  if (total >= STDIO_SLICE)
+    work_queue_post(WORK_STDIO, 0); // there may be more, after the keys that came in meanwhile
+}
 
-  u8g2_DrawXBM(&u8g2, 248, 1, 7, 7, image_status_shift_bits); // shift icon (top right)
+void run_command(const char *command)
+{
+  if (!strcmp(command, "trace json"))
+    trace_dump_json();
+  else if (!strcmp(command, "trace hist"))
+    trace_dump_histograms();
+  else if (!strcmp(command, "trace clear"))
+    trace_clear();
+  else if (!strcmp(command, "xip"))
+    xip_profile_dump();
+  else if (!strcmp(command, "xip clear"))
+    xip_profile_clear();
+  else if (!strcmp(command, "stats"))
+    print_stats();
+  else if (!strcmp(command, "sleep"))
+    power_sleep(); // the next key or command wakes it, for timing wake-ups
+  else if (!strcmp(command, "history"))
+    print_history();
+  else if (!strcmp(command, "boot"))
+    print_boot();
+  else if (!strncmp(command, "format", 6) && (command[6] == ' ' || command[6] == '\0'))
+    batch_format(command + 6);
+  else if (!strncmp(command, "prog", 4) && (command[4] == ' ' || command[4] == '\0'))
+    program_command(command + 4);
+  else
+    printf("commands: trace json, trace hist, trace clear, xip, xip clear, stats, sleep, history, boot, format, prog, =EXPRESSION\n");
+}
 
-  // labels for each number mode
-  u8g2_DrawStr(&u8g2, 1, 53, "DEC:");
-  u8g2_DrawStr(&u8g2, 1, 43, "HEX:");
-  u8g2_DrawStr(&u8g2, 1, 63, "BIN:");
+void print_stats()
+{
+  struct KeypadStats keypad;
+  keypad_get_stats(&keypad);
+  struct RenderStats render;
+  render_get_stats(&render);
+  struct PowerStats power;
+  power_get_stats(&power);
+  struct BatteryState battery;
+  battery_get(&battery);
+  struct JournalStats journal;
+  journal_get_stats(&journal);
+  struct BootReport boot;
+  boot_get_report(&boot);
+  struct BatchStats batch;
+  batch_get_stats(&batch);
+  struct GovernorStats governor;
+  governor_get_stats(&governor);
+  struct I2cAsyncStats i2c;
+  i2c_async_get_stats(&i2c);
+  struct ProgramInfo program;
+  program_get_info(&program);
+
+  printf("gpio_callback worst case: %lu cycles\n", (unsigned long)gpio_callback_worst_cycles);
+  printf("work dropped: %lu\n", (unsigned long)work_queue_dropped());
+  printf("keypad: %lu events in %lu drains, %lu FIFO overflows, %lu dropped\n",
+         (unsigned long)keypad.events, (unsigned long)keypad.drains,
+         (unsigned long)keypad.overflows, (unsigned long)keypad.dropped);
+  // the CPU used to spin for the whole drain, now it only runs the handlers between transfers
+  printf("keypad drain: %lu us per event waiting on the bus, %lu ns per event of CPU\n",
+         (unsigned long)(keypad.events ? keypad.drain_us / keypad.events : 0),
+         (unsigned long)(keypad.events ? i2c.cpu_ns / keypad.events : 0));
+  printf("i2c: %lu transfers, %lu aborts, %lu us on the bus, %lu waits for blocking calls\n",
+         (unsigned long)i2c.transfers, (unsigned long)i2c.aborts, (unsigned long)i2c.bus_us,
+         (unsigned long)i2c.waits);
+  printf("render: %lu states submitted, %lu frames rendered, %lu coalesced, %lu paced\n",
+         (unsigned long)render.submitted, (unsigned long)render.rendered, (unsigned long)render.coalesced,
+         (unsigned long)render.paced);
+  printf("state to panel: %lu us last, %lu us worst\n", (unsigned long)render.latency_us,
+         (unsigned long)render.latency_max_us);
+  printf("wake to frame: %lu us last, %lu us worst over %lu wakes\n",
+         (unsigned long)render.wake_to_frame_us, (unsigned long)render.wake_to_frame_max_us,
+         (unsigned long)render.wakes);
+  printf("power: %lu ms active, %lu ms asleep, %lu sleeps, %lu dormant\n",
+         (unsigned long)(power.active_us / 1000), (unsigned long)(power.sleep_us / 1000),
+         (unsigned long)power.sleeps, (unsigned long)power.dormants);
+  printf("battery: %u mV, %u%%%s, %lu measurements\n", battery.mv, battery.percent,
+         battery.full ? ", charged" : battery.charging ? ", charging" : "", (unsigned long)battery.samples);
+  printf("current budget: %lu uA average, %u uA asleep, %u uA dormant (estimates)\n",
+         (unsigned long)power.budget_ua, POWER_SLEEP_UA, POWER_DORMANT_UA);
+  printf("journal: %lu records replayed in %lu us, %lu written in %lu pages, %lu erases, %lu failed flushes, "
+         "%lu us longest flush, sector %u\n",
+         (unsigned long)journal.replayed, (unsigned long)journal.replay_us, (unsigned long)journal.records,
+         (unsigned long)journal.pages, (unsigned long)journal.erases, (unsigned long)journal.failures,
+         (unsigned long)journal.flush_us_max, journal.sector);
+  printf("boot: first frame on the panel %lu us after reset, see boot\n", (unsigned long)boot.end_us[BOOT_FIRST_FRAME]);
+  printf("batch: %lu requests, %lu in frames, %lu errors, %lu us mean and %lu us longest evaluation\n",
+         (unsigned long)batch.requests, (unsigned long)batch.frames, (unsigned long)batch.errors,
+         (unsigned long)(batch.requests ? batch.eval_us / batch.requests : 0), (unsigned long)batch.eval_us_max);
+  if (program.ready)
+    printf("program: %u keys in %u bytes of bytecode, %lu runs, see prog\n", program.keys, program.length,
+           (unsigned long)program.runs);
+  for (int i = 0; i < GOVERNOR_STEPS; i++)
+    printf("clock %lu MHz: %lu ms, %lu switches to it, %lu us last and %lu us longest switch\n",
+           (unsigned long)(governor_step_khz(i) / 1000), (unsigned long)(governor.step_us[i] / 1000),
+           (unsigned long)governor.switches[i], (unsigned long)governor.switch_us[i],
+           (unsigned long)governor.switch_max_us[i]);
+  printf("clock boosts: %lu\n", (unsigned long)governor.boosts);
+}
 
-  // Active Number Mode
-  u8g2_SetDrawColor(&u8g2, 2);
-  u8g2_DrawBox(&u8g2, 0, 35, 24, 9);
+// Results of =, oldest first, as saved in the journal
+void print_history()
+{
+  struct JournalState saved;
+  journal_get(&saved);
 
-  // Example values in each mode
-  u8g2_SetDrawColor(&u8g2, 1);
-  u8g2_SetFont(&u8g2, u8g2_font_profont11_tr);
+  char hex[RADIX_FORMAT_WORD_HEX_MAX];
+  char dec[RADIX_FORMAT_WORD_DEC_MAX];
 
-  u8g2_DrawStr(&u8g2, 25, 63, "00000000 00000000 00000000 00000000"); // bin
-  u8g2_DrawStr(&u8g2, 25, 53, "0");                                   // dec
-  u8g2_DrawStr(&u8g2, 25, 43, "00000000");                            // hex
+  for (int i = 0; i < saved.history_count; i++)
+  {
+    radix_format_hex_word(hex, &saved.history[i], saved.history_bits[i]);
+    radix_format_dec_word(dec, &saved.history[i], saved.history_bits[i], false);
+    printf("%d: 0x%s %s\n", i - saved.history_count, hex, dec);
+  }
+}
 
-  // Entry text example
-  u8g2_SetFont(&u8g2, u8g2_font_profont22_tr);
-  u8g2_DrawStr(&u8g2, 160, 26, "00000000");
+// Boot stages in microseconds since reset, which approximates since the power button
+void print_boot()
+{
+  struct BootReport boot;
+  boot_get_report(&boot);
 
-  u8g2_SendBuffer(&u8g2);
+  printf("main() at %lu us, first frame on the panel at %lu us\n", (unsigned long)boot.main_us,
+         (unsigned long)boot.end_us[BOOT_FIRST_FRAME]);
+  for (int i = 0; i < BOOT_STAGES; i++)
+  {
+    if (boot.done & (1u << i))
+      printf("  %-12s core %d  %7lu us  +%lu us\n", boot_stage_name(i), i >= BOOT_PANEL,
+             (unsigned long)boot.begin_us[i], (unsigned long)(boot.end_us[i] - boot.begin_us[i]));
+    else
+      printf("  %-12s core %d  not finished\n", boot_stage_name(i), i >= BOOT_PANEL);
+  }
 }
 
 // init
-void init_oled()
+void restore_state()
 {
-  u8g2_Setup_ssd1322_nhd_256x64_f(&u8g2, U8G2_R0, u8x8_byte_pico_hw_spi, u8x8_gpio_and_delay_pico); // or instead of nhd, zjy
-  u8g2_InitDisplay(&u8g2);                                                                          // send init sequence to the display, display is in sleep mode after this,
-  u8g2_SetPowerSave(&u8g2, 0);
+  struct JournalState saved;
+
+  if (journal_init(&saved, journal_due) && (saved.radix == 2 || saved.radix == 10 || saved.radix == 16) &&
+      word_bits_valid(saved.bits))
+  {
+    calc_set_radix(saved.radix);
+    calc_set_word(saved.bits, saved.is_signed);
+    calc_load(&saved.value);
+  }
+  else
+  {
+    calc_reset();
+  }
 }
 
 void init_matrix()
 {
   // Setup TCA8418
   TCA8418_init();
+  i2c_async_init(TCA8418_I2C_PORT, TCA8418_I2C_ADDR); // the drain reads the FIFO with queued DMA transfers
+  keypad_init(keypad_drained);
   TCA8418_matrix(8, 10);
   TCA8418_set_interrupt(1);
+  TCA8418_set_matrix_overflow(1); // keep the newest events on overflow, counted by the keypad drain
   TCA8418_set_debounce(1);
+  TCA8418_sync(); // the settings above go out together as register bursts
+
+  // start from an empty FIFO with INT released so the first edge is seen
+  TCA8418_flush();
+  TCA8418_clear_interrupt_status(TCA8418_get_interrupt_status());
 
   // Setup interrupt pin
   gpio_init(TCA8418_INT);             // initialize GPIO pin
@@ -218,9 +428,7 @@ void init_bit_leds()
 
 void init_power(){
   // Immediately latch power on
-  gpio_init(POWER_EN);
-  gpio_set_dir(POWER_EN, GPIO_OUT);
-  gpio_put(POWER_EN, 1); // latch soft power on
+  power_init(power_wake_callback);
 
   gpio_init(POWER_BTN);
   gpio_set_dir(POWER_BTN, GPIO_IN);
@@ -228,60 +436,177 @@ void init_power(){
   gpio_set_irq_enabled_with_callback(POWER_BTN, GPIO_IRQ_EDGE_FALL, true, &gpio_callback); // interrupt on button press
 }
 
+// A dormant wake-up loses the edge that caused it, so drain the keypad in case it was a key
+void power_wake_callback()
+{
+  keypad_drain_start(trace_next_key());
+}
+
 // matrix functions
-void gpio_callback(uint gpio, uint32_t events)
+// Runs in IRQ context, so it only posts work for the run loop or starts the
+// keypad drain, which queues its I2C transfers and returns. No printf here.
+void HOT_FUNC(gpio_callback)(uint gpio, uint32_t events)
 {
+  uint32_t start = cycles_now();
+  uint64_t trace_start = trace_begin();
+  struct XipProfileMark xip_start = xip_profile_begin();
+  uint16_t key = 0;
+
   // determine why the interrupt was triggered
   switch (gpio)
   {
   case TCA8418_INT:
-    TCA8418_interrupt_handler();
+    key = trace_next_key();
+    governor_boost();
+    keypad_drain_start(key); // posts WORK_KEYPAD from the DMA interrupt once the FIFO is read
     break;
   case POWER_BTN:
-    printf("Power button pressed\n");
+    work_queue_post(WORK_POWER_BUTTON, 0);
     break;
   default:
-    printf("Unknown GPIO interrupt on pin %d\n", gpio);
+    work_queue_post(WORK_UNKNOWN_GPIO, gpio);
     break;
   }
+
+  uint32_t elapsed = cycles_since(start);
+  if (elapsed > gpio_callback_worst_cycles)
+    gpio_callback_worst_cycles = elapsed;
+
+  trace_end(TRACE_IRQ, trace_start, key);
+  xip_profile_end(XIP_PROFILE_IRQ, xip_start);
 }
 
-// for now we assume it is only a keypress interrupt
-void TCA8418_interrupt_handler(void)
+// Runs in the DMA interrupt once the keypad drain has read the FIFO
+void HOT_FUNC(keypad_drained)(uint16_t key)
 {
-  uint8_t event = TCA8418_get_event();
-  if (event == 0)
-    return; // maybe there is no key event for some reason. maybe we should also be checking for multiple events...
+  work_queue_post(WORK_KEYPAD, key);
+}
 
+// Deferred from keypad_drained, the events are in the keypad ring by now
+// key is the trace id from gpio_callback
+void HOT_FUNC(TCA8418_interrupt_handler)(uint16_t key)
+{
+  uint64_t start = trace_begin();
+  struct XipProfileMark xip_start = xip_profile_begin();
   struct KeyPressEvent keypress;
-  interpret_key_event(event, &keypress);
+  while (keypad_pop(&keypress))
+    handle_key_event(&keypress);
+  update_display();
+  trace_end(TRACE_EVALUATE, start, key);
+  xip_profile_end(XIP_PROFILE_EVALUATE, xip_start);
 
-  if (keypress.pressed)
-  { // if key pressed
+  render_submit(&display);
+}
 
-    if (keypress.col <= 4 && keypress.row <= 5)
-    { // if a matrix keypress
-      printf("Matrix key (%d,%d) pressed\n", keypress.row, keypress.col);
-    }
+// Keys act on press. The keymap is indexed by the raw key code, so a key
+// is dispatched without decoding it, and each one is folded into the
+// expression as it comes, so the cost per key does not grow with the entry.
+void HOT_FUNC(handle_key_event)(const struct KeyPressEvent *keypress)
+{
+  if (!keypress->pressed)
+    return;
 
-    if (keypress.col >= 5 && keypress.col <= 8)
-    { // if a button keypress (all rows 0-7 are used)
-      printf("Bit button (%d, %d) pressed\n", keypress.row, keypress.col);
-    }
+  const struct KeyAction *action = &keymap[display.shift][keypress->code];
+  bool shift = false;
 
-    // at this point, any other combination is invalid
-    printf("Invalid keypress (%d,%d)");
-  }
-  else
-  { // key released
-    printf("Key released");
-    return; // we don't care for now
+  switch (action->type)
+  {
+  case KEY_NONE:
+    printf("Unmapped key %u\n", keypress->code);
+    break;
+  case KEY_DIGIT:
+    calc_digit(action->arg);
+    break;
+  case KEY_OPERATOR:
+    calc_operator(action->arg);
+    break;
+  case KEY_OPEN:
+    calc_open();
+    break;
+  case KEY_CLOSE:
+    calc_close();
+    break;
+  case KEY_EQUALS:
+    calc_equals();
+    if (!calc_error())
+    {
+      struct Word result = calc_result();
+      journal_history(&result, calc_bits());
+    }
+    break;
+  case KEY_NOT:
+    calc_not();
+    break;
+  case KEY_NEGATE:
+    calc_negate();
+    break;
+  case KEY_BACKSPACE:
+    calc_backspace();
+    break;
+  case KEY_CLEAR:
+    calc_reset();
+    break;
+  case KEY_MODE:
+    calc_set_radix(calc_radix() == 16 ? 10 : calc_radix() == 10 ? 2 : 16);
+    break;
+  case KEY_SHIFT:
+    shift = !display.shift;
+    break;
+  case KEY_BIT:
+    calc_toggle_bit(action->arg + 32 * display.page);
+    break;
+  case KEY_WORD:
+    calc_set_word(calc_bits() == 128 ? 8 : calc_bits() * 2, calc_signed());
+    break;
+  case KEY_SIGN:
+    calc_set_word(calc_bits(), !calc_signed());
+    break;
+  case KEY_PAGE:
+    if (action->arg && (display.page + 1) * 32 < calc_bits())
+      display.page++;
+    else if (!action->arg && display.page > 0)
+      display.page--;
+    break;
+  case KEY_RECORD:
+    if (!program_recording())
+      program_record_start();
+    else if (!program_record_stop())
+      printf("Program not recorded\n");
+    break;
+  case KEY_RUN:
+    program_execute();
+    break;
   }
+  display.shift = shift; // one shot
+
+  // the keys as they acted, bits on the page shown as bits of the word
+  program_record(action->type, action->type == KEY_BIT ? action->arg + 32 * display.page : action->arg);
 }
 
-void interpret_key_event(uint8_t event, struct KeyPressEvent *out)
+// Copy the evaluator state into the display and the bit LEDs. Words wider
+// than the 32 LEDs are shown a page of 32 bits at a time, the same page as
+// the BIN row, and the bit buttons toggle the bits of that page.
+void HOT_FUNC(update_display)()
 {
-  out->pressed = event >> 7;      // direction in bit 7 of event
-  out->col = (event & 0x7F) % 10; // 10 columns in matrix, col is remainder of row
-  out->row = (event & 0x7F) / 10; // 10 cols, get row
+  static uint32_t shown = 0;
+
+  display.value = calc_result();
+  display.bits = calc_bits();
+  display.is_signed = calc_signed();
+  display.flags = calc_flags();
+  if (display.page * 32 >= display.bits)
+    display.page = 0; // the word got narrower
+  calc_entry(display.entry, ENTRY_CHARS);
+  display.mode = calc_radix() == 16 ? MODE_HEX : calc_radix() == 10 ? MODE_DEC : MODE_BIN;
+  display.recording = program_recording();
+  journal_set(&display.value, calc_radix(), display.bits, display.is_signed); // batched, written once the keys stop
+
+  uint32_t leds = display.value.limb[display.page];
+  if (leds != shown)
+  {
+    struct XipProfileMark xip_start = xip_profile_begin();
+    bit_leds_set(leds);
+    xip_profile_end(XIP_PROFILE_LEDS, xip_start);
+    shown = leds;
+  }
 }
@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <u8g2.h>
+#include "bench.h"
+#include "keypad.h"
+#include "tca8418.h"
+#include "i2c_async.h"
+#include "peripherals.h"
+#include "bit_leds.h"
+#include "gray4.h"
+#include "dirty_tiles.h"
+#include "oled_spi.h"
+#include "radix_format.h"
+#include "word.h"
+
+// Host benchmarks of the logic between the firmware and its buses: key
+// decoding and draining, TCA8418 setup, LED serialisation and plane tables, number formatting
+// and composing the value rows of the screen. The modules are compiled for
+// the host against the fakes in bench_fakes.c, which count the bus traffic
+// each operation causes.
+//
+//   build-sim/bench [-o FILE] [-c BASELINE]
+//
+// Results are CSV, one benchmark per line in a fixed order, with the mean
+// host time per operation and the bus counters per operation. The counters
+// are exact and repeat from run to run; the times are the best of
+// BENCH_REPEATS runs. -o writes the results to FILE as well, and -c compares
+// them with an earlier file, exiting 1 if any counter went up.
+
+#define BENCH_REPEATS 7
+#define BENCH_MAX 32
+#define BENCH_COLUMNS "benchmark,ns_per_op,i2c_transactions,i2c_bytes,gpio_writes,shift_bytes,spi_bytes,delay_us"
+#define BENCH_COUNTERS 6
+
+struct Bench
+{
+    const char *name;
+    void (*setup)();
+    void (*run)(uint32_t i);
+    uint32_t ops; // per repeat
+};
+
+struct BenchResult
+{
+    char name[48];
+    double ns;
+    double counters[BENCH_COUNTERS]; // per op, in BENCH_COLUMNS order
+};
+
+static volatile uint32_t sink; // keeps results the compiler could otherwise drop
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// keypad and TCA8418
+
+static void run_interpret(uint32_t i)
+{
+    struct KeyPressEvent keypress;
+    interpret_key_event(i & 0xFF, &keypress);
+    sink += keypress.code + keypress.pressed;
+}
+
+/// @brief Drain a FIFO holding count events and hand them on, as the TCA8418_INT handler does.
+static void drain(uint32_t i, uint8_t count)
+{
+    uint8_t events[10];
+    struct KeyPressEvent keypress;
+
+    for (uint8_t k = 0; k < count; k++)
+        events[k] = 0x80 | ((i + k) % 80 + 1);
+    bench_tca8418_queue(events, count);
+    keypad_drain_start(0); // the fake DMA finishes the whole chain before this returns
+    while (keypad_pop(&keypress))
+        sink += keypress.code;
+}
+
+static void setup_keypad()
+{
+    static bool done; // the DMA channels are only claimed once
+    if (!done)
+    {
+        i2c_async_init(TCA8418_I2C_PORT, TCA8418_I2C_ADDR);
+        keypad_init(NULL);
+        done = true;
+    }
+}
+
+static void run_drain_1(uint32_t i)
+{
+    drain(i, 1);
+}
+
+static void run_drain_10(uint32_t i)
+{
+    drain(i, 10);
+}
+
+static void run_matrix(uint32_t i)
+{
+    TCA8418_matrix(8 - (i & 1), 10); // unchanged registers are not written again
+    TCA8418_sync();
+}
+
+static void run_tca8418_init(uint32_t i)
+{
+    (void)i;
+    TCA8418_init();
+    TCA8418_sync();
+}
+
+/// @brief The whole keypad setup of init_matrix(), up to an empty FIFO with INT released.
+static void run_tca8418_configure(uint32_t i)
+{
+    (void)i;
+    TCA8418_init();
+    TCA8418_matrix(8, 10);
+    TCA8418_set_interrupt(1);
+    TCA8418_set_matrix_overflow(1);
+    TCA8418_set_debounce(1);
+    TCA8418_sync();
+    TCA8418_flush();
+    TCA8418_clear_interrupt_status(TCA8418_get_interrupt_status());
+}
+
+// bit LEDs, bit-banged as the simulator builds them and with the PIO and DMA
+// refresh loop the firmware ships. The PIO build only rebuilds a plane table,
+// the fake loop then feeds it to the FIFO as the DMA would within a refresh.
+
+static void run_bit_leds_set(uint32_t i)
+{
+    bit_leds_set(i * 0x9E3779B9u);
+}
+
+static void setup_bit_leds_pio()
+{
+    static bool done; // the DMA channels are only claimed once
+    if (!done)
+    {
+        bit_leds_pio_init();
+        done = true;
+    }
+}
+
+static void run_bit_leds_pio_set(uint32_t i)
+{
+    bit_leds_pio_set(i * 0x9E3779B9u);
+    bench_dma_loop_pass();
+}
+
+/// @brief Two values within one refresh, the second may not touch the table still being played.
+static void run_bit_leds_pio_set_twice(uint32_t i)
+{
+    bit_leds_pio_set(i * 0x9E3779B9u);
+    bit_leds_pio_set(~i * 0x9E3779B9u);
+    bench_dma_loop_pass();
+}
+
+static void run_bit_leds_pio_levels(uint32_t i)
+{
+    uint8_t levels[32];
+    for (int b = 0; b < 32; b++)
+        levels[b] = (i + b) % BIT_LEDS_LEVELS;
+    bit_leds_pio_set_levels(levels);
+    bench_dma_loop_pass();
+}
+
+static void run_bit_leds_pio_brightness(uint32_t i)
+{
+    bit_leds_pio_set_brightness(i);
+    bench_dma_loop_pass();
+}
+
+static void run_bit_leds_pio_clock(uint32_t i)
+{
+    (void)i;
+    bit_leds_pio_clock_changed();
+}
+
+// number formatting
+
+static struct Word bench_word(uint32_t i, uint8_t bits)
+{
+    struct Word word;
+    for (int l = 0; l < WORD_LIMBS; l++)
+        word.limb[l] = (i + l) * 0x9E3779B9u;
+    word_resize(&word, WORD_BITS_MAX, bits, false);
+    return word;
+}
+
+static char text[RADIX_FORMAT_WORD_BIN_MAX];
+
+static void run_hex_32(uint32_t i)
+{
+    struct Word word = bench_word(i, 32);
+    sink += radix_format_hex_word(text, &word, 32);
+}
+
+static void run_dec_32(uint32_t i)
+{
+    struct Word word = bench_word(i, 32);
+    sink += radix_format_dec_word(text, &word, 32, i & 1);
+}
+
+static void run_bin_32(uint32_t i)
+{
+    struct Word word = bench_word(i, 32);
+    sink += radix_format_bin_word(text, &word, 32);
+}
+
+static void run_hex_128(uint32_t i)
+{
+    struct Word word = bench_word(i, 128);
+    sink += radix_format_hex_word(text, &word, 128);
+}
+
+static void run_dec_128(uint32_t i)
+{
+    struct Word word = bench_word(i, 128);
+    sink += radix_format_dec_word(text, &word, 128, i & 1);
+}
+
+// Display composition: the HEX, DEC and BIN rows drawn where render.c puts
+// them, then only what changed sent to the panel. Full frames start from a
+// cleared screen, digits change the value by one from the previous frame.
+
+static const uint8_t row_top[3] = {35, 45, 55};
+
+static u8g2_t u8g2;
+
+static uint8_t u8x8_byte_bench(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr)
+{
+    (void)u8x8;
+    if (msg == U8X8_MSG_BYTE_SEND)
+        oled_spi_write(arg_ptr, arg_int);
+    return 1;
+}
+
+static uint8_t u8x8_gpio_bench(u8x8_t *u8x8, uint8_t msg, uint8_t arg_int, void *arg_ptr)
+{
+    (void)u8x8;
+    (void)msg;
+    (void)arg_int;
+    (void)arg_ptr;
+    return 1;
+}
+
+static void setup_display()
+{
+    static bool done = false;
+    if (done)
+        return;
+    u8g2_Setup_ssd1322_nhd_256x64_f(&u8g2, U8G2_R0, u8x8_byte_bench, u8x8_gpio_bench);
+    u8g2_InitDisplay(&u8g2);
+    u8g2_SetPowerSave(&u8g2, 0);
+    done = true;
+}
+
+/// @brief Text of the three value rows of a 32-bit value.
+static void value_rows(uint32_t value, char rows[3][RADIX_FORMAT_BIN_MAX])
+{
+    radix_format_hex(rows[0], value, 32);
+    radix_format_dec(rows[1], value, 32, false);
+    radix_format_bin(rows[2], value, 32);
+}
+
+static void compose_u8g2(uint32_t value, bool full)
+{
+    char rows[3][RADIX_FORMAT_BIN_MAX];
+    value_rows(value, rows);
+
+    u8g2_SetFont(&u8g2, u8g2_font_profont11_tr);
+    if (full)
+    {
+        u8g2_ClearBuffer(&u8g2);
+        dirty_tiles_mark_all();
+    }
+    for (int r = 0; r < 3; r++)
+    {
+        u8g2_SetDrawColor(&u8g2, 0);
+        u8g2_DrawBox(&u8g2, 25, row_top[r], 256 - 25, 9);
+        u8g2_SetDrawColor(&u8g2, 1);
+        u8g2_DrawStr(&u8g2, 25, row_top[r] + 8, rows[r]);
+        dirty_tiles_mark(25, row_top[r], 6 * strlen(rows[r]), 9);
+    }
+    dirty_tiles_flush(&u8g2);
+}
+
+static void compose_gray4(uint32_t value, bool full)
+{
+    char rows[3][RADIX_FORMAT_BIN_MAX];
+    value_rows(value, rows);
+
+    if (full)
+        gray4_clear();
+    for (int r = 0; r < 3; r++)
+        gray4_text(&gray4_font_small, 25, row_top[r], rows[r], GRAY4_MAX, 0);
+    gray4_flush();
+}
+
+static void run_u8g2_full(uint32_t i)
+{
+    compose_u8g2(i, true);
+}
+
+static void run_u8g2_digit(uint32_t i)
+{
+    compose_u8g2(i, false);
+}
+
+static void run_gray4_full(uint32_t i)
+{
+    compose_gray4(i, true);
+}
+
+static void run_gray4_digit(uint32_t i)
+{
+    compose_gray4(i, false);
+}
+
+static const struct Bench benches[] = {
+    {"keypad.interpret_key_event", NULL, run_interpret, 1000000},
+    {"keypad.drain_1_event", setup_keypad, run_drain_1, 100000},
+    {"keypad.drain_10_events", setup_keypad, run_drain_10, 100000},
+    {"tca8418.init", NULL, run_tca8418_init, 100000},
+    {"tca8418.matrix_8x10", NULL, run_matrix, 100000},
+    {"tca8418.configure", NULL, run_tca8418_configure, 100000},
+    {"bit_leds.set_bitbang", NULL, run_bit_leds_set, 100000},
+    {"bit_leds.set_pio", setup_bit_leds_pio, run_bit_leds_pio_set, 1000000},
+    {"bit_leds.set_pio_twice", setup_bit_leds_pio, run_bit_leds_pio_set_twice, 1000000},
+    {"bit_leds.set_levels_pio", setup_bit_leds_pio, run_bit_leds_pio_levels, 1000000},
+    {"bit_leds.set_brightness_pio", setup_bit_leds_pio, run_bit_leds_pio_brightness, 1000000},
+    {"bit_leds.clock_changed_pio", setup_bit_leds_pio, run_bit_leds_pio_clock, 1000000},
+    {"radix_format.hex_32", NULL, run_hex_32, 1000000},
+    {"radix_format.dec_32", NULL, run_dec_32, 1000000},
+    {"radix_format.bin_32", NULL, run_bin_32, 1000000},
+    {"radix_format.hex_128", NULL, run_hex_128, 1000000},
+    {"radix_format.dec_128", NULL, run_dec_128, 200000},
+    {"display.u8g2_full_frame", setup_display, run_u8g2_full, 2000},
+    {"display.u8g2_value_change", setup_display, run_u8g2_digit, 2000},
+    {"display.gray4_full_frame", setup_display, run_gray4_full, 2000},
+    {"display.gray4_value_change", setup_display, run_gray4_digit, 2000},
+};
+
+static void run(const struct Bench *bench, struct BenchResult *out)
+{
+    uint64_t best = UINT64_MAX;
+
+    if (bench->setup)
+        bench->setup();
+    bench->run(0); // settle caches and any first-call setup
+
+    for (int repeat = 0; repeat < BENCH_REPEATS; repeat++)
+    {
+        memset(&bench_bus, 0, sizeof(bench_bus));
+        uint64_t start = now_ns();
+        for (uint32_t i = 1; i <= bench->ops; i++)
+            bench->run(i);
+        uint64_t ns = now_ns() - start;
+        if (ns < best)
+            best = ns;
+    }
+
+    snprintf(out->name, sizeof(out->name), "%s", bench->name);
+    out->ns = (double)best / bench->ops;
+    out->counters[0] = (double)bench_bus.i2c_transactions / bench->ops;
+    out->counters[1] = (double)bench_bus.i2c_bytes / bench->ops;
+    out->counters[2] = (double)bench_bus.gpio_writes / bench->ops;
+    out->counters[3] = (double)bench_bus.shift_bits / 8 / bench->ops;
+    out->counters[4] = (double)bench_bus.spi_bytes / bench->ops;
+    out->counters[5] = (double)bench_bus.delay_us / bench->ops;
+}
+
+static void print_result(FILE *f, const struct BenchResult *result)
+{
+    fprintf(f, "%s,%.1f", result->name, result->ns);
+    for (int c = 0; c < BENCH_COUNTERS; c++)
+        fprintf(f, ",%.2f", result->counters[c]);
+    fprintf(f, "\n");
+}
+
+/// @brief Read a results file written by -o. Lines that do not parse are skipped.
+static int load(const char *path, struct BenchResult *out, int max)
+{
+    FILE *f = fopen(path, "r");
+    char line[256];
+    int count = 0;
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+    while (count < max && fgets(line, sizeof(line), f))
+    {
+        struct BenchResult *r = &out[count];
+        if (sscanf(line, "%47[^,],%lf,%lf,%lf,%lf,%lf,%lf,%lf", r->name, &r->ns, &r->counters[0], &r->counters[1],
+                   &r->counters[2], &r->counters[3], &r->counters[4], &r->counters[5]) == 2 + BENCH_COUNTERS)
+            count++;
+    }
+    fclose(f);
+    return count;
+}
+
+/// @brief Print the change of every benchmark against the baseline.
+/// @return whether any counter went up
+static bool compare(const struct BenchResult *results, int count, const struct BenchResult *baseline, int baseline_count)
+{
+    static const char *const counter_names[BENCH_COUNTERS] = {
+        "i2c_transactions", "i2c_bytes", "gpio_writes", "shift_bytes", "spi_bytes", "delay_us",
+    };
+    bool worse = false;
+
+    printf("\n%-30s %10s %10s %8s  counters\n", "benchmark", "base ns", "ns", "change");
+    for (int i = 0; i < count; i++)
+    {
+        const struct BenchResult *base = NULL;
+        for (int j = 0; j < baseline_count && !base; j++)
+            if (!strcmp(baseline[j].name, results[i].name))
+                base = &baseline[j];
+        if (!base)
+        {
+            printf("%-30s %10s %10.1f %8s  new\n", results[i].name, "-", results[i].ns, "-");
+            continue;
+        }
+
+        printf("%-30s %10.1f %10.1f %+7.1f%% ", results[i].name, base->ns, results[i].ns,
+               base->ns > 0 ? (results[i].ns / base->ns - 1) * 100 : 0);
+        for (int c = 0; c < BENCH_COUNTERS; c++)
+        {
+            // counters are printed to two places, so anything smaller is the same
+            double diff = results[i].counters[c] - base->counters[c];
+            if (diff > 0.005 || diff < -0.005)
+            {
+                printf(" %s %.2f -> %.2f", counter_names[c], base->counters[c], results[i].counters[c]);
+                worse |= diff > 0;
+            }
+        }
+        printf("\n");
+    }
+    return worse;
+}
+
+int main(int argc, char **argv)
+{
+    static struct BenchResult results[BENCH_MAX];
+    static struct BenchResult baseline[BENCH_MAX];
+    const char *out_path = NULL;
+    const char *baseline_path = NULL;
+    const int count = sizeof(benches) / sizeof(benches[0]);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            out_path = argv[++i];
+        else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+            baseline_path = argv[++i];
+        else
+        {
+            fprintf(stderr, "usage: %s [-o FILE] [-c BASELINE]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("%s\n", BENCH_COLUMNS);
+    for (int i = 0; i < count; i++)
+    {
+        run(&benches[i], &results[i]);
+        print_result(stdout, &results[i]);
+    }
+
+    if (out_path)
+    {
+        FILE *f = fopen(out_path, "w");
+        if (!f)
+        {
+            perror(out_path);
+            return 2;
+        }
+        fprintf(f, "%s\n", BENCH_COLUMNS);
+        for (int i = 0; i < count; i++)
+            print_result(f, &results[i]);
+        fclose(f);
+    }
+
+    if (baseline_path)
+    {
+        int baseline_count = load(baseline_path, baseline, BENCH_MAX);
+        if (baseline_count < 0)
+            return 2;
+        if (compare(results, count, baseline, baseline_count))
+        {
+            printf("counters went up against %s\n", baseline_path);
+            return 1;
+        }
+    }
+    return 0;
+}
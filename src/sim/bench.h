@@ -0,0 +1,32 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Counters kept by the instrumented SDK fakes in bench_fakes.c. Unlike the
+// simulator's board models they do nothing but count and answer, so a
+// benchmark times the firmware code and not the model.
+struct BenchBus
+{
+    uint64_t i2c_transactions; // START to STOP, a repeated start continues the transaction
+    uint64_t i2c_bytes;        // data bytes either way, without the address byte
+    uint64_t gpio_writes;      // gpio_put calls
+    uint64_t shift_bits;       // rising edges on LED_SRCLK, or 32 per LED word fed to the PIO
+    uint64_t spi_bytes;        // bytes queued for the display, commands and pixels
+    uint64_t delay_us;         // asked for by sleep_us and busy_wait_us, not spent
+};
+
+extern struct BenchBus bench_bus;
+
+void bench_tca8418_queue(const uint8_t *events, uint8_t count);
+void bench_dma_loop_pass();
+
+// The PIO build of bit_leds.c, from bench_bit_leds_pio.c
+void bit_leds_pio_init();
+void bit_leds_pio_set(uint32_t value);
+void bit_leds_pio_set_brightness(uint8_t brightness);
+void bit_leds_pio_set_levels(const uint8_t *levels);
+void bit_leds_pio_clock_changed();
+
+#endif
@@ -0,0 +1,15 @@
+// bit_leds.c built a second time as the firmware ships it, with the PIO and
+// DMA refresh loop, next to the bit-banged build the other benchmarks use.
+// Its functions are renamed so the two can be linked together, see bench.h.
+
+#define BIT_LEDS_PIO 1
+#define bit_leds_init bit_leds_pio_init
+#define bit_leds_enable bit_leds_pio_enable
+#define bit_leds_clear bit_leds_pio_clear
+#define bit_leds_latch bit_leds_pio_latch
+#define bit_leds_set bit_leds_pio_set
+#define bit_leds_set_brightness bit_leds_pio_set_brightness
+#define bit_leds_set_levels bit_leds_pio_set_levels
+#define bit_leds_clock_changed bit_leds_pio_clock_changed
+
+#include "bit_leds.c"
@@ -0,0 +1,480 @@
+#include <string.h>
+#include "bench.h"
+#include "peripherals.h"
+#include "tca8418.h"
+#include "oled_spi.h"
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "hardware/pio.h"
+#include "hardware/structs/systick.h"
+
+// Instrumented stand-ins for the SDK calls of the modules under benchmark.
+// Every call is counted in bench_bus and returns at once: delays are added
+// up instead of waited for, the TCA8418 is a register file with an event
+// FIFO the benchmark fills, and the PIO only has TX FIFOs for the bit LED
+// refresh loop to write. Nothing here is timed against the real
+// bus, see the simulator for that.
+
+#define BENCH_TCA8418_FIFO 10
+
+struct BenchBus bench_bus;
+i2c_inst_t sim_i2c[2];
+systick_hw_t sim_systick; // stands still, handler times are not measured here
+dma_hw_t sim_dma_hw;
+pio_hw_t sim_pio[2];
+
+static uint8_t tca_regs[TCA8418_REG_COUNT];
+static uint8_t tca_pointer;
+static uint8_t tca_fifo[BENCH_TCA8418_FIFO];
+static uint8_t tca_count;
+static bool gpio_levels[NUM_BANK0_GPIOS];
+
+/// @brief Put key events in the fake TCA8418's FIFO, as if they had been scanned. Raises K_INT.
+void bench_tca8418_queue(const uint8_t *events, uint8_t count)
+{
+    for (uint8_t i = 0; i < count && tca_count < BENCH_TCA8418_FIFO; i++)
+        tca_fifo[tca_count++] = events[i];
+    if (tca_count)
+        tca_regs[TCA8418_REG_INT_STAT] |= TCA8418_REG_STAT_K_INT;
+}
+
+static uint8_t tca_read()
+{
+    uint8_t reg = tca_pointer;
+    if (tca_regs[TCA8418_REG_CFG] & TCA8418_REG_CFG_AI)
+        tca_pointer++;
+    if (reg == TCA8418_REG_KEY_EVENT_A)
+    {
+        // every byte read here pops an event
+        if (tca_count == 0)
+            return 0;
+        uint8_t event = tca_fifo[0];
+        memmove(tca_fifo, tca_fifo + 1, --tca_count);
+        return event;
+    }
+    if (reg == TCA8418_REG_KEY_LCK_EC)
+        return (tca_regs[reg] & 0xF0) | tca_count;
+    return reg < sizeof(tca_regs) ? tca_regs[reg] : 0;
+}
+
+static void tca_write(uint8_t value)
+{
+    uint8_t reg = tca_pointer;
+    if (tca_regs[TCA8418_REG_CFG] & TCA8418_REG_CFG_AI)
+        tca_pointer++;
+    if (reg == TCA8418_REG_INT_STAT)
+        tca_regs[reg] &= ~value; // write 1 to clear
+    else if (reg < sizeof(tca_regs))
+        tca_regs[reg] = value;
+}
+
+// I2C, the TCA8418 is the only device
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate)
+{
+    i2c->baudrate = baudrate;
+    return baudrate;
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop)
+{
+    (void)i2c;
+    (void)addr;
+    bench_bus.i2c_bytes += len;
+    bench_bus.i2c_transactions += !nostop;
+    if (len)
+        tca_pointer = src[0];
+    for (size_t i = 1; i < len; i++)
+        tca_write(src[i]);
+    return len;
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop)
+{
+    (void)i2c;
+    (void)addr;
+    bench_bus.i2c_bytes += len;
+    bench_bus.i2c_transactions += !nostop;
+    for (size_t i = 0; i < len; i++)
+        dst[i] = tca_read();
+    return len;
+}
+
+// DMA and interrupts, for the command and receive channels of i2c_async.
+// Command words written to IC_DATA_CMD run on the fake TCA8418 at once, the
+// receive channel collects what they read, and its DMA_IRQ_1 handler is
+// called before dma_start_channel_mask() returns.
+
+struct BenchDmaChannel
+{
+    dma_channel_config config;
+    volatile void *write_addr;
+    const volatile void *read_addr;
+    uint32_t trans_count;
+    bool claimed;
+    bool irq1_enabled;
+};
+
+static struct BenchDmaChannel dma_channels[NUM_DMA_CHANNELS];
+static uint32_t dma_ints1;
+static irq_handler_t dma_irq1_handler;
+static uint8_t i2c_rx[16];
+static uint8_t i2c_rx_count;
+static bool i2c_active;  // a START has gone out and no STOP since
+static bool i2c_reading; // direction of the current transaction
+static bool i2c_address; // the next byte written is the register address
+
+static void i2c_command(uint16_t command)
+{
+    bool read = command & I2C_IC_DATA_CMD_CMD_BITS;
+    if (!i2c_active || read != i2c_reading || (command & I2C_IC_DATA_CMD_RESTART_BITS))
+    {
+        i2c_active = true;
+        i2c_reading = read;
+        i2c_address = !read;
+    }
+
+    bench_bus.i2c_bytes++;
+    if (read && i2c_rx_count < sizeof(i2c_rx))
+        i2c_rx[i2c_rx_count++] = tca_read();
+    else if (i2c_address)
+        tca_pointer = (uint8_t)command;
+    else
+        tca_write((uint8_t)command);
+    i2c_address = false;
+
+    if (command & I2C_IC_DATA_CMD_STOP_BITS)
+    {
+        bench_bus.i2c_transactions++;
+        i2c_active = false;
+    }
+}
+
+int dma_claim_unused_channel(bool required)
+{
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; channel++)
+    {
+        if (!dma_channels[channel].claimed)
+        {
+            dma_channels[channel].claimed = true;
+            return channel;
+        }
+    }
+    (void)required;
+    return -1;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    return (dma_channel_config){
+        .size = DMA_SIZE_32,
+        .read_increment = true,
+        .write_increment = false,
+        .dreq = DREQ_FORCE,
+        .chain_to = channel,
+        .enable = true,
+    };
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger)
+{
+    (void)trigger;
+    dma_channels[channel].config = *config;
+    dma_channels[channel].write_addr = write_addr;
+    dma_channels[channel].read_addr = read_addr;
+    dma_channels[channel].trans_count = transfer_count;
+    dma_hw->ch[channel].read_addr = (uintptr_t)read_addr;
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger)
+{
+    (void)trigger;
+    dma_channels[channel].read_addr = read_addr;
+    dma_hw->ch[channel].read_addr = (uintptr_t)read_addr;
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger)
+{
+    (void)trigger;
+    dma_channels[channel].write_addr = write_addr;
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger)
+{
+    (void)trigger;
+    dma_channels[channel].trans_count = trans_count;
+}
+
+void dma_start_channel_mask(uint32_t chan_mask)
+{
+    volatile void *data_cmd = &i2c_get_hw(TCA8418_I2C_PORT)->data_cmd;
+
+    // commands first, whatever the channel order, then the bytes they read
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; channel++)
+    {
+        struct BenchDmaChannel *ch = &dma_channels[channel];
+        if ((chan_mask & (1u << channel)) && ch->write_addr == data_cmd)
+        {
+            const uint16_t *commands = (const uint16_t *)ch->read_addr;
+            for (uint32_t i = 0; i < ch->trans_count; i++)
+                i2c_command(commands[i]);
+        }
+    }
+
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; channel++)
+    {
+        struct BenchDmaChannel *ch = &dma_channels[channel];
+        if (!(chan_mask & (1u << channel)) || ch->read_addr != data_cmd)
+            continue;
+
+        uint8_t *write = (uint8_t *)ch->write_addr;
+        for (uint32_t i = 0; i < ch->trans_count && i < i2c_rx_count; i++)
+            write[i] = i2c_rx[i];
+        i2c_rx_count = 0;
+        if (ch->irq1_enabled && dma_irq1_handler)
+        {
+            dma_ints1 |= 1u << channel;
+            dma_irq1_handler(); // may start the next transfer
+        }
+    }
+}
+
+/// @brief One pass of the bit LED refresh loop, the only one that runs by itself. The control channel
+/// writes the data channel's al3_read_addr_trig, and the data channel feeds a plane table to the TX
+/// FIFO. The table holds (LED word, on time) pairs, and each LED word is 32 bits into the shift registers.
+void bench_dma_loop_pass()
+{
+    for (uint ctrl = 0; ctrl < NUM_DMA_CHANNELS; ctrl++)
+    {
+        for (uint data = 0; data < NUM_DMA_CHANNELS; data++)
+        {
+            if (!dma_channels[ctrl].claimed || dma_channels[ctrl].write_addr != &dma_hw->ch[data].al3_read_addr_trig)
+                continue;
+
+            const uint32_t *words = *(const uint32_t *const *)dma_channels[ctrl].read_addr;
+            volatile uint32_t *fifo = dma_channels[data].write_addr;
+            dma_hw->ch[data].read_addr = (uintptr_t)words;
+            for (uint32_t i = 0; i < dma_channels[data].trans_count; i++)
+            {
+                *fifo = words[i];
+                dma_hw->ch[data].read_addr += sizeof(words[i]);
+                if (i % 2 == 0)
+                    bench_bus.shift_bits += 32;
+            }
+        }
+    }
+}
+
+void dma_channel_abort(uint channel)
+{
+    (void)channel;
+}
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled)
+{
+    dma_channels[channel].irq1_enabled = enabled;
+}
+
+bool dma_channel_get_irq1_status(uint channel)
+{
+    return dma_ints1 & (1u << channel);
+}
+
+void dma_channel_acknowledge_irq1(uint channel)
+{
+    dma_ints1 &= ~(1u << channel);
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority)
+{
+    (void)order_priority;
+    if (num == DMA_IRQ_1)
+        dma_irq1_handler = handler;
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    (void)num;
+    (void)handler; // no aborts, the fake TCA8418 always answers
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    (void)num;
+    (void)enabled;
+}
+
+void tight_loop_contents()
+{
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index)
+{
+    (void)clk_index;
+    return 125000000;
+}
+
+// PIO, the state machine is never run
+
+uint pio_add_program(PIO pio, const pio_program_t *program)
+{
+    (void)pio;
+    (void)program;
+    return 0;
+}
+
+uint pio_claim_unused_sm(PIO pio, bool required)
+{
+    (void)pio;
+    (void)required;
+    return 0;
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled)
+{
+    (void)pio;
+    (void)sm;
+    (void)enabled;
+}
+
+void pio_sm_exec(PIO pio, uint sm, uint instr)
+{
+    (void)pio;
+    (void)sm;
+    (void)instr;
+}
+
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div)
+{
+    (void)pio;
+    (void)sm;
+    (void)div;
+}
+
+// GPIO, TCA8418_INT follows the fake's K_INT
+
+void gpio_init(uint gpio)
+{
+    gpio_levels[gpio] = false;
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn)
+{
+    (void)gpio;
+    (void)fn;
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    (void)gpio;
+    (void)out;
+}
+
+void gpio_set_pulls(uint gpio, bool up, bool down)
+{
+    (void)gpio;
+    (void)up;
+    (void)down;
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    bench_bus.gpio_writes++;
+    if (gpio == LED_SRCLK && value && !gpio_levels[gpio])
+        bench_bus.shift_bits++;
+    gpio_levels[gpio] = value;
+}
+
+bool gpio_get(uint gpio)
+{
+    if (gpio == TCA8418_INT)
+        return !(tca_regs[TCA8418_REG_INT_STAT] & TCA8418_REG_STAT_K_INT); // active low
+    return gpio_levels[gpio];
+}
+
+// time, delays are only counted
+
+void sleep_us(uint64_t us)
+{
+    bench_bus.delay_us += us;
+}
+
+void busy_wait_us(uint64_t us)
+{
+    bench_bus.delay_us += us;
+}
+
+void busy_wait_us_32(uint32_t us)
+{
+    bench_bus.delay_us += us;
+}
+
+uint64_t time_us_64()
+{
+    return 0;
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    (void)us, (void)callback, (void)user_data, (void)fire_if_past;
+    return 1; // time stands still, so it never fires
+}
+
+uint32_t save_and_disable_interrupts()
+{
+    return 0;
+}
+
+void restore_interrupts(uint32_t status)
+{
+    (void)status;
+}
+
+// display transport, bytes are counted and dropped
+
+static uint32_t spi_total;
+
+void oled_spi_init()
+{
+}
+
+void oled_spi_set_dc(bool dc)
+{
+    (void)dc;
+}
+
+void oled_spi_write(const uint8_t *data, size_t len)
+{
+    (void)data;
+    spi_total += len;
+    bench_bus.spi_bytes += len;
+}
+
+void oled_spi_end_transfer()
+{
+}
+
+bool oled_spi_busy()
+{
+    return false;
+}
+
+void oled_spi_wait()
+{
+}
+
+void oled_spi_set_callback(oled_spi_callback_t callback)
+{
+    (void)callback;
+}
+
+uint32_t oled_spi_bytes_total()
+{
+    return spi_total;
+}
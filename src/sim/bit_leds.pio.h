@@ -0,0 +1,20 @@
+#ifndef SIM_BIT_LEDS_PIO_H
+#define SIM_BIT_LEDS_PIO_H
+
+#include "hardware/pio.h"
+
+// Stand-in for the header pioasm generates from bit_leds/bit_leds.pio, for
+// the benchmarks of the PIO build of bit_leds.c. The program is never run,
+// the fake DMA loop counts the words it would be fed instead.
+
+static const pio_program_t bit_leds_program = {.instructions = NULL, .length = 10, .origin = -1};
+
+static inline void bit_leds_program_init(PIO pio, uint sm, uint offset, uint ser_pin, uint srclk_pin, uint rclk_pin,
+                                         float clkdiv)
+{
+    (void)offset, (void)ser_pin, (void)srclk_pin, (void)rclk_pin;
+    pio_sm_set_clkdiv(pio, sm, clkdiv);
+    pio_sm_set_enabled(pio, sm, true);
+}
+
+#endif
@@ -0,0 +1,527 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "calc.h"
+
+// Stress test for the incremental evaluator. Feeds it random key sequences
+// and checks the live result and the entry line after every key against a
+// reference that re-parses the whole expression so far. Then times one very
+// long expression per key, to show the cost does not grow with its length.
+//
+// Each verified expression runs at a random word size and signedness, with
+// unsigned __int128 as the reference for every size.
+//
+//   calc-stress [SEED] [KEYS]
+
+#define STRESS_EXPRESSIONS 20000  // verified expressions
+#define STRESS_KEYS 200000        // keys in the timed expression, by default
+#define STRESS_MAX_TOKENS 512     // per verified expression
+#define STRESS_MAX_PARENS 4
+#define STRESS_ENTRY_CHARS 21     // as on the panel
+
+enum TokenKind
+{
+    TOKEN_NUMBER,
+    TOKEN_OP,
+    TOKEN_OPEN,
+    TOKEN_CLOSE,
+};
+
+typedef unsigned __int128 u128;
+
+struct Token
+{
+    uint8_t kind;
+    u128 value; // number, or CalcOp
+};
+
+// What the generator expects next, mirroring the evaluator
+enum GenState
+{
+    GEN_RESULT,  // after = or a reset, tokens hold the result
+    GEN_NUMBER,  // typing the last token
+    GEN_OPERAND, // after an operator or (
+    GEN_CLOSED,  // after )
+};
+
+static struct Token tokens[STRESS_MAX_TOKENS];
+static int token_count;
+static int gen_state;
+static int open_parens;
+static uint8_t radix;
+static uint8_t bits;
+static bool is_signed;
+static u128 mask; // of the word size
+static uint64_t rng_state;
+static bool timing; // one endless expression, no = and no reference
+
+static const char *const op_symbol[CALC_OP_COUNT] = {
+    [CALC_ADD] = "+", [CALC_SUB] = "-", [CALC_MUL] = "*", [CALC_DIV] = "/", [CALC_MOD] = "%",
+    [CALC_AND] = "&", [CALC_NAND] = "~&", [CALC_OR] = "|", [CALC_NOR] = "~|", [CALC_XOR] = "^",
+    [CALC_SHL] = "<<", [CALC_SHR] = ">>", [CALC_ROL] = "<<<", [CALC_ROR] = ">>>",
+};
+
+static uint32_t rng()
+{
+    rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return rng_state >> 33;
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void set_word(uint8_t word_bits, bool word_signed)
+{
+    bits = word_bits;
+    is_signed = word_signed;
+    mask = bits == 128 ? ~(u128)0 : ((u128)1 << bits) - 1;
+}
+
+static bool negative(u128 value)
+{
+    return (value >> (bits - 1)) & 1;
+}
+
+static u128 to_u128(const struct Word *word)
+{
+    u128 value = 0;
+    for (int i = WORD_LIMBS - 1; i >= 0; i--)
+        value = value << 32 | word->limb[i];
+    return value;
+}
+
+static void print_u128(const char *prefix, u128 value)
+{
+    printf("%s%016llX%016llX", prefix, (unsigned long long)(value >> 64), (unsigned long long)value);
+}
+
+// Reference: recursive descent over the token list, C precedence
+
+static int parse_pos;
+static int parse_end;
+static bool parse_error;
+
+static u128 parse_level(int level);
+
+static u128 parse_primary()
+{
+    if (parse_pos < parse_end && tokens[parse_pos].kind == TOKEN_OPEN)
+    {
+        parse_pos++;
+        u128 value = parse_level(0);
+        if (parse_pos < parse_end && tokens[parse_pos].kind == TOKEN_CLOSE)
+            parse_pos++; // unclosed groups end with the expression
+        return value;
+    }
+    return tokens[parse_pos++].value;
+}
+
+static int op_level(uint8_t op)
+{
+    switch (op)
+    {
+    case CALC_OR:
+    case CALC_NOR:
+        return 0;
+    case CALC_XOR:
+        return 1;
+    case CALC_AND:
+    case CALC_NAND:
+        return 2;
+    case CALC_SHL:
+    case CALC_SHR:
+    case CALC_ROL:
+    case CALC_ROR:
+        return 3;
+    case CALC_ADD:
+    case CALC_SUB:
+        return 4;
+    default:
+        return 5;
+    }
+}
+
+/// @brief a / b or a % b in the word, truncated towards zero when signed. b is not zero.
+static u128 divide(u128 a, u128 b, bool remainder)
+{
+    if (!is_signed)
+        return remainder ? a % b : a / b;
+
+    bool neg_a = negative(a), neg_b = negative(b);
+    u128 x = neg_a ? -a & mask : a;
+    u128 y = neg_b ? -b & mask : b;
+    if (remainder)
+        return neg_a ? -(x % y) : x % y;
+    return neg_a != neg_b ? -(x / y) : x / y; // MIN / -1 wraps to MIN
+}
+
+static u128 parse_level(int level)
+{
+    if (level == 6)
+        return parse_primary();
+
+    u128 a = parse_level(level + 1);
+    while (parse_pos < parse_end && tokens[parse_pos].kind == TOKEN_OP && op_level(tokens[parse_pos].value) == level)
+    {
+        uint8_t op = tokens[parse_pos++].value;
+        u128 b = parse_level(level + 1);
+        uint32_t r = (uint32_t)b % bits; // rotates take the low limb modulo the size
+        u128 fill = is_signed && negative(a) ? mask : 0;
+        switch (op)
+        {
+        case CALC_ADD: a = a + b; break;
+        case CALC_SUB: a = a - b; break;
+        case CALC_MUL: a = a * b; break;
+        case CALC_DIV: parse_error |= b == 0; a = b ? divide(a, b, false) : 0; break;
+        case CALC_MOD: parse_error |= b == 0; a = b ? divide(a, b, true) : 0; break;
+        case CALC_AND: a = a & b; break;
+        case CALC_NAND: a = ~(a & b); break;
+        case CALC_OR: a = a | b; break;
+        case CALC_NOR: a = ~(a | b); break;
+        case CALC_XOR: a = a ^ b; break;
+        case CALC_SHL: a = b >= bits ? 0 : a << b; break;
+        case CALC_SHR: a = b >= bits ? fill : a >> b | (b ? fill << (bits - b) : 0); break;
+        case CALC_ROL: a = r ? (a << r) | (a >> (bits - r)) : a; break;
+        case CALC_ROR: a = r ? (a >> r) | (a << (bits - r)) : a; break;
+        }
+        a &= mask;
+    }
+    return a;
+}
+
+/// @brief Value of the tokens so far, leaving out a trailing operator or (. 0 on division by zero.
+static u128 reference_eval()
+{
+    parse_end = token_count;
+    while (parse_end > 0 && (tokens[parse_end - 1].kind == TOKEN_OP || tokens[parse_end - 1].kind == TOKEN_OPEN))
+        parse_end--;
+    if (parse_end == 0)
+        return 0;
+
+    parse_pos = 0;
+    parse_error = false;
+    u128 value = parse_level(0);
+    return parse_error ? 0 : value;
+}
+
+static int format_number(char *out, u128 value)
+{
+    char digits[130];
+    int len = 0;
+    int sign = 0;
+    if (radix == 10 && is_signed && negative(value))
+    {
+        out[sign++] = '-';
+        value = -value & mask;
+    }
+    do
+    {
+        digits[len++] = "0123456789ABCDEF"[value % radix];
+        value /= radix;
+    } while (value);
+    for (int i = 0; i < len; i++)
+        out[sign + i] = digits[len - 1 - i];
+    out[sign + len] = '\0';
+    return sign + len;
+}
+
+/// @brief The end of the whole entry as text, as much as the panel shows.
+static void reference_entry(char *out)
+{
+    static char line[STRESS_MAX_TOKENS * 130];
+    char *p = line;
+    for (int i = 0; i < token_count; i++)
+    {
+        if (tokens[i].kind == TOKEN_NUMBER)
+            p += format_number(p, tokens[i].value);
+        else if (tokens[i].kind == TOKEN_OP)
+            p += sprintf(p, "%s", op_symbol[tokens[i].value]);
+        else
+            *p++ = tokens[i].kind == TOKEN_OPEN ? '(' : ')';
+    }
+    *p = '\0';
+    size_t len = p - line;
+    strcpy(out, line + (len > STRESS_ENTRY_CHARS ? len - STRESS_ENTRY_CHARS : 0));
+}
+
+static void gen_reset()
+{
+    token_count = 1;
+    tokens[0] = (struct Token){TOKEN_NUMBER, 0};
+    gen_state = GEN_RESULT;
+    open_parens = 0;
+}
+
+static struct Token *last_number()
+{
+    return &tokens[token_count - 1];
+}
+
+/// @brief Pick a key the evaluator accepts in its current state, update the mirrored tokens and send it.
+/// @param room whether the expression may still grow
+static void gen_key(bool room)
+{
+    uint32_t roll = rng() % 100;
+    struct Token *number;
+
+    // a number is entered by digits, or by a unary key on an empty operand
+    if (gen_state == GEN_OPERAND || (gen_state == GEN_RESULT && roll < 40))
+    {
+        if (gen_state == GEN_OPERAND && roll < 15 && open_parens < STRESS_MAX_PARENS && room)
+        {
+            tokens[token_count++] = (struct Token){TOKEN_OPEN, 0};
+            open_parens++;
+            calc_open();
+            return;
+        }
+        bool unary = gen_state == GEN_OPERAND && roll % 8 == 0; // after = it would act on the result
+        if (gen_state == GEN_RESULT)
+            token_count = 0; // a digit starts over
+        tokens[token_count++] = (struct Token){TOKEN_NUMBER, 0};
+        gen_state = GEN_NUMBER;
+        if (unary)
+        {
+            last_number()->value = mask;
+            calc_not();
+            return;
+        }
+        uint8_t digit = 1 + rng() % (radix - 1);
+        last_number()->value = digit;
+        calc_digit(digit);
+        return;
+    }
+
+    if (gen_state == GEN_NUMBER && roll < 45)
+    {
+        number = last_number();
+        uint32_t choice = rng() % 16;
+        // signed decimals are typed and erased as magnitudes
+        bool minus = radix == 10 && is_signed && negative(number->value);
+        u128 magnitude = minus ? -number->value & mask : number->value;
+        if (choice < 10)
+        {
+            uint8_t digit = rng() % radix;
+            calc_digit(digit);
+            if (magnitude > (mask - digit) / radix)
+                return; // ignored by the evaluator too
+            magnitude = magnitude * radix + digit;
+            if (radix == 10 && is_signed && negative(magnitude))
+                return;
+            number->value = minus ? -magnitude & mask : magnitude;
+        }
+        else if (choice == 10)
+        {
+            number->value = ~number->value & mask;
+            calc_not();
+        }
+        else if (choice == 11)
+        {
+            number->value = -number->value & mask;
+            calc_negate();
+        }
+        else if (choice < 14)
+        {
+            uint8_t bit = rng() % bits;
+            number->value ^= (u128)1 << bit;
+            calc_toggle_bit(bit);
+        }
+        else if (choice == 14)
+        {
+            magnitude /= radix;
+            number->value = minus ? -magnitude & mask : magnitude;
+            calc_backspace();
+        }
+        else
+        {
+            radix = radix == 16 ? 10 : radix == 10 ? 2 : 16;
+            calc_set_radix(radix);
+        }
+        return;
+    }
+
+    // GEN_RESULT, GEN_NUMBER or GEN_CLOSED: something completes an operand
+    if (roll < 52 && open_parens > 0)
+    {
+        tokens[token_count++] = (struct Token){TOKEN_CLOSE, 0};
+        open_parens--;
+        gen_state = GEN_CLOSED;
+        calc_close();
+        return;
+    }
+    if (!timing && (roll < 56 || !room))
+    {
+        static const uint8_t widths[] = {8, 16, 32, 64, 128};
+        uint8_t next = roll % 8 == 0 ? widths[rng() % 5] : bits;
+        u128 value = reference_eval();
+        gen_reset();
+        if (next != bits)
+        {
+            // a new word size evaluates first, then the result is truncated or extended
+            if (next > bits && is_signed && negative(value))
+                value |= ~mask;
+            set_word(next, is_signed);
+            tokens[0].value = value & mask;
+            calc_set_word(bits, is_signed);
+            return;
+        }
+        tokens[0].value = value;
+        calc_equals();
+        return;
+    }
+
+    enum CalcOp op = rng() % CALC_OP_COUNT;
+    tokens[token_count++] = (struct Token){TOKEN_OP, op};
+    gen_state = GEN_OPERAND;
+    calc_operator(op);
+    if (rng() % 20 == 0)
+    {
+        // change of mind, the next operator replaces it
+        op = rng() % CALC_OP_COUNT;
+        tokens[token_count - 1].value = op;
+        calc_operator(op);
+    }
+}
+
+static bool verify(uint32_t seed)
+{
+    char expect[STRESS_ENTRY_CHARS + 1];
+    char entry[STRESS_ENTRY_CHARS + 1];
+    uint64_t keys = 0;
+
+    static const uint8_t widths[] = {8, 16, 32, 64, 128};
+
+    rng_state = seed;
+    for (int n = 0; n < STRESS_EXPRESSIONS; n++)
+    {
+        calc_reset();
+        radix = 16;
+        calc_set_radix(radix);
+        set_word(widths[rng() % 5], rng() % 2);
+        calc_set_word(bits, is_signed);
+        gen_reset();
+
+        int length = 8 + rng() % 200;
+        for (int k = 0; k < length * 2; k++)
+        {
+            bool room = token_count < length;
+            gen_key(room);
+            keys++;
+
+            if (calc_error())
+            {
+                if (reference_eval() != 0)
+                {
+                    printf("expression %d key %d: evaluator in error,", n, k);
+                    print_u128(" reference ", reference_eval());
+                    printf("\n");
+                    return false;
+                }
+                break;
+            }
+
+            u128 expected = reference_eval();
+            struct Word result = calc_result();
+            uint8_t flags = (expected == 0 ? WORD_ZERO : 0) | (negative(expected) ? WORD_SIGN : 0);
+            if (to_u128(&result) != expected || calc_bits() != bits ||
+                (calc_flags() & (WORD_ZERO | WORD_SIGN)) != flags)
+            {
+                printf("expression %d key %d, %s %u bits:", n, k, is_signed ? "signed" : "unsigned", bits);
+                print_u128(" result ", to_u128(&result));
+                print_u128(", expected ", expected);
+                printf(", flags %02X\n", calc_flags());
+                return false;
+            }
+            calc_entry(entry, STRESS_ENTRY_CHARS);
+            reference_entry(expect);
+            if (strcmp(entry, expect))
+            {
+                printf("expression %d key %d: entry \"%s\", expected \"%s\"\n", n, k, entry, expect);
+                return false;
+            }
+            if (!room && gen_state == GEN_RESULT)
+                break;
+        }
+    }
+    printf("verified %llu keys in %d expressions\n", (unsigned long long)keys, STRESS_EXPRESSIONS);
+    return true;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/// @brief One expression of count keys, no = until the end. Times each key with the entry line redraw.
+static void timed(uint32_t seed, uint32_t count)
+{
+    uint32_t *ns = malloc(count * sizeof(*ns));
+    char entry[STRESS_ENTRY_CHARS + 1];
+    uint32_t sink = 0;
+
+    rng_state = seed;
+    timing = true;
+    calc_reset();
+    radix = 16;
+    calc_set_radix(radix);
+    set_word(32, false);
+    calc_set_word(bits, is_signed);
+    gen_reset();
+
+    // only the last few tokens are mirrored, the reference is not run here
+    for (uint32_t k = 0; k < count; k++)
+    {
+        if (token_count > STRESS_MAX_TOKENS - 8)
+        {
+            memmove(tokens, tokens + token_count - 8, 8 * sizeof(*tokens));
+            token_count = 8;
+        }
+
+        uint64_t start = now_ns();
+        gen_key(true);
+        if (calc_error())
+        {
+            calc_reset();
+            gen_reset();
+        }
+        sink += calc_result().limb[0];
+        calc_entry(entry, STRESS_ENTRY_CHARS);
+        ns[k] = now_ns() - start;
+        sink += entry[0];
+    }
+
+    uint32_t tenth = count / 10;
+    uint64_t first = 0, last = 0, total = 0;
+    for (uint32_t k = 0; k < count; k++)
+    {
+        total += ns[k];
+        if (k < tenth)
+            first += ns[k];
+        if (k >= count - tenth)
+            last += ns[k];
+    }
+    qsort(ns, count, sizeof(*ns), compare_u32);
+
+    printf("timed %u keys in one 32-bit expression (includes the generator and two clock reads)\n", count);
+    printf("ns per key: mean %.0f, p50 %u, p99 %u, max %u\n",
+           (double)total / count, ns[count / 2], ns[count - count / 100 - 1], ns[count - 1]);
+    printf("mean of the first tenth %.0f ns, of the last tenth %.0f ns (sink %u)\n",
+           (double)first / tenth, (double)last / tenth, sink & 1);
+    free(ns);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t seed = argc > 1 ? strtoul(argv[1], NULL, 0) : 1;
+    uint32_t keys = argc > 2 ? strtoul(argv[2], NULL, 0) : STRESS_KEYS;
+
+    if (!verify(seed))
+        return 1;
+    timed(seed, keys < 10 ? 10 : keys);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef SIM_HARDWARE_ADC_H
+#define SIM_HARDWARE_ADC_H
+
+#include "pico/types.h"
+
+#define DREQ_ADC 36
+
+typedef struct
+{
+    volatile uint32_t fifo; // DMA reads conversions from here, see sim_adc.c
+} adc_hw_t;
+
+extern adc_hw_t sim_adc_hw;
+
+#define adc_hw (&sim_adc_hw)
+
+void adc_init(void);
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+void adc_set_clkdiv(float clkdiv);
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+void adc_run(bool run);
+void adc_fifo_drain(void);
+uint16_t adc_read(void);
+
+#endif
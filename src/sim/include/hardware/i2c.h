@@ -0,0 +1,69 @@
+#ifndef SIM_HARDWARE_I2C_H
+#define SIM_HARDWARE_I2C_H
+
+#include "pico/types.h"
+
+typedef struct
+{
+    volatile uint32_t enable;
+    volatile uint32_t tar;
+    volatile uint32_t data_cmd; // DMA addresses this, the simulator runs the command words written here on the bus
+    volatile uint32_t intr_stat;
+    volatile uint32_t intr_mask;
+    volatile uint32_t clr_tx_abrt;
+    volatile uint32_t rxflr;
+    volatile uint32_t tx_abrt_source;
+    volatile uint32_t dma_cr;
+    volatile uint32_t dma_tdlr;
+    volatile uint32_t dma_rdlr;
+} i2c_hw_t;
+
+typedef struct
+{
+    i2c_hw_t hw;
+    uint baudrate;
+    uint32_t clk_hz; // clk_sys when the divider was set
+} i2c_inst_t;
+
+// Register fields, as on the RP2040
+#define I2C_IC_DATA_CMD_CMD_BITS 0x00000100u     // read
+#define I2C_IC_DATA_CMD_STOP_BITS 0x00000200u    // STOP after this byte
+#define I2C_IC_DATA_CMD_RESTART_BITS 0x00000400u // RESTART before this byte
+#define I2C_IC_INTR_STAT_R_TX_ABRT_BITS 0x00000040u
+#define I2C_IC_INTR_MASK_M_TX_ABRT_BITS 0x00000040u
+#define I2C_IC_DMA_CR_TDMAE_BITS 0x00000002u
+#define I2C_IC_DMA_CR_RDMAE_BITS 0x00000001u
+
+// DREQ numbers, as on the RP2040
+#define DREQ_I2C0_TX 32
+#define DREQ_I2C0_RX 33
+#define DREQ_I2C1_TX 34
+#define DREQ_I2C1_RX 35
+
+extern i2c_inst_t sim_i2c[2];
+
+#define i2c0 (&sim_i2c[0])
+#define i2c1 (&sim_i2c[1])
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+void i2c_deinit(i2c_inst_t *i2c);
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate);
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop);
+
+static inline uint i2c_get_index(i2c_inst_t *i2c)
+{
+    return i2c == i2c1 ? 1 : 0;
+}
+
+static inline i2c_hw_t *i2c_get_hw(i2c_inst_t *i2c)
+{
+    return &i2c->hw;
+}
+
+static inline uint i2c_get_dreq(i2c_inst_t *i2c, bool is_tx)
+{
+    return DREQ_I2C0_TX + 2 * i2c_get_index(i2c) + (is_tx ? 0 : 1);
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef SIM_HARDWARE_PIO_H
+#define SIM_HARDWARE_PIO_H
+
+#include "pico/types.h"
+
+// The PIO calls of the bit LED refresh loop. The simulator has no PIO model
+// and bit-bangs the LEDs, only the benchmarks fake these, see bench_fakes.c.
+
+typedef struct
+{
+    volatile uint32_t txf[4];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+typedef struct
+{
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+enum pio_src_dest
+{
+    pio_pins = 0,
+    pio_x = 1,
+    pio_y = 2,
+};
+
+extern pio_hw_t sim_pio[2];
+
+#define pio0 (&sim_pio[0])
+#define pio1 (&sim_pio[1])
+
+uint pio_add_program(PIO pio, const pio_program_t *program);
+uint pio_claim_unused_sm(PIO pio, bool required);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_sm_exec(PIO pio, uint sm, uint instr);
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div);
+
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx)
+{
+    return (pio == pio0 ? 0 : 8) + (is_tx ? 0 : 4) + sm;
+}
+
+static inline uint pio_encode_set(enum pio_src_dest dest, uint value)
+{
+    return 0xE000 | (dest << 5) | (value & 31);
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef SIM_HARDWARE_PLL_H
+#define SIM_HARDWARE_PLL_H
+
+#include "pico/types.h"
+
+typedef struct sim_pll *PLL;
+
+extern struct sim_pll sim_pll_sys;
+extern struct sim_pll sim_pll_usb;
+
+#define pll_sys (&sim_pll_sys)
+#define pll_usb (&sim_pll_usb)
+
+void pll_init(PLL pll, uint ref_div, uint vco_freq, uint post_div1, uint post_div2);
+void pll_deinit(PLL pll);
+
+#endif
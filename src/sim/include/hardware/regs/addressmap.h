@@ -0,0 +1,12 @@
+#ifndef SIM_HARDWARE_REGS_ADDRESSMAP_H
+#define SIM_HARDWARE_REGS_ADDRESSMAP_H
+
+#include <stdint.h>
+
+// The XIP windows map the simulated flash, see sim_flash.c
+extern uint8_t sim_flash[];
+
+#define XIP_BASE ((uintptr_t)sim_flash)
+#define XIP_NOCACHE_NOALLOC_BASE ((uintptr_t)sim_flash)
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef SIM_HARDWARE_SPI_H
+#define SIM_HARDWARE_SPI_H
+
+#include "pico/types.h"
+
+typedef struct
+{
+    volatile uint32_t dr; // DMA addresses this, the simulator forwards bytes written here to the device on the bus
+} spi_hw_t;
+
+typedef struct
+{
+    spi_hw_t hw;
+    uint baudrate;
+    uint32_t clk_hz; // clk_peri when the divider was set
+} spi_inst_t;
+
+extern spi_inst_t sim_spi[2];
+
+#define spi0 (&sim_spi[0])
+#define spi1 (&sim_spi[1])
+
+// DREQ numbers, as on the RP2040
+#define DREQ_SPI0_TX 16
+#define DREQ_SPI0_RX 17
+#define DREQ_SPI1_TX 18
+#define DREQ_SPI1_RX 19
+
+uint spi_init(spi_inst_t *spi, uint baudrate);
+void spi_deinit(spi_inst_t *spi);
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate);
+uint spi_get_baudrate(const spi_inst_t *spi);
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len);
+
+static inline uint spi_get_index(const spi_inst_t *spi)
+{
+    return spi == spi1 ? 1 : 0;
+}
+
+static inline spi_hw_t *spi_get_hw(spi_inst_t *spi)
+{
+    return &spi->hw;
+}
+
+static inline uint spi_get_dreq(spi_inst_t *spi, bool is_tx)
+{
+    return DREQ_SPI0_TX + 2 * spi_get_index(spi) + (is_tx ? 0 : 1);
+}
+
+#endif
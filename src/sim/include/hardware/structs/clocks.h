@@ -0,0 +1,49 @@
+#ifndef SIM_HARDWARE_STRUCTS_CLOCKS_H
+#define SIM_HARDWARE_STRUCTS_CLOCKS_H
+
+#include "pico/types.h"
+
+// The clock gates used while the cores sleep, at their RP2040 bit positions
+#define CLOCKS_SLEEP_EN0_CLK_SYS_SPI1_BITS 0x08000000
+#define CLOCKS_SLEEP_EN0_CLK_PERI_SPI1_BITS 0x04000000
+#define CLOCKS_SLEEP_EN0_CLK_SYS_SPI0_BITS 0x02000000
+#define CLOCKS_SLEEP_EN0_CLK_PERI_SPI0_BITS 0x01000000
+#define CLOCKS_SLEEP_EN0_CLK_SYS_RTC_BITS 0x00400000
+#define CLOCKS_SLEEP_EN0_CLK_RTC_RTC_BITS 0x00200000
+#define CLOCKS_SLEEP_EN0_CLK_SYS_PWM_BITS 0x00020000
+#define CLOCKS_SLEEP_EN0_CLK_SYS_PIO1_BITS 0x00002000
+#define CLOCKS_SLEEP_EN0_CLK_SYS_PIO0_BITS 0x00001000
+#define CLOCKS_SLEEP_EN0_CLK_SYS_JTAG_BITS 0x00000200
+#define CLOCKS_SLEEP_EN0_CLK_SYS_I2C1_BITS 0x00000080
+#define CLOCKS_SLEEP_EN0_CLK_SYS_I2C0_BITS 0x00000040
+#define CLOCKS_SLEEP_EN0_CLK_SYS_DMA_BITS 0x00000020
+#define CLOCKS_SLEEP_EN0_CLK_SYS_ADC_BITS 0x00000004
+#define CLOCKS_SLEEP_EN0_CLK_ADC_ADC_BITS 0x00000002
+#define CLOCKS_SLEEP_EN1_CLK_SYS_UART1_BITS 0x00000200
+#define CLOCKS_SLEEP_EN1_CLK_PERI_UART1_BITS 0x00000100
+#define CLOCKS_SLEEP_EN1_CLK_SYS_UART0_BITS 0x00000080
+#define CLOCKS_SLEEP_EN1_CLK_PERI_UART0_BITS 0x00000040
+
+#define CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF 0x0
+#define CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX 0x1
+#define CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS 0x0
+#define CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB 0x1
+#define CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS 0x0
+#define CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB 0x2
+#define CLOCKS_CLK_USB_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB 0x0
+#define CLOCKS_CLK_ADC_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB 0x0
+#define CLOCKS_CLK_RTC_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB 0x0
+
+typedef struct
+{
+    volatile uint32_t wake_en0;
+    volatile uint32_t wake_en1;
+    volatile uint32_t sleep_en0; // clocks left running while both cores are in deep sleep
+    volatile uint32_t sleep_en1;
+} clocks_hw_t;
+
+extern clocks_hw_t sim_clocks;
+
+#define clocks_hw (&sim_clocks)
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef SIM_HARDWARE_STRUCTS_DMA_H
+#define SIM_HARDWARE_STRUCTS_DMA_H
+
+#include "pico/types.h"
+
+#define NUM_DMA_CHANNELS 12
+
+// The channel registers reached directly, by the bit LED refresh loop. The
+// addresses they hold are host pointers, so the registers are pointer sized.
+typedef struct
+{
+    volatile uintptr_t read_addr;
+    volatile uintptr_t write_addr;
+    volatile uint32_t transfer_count;
+    volatile uint32_t ctrl_trig;
+    volatile uintptr_t al3_read_addr_trig; // read_addr, then start the channel
+} dma_channel_hw_t;
+
+typedef struct
+{
+    dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+} dma_hw_t;
+
+extern dma_hw_t sim_dma_hw;
+
+#define dma_hw (&sim_dma_hw)
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef SIM_HARDWARE_STRUCTS_SCB_H
+#define SIM_HARDWARE_STRUCTS_SCB_H
+
+#include "pico/types.h"
+
+#define M0PLUS_SCR_SLEEPDEEP_BITS 0x00000004
+
+// Only the registers the firmware touches. Each core sees its own, as on the RP2040.
+typedef struct
+{
+    volatile uint32_t scr; // SLEEPDEEP is counted as deep sleep while the core waits
+} armv6m_scb_hw_t;
+
+extern armv6m_scb_hw_t sim_scb[2];
+
+uint get_core_num(void);
+
+#define scb_hw (&sim_scb[get_core_num()])
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef SIM_HARDWARE_STRUCTS_SYSTICK_H
+#define SIM_HARDWARE_STRUCTS_SYSTICK_H
+
+#include "pico/types.h"
+
+typedef struct
+{
+    volatile uint32_t csr;
+    volatile uint32_t rvr;
+    volatile uint32_t cvr; // counts down at clk_sys in virtual time
+    volatile uint32_t calib;
+} systick_hw_t;
+
+extern systick_hw_t sim_systick;
+
+#define systick_hw (&sim_systick)
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef SIM_HARDWARE_VREG_H
+#define SIM_HARDWARE_VREG_H
+
+// Core voltage, checked against clk_sys by the clock model
+enum vreg_voltage
+{
+    VREG_VOLTAGE_1_10 = 0xB,
+    VREG_VOLTAGE_1_15 = 0xC,
+    VREG_VOLTAGE_1_20 = 0xD,
+    VREG_VOLTAGE_1_25 = 0xE,
+    VREG_VOLTAGE_1_30 = 0xF,
+    VREG_VOLTAGE_DEFAULT = VREG_VOLTAGE_1_10,
+};
+
+void vreg_set_voltage(enum vreg_voltage voltage);
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef SIM_HARDWARE_XOSC_H
+#define SIM_HARDWARE_XOSC_H
+
+// Blocks the calling core until a pin enabled with gpio_set_dormant_irq_enabled() wakes it
+void xosc_dormant(void);
+
+#endif
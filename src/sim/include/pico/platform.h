@@ -0,0 +1,9 @@
+#ifndef SIM_PICO_PLATFORM_H
+#define SIM_PICO_PLATFORM_H
+
+#include "pico/types.h"
+
+// Sleeps the cycles at the current clk_sys in virtual time
+void busy_wait_at_least_cycles(uint32_t minimum_cycles);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef SIM_PICO_STDLIB_H
+#define SIM_PICO_STDLIB_H
+
+#include <stdio.h>
+#include "pico/types.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "hardware/sync.h"
+
+bool stdio_init_all(void);
+bool stdio_usb_connected(void);
+uint get_core_num(void);
+void stdio_set_chars_available_callback(void (*fn)(void *), void *param);
+int getchar_timeout_us(uint32_t timeout_us);
+int stdio_get_until(char *buf, int len, absolute_time_t until);
+int stdio_put_string(const char *s, int len, bool newline, bool cr_translation);
+
+// Busy-wait loops yield here, so the other core and the peripherals can make progress
+void tight_loop_contents(void);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef SIM_PICO_SYNC_H
+#define SIM_PICO_SYNC_H
+
+// Both cores share one host thread and only switch at wait points, so a
+// critical section only has to mask interrupts on the calling core.
+
+#include "pico/types.h"
+#include "hardware/sync.h"
+
+typedef struct
+{
+    uint32_t save;
+} critical_section_t;
+
+static inline void critical_section_init(critical_section_t *crit_sec)
+{
+    crit_sec->save = 0;
+}
+
+static inline void critical_section_enter_blocking(critical_section_t *crit_sec)
+{
+    crit_sec->save = save_and_disable_interrupts();
+}
+
+static inline void critical_section_exit(critical_section_t *crit_sec)
+{
+    restore_interrupts(crit_sec->save);
+}
+
+static inline void critical_section_deinit(critical_section_t *crit_sec)
+{
+    (void)crit_sec;
+}
+
+#endif
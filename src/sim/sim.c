@@ -0,0 +1,642 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include "sim.h"
+#include "peripherals.h"
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/platform.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/scb.h"
+
+#define SIM_CORE_STACK (256 * 1024)
+#define SIM_MAX_EVENTS 64
+#define SIM_MAX_SHARED_HANDLERS 4
+#define SIM_SPIN_ROUNDS 64 // bound on re-running busy-waiting cores before time moves on
+
+int firmware_main(); // the firmware's main(), renamed by the sim build
+
+enum SimCoreState
+{
+    CORE_OFF,
+    CORE_READY,      // runnable
+    CORE_SPIN,       // in tight_loop_contents(), waiting on something another core or peripheral does
+    CORE_WAIT,       // in __wfe()
+    CORE_WAIT_UNTIL, // in best_effort_wfe_or_timeout(), as CORE_WAIT but also wakes at wake_ns
+    CORE_SLEEP,      // in a sleep, until wake_ns
+};
+
+struct SimCore
+{
+    ucontext_t context;
+    void (*entry)(void);
+    enum SimCoreState state;
+    uint64_t wake_ns;
+    bool event;   // WFE event register
+    bool primask; // interrupts masked
+    bool locked;  // paused by the other core, see sim_lockout()
+    uint32_t irq_enabled;
+    uint32_t irq_lines;
+    uint32_t irq_active; // handlers running, no re-entry
+    irq_handler_t handlers[IRQ_COUNT][SIM_MAX_SHARED_HANDLERS];
+    uint64_t host_ns; // host time spent running this core
+};
+
+struct SimEvent
+{
+    uint64_t at_ns;
+    uint32_t seq; // events at the same time run in the order they were scheduled
+    sim_event_t event;
+    uint32_t arg;
+    bool used;
+};
+
+struct SimOptions sim_options;
+systick_hw_t sim_systick;
+armv6m_scb_hw_t sim_scb[2];
+
+static struct SimCore cores[2];
+static uint current_core;
+static bool in_core; // false while the scheduler itself runs
+static ucontext_t scheduler_context;
+
+static uint64_t now_ns;
+static struct SimEvent events[SIM_MAX_EVENTS];
+static uint32_t event_seq;
+static uint32_t activity;
+static uint32_t failures;
+static bool stopped;
+static uint64_t deep_sleep_ns; // both cores waiting with SLEEPDEEP set
+
+// time
+
+/// @brief Current virtual time.
+uint64_t sim_now_ns()
+{
+    return now_ns;
+}
+
+/// @brief Host monotonic time, for measuring how long simulated code takes to run.
+uint64_t sim_host_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/// @brief Run `event(arg)` from the scheduler once virtual time reaches `at_ns`.
+void sim_schedule(uint64_t at_ns, sim_event_t event, uint32_t arg)
+{
+    for (int i = 0; i < SIM_MAX_EVENTS; i++)
+    {
+        if (!events[i].used)
+        {
+            events[i] = (struct SimEvent){at_ns < now_ns ? now_ns : at_ns, event_seq++, event, arg, true};
+            return;
+        }
+    }
+    fprintf(stderr, "sim: event table full\n");
+    exit(2);
+}
+
+/// @brief Note that something observable happened, so busy-waiting cores get another look before time moves on.
+void sim_activity()
+{
+    activity++;
+}
+
+/// @brief Count a failed check. The run continues, the exit status reports it.
+void sim_fail(const char *reason)
+{
+    fprintf(stderr, "sim: FAIL at %.3f ms: %s\n", now_ns / 1e6, reason);
+    failures++;
+}
+
+/// @brief End the run once the current core next waits, e.g. because the board lost power.
+void sim_stop()
+{
+    stopped = true;
+}
+
+static bool core_deep_sleep(uint num)
+{
+    return cores[num].state == CORE_OFF ||
+           (cores[num].state != CORE_READY && cores[num].state != CORE_SPIN &&
+            (sim_scb[num].scr & M0PLUS_SCR_SLEEPDEEP_BITS));
+}
+
+static void advance_to(uint64_t t)
+{
+    if (core_deep_sleep(0) && core_deep_sleep(1))
+        deep_sleep_ns += t - now_ns;
+
+    // SysTick counts down at clk_sys, wrapping at its 24-bit reload value
+    uint64_t cycles = (t - now_ns) * (SIM_SYS_HZ / 1000000) / 1000;
+    uint32_t reload = (sim_systick.rvr & 0x00FFFFFF) + 1;
+    if (sim_systick.csr & 1)
+        sim_systick.cvr = (uint32_t)((sim_systick.cvr + reload - cycles % reload) % reload);
+
+    now_ns = t;
+}
+
+static bool next_event(struct SimEvent **out)
+{
+    struct SimEvent *best = NULL;
+    for (int i = 0; i < SIM_MAX_EVENTS; i++)
+    {
+        struct SimEvent *e = &events[i];
+        if (e->used && (!best || e->at_ns < best->at_ns || (e->at_ns == best->at_ns && e->seq < best->seq)))
+            best = e;
+    }
+    *out = best;
+    return best != NULL;
+}
+
+// interrupts
+
+static bool irq_deliverable(struct SimCore *core)
+{
+    return !core->primask && (core->irq_lines & core->irq_enabled & ~core->irq_active);
+}
+
+/// @brief Run the handlers of every pending, enabled interrupt on the current core, lowest number first.
+static void irq_service()
+{
+    if (!in_core)
+        return;
+
+    struct SimCore *core = &cores[current_core];
+    for (int pass = 0; pass < IRQ_COUNT && irq_deliverable(core); pass++)
+    {
+        uint32_t ready = core->irq_lines & core->irq_enabled & ~core->irq_active;
+        uint num = __builtin_ctz(ready);
+
+        core->irq_active |= 1u << num;
+        for (int i = 0; i < SIM_MAX_SHARED_HANDLERS; i++)
+            if (core->handlers[num][i])
+                core->handlers[num][i]();
+        core->irq_active &= ~(1u << num);
+    }
+}
+
+/// @brief Assert or release an interrupt line into one core's NVIC.
+void sim_irq_set_line(uint core, uint num, bool asserted)
+{
+    uint32_t old = cores[core].irq_lines;
+    if (asserted)
+        cores[core].irq_lines |= 1u << num;
+    else
+        cores[core].irq_lines &= ~(1u << num);
+
+    if (cores[core].irq_lines != old)
+        sim_activity();
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    struct SimCore *core = &cores[current_core];
+    if (enabled)
+        core->irq_enabled |= 1u << num;
+    else
+        core->irq_enabled &= ~(1u << num);
+    irq_service();
+}
+
+bool irq_is_enabled(uint num)
+{
+    return cores[current_core].irq_enabled & (1u << num);
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    struct SimCore *core = &cores[current_core];
+    memset(core->handlers[num], 0, sizeof(core->handlers[num]));
+    core->handlers[num][0] = handler;
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority)
+{
+    (void)order_priority;
+    struct SimCore *core = &cores[current_core];
+    for (int i = 0; i < SIM_MAX_SHARED_HANDLERS; i++)
+    {
+        if (!core->handlers[num][i])
+        {
+            core->handlers[num][i] = handler;
+            return;
+        }
+    }
+    fprintf(stderr, "sim: too many shared handlers for IRQ %u\n", num);
+    exit(2);
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler)
+{
+    struct SimCore *core = &cores[current_core];
+    for (int i = 0; i < SIM_MAX_SHARED_HANDLERS; i++)
+        if (core->handlers[num][i] == handler)
+            core->handlers[num][i] = NULL;
+}
+
+void irq_set_pending(uint num)
+{
+    sim_irq_set_line(current_core, num, true);
+    irq_service();
+    sim_irq_set_line(current_core, num, false);
+}
+
+uint32_t save_and_disable_interrupts()
+{
+    uint32_t status = cores[current_core].primask;
+    cores[current_core].primask = true;
+    return status;
+}
+
+void restore_interrupts(uint32_t status)
+{
+    cores[current_core].primask = status;
+    irq_service();
+}
+
+// cores
+
+/// @brief Hand control back to the scheduler. Interrupts that came in meanwhile are serviced on return.
+static void core_yield(enum SimCoreState state)
+{
+    struct SimCore *core = &cores[current_core];
+
+    if (!in_core)
+    {
+        fprintf(stderr, "sim: a peripheral model tried to wait\n");
+        exit(2);
+    }
+
+    core->state = state;
+    swapcontext(&core->context, &scheduler_context);
+    irq_service();
+}
+
+static void core_trampoline()
+{
+    cores[current_core].entry();
+
+    fprintf(stderr, "sim: core %u returned from its entry point\n", current_core);
+    exit(2);
+}
+
+static void core_start(uint num, void (*entry)(void))
+{
+    struct SimCore *core = &cores[num];
+
+    getcontext(&core->context);
+    core->context.uc_stack.ss_sp = malloc(SIM_CORE_STACK);
+    core->context.uc_stack.ss_size = SIM_CORE_STACK;
+    core->context.uc_link = NULL;
+    makecontext(&core->context, core_trampoline, 0);
+
+    core->entry = entry;
+    core->state = CORE_READY;
+}
+
+static bool core_wakeable(struct SimCore *core)
+{
+    if (core->locked)
+        return false;
+
+    switch (core->state)
+    {
+    case CORE_READY:
+        return true;
+    case CORE_WAIT:
+        return core->event || irq_deliverable(core);
+    case CORE_WAIT_UNTIL:
+        return core->event || now_ns >= core->wake_ns || irq_deliverable(core);
+    case CORE_SLEEP:
+        return now_ns >= core->wake_ns || irq_deliverable(core);
+    case CORE_SPIN:
+        return irq_deliverable(core);
+    default:
+        return false;
+    }
+}
+
+static void core_run(uint num)
+{
+    uint64_t start = sim_host_ns();
+
+    current_core = num;
+    in_core = true;
+    swapcontext(&scheduler_context, &cores[num].context);
+    in_core = false;
+
+    cores[num].host_ns += sim_host_ns() - start;
+}
+
+/// @brief Hold a core at its current wait point, as the SDK's multicore lockout does while flash is written.
+void sim_lockout(uint core, bool locked)
+{
+    cores[core].locked = locked;
+    if (!locked)
+        sim_activity();
+}
+
+void multicore_launch_core1(void (*entry)(void))
+{
+    core_start(1, entry);
+}
+
+void multicore_reset_core1()
+{
+    cores[1].state = CORE_OFF;
+    cores[1].irq_enabled = 0;
+}
+
+uint get_core_num()
+{
+    return current_core;
+}
+
+void __wfe()
+{
+    struct SimCore *core = &cores[current_core];
+
+    if (core->event)
+        core_yield(CORE_READY); // returns at once, but give the other core a turn
+    else
+        core_yield(CORE_WAIT);
+    core->event = false;
+}
+
+void __wfi()
+{
+    core_yield(CORE_WAIT);
+}
+
+void __sev()
+{
+    cores[0].event = true;
+    cores[1].event = true;
+    sim_activity();
+}
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp)
+{
+    struct SimCore *core = &cores[current_core];
+    uint64_t deadline = timeout_timestamp * 1000;
+
+    if (now_ns >= deadline)
+        return true;
+
+    if (core->event)
+    {
+        core_yield(CORE_READY);
+    }
+    else
+    {
+        core->wake_ns = deadline;
+        core_yield(CORE_WAIT_UNTIL);
+    }
+    core->event = false;
+    return now_ns >= deadline;
+}
+
+void tight_loop_contents()
+{
+    core_yield(CORE_SPIN);
+}
+
+/// @brief Let virtual time pass on the calling core. The other core and the peripherals keep running.
+void sim_sleep_ns(uint64_t ns)
+{
+    uint64_t wake = now_ns + ns;
+    while (now_ns < wake)
+    {
+        cores[current_core].wake_ns = wake;
+        core_yield(CORE_SLEEP);
+    }
+}
+
+uint64_t time_us_64()
+{
+    return now_ns / 1000;
+}
+
+uint32_t time_us_32()
+{
+    return (uint32_t)(now_ns / 1000);
+}
+
+void sleep_us(uint64_t us)
+{
+    sim_sleep_ns(us * 1000);
+}
+
+void sleep_ms(uint32_t ms)
+{
+    sim_sleep_ns((uint64_t)ms * 1000000);
+}
+
+void sleep_until(absolute_time_t target)
+{
+    if (target > time_us_64())
+        sim_sleep_ns((target - time_us_64()) * 1000);
+}
+
+void busy_wait_us(uint64_t us)
+{
+    sim_sleep_ns(us * 1000);
+}
+
+void busy_wait_us_32(uint32_t us)
+{
+    sim_sleep_ns((uint64_t)us * 1000);
+}
+
+void busy_wait_at_least_cycles(uint32_t minimum_cycles)
+{
+    sim_sleep_ns((uint64_t)minimum_cycles * 1000000000u / clock_get_hz(clk_sys));
+}
+
+bool stdio_init_all()
+{
+    return true;
+}
+
+bool stdio_usb_connected()
+{
+    return true;
+}
+
+// scheduler
+
+static bool any_wakeable()
+{
+    return core_wakeable(&cores[0]) || core_wakeable(&cores[1]);
+}
+
+/// @brief Run the cores until nothing is left to happen, the time limit is reached or the cores deadlock.
+static void sim_run()
+{
+    while (!stopped)
+    {
+        bool ran = false;
+        for (uint num = 0; num < 2; num++)
+        {
+            if (core_wakeable(&cores[num]))
+            {
+                core_run(num);
+                ran = true;
+            }
+        }
+        if (ran)
+            continue;
+
+        // Only busy-waiting cores left. Let them poll until they stop changing
+        // anything, then whatever they are waiting for must be in the future.
+        for (int round = 0; round < SIM_SPIN_ROUNDS && !any_wakeable(); round++)
+        {
+            uint32_t before = activity;
+            for (uint num = 0; num < 2; num++)
+                if (cores[num].state == CORE_SPIN)
+                    core_run(num);
+            if (activity == before)
+                break;
+        }
+        if (any_wakeable())
+            continue;
+
+        if (!sim_dma_busy())
+            sim_ssd1322_idle(); // the display side has gone quiet, a frame is complete
+
+        // move time on to whatever happens next
+        struct SimEvent *event;
+        uint64_t next = UINT64_MAX;
+        if (next_event(&event))
+            next = event->at_ns;
+        for (uint num = 0; num < 2; num++)
+            if ((cores[num].state == CORE_SLEEP || cores[num].state == CORE_WAIT_UNTIL) && cores[num].wake_ns < next)
+                next = cores[num].wake_ns;
+
+        if (next == UINT64_MAX)
+        {
+            if (cores[0].state == CORE_SPIN || cores[1].state == CORE_SPIN)
+                sim_fail("deadlock, a core is busy-waiting on something that will never happen");
+            return; // idle with nothing scheduled, the run is over
+        }
+        if (next > sim_options.max_ns)
+        {
+            advance_to(sim_options.max_ns);
+            return;
+        }
+
+        advance_to(next);
+        while (next_event(&event) && event->at_ns <= now_ns)
+        {
+            event->used = false;
+            event->event(event->arg);
+        }
+    }
+}
+
+// reports
+
+static void sim_report(FILE *out, uint64_t host_start)
+{
+    fprintf(out, "sim_ms=%.3f\n", now_ns / 1e6);
+    fprintf(out, "host_ms=%.3f\n", (sim_host_ns() - host_start) / 1e6);
+    fprintf(out, "core0_host_ms=%.3f\n", cores[0].host_ns / 1e6);
+    fprintf(out, "core1_host_ms=%.3f\n", cores[1].host_ns / 1e6);
+    fprintf(out, "deep_sleep_ms=%.3f\n", deep_sleep_ns / 1e6);
+    sim_power_report(out);
+    sim_ssd1322_report(out);
+    sim_i2c_report(out);
+    sim_gpio_report(out);
+    sim_adc_report(out);
+    sim_flash_report(out);
+    fprintf(out, "failures=%lu\n", (unsigned long)failures);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [options] [script]\n"
+            "  -o DIR                 write frames (PGM), frames.csv, leds.csv and summary.txt to DIR\n"
+            "  --max-ms N             stop after N ms of virtual time (default 10000)\n"
+            "  --max-frame-bytes N    fail if a frame sends more than N bytes to the display\n"
+            "  --max-frame-us N       fail if a frame keeps the display bus busy for more than N us\n"
+            "  --usb                  powered from USB, so releasing POWER_EN does not end the run\n"
+            "  --flash FILE           load flash from FILE if it exists and save it back at the end\n",
+            name);
+}
+
+static void core0_entry()
+{
+    firmware_main();
+}
+
+int main(int argc, char **argv)
+{
+    sim_options.max_ns = 10000 * 1000000ull;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            sim_options.out_dir = argv[++i];
+        else if (!strcmp(argv[i], "--max-ms") && i + 1 < argc)
+            sim_options.max_ns = strtoull(argv[++i], NULL, 0) * 1000000ull;
+        else if (!strcmp(argv[i], "--max-frame-bytes") && i + 1 < argc)
+            sim_options.max_frame_bytes = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--max-frame-us") && i + 1 < argc)
+            sim_options.max_frame_us = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--usb"))
+            sim_options.usb_power = true;
+        else if (!strcmp(argv[i], "--flash") && i + 1 < argc)
+            sim_options.flash_path = argv[++i];
+        else if (argv[i][0] != '-' && !sim_options.script)
+            sim_options.script = argv[i];
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (sim_options.script && !sim_script_load(sim_options.script))
+        return 2;
+    if (sim_options.out_dir)
+    {
+        sim_gpio_open(sim_options.out_dir);
+        sim_ssd1322_open(sim_options.out_dir);
+    }
+
+    sim_flash_load(sim_options.flash_path);
+
+    uint64_t host_start = sim_host_ns();
+    sim_tca8418_reset();
+    sim_gpio_drive(POWER_BTN, true); // released
+    sim_script_start();
+    core_start(0, core0_entry);
+    sim_run();
+
+    fflush(stdout);
+    if (sim_options.flash_path && !sim_flash_save(sim_options.flash_path))
+        sim_fail("could not save the flash image");
+    sim_report(stdout, host_start);
+    if (sim_options.out_dir)
+    {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/summary.txt", sim_options.out_dir);
+        FILE *out = fopen(path, "w");
+        if (out)
+        {
+            sim_report(out, host_start);
+            fclose(out);
+        }
+    }
+
+    return failures ? 1 : 0;
+}
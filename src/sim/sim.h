@@ -0,0 +1,97 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdio.h>
+#include "pico/types.h"
+#include "hardware/i2c.h"
+
+// Host simulator internals, shared by the fake SDK and the board models.
+//
+// Both RP2040 cores run as coroutines on one host thread and only switch at
+// wait points (__wfe, sleeps, tight_loop_contents), so a run is fully
+// deterministic. Time is virtual and jumps to the next scheduled event
+// whenever every core is waiting.
+
+#define SIM_SYS_HZ 125000000 // clk_sys, for SysTick and clock_get_hz
+
+struct SimOptions
+{
+    const char *script;      // key script, see sim_script.c, or NULL
+    const char *out_dir;     // frames and logs are written here if set
+    uint64_t max_ns;         // stop after this much virtual time
+    uint32_t max_frame_bytes; // fail if a frame sends more, 0 for no limit
+    uint32_t max_frame_us;    // fail if a frame takes longer on the bus, 0 for no limit
+    bool usb_power;           // the board stays powered when the firmware releases POWER_EN
+    const char *flash_path;   // flash image kept between runs, or NULL
+};
+
+extern struct SimOptions sim_options;
+
+// time and scheduling
+typedef void (*sim_event_t)(uint32_t arg);
+
+uint64_t sim_now_ns();
+void sim_schedule(uint64_t at_ns, sim_event_t event, uint32_t arg);
+void sim_sleep_ns(uint64_t ns);
+void sim_activity();
+uint64_t sim_host_ns();
+void sim_fail(const char *reason);
+void sim_stop();
+
+// interrupts, lines are level sensitive and per core
+void sim_irq_set_line(uint core, uint num, bool asserted);
+void sim_lockout(uint core, bool locked);
+
+// gpio
+bool sim_gpio_level(uint gpio);
+void sim_gpio_drive(uint gpio, bool level);
+void sim_gpio_open(const char *dir);
+void sim_gpio_report(FILE *out);
+bool sim_gpio_dormant_wake();
+
+// dma and spi
+bool sim_dma_busy();
+
+// clocks and power
+void sim_power_en(bool level);
+void sim_power_report(FILE *out);
+void sim_check_divider(const char *what, uint32_t set_hz, uint32_t now_hz);
+
+// ADC and battery
+void sim_adc_battery_mv(uint mv);
+void sim_adc_divider(bool on);
+uint16_t sim_adc_fifo_pop();
+uint64_t sim_adc_samples_ns(uint32_t count);
+void sim_adc_report(FILE *out);
+
+// QSPI flash
+void sim_flash_load(const char *path);
+bool sim_flash_save(const char *path);
+void sim_flash_report(FILE *out);
+
+// SSD1322
+void sim_ssd1322_byte(uint8_t byte);
+void sim_ssd1322_idle();
+void sim_ssd1322_open(const char *dir);
+void sim_ssd1322_report(FILE *out);
+
+// TCA8418
+int sim_tca8418_write(const uint8_t *src, size_t len);
+int sim_tca8418_read(uint8_t *dst, size_t len);
+void sim_tca8418_key(uint8_t row, uint8_t col, bool pressed);
+void sim_tca8418_reset();
+void sim_i2c_report(FILE *out);
+void sim_i2c_command(i2c_inst_t *i2c, uint32_t command);
+uint64_t sim_i2c_bus_until_ns(i2c_inst_t *i2c);
+uint64_t sim_i2c_rx_ready_ns(i2c_inst_t *i2c, uint32_t count);
+uint8_t sim_i2c_rx_pop(i2c_inst_t *i2c);
+
+// usb stdio
+void sim_stdin_feed(const char *text);
+void sim_stdin_feed_bytes(const uint8_t *data, size_t len);
+
+// key script
+bool sim_script_load(const char *path);
+void sim_script_start();
+
+#endif
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include "sim.h"
+#include "peripherals.h"
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+
+// The ADC and the battery behind BAT_ADC. The cell voltage comes from the key
+// script. BAT_ADC only sees it through the divider while BAT_ADC_EN is high,
+// and only once the divider has settled; sampling earlier is a failure.
+
+#define SIM_ADC_SAMPLE_NS 2000     // 96 cycles of the 48 MHz ADC clock
+#define SIM_ADC_SETTLE_NS 500000   // divider and filter capacitor, a few RC time constants
+#define SIM_ADC_NOISE_LSB 6        // peak to peak
+#define SIM_BATTERY_MV_DEFAULT 3900
+
+adc_hw_t sim_adc_hw;
+
+static uint battery_mv = SIM_BATTERY_MV_DEFAULT;
+static uint input;
+static bool running;
+static uint32_t noise_state = 1;
+static uint64_t divider_on_ns; // when BAT_ADC_EN last went high
+static uint64_t divider_total_ns;
+static uint32_t samples;
+static uint32_t early_samples;
+
+/// @brief Set the cell voltage, from the key script.
+void sim_adc_battery_mv(uint mv)
+{
+    battery_mv = mv;
+}
+
+/// @brief BAT_ADC_EN changed.
+void sim_adc_divider(bool on)
+{
+    if (on)
+        divider_on_ns = sim_now_ns();
+    else
+        divider_total_ns += sim_now_ns() - divider_on_ns;
+}
+
+static uint16_t adc_convert()
+{
+    if (input != BAT_ADC - 26)
+        return 0;
+
+    samples++;
+    if (!sim_gpio_level(BAT_ADC_EN))
+        return 0; // divider off, the input is pulled to ground
+
+    if (sim_now_ns() - divider_on_ns < SIM_ADC_SETTLE_NS)
+    {
+        if (early_samples++ == 0)
+            sim_fail("battery sampled before the divider settled");
+    }
+
+    noise_state = noise_state * 1103515245 + 12345;
+    int noise = (int)((noise_state >> 16) % (SIM_ADC_NOISE_LSB + 1)) - SIM_ADC_NOISE_LSB / 2;
+    int code = (int)((uint64_t)battery_mv * 4096 / (3300 * BAT_ADC_DIVIDER)) + noise;
+    return code < 0 ? 0 : code > 4095 ? 4095 : code;
+}
+
+/// @brief Next conversion out of the FIFO, for DMA reads of adc_hw->fifo.
+uint16_t sim_adc_fifo_pop()
+{
+    if (!running)
+        sim_fail("ADC FIFO read with the ADC stopped");
+    return adc_convert();
+}
+
+uint64_t sim_adc_samples_ns(uint32_t count)
+{
+    return (uint64_t)count * SIM_ADC_SAMPLE_NS;
+}
+
+void adc_init()
+{
+    running = false;
+}
+
+void adc_gpio_init(uint gpio)
+{
+    gpio_set_function(gpio, GPIO_FUNC_NULL);
+}
+
+void adc_select_input(uint in)
+{
+    input = in;
+}
+
+void adc_set_clkdiv(float clkdiv)
+{
+    (void)clkdiv;
+}
+
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift)
+{
+    (void)en;
+    (void)dreq_en;
+    (void)dreq_thresh;
+    (void)err_in_fifo;
+    (void)byte_shift;
+}
+
+void adc_run(bool run)
+{
+    running = run;
+}
+
+void adc_fifo_drain()
+{
+}
+
+uint16_t adc_read()
+{
+    sim_sleep_ns(SIM_ADC_SAMPLE_NS);
+    return adc_convert();
+}
+
+void sim_adc_report(FILE *out)
+{
+    uint64_t on_ns = divider_total_ns + (sim_gpio_level(BAT_ADC_EN) ? sim_now_ns() - divider_on_ns : 0);
+    fprintf(out, "adc_samples=%lu\n", (unsigned long)samples);
+    fprintf(out, "adc_early_samples=%lu\n", (unsigned long)early_samples);
+    fprintf(out, "battery_divider_on_ms=%.3f\n", on_ns / 1e6);
+}
@@ -0,0 +1,411 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/spi.h"
+#include "hardware/irq.h"
+#include "hardware/adc.h"
+#include "hardware/clocks.h"
+
+// DMA channels and the SPI blocks. A transfer is carried out in full when it
+// is triggered, so bytes reach the display model at once, but the channel
+// stays busy and its interrupt is held back for as long as the SPI clock
+// would take to shift them out. Paced by a SPI DREQ, that is 8 clocks a byte.
+// Reads of the ADC FIFO are the exception: conversions only exist once the
+// ADC runs, so they are taken when the transfer completes, 2 us apart.
+// Command words written to an I2C block run on its bus in the TCA8418 model,
+// and a channel reading the I2C block completes once the bytes it counts on
+// have been clocked in, whichever of the two channels was started first.
+
+struct SimDmaChannel
+{
+    dma_channel_config config;
+    volatile void *write_addr;
+    const volatile void *read_addr;
+    uint32_t trans_count;
+    bool claimed;
+    bool busy;
+    bool irq0_enabled;
+    bool irq1_enabled;
+    bool adc_pending;   // ADC transfer whose conversions are taken on completion
+    i2c_inst_t *i2c_rx; // I2C read whose bytes are taken from the model on completion
+    bool i2c_scheduled; // and whose completion is due
+};
+
+spi_inst_t sim_spi[2];
+
+static struct SimDmaChannel channels[NUM_DMA_CHANNELS];
+static uint32_t ints0; // raised and not yet acknowledged
+static uint32_t ints1;
+static uint32_t busy_count;
+
+static uint64_t spi_bytes_ns(spi_inst_t *spi, uint32_t bytes)
+{
+    uint baudrate = spi->baudrate ? spi->baudrate : 1000000;
+    if (spi->baudrate)
+        sim_check_divider("SPI", spi->clk_hz, clock_get_hz(clk_peri));
+    return (uint64_t)bytes * 8 * 1000000000u / baudrate;
+}
+
+static void spi_tx_byte(spi_inst_t *spi, uint8_t byte)
+{
+    if (spi == spi0)
+        sim_ssd1322_byte(byte); // the OLED is the only device on spi0
+}
+
+static void dma_update_line()
+{
+    sim_irq_set_line(0, DMA_IRQ_0, ints0 != 0);
+    sim_irq_set_line(1, DMA_IRQ_0, ints0 != 0);
+    sim_irq_set_line(0, DMA_IRQ_1, ints1 != 0);
+    sim_irq_set_line(1, DMA_IRQ_1, ints1 != 0);
+}
+
+static void dma_trigger(uint channel);
+static void dma_complete(uint32_t channel);
+
+/// @brief Move a completed ADC-paced transfer's conversions into memory.
+static void dma_adc_copy(struct SimDmaChannel *ch)
+{
+    uint size = 1u << ch->config.size;
+    uint8_t *write = (uint8_t *)ch->write_addr;
+    for (uint32_t i = 0; i < ch->trans_count; i++)
+    {
+        uint32_t value = sim_adc_fifo_pop();
+        memcpy(write, &value, size);
+        if (ch->config.write_increment)
+            write += size;
+    }
+    ch->write_addr = write;
+    ch->adc_pending = false;
+}
+
+/// @brief Move the bytes of a completed I2C read out of the model's receive FIFO.
+static void dma_i2c_copy(struct SimDmaChannel *ch)
+{
+    uint size = 1u << ch->config.size;
+    uint8_t *write = (uint8_t *)ch->write_addr;
+    for (uint32_t i = 0; i < ch->trans_count; i++)
+    {
+        uint32_t value = sim_i2c_rx_pop(ch->i2c_rx);
+        memcpy(write, &value, size);
+        if (ch->config.write_increment)
+            write += size;
+    }
+    ch->write_addr = write;
+}
+
+/// @brief Schedule the completion of I2C reads on i2c whose bytes are now on their way.
+static void dma_i2c_rx_check(i2c_inst_t *i2c)
+{
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; channel++)
+    {
+        struct SimDmaChannel *ch = &channels[channel];
+        if (ch->i2c_rx != i2c || ch->i2c_scheduled)
+            continue;
+
+        uint64_t ready = sim_i2c_rx_ready_ns(i2c, ch->trans_count);
+        if (ready == UINT64_MAX)
+            continue;
+        ch->i2c_scheduled = true;
+        sim_schedule(ready > sim_now_ns() ? ready : sim_now_ns(), dma_complete, channel);
+    }
+}
+
+static void dma_complete(uint32_t channel)
+{
+    struct SimDmaChannel *ch = &channels[channel];
+
+    ch->busy = false;
+    busy_count--;
+    if (ch->adc_pending && ch->config.enable)
+        dma_adc_copy(ch);
+    ch->adc_pending = false;
+    if (ch->i2c_rx && ch->config.enable)
+        dma_i2c_copy(ch);
+    ch->i2c_rx = NULL;
+    ch->i2c_scheduled = false;
+    if (!ch->config.irq_quiet && (ch->irq0_enabled || ch->irq1_enabled))
+    {
+        ints0 |= ch->irq0_enabled ? 1u << channel : 0;
+        ints1 |= ch->irq1_enabled ? 1u << channel : 0;
+        dma_update_line();
+    }
+    if (ch->config.chain_to != channel)
+        dma_trigger(ch->config.chain_to);
+    sim_activity();
+}
+
+static void dma_trigger(uint channel)
+{
+    struct SimDmaChannel *ch = &channels[channel];
+    uint size = 1u << ch->config.size;
+    uint8_t *write = (uint8_t *)ch->write_addr;
+    const uint8_t *read = (const uint8_t *)ch->read_addr;
+    spi_inst_t *tx_spi = NULL;
+    spi_inst_t *rx_spi = NULL;
+    i2c_inst_t *tx_i2c = NULL;
+    i2c_inst_t *rx_i2c = NULL;
+    bool rx_adc = read == (const uint8_t *)&adc_hw->fifo;
+
+    if (!ch->config.enable || ch->busy)
+        return;
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (write == (uint8_t *)&sim_spi[i].hw.dr)
+            tx_spi = &sim_spi[i];
+        if (read == (const uint8_t *)&sim_spi[i].hw.dr)
+            rx_spi = &sim_spi[i];
+        if (write == (uint8_t *)&sim_i2c[i].hw.data_cmd)
+            tx_i2c = &sim_i2c[i];
+        if (read == (const uint8_t *)&sim_i2c[i].hw.data_cmd)
+            rx_i2c = &sim_i2c[i];
+    }
+
+    if (rx_i2c)
+    {
+        // completes once the bytes have been read, maybe by commands not sent yet
+        ch->i2c_rx = rx_i2c;
+        ch->busy = true;
+        busy_count++;
+        dma_i2c_rx_check(rx_i2c);
+        sim_activity();
+        return;
+    }
+
+    for (uint32_t i = 0; i < ch->trans_count && !rx_adc; i++)
+    {
+        uint32_t value = 0;
+        if (!rx_spi)
+            memcpy(&value, (const void *)read, size);
+        if (tx_spi)
+            spi_tx_byte(tx_spi, (uint8_t)value);
+        else if (tx_i2c)
+            sim_i2c_command(tx_i2c, value);
+        else
+            memcpy((void *)write, &value, size);
+
+        if (ch->config.read_increment)
+            read += size;
+        if (ch->config.write_increment)
+            write += size;
+    }
+
+    // the hardware leaves the address registers where the transfer ended
+    ch->read_addr = read;
+    ch->write_addr = write;
+
+    spi_inst_t *paced = tx_spi ? tx_spi : rx_spi;
+    uint64_t duration = paced ? spi_bytes_ns(paced, ch->trans_count) : 0;
+    if (rx_adc)
+    {
+        duration = sim_adc_samples_ns(ch->trans_count);
+        ch->adc_pending = true;
+    }
+    if (tx_i2c && sim_i2c_bus_until_ns(tx_i2c) > sim_now_ns())
+        duration = sim_i2c_bus_until_ns(tx_i2c) - sim_now_ns();
+
+    ch->busy = true;
+    busy_count++;
+    sim_schedule(sim_now_ns() + duration, dma_complete, channel);
+    if (tx_i2c)
+        dma_i2c_rx_check(tx_i2c);
+    sim_activity();
+}
+
+/// @brief Whether any channel is still moving data.
+bool sim_dma_busy()
+{
+    return busy_count > 0;
+}
+
+int dma_claim_unused_channel(bool required)
+{
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; channel++)
+    {
+        if (!channels[channel].claimed)
+        {
+            channels[channel].claimed = true;
+            return channel;
+        }
+    }
+    if (required)
+    {
+        fprintf(stderr, "sim: no free DMA channels\n");
+        exit(2);
+    }
+    return -1;
+}
+
+void dma_channel_unclaim(uint channel)
+{
+    channels[channel].claimed = false;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    return (dma_channel_config){
+        .size = DMA_SIZE_32,
+        .read_increment = true,
+        .write_increment = false,
+        .dreq = DREQ_FORCE,
+        .chain_to = channel,
+        .irq_quiet = false,
+        .enable = true,
+    };
+}
+
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger)
+{
+    channels[channel].config = *config;
+    if (trigger)
+        dma_trigger(channel);
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger)
+{
+    channels[channel].write_addr = write_addr;
+    channels[channel].read_addr = read_addr;
+    channels[channel].trans_count = transfer_count;
+    dma_channel_set_config(channel, config, trigger);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger)
+{
+    channels[channel].read_addr = read_addr;
+    if (trigger)
+        dma_trigger(channel);
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger)
+{
+    channels[channel].write_addr = write_addr;
+    if (trigger)
+        dma_trigger(channel);
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger)
+{
+    channels[channel].trans_count = trans_count;
+    if (trigger)
+        dma_trigger(channel);
+}
+
+void dma_start_channel_mask(uint32_t chan_mask)
+{
+    for (uint channel = 0; channel < NUM_DMA_CHANNELS; channel++)
+        if (chan_mask & (1u << channel))
+            dma_trigger(channel);
+}
+
+void dma_channel_abort(uint channel)
+{
+    struct SimDmaChannel *ch = &channels[channel];
+    ch->config.enable = false; // the pending completion still retires it, but nothing chains
+    if (ch->i2c_rx && !ch->i2c_scheduled)
+    {
+        // an I2C read with nothing coming has no completion to retire it
+        ch->i2c_rx = NULL;
+        ch->busy = false;
+        busy_count--;
+    }
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+    return channels[channel].busy;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel)
+{
+    while (channels[channel].busy)
+        tight_loop_contents();
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled)
+{
+    channels[channel].irq0_enabled = enabled;
+}
+
+bool dma_channel_get_irq0_status(uint channel)
+{
+    return ints0 & (1u << channel);
+}
+
+void dma_channel_acknowledge_irq0(uint channel)
+{
+    ints0 &= ~(1u << channel);
+    dma_update_line();
+}
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled)
+{
+    channels[channel].irq1_enabled = enabled;
+}
+
+bool dma_channel_get_irq1_status(uint channel)
+{
+    return ints1 & (1u << channel);
+}
+
+void dma_channel_acknowledge_irq1(uint channel)
+{
+    ints1 &= ~(1u << channel);
+    dma_update_line();
+}
+
+// SPI, blocking transfers take bus time too
+
+uint spi_init(spi_inst_t *spi, uint baudrate)
+{
+    return spi_set_baudrate(spi, baudrate);
+}
+
+void spi_deinit(spi_inst_t *spi)
+{
+    spi->baudrate = 0;
+}
+
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate)
+{
+    // clk_peri / (prescale * postdiv), as the SDK picks them
+    uint32_t freq_in = clock_get_hz(clk_peri);
+    uint prescale, postdiv;
+    for (prescale = 2; prescale <= 254; prescale += 2)
+        if ((uint64_t)freq_in < (uint64_t)(prescale + 2) * 256 * baudrate)
+            break;
+    for (postdiv = 256; postdiv > 1; --postdiv)
+        if (freq_in / (prescale * (postdiv - 1)) > baudrate)
+            break;
+
+    spi->baudrate = freq_in / (prescale * postdiv);
+    spi->clk_hz = freq_in;
+    return spi->baudrate;
+}
+
+uint spi_get_baudrate(const spi_inst_t *spi)
+{
+    return spi->baudrate;
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        spi_tx_byte(spi, src[i]);
+    sim_sleep_ns(spi_bytes_ns(spi, len));
+    return len;
+}
+
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        spi_tx_byte(spi, repeated_tx_data);
+        dst[i] = 0;
+    }
+    sim_sleep_ns(spi_bytes_ns(spi, len));
+    return len;
+}
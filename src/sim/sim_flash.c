@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/regs/addressmap.h"
+
+// QSPI flash behind the XIP window. As on the real part an erase sets bytes
+// to 0xFF and programming can only clear bits. Both take typical W25Q16
+// times, and are only allowed inside flash_safe_execute(), which masks the
+// calling core's interrupts and holds the other core. --flash keeps the
+// contents in a file between runs, so a saved state comes back on the next.
+
+#define SIM_FLASH_PAGE_NS 700000     // tPP, typical
+#define SIM_FLASH_SECTOR_NS 45000000 // tSE, typical
+
+uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+
+static bool victim_ready[2]; // flash_safe_execute_core_init() ran on the core
+static bool safe;            // inside flash_safe_execute()
+static uint32_t pages;
+static uint32_t erases;
+static uint64_t lockout_max_ns;
+
+/// @brief Start erased, or from the image at path if there is one.
+void sim_flash_load(const char *path)
+{
+    memset(sim_flash, 0xFF, sizeof(sim_flash));
+    if (!path)
+        return;
+
+    FILE *in = fopen(path, "rb");
+    if (in)
+    {
+        if (fread(sim_flash, 1, sizeof(sim_flash), in) != sizeof(sim_flash))
+            fprintf(stderr, "sim: %s is shorter than the flash, the rest is erased\n", path);
+        fclose(in);
+    }
+}
+
+bool sim_flash_save(const char *path)
+{
+    FILE *out = fopen(path, "wb");
+    if (!out)
+    {
+        perror(path);
+        return false;
+    }
+    bool ok = fwrite(sim_flash, 1, sizeof(sim_flash), out) == sizeof(sim_flash);
+    return fclose(out) == 0 && ok;
+}
+
+static bool flash_check(uint32_t flash_offs, size_t count, uint32_t align)
+{
+    if (!safe)
+    {
+        sim_fail("flash written while code may run from it, outside flash_safe_execute()");
+        return false;
+    }
+    if (flash_offs % align || count % align || flash_offs + count > sizeof(sim_flash))
+    {
+        sim_fail("flash offset or length not aligned, or past the end");
+        return false;
+    }
+    return true;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    if (!flash_check(flash_offs, count, FLASH_SECTOR_SIZE))
+        return;
+
+    memset(sim_flash + flash_offs, 0xFF, count);
+    erases += count / FLASH_SECTOR_SIZE;
+    sim_sleep_ns((uint64_t)(count / FLASH_SECTOR_SIZE) * SIM_FLASH_SECTOR_NS);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    if (!flash_check(flash_offs, count, FLASH_PAGE_SIZE))
+        return;
+
+    // 1 bits leave a byte as it is, so 0xFF over earlier data is fine
+    for (size_t i = 0; i < count; i++)
+    {
+        uint8_t *byte = &sim_flash[flash_offs + i];
+        if (*byte != 0xFF && data[i] != 0xFF && data[i] != *byte)
+        {
+            sim_fail("flash programmed over earlier data without an erase");
+            break;
+        }
+        *byte &= data[i];
+    }
+    pages += count / FLASH_PAGE_SIZE;
+    sim_sleep_ns((uint64_t)(count / FLASH_PAGE_SIZE) * SIM_FLASH_PAGE_NS);
+}
+
+bool flash_safe_execute_core_init()
+{
+    victim_ready[get_core_num()] = true;
+    return true;
+}
+
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t enter_exit_timeout_ms)
+{
+    (void)enter_exit_timeout_ms;
+    uint other = get_core_num() ^ 1;
+    if (!victim_ready[other])
+        return PICO_ERROR_NOT_PERMITTED;
+
+    uint64_t start = sim_now_ns();
+    uint32_t status = save_and_disable_interrupts();
+    sim_lockout(other, true);
+    safe = true;
+
+    func(param);
+
+    safe = false;
+    sim_lockout(other, false);
+    restore_interrupts(status);
+
+    if (sim_now_ns() - start > lockout_max_ns)
+        lockout_max_ns = sim_now_ns() - start;
+    return PICO_OK;
+}
+
+void sim_flash_report(FILE *out)
+{
+    fprintf(out, "flash_pages=%lu\n", (unsigned long)pages);
+    fprintf(out, "flash_erases=%lu\n", (unsigned long)erases);
+    fprintf(out, "flash_lockout_max_us=%.3f\n", lockout_max_ns / 1e3);
+}
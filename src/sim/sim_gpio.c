@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include "sim.h"
+#include "peripherals.h"
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+
+// GPIO bank 0, plus the 74HC595 chain behind the bit LEDs. The chain is
+// decoded from the SER/SRCLK/RCLK/SRCLR/OE pins, so it sees exactly what a
+// bit-banged bit_leds would put on the board.
+
+struct SimPin
+{
+    bool out;          // output register
+    bool dir_out;      // output enable
+    bool driven;       // an external model drives the pad
+    bool driven_level; // level it drives
+    bool pull_up;
+    bool pull_down;
+    uint8_t function;
+    uint32_t irq_mask[2];  // per core
+    uint32_t irq_status;   // latched edges and current levels
+    uint32_t dormant_mask; // events that wake the crystal from dormant
+};
+
+static struct SimPin pins[NUM_BANK0_GPIOS];
+static gpio_irq_callback_t callbacks[2];
+
+// 74HC595 chain
+static uint32_t led_shift;
+static uint32_t led_word;
+static uint32_t led_latches;
+static FILE *led_log;
+
+/// @brief Level on the pad: the output if the pin drives it, else an external driver or the pulls.
+bool sim_gpio_level(uint gpio)
+{
+    struct SimPin *pin = &pins[gpio];
+    if (pin->dir_out && pin->function == GPIO_FUNC_SIO)
+        return pin->out;
+    if (pin->driven)
+        return pin->driven_level;
+    return pin->pull_up;
+}
+
+static void irq_update_lines()
+{
+    for (uint core = 0; core < 2; core++)
+    {
+        bool asserted = false;
+        for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++)
+            asserted |= (pins[gpio].irq_status & pins[gpio].irq_mask[core]) != 0;
+        sim_irq_set_line(core, IO_IRQ_BANK0, asserted);
+    }
+}
+
+static void irq_update_levels(uint gpio)
+{
+    struct SimPin *pin = &pins[gpio];
+    pin->irq_status &= ~(GPIO_IRQ_LEVEL_LOW | GPIO_IRQ_LEVEL_HIGH);
+    pin->irq_status |= sim_gpio_level(gpio) ? GPIO_IRQ_LEVEL_HIGH : GPIO_IRQ_LEVEL_LOW;
+}
+
+static void leds_edge(uint gpio, bool level)
+{
+    switch (gpio)
+    {
+    case LED_SRCLK:
+        if (level && sim_gpio_level(LED_SRCLR))
+            led_shift = (led_shift << 1) | sim_gpio_level(LED_SER); // byte 3 goes in first, so the word ends up in order
+        break;
+    case LED_SRCLR:
+        if (!level)
+            led_shift = 0;
+        break;
+    case LED_RCLK:
+        if (level)
+        {
+            led_word = led_shift;
+            led_latches++;
+            if (led_log)
+                fprintf(led_log, "%.3f,0x%08lX,%d\n", sim_now_ns() / 1e3, (unsigned long)led_word,
+                        !sim_gpio_level(LED_OE));
+        }
+        break;
+    case LED_OE:
+        if (led_log)
+            fprintf(led_log, "%.3f,0x%08lX,%d\n", sim_now_ns() / 1e3, (unsigned long)led_word, !level);
+        break;
+    }
+}
+
+/// @brief Latch edges and run the board models after the level of a pin may have changed.
+static void pin_changed(uint gpio, bool old)
+{
+    bool level = sim_gpio_level(gpio);
+    if (level == old)
+        return;
+
+    pins[gpio].irq_status |= level ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+    irq_update_levels(gpio);
+    irq_update_lines();
+    leds_edge(gpio, level);
+    if (gpio == POWER_EN)
+        sim_power_en(level);
+    if (gpio == BAT_ADC_EN)
+        sim_adc_divider(level);
+    if (pins[gpio].irq_status & pins[gpio].dormant_mask)
+        __sev(); // xosc_dormant() waits on the event
+    sim_activity();
+}
+
+/// @brief Drive a pad from a board model, e.g. the TCA8418 INT output or a button.
+void sim_gpio_drive(uint gpio, bool level)
+{
+    bool old = sim_gpio_level(gpio);
+    pins[gpio].driven = true;
+    pins[gpio].driven_level = level;
+    pin_changed(gpio, old);
+}
+
+static void gpio_bank0_handler()
+{
+    uint core = get_core_num();
+
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++)
+    {
+        uint32_t events = pins[gpio].irq_status & pins[gpio].irq_mask[core];
+        if (!events)
+            continue;
+
+        gpio_acknowledge_irq(gpio, events);
+        if (callbacks[core])
+            callbacks[core](gpio, events);
+    }
+}
+
+void gpio_init(uint gpio)
+{
+    bool old = sim_gpio_level(gpio);
+    pins[gpio].dir_out = false;
+    pins[gpio].out = false;
+    pins[gpio].function = GPIO_FUNC_SIO;
+    pin_changed(gpio, old);
+}
+
+void gpio_deinit(uint gpio)
+{
+    gpio_set_function(gpio, GPIO_FUNC_NULL);
+}
+
+void gpio_init_mask(uint32_t gpio_mask)
+{
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++)
+        if (gpio_mask & (1u << gpio))
+            gpio_init(gpio);
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn)
+{
+    bool old = sim_gpio_level(gpio);
+    pins[gpio].function = fn;
+    pin_changed(gpio, old);
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    bool old = sim_gpio_level(gpio);
+    pins[gpio].dir_out = out;
+    pin_changed(gpio, old);
+}
+
+bool gpio_is_dir_out(uint gpio)
+{
+    return pins[gpio].dir_out;
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    bool old = sim_gpio_level(gpio);
+    pins[gpio].out = value;
+    pin_changed(gpio, old);
+}
+
+bool gpio_get(uint gpio)
+{
+    return sim_gpio_level(gpio);
+}
+
+uint32_t gpio_get_all()
+{
+    uint32_t all = 0;
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++)
+        all |= (uint32_t)sim_gpio_level(gpio) << gpio;
+    return all;
+}
+
+void gpio_set_pulls(uint gpio, bool up, bool down)
+{
+    bool old = sim_gpio_level(gpio);
+    pins[gpio].pull_up = up;
+    pins[gpio].pull_down = down;
+    pin_changed(gpio, old);
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled)
+{
+    uint core = get_core_num();
+
+    gpio_acknowledge_irq(gpio, event_mask); // stale edges are cleared on enable, as on the RP2040
+    if (enabled)
+        pins[gpio].irq_mask[core] |= event_mask;
+    else
+        pins[gpio].irq_mask[core] &= ~event_mask;
+    irq_update_levels(gpio);
+    irq_update_lines();
+}
+
+void gpio_set_irq_callback(gpio_irq_callback_t callback)
+{
+    callbacks[get_core_num()] = callback;
+}
+
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t event_mask, bool enabled, gpio_irq_callback_t callback)
+{
+    gpio_set_irq_enabled(gpio, event_mask, enabled);
+    gpio_set_irq_callback(callback);
+    irq_set_exclusive_handler(IO_IRQ_BANK0, gpio_bank0_handler);
+    if (enabled)
+        irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+void gpio_acknowledge_irq(uint gpio, uint32_t event_mask)
+{
+    pins[gpio].irq_status &= ~(event_mask & (GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE));
+    irq_update_lines();
+}
+
+void gpio_set_dormant_irq_enabled(uint gpio, uint32_t event_mask, bool enabled)
+{
+    gpio_acknowledge_irq(gpio, event_mask);
+    if (enabled)
+        pins[gpio].dormant_mask |= event_mask;
+    else
+        pins[gpio].dormant_mask &= ~event_mask;
+}
+
+/// @brief True once a pin enabled for dormant wake-up has seen its event.
+bool sim_gpio_dormant_wake()
+{
+    for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++)
+        if (pins[gpio].irq_status & pins[gpio].dormant_mask)
+            return true;
+    return false;
+}
+
+/// @brief Log every LED latch to DIR/leds.csv.
+void sim_gpio_open(const char *dir)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/leds.csv", dir);
+    led_log = fopen(path, "w");
+    if (led_log)
+        fprintf(led_log, "t_us,word,enabled\n");
+}
+
+void sim_gpio_report(FILE *out)
+{
+    fprintf(out, "led_latches=%lu\n", (unsigned long)led_latches);
+    fprintf(out, "led_word=0x%08lX\n", (unsigned long)led_word);
+    if (led_log)
+        fflush(led_log);
+}
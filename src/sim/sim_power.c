@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include "sim.h"
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/xosc.h"
+#include "hardware/vreg.h"
+#include "hardware/structs/clocks.h"
+
+// Clocks, PLLs, the crystal and the board's soft power latch. Frequencies
+// are mostly bookkeeping: SysTick stays at its boot rate. The SPI and I2C
+// baud rates follow their source clocks the way the hardware dividers do,
+// and a transfer fails the run if its clock moved since the divider was set.
+// Unlike the RP2040, the timer keeps counting through dormant.
+
+#define SIM_OVERCLOCK_HZ 133000000 // above this clk_sys needs at least 1.15 V
+#define SIM_DIVIDER_SLACK 20       // a rate may be off by 1/20 before the run fails
+
+struct sim_pll
+{
+    bool running;
+};
+
+clocks_hw_t sim_clocks = {.wake_en0 = 0xFFFFFFFF, .wake_en1 = 0x7FFF, .sleep_en0 = 0xFFFFFFFF, .sleep_en1 = 0x7FFF};
+struct sim_pll sim_pll_sys = {true};
+struct sim_pll sim_pll_usb = {true};
+
+// what clk_sys and clk_peri run from, only what the firmware uses
+enum SysSource
+{
+    SYS_FROM_REF,
+    SYS_FROM_PLL_SYS,
+    SYS_FROM_PLL_USB,
+};
+static uint8_t sys_source = SYS_FROM_PLL_SYS;
+static bool peri_from_sys = true;
+static enum vreg_voltage voltage = VREG_VOLTAGE_DEFAULT;
+static uint32_t sys_switches;
+
+static uint32_t clock_hz[CLK_COUNT] = {
+    [clk_ref] = 12000000,
+    [clk_sys] = SIM_SYS_HZ,
+    [clk_peri] = SIM_SYS_HZ,
+    [clk_usb] = 48000000,
+    [clk_adc] = 48000000,
+    [clk_rtc] = 46875,
+};
+
+static uint32_t dormant_count;
+static uint64_t dormant_ns;
+static bool powered_off;
+static uint64_t power_off_ns;
+
+uint32_t clock_get_hz(enum clock_index clk_index)
+{
+    return clock_hz[clk_index];
+}
+
+static void sys_changed()
+{
+    if (clock_hz[clk_sys] > SIM_OVERCLOCK_HZ && voltage < VREG_VOLTAGE_1_15)
+        sim_fail("clk_sys overclocked without raising the core voltage");
+    if (peri_from_sys)
+        clock_hz[clk_peri] = clock_hz[clk_sys];
+    sys_switches++;
+}
+
+bool clock_configure(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t freq)
+{
+    if (freq > src_freq)
+        return false;
+    clock_hz[clk_index] = freq;
+
+    if (clk_index == clk_sys)
+    {
+        if (src == CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF)
+            sys_source = SYS_FROM_REF;
+        else if (auxsrc == CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS)
+            sys_source = SYS_FROM_PLL_SYS;
+        else
+            sys_source = SYS_FROM_PLL_USB;
+        if ((sys_source == SYS_FROM_PLL_SYS && !sim_pll_sys.running) ||
+            (sys_source == SYS_FROM_PLL_USB && !sim_pll_usb.running))
+            sim_fail("clk_sys switched to a stopped PLL");
+        sys_changed();
+    }
+    else if (clk_index == clk_peri)
+    {
+        peri_from_sys = auxsrc == CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS;
+    }
+    return true;
+}
+
+void clock_stop(enum clock_index clk_index)
+{
+    clock_hz[clk_index] = 0;
+}
+
+bool set_sys_clock_khz(uint32_t freq_khz, bool required)
+{
+    (void)required;
+    sim_pll_sys.running = true; // the SDK sets PLL_SYS up again for the new frequency
+    sys_source = SYS_FROM_PLL_SYS;
+    peri_from_sys = true;
+    clock_hz[clk_sys] = freq_khz * KHZ;
+    sys_changed();
+    return true;
+}
+
+bool check_sys_clock_khz(uint32_t freq_khz, uint *vco_freq_out, uint *post_div1_out, uint *post_div2_out)
+{
+    // as the SDK searches: 12 MHz reference, VCO 750 to 1600 MHz, post dividers 1 to 7
+    uint32_t ref_khz = clock_hz[clk_ref] / KHZ;
+    for (uint fbdiv = 16; fbdiv <= 320; fbdiv++)
+    {
+        uint32_t vco_khz = fbdiv * ref_khz;
+        if (vco_khz < 750000 || vco_khz > 1600000)
+            continue;
+        for (uint post_div1 = 7; post_div1 >= 1; post_div1--)
+            for (uint post_div2 = post_div1; post_div2 >= 1; post_div2--)
+                if (vco_khz == freq_khz * post_div1 * post_div2)
+                {
+                    *vco_freq_out = vco_khz * KHZ;
+                    *post_div1_out = post_div1;
+                    *post_div2_out = post_div2;
+                    return true;
+                }
+    }
+    return false;
+}
+
+void vreg_set_voltage(enum vreg_voltage to)
+{
+    voltage = to;
+}
+
+/// @brief A peripheral divider was set for `set_hz` and its source now runs at `now_hz`. Fails the run if they differ by much.
+void sim_check_divider(const char *what, uint32_t set_hz, uint32_t now_hz)
+{
+    uint32_t slack = set_hz / SIM_DIVIDER_SLACK;
+    if (now_hz + slack < set_hz || now_hz > set_hz + slack)
+    {
+        char reason[96];
+        snprintf(reason, sizeof(reason), "%s divider set for a %lu Hz clock, which now runs at %lu Hz", what,
+                 (unsigned long)set_hz, (unsigned long)now_hz);
+        sim_fail(reason);
+    }
+}
+
+void pll_init(PLL pll, uint ref_div, uint vco_freq, uint post_div1, uint post_div2)
+{
+    (void)ref_div;
+    (void)vco_freq;
+    (void)post_div1;
+    (void)post_div2;
+    pll->running = true;
+}
+
+void pll_deinit(PLL pll)
+{
+    if ((pll == pll_sys && sys_source == SYS_FROM_PLL_SYS) || (pll == pll_usb && sys_source == SYS_FROM_PLL_USB))
+        sim_fail("PLL stopped while clk_sys runs from it");
+    pll->running = false;
+}
+
+void xosc_dormant()
+{
+    if (sim_pll_sys.running || sim_pll_usb.running)
+        sim_fail("dormant with a PLL still running");
+
+    uint64_t start = sim_now_ns();
+    dormant_count++;
+    while (!sim_gpio_dormant_wake())
+        __wfe();
+    dormant_ns += sim_now_ns() - start;
+}
+
+/// @brief POWER_EN changed. On battery, releasing it cuts the supply and the run ends there.
+void sim_power_en(bool level)
+{
+    if (level || sim_options.usb_power || powered_off)
+        return;
+
+    powered_off = true;
+    power_off_ns = sim_now_ns();
+    sim_stop();
+}
+
+void sim_power_report(FILE *out)
+{
+    fprintf(out, "dormant_count=%lu\n", (unsigned long)dormant_count);
+    fprintf(out, "dormant_ms=%.3f\n", dormant_ns / 1e6);
+    fprintf(out, "clk_sys_switches=%lu\n", (unsigned long)sys_switches);
+    if (powered_off)
+        fprintf(out, "power_off_ms=%.3f\n", power_off_ns / 1e6);
+}
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "peripherals.h"
+
+// Key scripts drive the keypad and the power button. One command per line,
+// `#` starts a comment. Times are relative, the script clock starts at boot:
+//
+//   wait MS              let MS milliseconds pass
+//   press ROW COL        key goes down
+//   release ROW COL      key comes up
+//   tap ROW COL [MS]     press, hold for MS (default 40), release
+//   power [MS]           press the power button for MS (default 50)
+//   type TEXT            send TEXT and a newline to USB stdio
+//   send HEX...          send raw bytes to USB stdio, e.g. a batch frame
+//   battery MV           set the cell voltage, in millivolts
+//   charger STATE        charger outputs: off, charging or full
+//   repeat N ... end     run the enclosed lines N times
+//
+// Rows and columns are TCA8418 matrix positions, row 0-7 and column 0-9.
+
+#define SCRIPT_MAX_STEPS 65536
+#define SCRIPT_MAX_DEPTH 8
+#define SCRIPT_TAP_MS 40
+#define SCRIPT_POWER_MS 50
+
+enum ScriptAction
+{
+    SCRIPT_KEY_DOWN,
+    SCRIPT_KEY_UP,
+    SCRIPT_POWER_DOWN,
+    SCRIPT_POWER_UP,
+    SCRIPT_TYPE,
+    SCRIPT_SEND,
+    SCRIPT_BATTERY,
+    SCRIPT_CHARGER,
+};
+
+struct ScriptStep
+{
+    uint64_t at_ns;
+    uint8_t action;
+    uint8_t row;
+    uint8_t col;
+    char *text;     // SCRIPT_TYPE and SCRIPT_SEND only
+    uint32_t value; // millivolts for SCRIPT_BATTERY, ChargerState for SCRIPT_CHARGER, bytes for SCRIPT_SEND
+};
+
+enum ChargerState
+{
+    CHARGER_OFF,
+    CHARGER_CHARGING,
+    CHARGER_FULL,
+};
+
+static struct ScriptStep *steps;
+static uint32_t step_count;
+static uint32_t step_next;
+
+static bool script_add(uint64_t at_ns, enum ScriptAction action, int row, int col, char *text, uint32_t value)
+{
+    if (step_count == SCRIPT_MAX_STEPS)
+    {
+        fprintf(stderr, "sim: script longer than %d steps\n", SCRIPT_MAX_STEPS);
+        return false;
+    }
+    steps[step_count++] = (struct ScriptStep){at_ns, action, row, col, text, value};
+    return true;
+}
+
+/// @brief Parse a key script into steps. The script clock only moves forward, so they come out in time order.
+bool sim_script_load(const char *path)
+{
+    FILE *in = fopen(path, "r");
+    if (!in)
+    {
+        perror(path);
+        return false;
+    }
+
+    steps = calloc(SCRIPT_MAX_STEPS, sizeof(*steps));
+
+    // repeat blocks are handled by seeking back to the line after `repeat`
+    long loop_pos[SCRIPT_MAX_DEPTH];
+    int loop_line[SCRIPT_MAX_DEPTH];
+    int loop_left[SCRIPT_MAX_DEPTH];
+    int depth = 0;
+
+    uint64_t t = 0;
+    char line[256];
+    int line_no = 0;
+    bool ok = true;
+
+    while (ok && fgets(line, sizeof(line), in))
+    {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        char word[16];
+        double ms = 0;
+        int row = 0, col = 0, n = 0;
+        if (sscanf(line, "%15s", word) != 1)
+            continue;
+
+        if (!strcmp(word, "wait") && sscanf(line, "%*s %lf", &ms) == 1)
+        {
+            t += (uint64_t)(ms * 1e6);
+        }
+        else if (!strcmp(word, "press") && sscanf(line, "%*s %d %d", &row, &col) == 2)
+        {
+            ok = script_add(t, SCRIPT_KEY_DOWN, row, col, NULL, 0);
+        }
+        else if (!strcmp(word, "release") && sscanf(line, "%*s %d %d", &row, &col) == 2)
+        {
+            ok = script_add(t, SCRIPT_KEY_UP, row, col, NULL, 0);
+        }
+        else if (!strcmp(word, "tap") && sscanf(line, "%*s %d %d", &row, &col) == 2)
+        {
+            if (sscanf(line, "%*s %*d %*d %lf", &ms) != 1)
+                ms = SCRIPT_TAP_MS;
+            ok = script_add(t, SCRIPT_KEY_DOWN, row, col, NULL, 0);
+            t += (uint64_t)(ms * 1e6);
+            ok = ok && script_add(t, SCRIPT_KEY_UP, row, col, NULL, 0);
+        }
+        else if (!strcmp(word, "power"))
+        {
+            if (sscanf(line, "%*s %lf", &ms) != 1)
+                ms = SCRIPT_POWER_MS;
+            ok = script_add(t, SCRIPT_POWER_DOWN, 0, 0, NULL, 0);
+            t += (uint64_t)(ms * 1e6);
+            ok = ok && script_add(t, SCRIPT_POWER_UP, 0, 0, NULL, 0);
+        }
+        else if (!strcmp(word, "type"))
+        {
+            // the rest of the line, comments already cut off
+            char *text = strstr(line, "type") + 4;
+            text += strspn(text, " \t");
+            text[strcspn(text, "\r\n")] = '\0';
+            for (size_t len = strlen(text); len > 0 && (text[len - 1] == ' ' || text[len - 1] == '\t'); len--)
+                text[len - 1] = '\0'; // spaces before a comment
+
+            char *typed = malloc(strlen(text) + 2);
+            sprintf(typed, "%s\n", text);
+            ok = script_add(t, SCRIPT_TYPE, 0, 0, typed, 0);
+        }
+        else if (!strcmp(word, "send"))
+        {
+            char *hex = strstr(line, "send") + 4;
+            char *bytes = malloc(strlen(hex) / 2 + 1);
+            unsigned byte;
+            int used;
+            n = 0;
+            while (sscanf(hex, " %2x%n", &byte, &used) == 1)
+            {
+                bytes[n++] = byte;
+                hex += used;
+            }
+            hex += strspn(hex, " \t\r\n");
+            ok = n > 0 && !*hex && script_add(t, SCRIPT_SEND, 0, 0, bytes, n);
+        }
+        else if (!strcmp(word, "battery") && sscanf(line, "%*s %d", &n) == 1)
+        {
+            ok = script_add(t, SCRIPT_BATTERY, 0, 0, NULL, n);
+        }
+        else if (!strcmp(word, "charger") && sscanf(line, "%*s %15s", word) == 1 &&
+                 (!strcmp(word, "off") || !strcmp(word, "charging") || !strcmp(word, "full")))
+        {
+            enum ChargerState charger = CHARGER_FULL;
+            if (!strcmp(word, "off"))
+                charger = CHARGER_OFF;
+            else if (!strcmp(word, "charging"))
+                charger = CHARGER_CHARGING;
+            ok = script_add(t, SCRIPT_CHARGER, 0, 0, NULL, charger);
+        }
+        else if (!strcmp(word, "repeat") && sscanf(line, "%*s %d", &n) == 1 && depth < SCRIPT_MAX_DEPTH)
+        {
+            loop_pos[depth] = ftell(in);
+            loop_line[depth] = line_no;
+            loop_left[depth] = n;
+            depth++;
+        }
+        else if (!strcmp(word, "end") && depth > 0)
+        {
+            if (--loop_left[depth - 1] > 0)
+            {
+                fseek(in, loop_pos[depth - 1], SEEK_SET);
+                line_no = loop_line[depth - 1];
+            }
+            else
+            {
+                depth--;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "%s:%d: cannot parse: %s", path, line_no, line);
+            ok = false;
+        }
+    }
+    fclose(in);
+    return ok;
+}
+
+static void script_step(uint32_t unused)
+{
+    (void)unused;
+
+    uint64_t now = sim_now_ns();
+    while (step_next < step_count && steps[step_next].at_ns <= now)
+    {
+        struct ScriptStep *step = &steps[step_next++];
+        switch (step->action)
+        {
+        case SCRIPT_KEY_DOWN:
+        case SCRIPT_KEY_UP:
+            sim_tca8418_key(step->row, step->col, step->action == SCRIPT_KEY_DOWN);
+            break;
+        case SCRIPT_POWER_DOWN:
+        case SCRIPT_POWER_UP:
+            sim_gpio_drive(POWER_BTN, step->action == SCRIPT_POWER_UP); // active low
+            break;
+        case SCRIPT_TYPE:
+            sim_stdin_feed(step->text);
+            break;
+        case SCRIPT_SEND:
+            sim_stdin_feed_bytes((const uint8_t *)step->text, step->value);
+            break;
+        case SCRIPT_BATTERY:
+            sim_adc_battery_mv(step->value);
+            break;
+        case SCRIPT_CHARGER:
+            // open drain and active low, released when the charger is off
+            sim_gpio_drive(CHARGER_CHRG, step->value != CHARGER_CHARGING);
+            sim_gpio_drive(CHARGER_STDBY, step->value != CHARGER_FULL);
+            break;
+        }
+    }
+
+    if (step_next < step_count)
+        sim_schedule(steps[step_next].at_ns, script_step, 0);
+}
+
+/// @brief Schedule the first step of the loaded script, if any.
+void sim_script_start()
+{
+    if (step_next < step_count)
+        sim_schedule(steps[step_next].at_ns, script_step, 0);
+}
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "peripherals.h"
+
+// SSD1322 model. Decodes the command/data stream from spi0, using the DC and
+// CS pins, into display RAM, and writes the visible window out as a frame
+// each time the display side goes quiet after RAM was written.
+//
+// Only what is needed to reconstruct the picture is modelled: the column and
+// row windows, RAM writes, display on/off and inverse. Other commands are
+// accepted and their arguments ignored. Rows are taken top to bottom and
+// the high nibble of each byte as the left pixel, which is what the u8g2
+// NHD 256x64 setup produces with its remap settings.
+
+#define SSD1322_RAM_COLS 120 // column addresses, 4 pixels (2 bytes) each
+#define SSD1322_RAM_ROWS 128
+#define SSD1322_COL_OFFSET 28 // first column address wired to the 256 pixel wide panel
+#define SSD1322_WIDTH 256
+#define SSD1322_HEIGHT 64
+
+#define SSD1322_CMD_SET_COLUMN 0x15
+#define SSD1322_CMD_WRITE_RAM 0x5C
+#define SSD1322_CMD_SET_ROW 0x75
+#define SSD1322_CMD_ALL_OFF 0xA4
+#define SSD1322_CMD_ALL_ON 0xA5
+#define SSD1322_CMD_NORMAL 0xA6
+#define SSD1322_CMD_INVERSE 0xA7
+#define SSD1322_CMD_DISPLAY_OFF 0xAE
+#define SSD1322_CMD_DISPLAY_ON 0xAF
+
+static uint8_t ram[SSD1322_RAM_ROWS][SSD1322_RAM_COLS * 2];
+
+static uint8_t command;
+static uint8_t arg_index;
+static uint8_t col_start, col_end = SSD1322_RAM_COLS - 1;
+static uint8_t row_start, row_end = SSD1322_RAM_ROWS - 1;
+static uint8_t col, row, half;
+static uint8_t display_mode = SSD1322_CMD_NORMAL;
+static bool display_on;
+
+// bus statistics
+static uint32_t bytes_total;
+static uint32_t bytes_cs_high; // clocked out with CS released, lost on real hardware
+
+// frames
+static bool dirty; // RAM written since the last frame
+static uint64_t frame_start_ns;
+static uint32_t frame_bytes; // bus bytes since the last frame, commands included
+static uint64_t frame_host_ns;
+static uint32_t frames;
+static uint32_t frame_bytes_max;
+static uint64_t frame_ns_max;
+static uint64_t frame_bytes_sum;
+static const char *frame_dir;
+static FILE *frame_log;
+
+static void ram_write(uint8_t byte)
+{
+    ram[row][col * 2 + half] = byte;
+    dirty = true;
+
+    // horizontal address increment, wrapping inside the window
+    if (++half < 2)
+        return;
+    half = 0;
+    if (col++ < col_end)
+        return;
+    col = col_start;
+    if (row++ < row_end)
+        return;
+    row = row_start;
+}
+
+static void command_arg(uint8_t byte)
+{
+    switch (command)
+    {
+    case SSD1322_CMD_WRITE_RAM:
+        ram_write(byte);
+        return;
+    case SSD1322_CMD_SET_COLUMN:
+        if (arg_index == 0)
+            col_start = col = byte % SSD1322_RAM_COLS;
+        else if (arg_index == 1)
+            col_end = byte % SSD1322_RAM_COLS;
+        half = 0;
+        break;
+    case SSD1322_CMD_SET_ROW:
+        if (arg_index == 0)
+            row_start = row = byte % SSD1322_RAM_ROWS;
+        else if (arg_index == 1)
+            row_end = byte % SSD1322_RAM_ROWS;
+        break;
+    }
+    arg_index++;
+}
+
+static void command_start(uint8_t byte)
+{
+    command = byte;
+    arg_index = 0;
+
+    switch (byte)
+    {
+    case SSD1322_CMD_WRITE_RAM:
+        col = col_start;
+        row = row_start;
+        half = 0;
+        break;
+    case SSD1322_CMD_ALL_OFF:
+    case SSD1322_CMD_ALL_ON:
+    case SSD1322_CMD_NORMAL:
+    case SSD1322_CMD_INVERSE:
+        display_mode = byte;
+        dirty = true;
+        break;
+    case SSD1322_CMD_DISPLAY_OFF:
+    case SSD1322_CMD_DISPLAY_ON:
+        display_on = byte == SSD1322_CMD_DISPLAY_ON;
+        dirty = true;
+        break;
+    }
+}
+
+/// @brief A byte clocked out on spi0. DC and CS are sampled as it goes out.
+void sim_ssd1322_byte(uint8_t byte)
+{
+    if (frame_bytes == 0)
+    {
+        frame_start_ns = sim_now_ns();
+        frame_host_ns = sim_host_ns();
+    }
+    bytes_total++;
+    frame_bytes++;
+
+    if (sim_gpio_level(OLED_CS))
+    {
+        if (bytes_cs_high++ == 0)
+            sim_fail("byte clocked out to the OLED with CS released");
+        return;
+    }
+
+    if (sim_gpio_level(OLED_DC))
+        command_arg(byte);
+    else
+        command_start(byte);
+}
+
+static uint8_t pixel(int x, int y)
+{
+    if (!display_on || display_mode == SSD1322_CMD_ALL_OFF)
+        return 0;
+    if (display_mode == SSD1322_CMD_ALL_ON)
+        return 15;
+
+    uint8_t byte = ram[y][SSD1322_COL_OFFSET * 2 + x / 2];
+    uint8_t level = x % 2 ? byte & 0x0F : byte >> 4;
+    return display_mode == SSD1322_CMD_INVERSE ? 15 - level : level;
+}
+
+static void frame_write_pgm(uint32_t index)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/frame_%04lu.pgm", frame_dir, (unsigned long)index);
+
+    FILE *out = fopen(path, "wb");
+    if (!out)
+        return;
+
+    fprintf(out, "P5\n%d %d\n255\n", SSD1322_WIDTH, SSD1322_HEIGHT);
+    for (int y = 0; y < SSD1322_HEIGHT; y++)
+        for (int x = 0; x < SSD1322_WIDTH; x++)
+            fputc(pixel(x, y) * 17, out);
+    fclose(out);
+}
+
+/// @brief Called by the scheduler when no core can run and no DMA is in flight. Closes a frame if RAM was written.
+void sim_ssd1322_idle()
+{
+    if (!dirty)
+        return;
+
+    uint64_t frame_ns = sim_now_ns() - frame_start_ns;
+    uint64_t host_ns = sim_host_ns() - frame_host_ns;
+
+    if (frame_dir)
+        frame_write_pgm(frames);
+    if (frame_log)
+        fprintf(frame_log, "%lu,%.3f,%.3f,%lu,%.3f\n", (unsigned long)frames, frame_start_ns / 1e3,
+                sim_now_ns() / 1e3, (unsigned long)frame_bytes, host_ns / 1e3);
+
+    if (sim_options.max_frame_bytes && frame_bytes > sim_options.max_frame_bytes)
+        sim_fail("frame sent more bytes than --max-frame-bytes");
+    if (sim_options.max_frame_us && frame_ns > sim_options.max_frame_us * 1000ull)
+        sim_fail("frame took longer than --max-frame-us");
+
+    frames++;
+    frame_bytes_sum += frame_bytes;
+    if (frame_bytes > frame_bytes_max)
+        frame_bytes_max = frame_bytes;
+    if (frame_ns > frame_ns_max)
+        frame_ns_max = frame_ns;
+
+    frame_bytes = 0;
+    dirty = false;
+}
+
+/// @brief Write frames as DIR/frame_NNNN.pgm and their timing to DIR/frames.csv.
+void sim_ssd1322_open(const char *dir)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/frames.csv", dir);
+    frame_dir = dir;
+    frame_log = fopen(path, "w");
+    if (frame_log)
+        fprintf(frame_log, "frame,start_us,end_us,bytes,host_us\n");
+}
+
+void sim_ssd1322_report(FILE *out)
+{
+    fprintf(out, "frames=%lu\n", (unsigned long)frames);
+    fprintf(out, "frame_bytes_max=%lu\n", (unsigned long)frame_bytes_max);
+    fprintf(out, "frame_bytes_mean=%lu\n", (unsigned long)(frames ? frame_bytes_sum / frames : 0));
+    fprintf(out, "frame_us_max=%.3f\n", frame_ns_max / 1e3);
+    fprintf(out, "spi_bytes=%lu\n", (unsigned long)bytes_total);
+    fprintf(out, "spi_bytes_cs_high=%lu\n", (unsigned long)bytes_cs_high);
+    if (frame_log)
+        fflush(frame_log);
+}
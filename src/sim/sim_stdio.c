@@ -0,0 +1,79 @@
+#include <string.h>
+#include "sim.h"
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+
+// USB stdio input. Output is plain printf to the host's stdout. Input comes
+// from the key script, and like the SDK's USB stdio it notifies the firmware
+// from the USB interrupt on core 0.
+
+#define SIM_STDIN_SIZE 65536
+
+static char input[SIM_STDIN_SIZE];
+static uint32_t input_head;
+static uint32_t input_tail;
+
+static void (*chars_available)(void *);
+static void *chars_available_param;
+
+static void usb_irq_handler()
+{
+    sim_irq_set_line(0, USBCTRL_IRQ, false);
+    if (chars_available)
+        chars_available(chars_available_param);
+}
+
+/// @brief Bytes sent from the host side of the USB serial port.
+void sim_stdin_feed_bytes(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        if (input_head - input_tail < SIM_STDIN_SIZE)
+            input[input_head++ % SIM_STDIN_SIZE] = data[i];
+
+    sim_irq_set_line(0, USBCTRL_IRQ, true);
+}
+
+/// @brief Characters typed on the host side of the USB serial port.
+void sim_stdin_feed(const char *text)
+{
+    sim_stdin_feed_bytes((const uint8_t *)text, strlen(text));
+}
+
+void stdio_set_chars_available_callback(void (*fn)(void *), void *param)
+{
+    chars_available = fn;
+    chars_available_param = param;
+    irq_add_shared_handler(USBCTRL_IRQ, usb_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(USBCTRL_IRQ, true);
+}
+
+int getchar_timeout_us(uint32_t timeout_us)
+{
+    if (input_tail == input_head && timeout_us)
+        sim_sleep_ns(timeout_us * 1000ull);
+    if (input_tail == input_head)
+        return PICO_ERROR_TIMEOUT;
+    return (uint8_t)input[input_tail++ % SIM_STDIN_SIZE];
+}
+
+int stdio_get_until(char *buf, int len, absolute_time_t until)
+{
+    int n = 0;
+    sim_check_divider("USB", 48 * MHZ, clock_get_hz(clk_usb));
+    while (input_tail == input_head && time_us_64() < until)
+        sim_sleep_ns(1000);
+    while (n < len && input_tail != input_head)
+        buf[n++] = input[input_tail++ % SIM_STDIN_SIZE];
+    return n ? n : PICO_ERROR_TIMEOUT;
+}
+
+int stdio_put_string(const char *s, int len, bool newline, bool cr_translation)
+{
+    (void)cr_translation;
+    sim_check_divider("USB", 48 * MHZ, clock_get_hz(clk_usb));
+    fwrite(s, 1, len, stdout);
+    if (newline)
+        putchar('\n');
+    return len;
+}
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "peripherals.h"
+#include "tca8418.h"
+#include "hardware/i2c.h"
+#include "hardware/clocks.h"
+
+// I2C blocks and the TCA8418 keypad scanner on i2c1. The register file,
+// address pointer, auto-increment, key event FIFO, overflow modes and the
+// INT output are modelled; scanning and debouncing are not, key events
+// arrive from the script already debounced.
+
+#define TCA8418_FIFO_DEPTH 10
+
+i2c_inst_t sim_i2c[2];
+
+static uint8_t regs[TCA8418_REG_COUNT];
+static uint8_t pointer; // register address for the next byte
+static uint8_t fifo[TCA8418_FIFO_DEPTH];
+static uint8_t fifo_count;
+
+// statistics
+static uint32_t transactions;
+static uint32_t bytes;
+static uint32_t nacks;
+static uint32_t key_events;
+static uint32_t key_events_ignored; // not on a row and column configured for the matrix
+static uint32_t fifo_overflows;
+
+static void int_update()
+{
+    // INT is open drain and active low, asserted while an enabled status bit is set
+    uint8_t enabled = 0;
+    if (regs[TCA8418_REG_CFG] & TCA8418_REG_CFG_KE_IEN)
+        enabled |= TCA8418_REG_STAT_K_INT;
+    if (regs[TCA8418_REG_CFG] & TCA8418_REG_CFG_OVR_FLOW_IEN)
+        enabled |= TCA8418_REG_STAT_OVR_FLOW_INT;
+
+    bool asserted = regs[TCA8418_REG_INT_STAT] & enabled;
+    if (sim_gpio_level(TCA8418_INT) == asserted)
+        sim_gpio_drive(TCA8418_INT, !asserted);
+}
+
+static uint8_t fifo_pop()
+{
+    if (fifo_count == 0)
+        return 0;
+
+    uint8_t event = fifo[0];
+    for (int i = 1; i < fifo_count; i++)
+        fifo[i - 1] = fifo[i];
+    fifo_count--;
+    return event;
+}
+
+static uint8_t reg_read(uint8_t reg)
+{
+    switch (reg)
+    {
+    case TCA8418_REG_KEY_LCK_EC:
+        return (regs[reg] & 0xF0) | fifo_count;
+    case TCA8418_REG_KEY_EVENT_A:
+        return fifo_pop();
+    default:
+        if (reg > TCA8418_REG_KEY_EVENT_A && reg <= TCA8418_REG_KEY_EVENT_J)
+            return reg - TCA8418_REG_KEY_EVENT_A < fifo_count ? fifo[reg - TCA8418_REG_KEY_EVENT_A] : 0;
+        return reg < TCA8418_REG_COUNT ? regs[reg] : 0;
+    }
+}
+
+static void reg_write(uint8_t reg, uint8_t value)
+{
+    switch (reg)
+    {
+    case TCA8418_REG_INT_STAT:
+        regs[reg] &= ~value; // write 1 to clear
+        break;
+    case TCA8418_REG_KEY_LCK_EC:
+        regs[reg] = (regs[reg] & 0x0F) | (value & 0xF0);
+        break;
+    default:
+        if (reg < TCA8418_REG_COUNT && (reg < TCA8418_REG_KEY_EVENT_A || reg > TCA8418_REG_KEY_EVENT_J))
+            regs[reg] = value;
+        break;
+    }
+    int_update();
+}
+
+static void pointer_advance()
+{
+    if (regs[TCA8418_REG_CFG] & TCA8418_REG_CFG_AI)
+        pointer = (pointer + 1) % TCA8418_REG_COUNT;
+}
+
+/// @brief Bytes written to the TCA8418: the register address, then data for consecutive registers.
+int sim_tca8418_write(const uint8_t *src, size_t len)
+{
+    if (len == 0)
+        return 0;
+
+    pointer = src[0];
+    for (size_t i = 1; i < len; i++)
+    {
+        reg_write(pointer, src[i]);
+        pointer_advance();
+    }
+    return len;
+}
+
+/// @brief Bytes read from the TCA8418, starting at the register address last written.
+int sim_tca8418_read(uint8_t *dst, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        dst[i] = reg_read(pointer);
+        pointer_advance();
+    }
+    return len;
+}
+
+/// @brief Put a key event in the FIFO, as the scanner would once the key is debounced.
+void sim_tca8418_key(uint8_t row, uint8_t col, bool pressed)
+{
+    // only rows and columns configured for the matrix generate key events
+    bool row_in_matrix = regs[TCA8418_REG_KP_GPIO_1] & (1u << row);
+    bool col_in_matrix = col < 8 ? regs[TCA8418_REG_KP_GPIO_2] & (1u << col)
+                                 : regs[TCA8418_REG_KP_GPIO_3] & (1u << (col - 8));
+    if (!row_in_matrix || !col_in_matrix)
+    {
+        key_events_ignored++;
+        return;
+    }
+
+    uint8_t event = (row * 10 + col + 1) | (pressed ? 0x80 : 0); // key numbers are 1 based, bit 7 set on press
+    key_events++;
+
+    if (fifo_count == TCA8418_FIFO_DEPTH)
+    {
+        fifo_overflows++;
+        regs[TCA8418_REG_INT_STAT] |= TCA8418_REG_STAT_OVR_FLOW_INT;
+        if (regs[TCA8418_REG_CFG] & TCA8418_REG_CFG_OVR_FLOW_M)
+        {
+            fifo_pop(); // overflow mode, the oldest event is pushed out
+            fifo[fifo_count++] = event;
+        }
+    }
+    else
+    {
+        fifo[fifo_count++] = event;
+    }
+
+    regs[TCA8418_REG_INT_STAT] |= TCA8418_REG_STAT_K_INT;
+    int_update();
+}
+
+/// @brief Power on state. INT has an external pull-up, so it reads high until the chip asserts it.
+void sim_tca8418_reset()
+{
+    sim_gpio_drive(TCA8418_INT, true);
+}
+
+// I2C, blocking transfers take bus time: 9 clocks a byte, address byte included
+
+static int i2c_transfer(i2c_inst_t *i2c, uint8_t addr, size_t len)
+{
+    uint baudrate = i2c->baudrate ? i2c->baudrate : 100000;
+    if (i2c->baudrate)
+        sim_check_divider("I2C", i2c->clk_hz, clock_get_hz(clk_sys));
+
+    transactions++;
+    bytes += len;
+    sim_sleep_ns((uint64_t)(len + 1) * 9 * 1000000000u / baudrate);
+
+    if (i2c != TCA8418_I2C_PORT || addr != TCA8418_I2C_ADDR)
+    {
+        nacks++;
+        return PICO_ERROR_GENERIC;
+    }
+    return len;
+}
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate)
+{
+    return i2c_set_baudrate(i2c, baudrate);
+}
+
+void i2c_deinit(i2c_inst_t *i2c)
+{
+    i2c->baudrate = 0;
+}
+
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate)
+{
+    i2c->baudrate = baudrate;
+    i2c->clk_hz = clock_get_hz(clk_sys);
+    return baudrate;
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop)
+{
+    (void)nostop;
+    int result = i2c_transfer(i2c, addr, len);
+    return result < 0 ? result : sim_tca8418_write(src, len);
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop)
+{
+    (void)nostop;
+    int result = i2c_transfer(i2c, addr, len);
+    return result < 0 ? result : sim_tca8418_read(dst, len);
+}
+
+// I2C driven by DMA. The command words written to IC_DATA_CMD run on the bus
+// as they arrive, the way SPI bytes reach the display: their effect on the
+// device is immediate, and the bus time adds up behind the bytes already
+// queued. Each START or RESTART costs an address byte. Bytes read wait in the
+// receive FIFO along with the time their last clock ends, and the RX DMA
+// channel completes once that time has come. An address the device does not
+// answer would abort the transfer, which is not modelled, so the run fails.
+
+#define SIM_I2C_RX_FIFO 64
+
+struct SimI2cCommands
+{
+    bool active;  // a START has gone out and no STOP since
+    bool reading; // direction of the current transaction
+    uint8_t write[TCA8418_REG_COUNT + 1];
+    size_t write_len;      // bytes of the write in progress, handed to the device together
+    uint64_t bus_until_ns; // when the last byte queued leaves the bus
+    uint8_t rx[SIM_I2C_RX_FIFO];
+    uint64_t rx_ns[SIM_I2C_RX_FIFO]; // when each byte was in
+    uint32_t rx_count;
+};
+
+static struct SimI2cCommands commands[2];
+
+static void command_byte(i2c_inst_t *i2c, struct SimI2cCommands *c)
+{
+    uint baudrate = i2c->baudrate ? i2c->baudrate : 100000;
+    uint64_t now = sim_now_ns();
+    if (c->bus_until_ns < now)
+        c->bus_until_ns = now;
+    c->bus_until_ns += 9 * 1000000000ull / baudrate;
+}
+
+static void command_write_end(struct SimI2cCommands *c)
+{
+    if (c->write_len)
+        sim_tca8418_write(c->write, c->write_len);
+    c->write_len = 0;
+}
+
+/// @brief Run a command word written to IC_DATA_CMD by DMA.
+void sim_i2c_command(i2c_inst_t *i2c, uint32_t command)
+{
+    struct SimI2cCommands *c = &commands[i2c_get_index(i2c)];
+    bool read = command & I2C_IC_DATA_CMD_CMD_BITS;
+
+    if (i2c->baudrate)
+        sim_check_divider("I2C", i2c->clk_hz, clock_get_hz(clk_sys));
+
+    if (!c->active || read != c->reading || (command & I2C_IC_DATA_CMD_RESTART_BITS))
+    {
+        // START, or a RESTART when the direction changes: the address byte
+        command_write_end(c);
+        if (i2c != TCA8418_I2C_PORT || i2c->hw.tar != TCA8418_I2C_ADDR)
+        {
+            nacks++;
+            sim_fail("I2C address not answered in a DMA transfer");
+        }
+        transactions++;
+        c->active = true;
+        c->reading = read;
+        command_byte(i2c, c);
+    }
+
+    bytes++;
+    command_byte(i2c, c);
+    if (read)
+    {
+        if (c->rx_count == SIM_I2C_RX_FIFO)
+            sim_fail("I2C receive FIFO overflow, nothing is reading it");
+        sim_tca8418_read(&c->rx[c->rx_count], 1);
+        c->rx_ns[c->rx_count++] = c->bus_until_ns;
+    }
+    else if (c->write_len < sizeof(c->write))
+    {
+        c->write[c->write_len++] = (uint8_t)command;
+    }
+
+    if (command & I2C_IC_DATA_CMD_STOP_BITS)
+    {
+        command_write_end(c);
+        c->active = false;
+    }
+}
+
+/// @brief When the last command word queued will have left the bus.
+uint64_t sim_i2c_bus_until_ns(i2c_inst_t *i2c)
+{
+    return commands[i2c_get_index(i2c)].bus_until_ns;
+}
+
+/// @brief When the first count bytes of the receive FIFO are all in, or UINT64_MAX if they have not been asked for yet.
+uint64_t sim_i2c_rx_ready_ns(i2c_inst_t *i2c, uint32_t count)
+{
+    struct SimI2cCommands *c = &commands[i2c_get_index(i2c)];
+    if (count == 0)
+        return sim_now_ns();
+    return count <= c->rx_count ? c->rx_ns[count - 1] : UINT64_MAX;
+}
+
+/// @brief Take the oldest byte from the receive FIFO.
+uint8_t sim_i2c_rx_pop(i2c_inst_t *i2c)
+{
+    struct SimI2cCommands *c = &commands[i2c_get_index(i2c)];
+    if (c->rx_count == 0)
+        return 0;
+
+    uint8_t value = c->rx[0];
+    c->rx_count--;
+    memmove(c->rx, c->rx + 1, c->rx_count);
+    memmove(c->rx_ns, c->rx_ns + 1, c->rx_count * sizeof(c->rx_ns[0]));
+    return value;
+}
+
+void sim_i2c_report(FILE *out)
+{
+    fprintf(out, "i2c_transactions=%lu\n", (unsigned long)transactions);
+    fprintf(out, "i2c_bytes=%lu\n", (unsigned long)bytes);
+    fprintf(out, "i2c_nacks=%lu\n", (unsigned long)nacks);
+    fprintf(out, "key_events=%lu\n", (unsigned long)key_events);
+    fprintf(out, "key_events_ignored=%lu\n", (unsigned long)key_events_ignored);
+    fprintf(out, "key_fifo_overflows=%lu\n", (unsigned long)fifo_overflows);
+}
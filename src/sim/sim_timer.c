@@ -0,0 +1,98 @@
+#include "sim.h"
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+
+// The SDK's default alarm pool: callbacks run from TIMER_IRQ_3 on core 0,
+// and their return value reschedules them, as in pico_time.
+
+#define SIM_MAX_ALARMS 16
+
+struct SimAlarm
+{
+    uint64_t at_us;
+    alarm_callback_t callback;
+    void *user_data;
+    alarm_id_t id;
+    bool used;
+};
+
+static struct SimAlarm alarms[SIM_MAX_ALARMS];
+static alarm_id_t next_id = 1;
+static bool handler_added;
+
+static void alarm_due(uint32_t unused)
+{
+    (void)unused;
+    sim_irq_set_line(0, TIMER_IRQ_3, true);
+}
+
+static void alarm_irq_handler()
+{
+    sim_irq_set_line(0, TIMER_IRQ_3, false);
+
+    for (int i = 0; i < SIM_MAX_ALARMS; i++)
+    {
+        struct SimAlarm *alarm = &alarms[i];
+        uint64_t now = time_us_64();
+        if (!alarm->used || alarm->at_us > now)
+            continue;
+
+        alarm->used = false;
+        int64_t again = alarm->callback(alarm->id, alarm->user_data);
+        if (again == 0)
+            continue;
+
+        // positive is relative to when it was due, negative to now
+        alarm->at_us = again > 0 ? alarm->at_us + again : now - again;
+        alarm->used = true;
+        sim_schedule(alarm->at_us * 1000, alarm_due, 0);
+    }
+}
+
+/// @brief Schedule a callback. One already due fires from the next timer interrupt rather than from this call.
+alarm_id_t add_alarm_at(absolute_time_t time, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    if (time <= time_us_64() && !fire_if_past)
+        return 0;
+
+    if (!handler_added)
+    {
+        irq_add_shared_handler(TIMER_IRQ_3, alarm_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(TIMER_IRQ_3, true);
+        handler_added = true;
+    }
+
+    for (int i = 0; i < SIM_MAX_ALARMS; i++)
+    {
+        if (!alarms[i].used)
+        {
+            alarms[i] = (struct SimAlarm){time, callback, user_data, next_id++, true};
+            sim_schedule(time * 1000, alarm_due, 0);
+            return alarms[i].id;
+        }
+    }
+    return -1; // no free slot, as the SDK reports it
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    return add_alarm_at(time_us_64() + us, callback, user_data, fire_if_past);
+}
+
+alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback, void *user_data, bool fire_if_past)
+{
+    return add_alarm_at(time_us_64() + (uint64_t)ms * 1000, callback, user_data, fire_if_past);
+}
+
+bool cancel_alarm(alarm_id_t alarm_id)
+{
+    for (int i = 0; i < SIM_MAX_ALARMS; i++)
+    {
+        if (alarms[i].used && alarms[i].id == alarm_id)
+        {
+            alarms[i].used = false; // its scheduled interrupt finds nothing due
+            return true;
+        }
+    }
+    return false;
+}
@@ -1,7 +1,73 @@
+#include <string.h>
 #include "hardware/i2c.h"
 #include "hardware/gpio.h"
 #include "tca8418.h"
 #include "peripherals.h"
+#include "i2c_async.h"
+#include "hot_path.h"
+
+#define REG_BIT(reg) (1ull << (reg))
+#define TCA8418_BURST_GAP 2 // clean registers rewritten to join two dirty runs, a new transfer costs about 3 byte times
+
+// RAM copy of the configuration registers. The setters only change the copy;
+// TCA8418_sync() sends what changed as auto-increment bursts over
+// consecutive registers, and configuration reads are answered from the copy.
+static uint8_t shadow[TCA8418_REG_COUNT];
+static uint64_t known; // registers whose shadow holds what the chip has, or will once synced
+static uint64_t dirty; // registers changed in the shadow and not yet written
+
+// Registers that only hold what was written to them, so can be shadowed
+static bool shadowed(uint8_t reg) {
+  return reg == TCA8418_REG_CFG || reg == TCA8418_REG_KP_LCK_TIMER ||
+         (reg >= TCA8418_REG_GPIO_DAT_OUT_1 && reg <= TCA8418_REG_GPIO_PULL_3);
+}
+
+static void stage(uint8_t reg, uint8_t value) {
+  if ((known & REG_BIT(reg)) && shadow[reg] == value) return;
+  shadow[reg] = value;
+  known |= REG_BIT(reg);
+  dirty |= REG_BIT(reg);
+}
+
+static void write_cfg(uint8_t ai) {
+  uint8_t data[2] = {TCA8418_REG_CFG, shadow[TCA8418_REG_CFG] | ai};
+  i2c_write_blocking(TCA8418_I2C_PORT, TCA8418_I2C_ADDR, data, sizeof(data), false);
+}
+
+// Write every staged register change to the chip
+// Runs of consecutive registers go in one transfer with CFG_AI set for the
+// duration, then turned off again: TCA8418_get_events and the keypad drain
+// rely on the address staying on KEY_EVENT_A while they read.
+void TCA8418_sync(void) {
+  uint64_t pending = dirty & ~REG_BIT(TCA8418_REG_CFG);
+  bool ai = false;
+
+  if (!dirty) return;
+  i2c_async_acquire();
+
+  while (pending) {
+    uint8_t first = __builtin_ctzll(pending);
+    uint8_t last = first;
+    for (uint8_t reg = first + 1; reg < TCA8418_REG_COUNT && reg <= last + TCA8418_BURST_GAP + 1; reg++) {
+      if (!shadowed(reg) || !(known & REG_BIT(reg))) break;
+      if (pending & REG_BIT(reg)) last = reg;
+    }
+
+    if (last > first && !ai) {
+      write_cfg(TCA8418_REG_CFG_AI);
+      ai = true;
+    }
+    uint8_t data[1 + TCA8418_REG_COUNT];
+    data[0] = first;
+    memcpy(data + 1, shadow + first, last - first + 1);
+    i2c_write_blocking(TCA8418_I2C_PORT, TCA8418_I2C_ADDR, data, last - first + 2, false);
+    pending &= ~((REG_BIT(last + 1) - 1) & ~(REG_BIT(first) - 1));
+  }
+
+  if (ai || (dirty & REG_BIT(TCA8418_REG_CFG))) write_cfg(0);
+  dirty = 0;
+  i2c_async_release();
+}
 
 void TCA8418_init(void) {
   // Init I2C
@@ -12,26 +78,35 @@ void TCA8418_init(void) {
   gpio_pull_up(TCA8418_I2C_SDA);
   gpio_pull_up(TCA8418_I2C_SCL);
 
+  // The chip may still be configured from before a reset, so every
+  // configuration register is written rather than assumed
+  known = 0;
+  dirty = 0;
+  stage(TCA8418_REG_CFG, 0x00);
+  for (uint8_t reg = TCA8418_REG_GPIO_DAT_OUT_1; reg <= TCA8418_REG_GPIO_PULL_3; reg++) {
+    stage(reg, 0x00);
+  }
+
   // Set defaults
   // Set GPIO direction to input
-  TCA8418_write_register(TCA8418_REG_GPIO_DIR_1, 0x00);
-  TCA8418_write_register(TCA8418_REG_GPIO_DIR_2, 0x00);
-  TCA8418_write_register(TCA8418_REG_GPIO_DIR_3, 0x00);
+  stage(TCA8418_REG_GPIO_DIR_1, 0x00);
+  stage(TCA8418_REG_GPIO_DIR_2, 0x00);
+  stage(TCA8418_REG_GPIO_DIR_3, 0x00);
 
   // Add all pins to key events
-  TCA8418_write_register(TCA8418_REG_GPI_EM_1, 0xFF);
-  TCA8418_write_register(TCA8418_REG_GPI_EM_2, 0xFF);
-  TCA8418_write_register(TCA8418_REG_GPI_EM_3, 0xFF);
+  stage(TCA8418_REG_GPI_EM_1, 0xFF);
+  stage(TCA8418_REG_GPI_EM_2, 0xFF);
+  stage(TCA8418_REG_GPI_EM_3, 0xFF);
 
   // Set all pins to falling edge interrupt
-  TCA8418_write_register(TCA8418_REG_GPIO_INT_LVL_1, 0x00);
-  TCA8418_write_register(TCA8418_REG_GPIO_INT_LVL_2, 0x00);
-  TCA8418_write_register(TCA8418_REG_GPIO_INT_LVL_3, 0x00);
+  stage(TCA8418_REG_GPIO_INT_LVL_1, 0x00);
+  stage(TCA8418_REG_GPIO_INT_LVL_2, 0x00);
+  stage(TCA8418_REG_GPIO_INT_LVL_3, 0x00);
 
   // Add all pins to interrupts
-  TCA8418_write_register(TCA8418_REG_GPIO_INT_EN_1, 0xFF);
-  TCA8418_write_register(TCA8418_REG_GPIO_INT_EN_2, 0xFF);
-  TCA8418_write_register(TCA8418_REG_GPIO_INT_EN_3, 0xFF);
+  stage(TCA8418_REG_GPIO_INT_EN_1, 0xFF);
+  stage(TCA8418_REG_GPIO_INT_EN_2, 0xFF);
+  stage(TCA8418_REG_GPIO_INT_EN_3, 0xFF);
 }
 
 void TCA8418_matrix(uint8_t rows, uint8_t columns){
@@ -43,40 +118,59 @@ void TCA8418_matrix(uint8_t rows, uint8_t columns){
     mask <<= 1;
     mask |= 1;
   }
-  TCA8418_write_register(TCA8418_REG_KP_GPIO_1, mask);
+  stage(TCA8418_REG_KP_GPIO_1, mask);
 
   mask = 0x00;
   for (int c = 0; c < columns && c < 8; c++) {
     mask <<= 1;
     mask |= 1;
   }
-  TCA8418_write_register(TCA8418_REG_KP_GPIO_2, mask);
-
-  if (columns > 8) {
-    if (columns == 9) {
-      mask = 0x01;
-    }  else {
-      mask = 0x03;
-      TCA8418_write_register(TCA8418_REG_KP_GPIO_3, mask);
-    }
+  stage(TCA8418_REG_KP_GPIO_2, mask);
+
+  if (columns == 10) {
+    mask = 0x03;
+  } else if (columns == 9) {
+    mask = 0x01;
+  } else {
+    mask = 0x00;
   }
+  stage(TCA8418_REG_KP_GPIO_3, mask);
 }
 
-uint8_t TCA8418_read_register(uint8_t reg) {
+// Configuration registers come from the shadow once known, the rest from the chip
+uint8_t HOT_FUNC(TCA8418_read_register)(uint8_t reg) {
+  if (shadowed(reg) && (known & REG_BIT(reg))) return shadow[reg];
+
   uint8_t value;
+  i2c_async_acquire();
+  TCA8418_sync();
+  // repeated start, one transaction
   i2c_write_blocking(TCA8418_I2C_PORT, TCA8418_I2C_ADDR, &reg, 1, true);
   i2c_read_blocking(TCA8418_I2C_PORT, TCA8418_I2C_ADDR, &value, 1, false);
+  i2c_async_release();
+  if (shadowed(reg)) {
+    shadow[reg] = value;
+    known |= REG_BIT(reg);
+  }
   return value;
 }
 
-void TCA8418_write_register(uint8_t reg, uint8_t value) {
+// Written straight away, after any staged changes so the chip sees them in order
+void HOT_FUNC(TCA8418_write_register)(uint8_t reg, uint8_t value) {
   uint8_t data[2] = {reg, value};
+  i2c_async_acquire();
+  TCA8418_sync();
   i2c_write_blocking(TCA8418_I2C_PORT, TCA8418_I2C_ADDR, data, sizeof(data), false);
+  i2c_async_release();
+  if (shadowed(reg)) {
+    shadow[reg] = value;
+    known |= REG_BIT(reg);
+  }
 }
 
 // Get number of key events in buffer
-uint8_t TCA8418_available(void){
-  return TCA8418_read_register(TCA8418_REG_LCK_EC_KLEC_0) & 0x0F; // event count is in lower 4 bits
+uint8_t HOT_FUNC(TCA8418_available)(void){
+  return TCA8418_read_register(TCA8418_REG_KEY_LCK_EC) & 0x0F; // event count is in lower 4 bits
 }
 
 // Get key event from buffer
@@ -87,10 +181,38 @@ uint8_t TCA8418_get_event(void){
   return TCA8418_read_register(TCA8418_REG_KEY_EVENT_A);
 }
 
+// Get up to max key events from the buffer in a single I2C transfer
+// With auto-increment off the address stays on KEY_EVENT_A, so every byte read pops one event
+// Returns number of events read, events use the same format as TCA8418_get_event
+uint8_t HOT_FUNC(TCA8418_get_events)(uint8_t *events, uint8_t max){
+  i2c_async_acquire();
+  uint8_t count = TCA8418_available();
+  if (count > max) count = max;
+  if (count > 0) {
+    uint8_t reg = TCA8418_REG_KEY_EVENT_A;
+    i2c_write_blocking(TCA8418_I2C_PORT, TCA8418_I2C_ADDR, &reg, 1, true);
+    i2c_read_blocking(TCA8418_I2C_PORT, TCA8418_I2C_ADDR, events, count, false);
+  }
+  i2c_async_release();
+  return count;
+}
+
+// Get interrupt status, see TCA8418_REG_STAT_* bits
+uint8_t HOT_FUNC(TCA8418_get_interrupt_status)(void){
+  return TCA8418_read_register(TCA8418_REG_INT_STAT);
+}
+
+// Clear interrupt status bits, INT is held low until all set bits are cleared
+void HOT_FUNC(TCA8418_clear_interrupt_status)(uint8_t mask){
+  TCA8418_write_register(TCA8418_REG_INT_STAT, mask); // write 1 to clear
+}
+
 // Flush key events, returning number of events flushed
 uint8_t TCA8418_flush(void){
+  uint8_t events[10];
   uint8_t count = 0;
-  while(TCA8418_get_event() != 0) count++;
+  uint8_t read;
+  while((read = TCA8418_get_events(events, sizeof(events))) != 0) count += read;
   return count;
 }
 
@@ -103,7 +225,7 @@ void TCA8418_set_interrupt(uint8_t enable) {
   } else {
     cfg &= ~TCA8418_REG_CFG_KE_IEN; // disable key events interrupt
   }
-  TCA8418_write_register(TCA8418_REG_CFG, cfg);
+  stage(TCA8418_REG_CFG, cfg);
 }
 
 // enable/disable matrix overflow interrupt
@@ -117,14 +239,14 @@ void TCA8418_set_matrix_overflow(uint8_t enable) {
     cfg &= ~TCA8418_REG_CFG_OVR_FLOW_IEN; // disable overflow interrupt
     cfg &= ~TCA8418_REG_CFG_OVR_FLOW_M;   // disable overflow mode
   }
-  TCA8418_write_register(TCA8418_REG_CFG, cfg);
+  stage(TCA8418_REG_CFG, cfg);
 }
 
 // enable/disable debounce on all keys
 // 0 = disable, 1 = enable
 void TCA8418_set_debounce(uint8_t enable) {
   uint8_t value = enable ? 0xFF : 0x00;
-  TCA8418_write_register(TCA8418_REG_DEBOUNCE_DIS_1, value);
-  TCA8418_write_register(TCA8418_REG_DEBOUNCE_DIS_2, value);
-  TCA8418_write_register(TCA8418_REG_DEBOUNCE_DIS_3, value);
+  stage(TCA8418_REG_DEBOUNCE_DIS_1, value);
+  stage(TCA8418_REG_DEBOUNCE_DIS_2, value);
+  stage(TCA8418_REG_DEBOUNCE_DIS_3, value);
 }
\ No newline at end of file
@@ -49,6 +49,7 @@
 #define TCA8418_REG_GPIO_PULL_2 0x2D     // GPIO pull-up disable 2
 #define TCA8418_REG_GPIO_PULL_3 0x2E     // GPIO pull-up disable 3
 // #define TCA8418_REG_RESERVED          0x2F
+#define TCA8418_REG_COUNT 0x30
 
 //  FIELDS CONFIG REGISTER  1
 #define TCA8418_REG_CFG_AI 0x80           // Auto-increment for read/write
@@ -76,12 +77,22 @@
 #define TCA8418_REG_LCK_EC_KLEC_1 0x02   // Key event count bit 1
 #define TCA8418_REG_LCK_EC_KLEC_0 0x01   // Key event count bit 0
 
+// TCA8418_init, TCA8418_matrix and the TCA8418_set_* calls only change the
+// driver's copy of the registers. It is written by TCA8418_sync, or before
+// the next access that goes to the chip.
+// Accesses that go to the chip block until they are done, taking the bus
+// from i2c_async while they run. The keypad drain reads the FIFO with queued
+// i2c_async transfers instead, without waiting.
 void TCA8418_init(void);
+void TCA8418_sync(void);
 void TCA8418_matrix(uint8_t rows, uint8_t columns);
 uint8_t TCA8418_read_register(uint8_t reg);
 void TCA8418_write_register(uint8_t reg, uint8_t value);
 uint8_t TCA8418_available(void);
 uint8_t TCA8418_get_event(void);
+uint8_t TCA8418_get_events(uint8_t *events, uint8_t max);
+uint8_t TCA8418_get_interrupt_status(void);
+void TCA8418_clear_interrupt_status(uint8_t mask);
 uint8_t TCA8418_flush(void);
 void TCA8418_set_interrupt(uint8_t enable);
 void TCA8418_set_matrix_overflow(uint8_t enable);
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.h"
+#include "pico/stdlib.h"
+#include "pico/sync.h"
+#include "hot_path.h"
+
+#if TRACE_ENABLED
+
+// Spans are recorded when they end, into one ring shared by both cores.
+// Recording takes a critical section for a handful of stores, so it is safe
+// from IRQ handlers. Dumping pauses recording instead of copying the ring,
+// so the output is consistent without holding up the other core.
+
+#define TRACE_INSTANT 0xFFFFFFFF // dur_us of a trace_mark() record
+#define TRACE_BUCKETS 16         // log2 histogram buckets, the last one is open ended
+
+struct TraceRecord
+{
+    uint64_t start_us;
+    uint32_t dur_us;
+    uint16_t id;  // key that caused this, 0 if none
+    uint8_t span; // enum TraceSpan
+    uint8_t core;
+};
+
+static const char *const span_names[TRACE_SPAN_COUNT] = {
+    [TRACE_IRQ] = "irq",
+    [TRACE_DRAIN] = "fifo_drain",
+    [TRACE_EVALUATE] = "evaluate",
+    [TRACE_RENDER] = "render",
+    [TRACE_SPI] = "spi_transfer",
+    [TRACE_LED_LATCH] = "led_latch",
+};
+
+static struct TraceRecord ring[TRACE_RING_SIZE];
+static uint32_t ring_head; // total records written, the oldest are overwritten
+static bool recording;
+static critical_section_t lock;
+static volatile uint16_t last_key;
+
+static uint32_t scratch[TRACE_RING_SIZE]; // durations being sorted for percentiles
+
+static void HOT_FUNC(trace_record)(uint8_t span, uint64_t start, uint32_t dur, uint16_t id)
+{
+    critical_section_enter_blocking(&lock);
+    if (recording)
+    {
+        struct TraceRecord *record = &ring[ring_head % TRACE_RING_SIZE];
+        record->start_us = start;
+        record->dur_us = dur;
+        record->id = id;
+        record->span = span;
+        record->core = get_core_num();
+        ring_head++;
+    }
+    critical_section_exit(&lock);
+}
+
+/// @brief Init the trace ring and start recording. Call before any span can end.
+void trace_init()
+{
+    critical_section_init(&lock);
+    recording = true;
+}
+
+/// @brief Record a span that started at `start`, a value from trace_begin(), and ends now.
+/// @param span enum TraceSpan
+/// @param start start time
+/// @param id key that caused this, from trace_next_key() or trace_last_key()
+void HOT_FUNC(trace_end)(uint8_t span, uint64_t start, uint16_t id)
+{
+    uint64_t now = time_us_64();
+    trace_record(span, start, now - start, id);
+}
+
+/// @brief Record an instant event.
+/// @param span enum TraceSpan
+/// @param id key that caused this
+void HOT_FUNC(trace_mark)(uint8_t span, uint16_t id)
+{
+    trace_record(span, time_us_64(), TRACE_INSTANT, id);
+}
+
+/// @brief Number the next key interrupt. Call from the IRQ, the id follows the key through the later spans.
+uint16_t HOT_FUNC(trace_next_key)()
+{
+    uint16_t id = last_key + 1;
+    if (id == 0)
+        id = 1; // 0 means no key
+    last_key = id;
+    return id;
+}
+
+/// @brief Id of the most recent key interrupt, for work that is not handed the id directly.
+uint16_t HOT_FUNC(trace_last_key)()
+{
+    return last_key;
+}
+
+/// @brief Drop everything recorded so far.
+void trace_clear()
+{
+    critical_section_enter_blocking(&lock);
+    ring_head = 0;
+    critical_section_exit(&lock);
+}
+
+static void trace_pause(bool pause)
+{
+    critical_section_enter_blocking(&lock);
+    recording = !pause;
+    critical_section_exit(&lock);
+}
+
+// records in the ring, oldest first
+static uint32_t trace_count()
+{
+    return ring_head < TRACE_RING_SIZE ? ring_head : TRACE_RING_SIZE;
+}
+
+static const struct TraceRecord *trace_at(uint32_t i)
+{
+    return &ring[(ring_head - trace_count() + i) % TRACE_RING_SIZE];
+}
+
+/// @brief Print the ring as Chrome trace event JSON, loadable in Perfetto or chrome://tracing.
+void trace_dump_json()
+{
+    trace_pause(true);
+
+    printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"core 0\"}},\n");
+    printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"core 1\"}}");
+
+    uint32_t count = trace_count();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const struct TraceRecord *record = trace_at(i);
+        printf(",\n{\"name\":\"%s\",\"pid\":0,\"tid\":%u,\"ts\":%llu,", span_names[record->span],
+               record->core, (unsigned long long)record->start_us);
+        if (record->dur_us == TRACE_INSTANT)
+            printf("\"ph\":\"i\",\"s\":\"t\"");
+        else
+            printf("\"ph\":\"X\",\"dur\":%lu", (unsigned long)record->dur_us);
+        printf(",\"args\":{\"key\":%u}}", record->id);
+    }
+    printf("\n]}\n");
+
+    trace_pause(false);
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// print percentiles and a log2 histogram of the first `count` entries of scratch
+static void print_histogram(const char *name, uint32_t count)
+{
+    if (count == 0)
+    {
+        printf("%-14s %6u\n", name, 0);
+        return;
+    }
+
+    qsort(scratch, count, sizeof(scratch[0]), compare_u32);
+    printf("%-14s %6lu %8lu %8lu %8lu\n", name, (unsigned long)count, (unsigned long)scratch[(count - 1) * 50 / 100],
+           (unsigned long)scratch[(count - 1) * 99 / 100], (unsigned long)scratch[count - 1]);
+
+    // bucket b holds [2^(b-1), 2^b) us, bucket 0 holds 0 us
+    uint32_t buckets[TRACE_BUCKETS] = {0};
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t b = scratch[i] ? 32 - __builtin_clz(scratch[i]) : 0;
+        buckets[b < TRACE_BUCKETS ? b : TRACE_BUCKETS - 1]++;
+    }
+    printf("  ");
+    for (int b = 0; b < TRACE_BUCKETS - 1; b++)
+        if (buckets[b])
+            printf(" <%lu:%lu", 1ul << b, (unsigned long)buckets[b]);
+    if (buckets[TRACE_BUCKETS - 1])
+        printf(" >=%lu:%lu", 1ul << (TRACE_BUCKETS - 2), (unsigned long)buckets[TRACE_BUCKETS - 1]);
+    printf("\n");
+}
+
+/// @brief Print p50, p99 and max of every span, and of key to photon, with a log2 histogram of each in us.
+void trace_dump_histograms()
+{
+    trace_pause(true);
+
+    uint32_t count = trace_count();
+    printf("%-14s %6s %8s %8s %8s  (us)\n", "span", "n", "p50", "p99", "max");
+
+    for (uint8_t span = 0; span < TRACE_SPAN_COUNT; span++)
+    {
+        if (span == TRACE_LED_LATCH)
+            continue; // instants, no duration
+
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < count; i++)
+            if (trace_at(i)->span == span)
+                scratch[n++] = trace_at(i)->dur_us;
+        print_histogram(span_names[span], n);
+    }
+
+    // Key to photon: from the key IRQ to the end of the SPI transfer of the
+    // first frame rendered after it, or the end of that render when nothing
+    // needed sending. States are coalesced, so the frame may carry a later key.
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const struct TraceRecord *irq = trace_at(i);
+        if (irq->span != TRACE_IRQ || irq->id == 0)
+            continue;
+
+        const struct TraceRecord *render = NULL;
+        uint64_t photon = 0;
+        for (uint32_t j = i + 1; j < count; j++)
+        {
+            const struct TraceRecord *record = trace_at(j);
+            if (!render && record->span == TRACE_RENDER && (int16_t)(record->id - irq->id) >= 0)
+            {
+                render = record;
+                photon = record->start_us + record->dur_us;
+            }
+            else if (render && record->span == TRACE_SPI && record->id == render->id)
+            {
+                photon = record->start_us + record->dur_us;
+                break;
+            }
+        }
+        if (photon)
+            scratch[n++] = photon - irq->start_us;
+    }
+    print_histogram("key_to_photon", n);
+
+    uint32_t leds = 0;
+    for (uint32_t i = 0; i < count; i++)
+        leds += trace_at(i)->span == TRACE_LED_LATCH;
+    printf("%-14s %6lu\n", span_names[TRACE_LED_LATCH], (unsigned long)leds);
+
+    trace_pause(false);
+}
+
+#endif
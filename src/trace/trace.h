@@ -0,0 +1,82 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/time.h"
+
+#define TRACE_RING_SIZE 512 // records kept, oldest overwritten first
+
+// Named spans along the key-to-photon path
+enum TraceSpan
+{
+    TRACE_IRQ,       // gpio_callback, from TCA8418_INT
+    TRACE_DRAIN,     // reading the TCA8418 FIFO
+    TRACE_EVALUATE,  // handling the decoded key events
+    TRACE_RENDER,    // drawing the new state on core 1
+    TRACE_SPI,       // from queueing a frame until its last byte has left the SPI block
+    TRACE_LED_LATCH, // new LED word latched, an instant
+    TRACE_SPAN_COUNT
+};
+
+#if TRACE_ENABLED
+
+/// @brief Timestamp for the start of a span, pass it to trace_end().
+static inline uint64_t trace_begin()
+{
+    return time_us_64();
+}
+
+void trace_init();
+void trace_end(uint8_t span, uint64_t start, uint16_t id);
+void trace_mark(uint8_t span, uint16_t id);
+uint16_t trace_next_key();
+uint16_t trace_last_key();
+void trace_clear();
+void trace_dump_json();
+void trace_dump_histograms();
+
+#else
+
+static inline uint64_t trace_begin()
+{
+    return 0;
+}
+
+static inline void trace_init()
+{
+}
+
+static inline void trace_end(uint8_t span, uint64_t start, uint16_t id)
+{
+}
+
+static inline void trace_mark(uint8_t span, uint16_t id)
+{
+}
+
+static inline uint16_t trace_next_key()
+{
+    return 0;
+}
+
+static inline uint16_t trace_last_key()
+{
+    return 0;
+}
+
+static inline void trace_clear()
+{
+}
+
+static inline void trace_dump_json()
+{
+}
+
+static inline void trace_dump_histograms()
+{
+}
+
+#endif
+
+#endif
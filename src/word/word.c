@@ -0,0 +1,610 @@
+#include <string.h>
+#include "word.h"
+#include "pico/stdlib.h"
+
+#if PICO_ON_DEVICE
+#include "hardware/divider.h"
+#endif
+
+// Integer engine for the word sizes of the calculator. A word is up to four
+// 32-bit limbs, and every operation works on as many limbs as the size needs,
+// so 8 to 32 bits cost the same as plain uint32_t arithmetic.
+//
+// The M0+ has a 32x32 multiply that keeps only the low half and a 32/32
+// hardware divider, and nothing wider. Products are built from 16x16 partial
+// products, which fit the multiply, and quotients from 16-bit digits, whose
+// partial dividends fit the divider. Both skip the limbs of an operand that
+// are zero, so small numbers in a wide word stay cheap.
+
+static inline int limbs_of(uint8_t bits)
+{
+    return bits <= 32 ? 1 : bits / 32;
+}
+
+static inline uint32_t top_mask(uint8_t bits)
+{
+    return bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1;
+}
+
+static inline bool sign_of(const struct Word *a, uint8_t bits)
+{
+    return (a->limb[(bits - 1) / 32] >> ((bits - 1) % 32)) & 1;
+}
+
+/// @brief Limbs up to the highest one that is not zero, 0 for a zero word.
+static inline int significant_limbs(const struct Word *a, int n)
+{
+    while (n > 0 && a->limb[n - 1] == 0)
+        n--;
+    return n;
+}
+
+static inline void truncate(struct Word *a, uint8_t bits)
+{
+    int n = limbs_of(bits);
+    a->limb[n - 1] &= top_mask(bits);
+    for (int i = n; i < WORD_LIMBS; i++)
+        a->limb[i] = 0;
+}
+
+/// @brief Set every bit from bit `from` up to the word size.
+static void fill_from(struct Word *a, uint32_t from, uint8_t bits)
+{
+    for (int i = 0; i < WORD_LIMBS; i++)
+    {
+        uint32_t low = i * 32;
+        if (low + 32 <= from)
+            continue;
+        a->limb[i] |= from > low ? ~0u << (from - low) : ~0u;
+    }
+    truncate(a, bits);
+}
+
+/// @brief 32-bit divide, quotient and remainder in one go.
+static inline uint32_t divmod_u32(uint32_t a, uint32_t b, uint32_t *remainder)
+{
+#if PICO_ON_DEVICE
+    divmod_result_t result = hw_divider_divmod_u32(a, b);
+    *remainder = to_remainder_u32(result);
+    return to_quotient_u32(result);
+#else
+    *remainder = a % b;
+    return a / b;
+#endif
+}
+
+/// @brief 32x32 to 64-bit product from four 16x16 products, the M0+ multiply only gives the low half.
+static inline uint32_t mul_32x32(uint32_t a, uint32_t b, uint32_t *hi)
+{
+    uint32_t a0 = a & 0xFFFF, a1 = a >> 16;
+    uint32_t b0 = b & 0xFFFF, b1 = b >> 16;
+    uint32_t p00 = a0 * b0;
+    uint32_t p01 = a0 * b1;
+    uint32_t p10 = a1 * b0;
+    uint32_t mid = (p00 >> 16) + (p01 & 0xFFFF) + (p10 & 0xFFFF); // below 3 << 16
+    *hi = a1 * b1 + (p01 >> 16) + (p10 >> 16) + (mid >> 16);
+    return (mid << 16) | (p00 & 0xFFFF);
+}
+
+/// @brief True for the word sizes the engine works in: 8, 16, 32, 64 and 128.
+bool word_bits_valid(uint8_t bits)
+{
+    return bits == 8 || bits == 16 || bits == 32 || bits == 64 || bits == 128;
+}
+
+/// @brief A word from a 64-bit value, truncated to the word size.
+void word_set(struct Word *out, uint64_t value, uint8_t bits)
+{
+    memset(out, 0, sizeof(*out));
+    out->limb[0] = (uint32_t)value;
+    out->limb[1] = value >> 32;
+    truncate(out, bits);
+}
+
+/// @brief WORD_SIGN and WORD_ZERO for a word.
+uint8_t word_flags(const struct Word *a, uint8_t bits)
+{
+    return (sign_of(a, bits) ? WORD_SIGN : 0) | (word_is_zero(a) ? WORD_ZERO : 0);
+}
+
+bool word_is_zero(const struct Word *a)
+{
+    return !(a->limb[0] | a->limb[1] | a->limb[2] | a->limb[3]);
+}
+
+bool word_bit(const struct Word *a, uint8_t bit)
+{
+    return bit < WORD_BITS_MAX && (a->limb[bit / 32] >> (bit % 32)) & 1;
+}
+
+/// @brief Change the word size of a value in place. Narrowing truncates, widening sign extends when signed.
+void word_resize(struct Word *a, uint8_t from_bits, uint8_t to_bits, bool is_signed)
+{
+    if (to_bits > from_bits && is_signed && sign_of(a, from_bits))
+        fill_from(a, from_bits, to_bits);
+    else
+        truncate(a, to_bits);
+}
+
+/// @brief a + b.
+/// @return WORD_CARRY on a carry out of the word, WORD_OVERFLOW when the signed sum does not fit
+uint8_t word_add(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits)
+{
+    int n = limbs_of(bits);
+    bool sign_a = sign_of(a, bits), sign_b = sign_of(b, bits);
+    uint32_t carry = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t sum = a->limb[i] + carry;
+        carry = sum < carry;
+        sum += b->limb[i];
+        carry |= sum < b->limb[i];
+        out->limb[i] = sum;
+    }
+    if (bits < 32)
+        carry = out->limb[0] >> bits; // the operands are below 1 << bits, so the sum carries into the limb
+    truncate(out, bits);
+
+    uint8_t flags = word_flags(out, bits) | (carry ? WORD_CARRY : 0);
+    if (sign_a == sign_b && sign_of(out, bits) != sign_a)
+        flags |= WORD_OVERFLOW;
+    return flags;
+}
+
+/// @brief a - b.
+/// @return WORD_CARRY on a borrow, WORD_OVERFLOW when the signed difference does not fit
+uint8_t word_sub(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits)
+{
+    int n = limbs_of(bits);
+    bool sign_a = sign_of(a, bits), sign_b = sign_of(b, bits);
+    uint32_t borrow = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t x = a->limb[i], y = b->limb[i];
+        uint32_t diff = x - y;
+        uint32_t next = x < y;
+        next |= diff < borrow;
+        out->limb[i] = diff - borrow;
+        borrow = next;
+    }
+    truncate(out, bits);
+
+    uint8_t flags = word_flags(out, bits) | (borrow ? WORD_CARRY : 0);
+    if (sign_a != sign_b && sign_of(out, bits) != sign_a)
+        flags |= WORD_OVERFLOW;
+    return flags;
+}
+
+/// @brief Two's complement negation, 0 - a with the flags of word_sub().
+uint8_t word_neg(struct Word *out, const struct Word *a, uint8_t bits)
+{
+    static const struct Word zero;
+    return word_sub(out, &zero, a, bits);
+}
+
+/// @brief Full product of the significant limbs, out has na + nb limbs.
+static void mul_limbs(uint32_t *out, const uint32_t *a, int na, const uint32_t *b, int nb)
+{
+    memset(out, 0, (na + nb) * sizeof(*out));
+    for (int i = 0; i < na; i++)
+    {
+        uint32_t carry = 0;
+        for (int j = 0; j < nb; j++)
+        {
+            uint32_t hi;
+            uint32_t lo = mul_32x32(a[i], b[j], &hi);
+            uint32_t sum = out[i + j] + lo;
+            hi += sum < lo; // hi is at most 0xFFFFFFFE, so neither add wraps it
+            sum += carry;
+            hi += sum < carry;
+            out[i + j] = sum;
+            carry = hi;
+        }
+        out[i + nb] = carry;
+    }
+}
+
+/// @brief a * b, the low half of the product.
+/// @return WORD_CARRY when the unsigned product does not fit, WORD_OVERFLOW when the signed one does not
+uint8_t word_mul(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits)
+{
+    bool sign_a = sign_of(a, bits), sign_b = sign_of(b, bits);
+    uint8_t flags = 0;
+
+    if (bits < 32)
+    {
+        // both operands fit 16 bits, so one multiply gives the whole product either way
+        uint32_t product = a->limb[0] * b->limb[0];
+        int32_t shift = 32 - bits;
+        int32_t signed_product = ((int32_t)(a->limb[0] << shift) >> shift) * ((int32_t)(b->limb[0] << shift) >> shift);
+        out->limb[0] = product;
+        truncate(out, bits);
+        if (product >> bits)
+            flags |= WORD_CARRY;
+        if (signed_product != (int32_t)(out->limb[0] << shift) >> shift)
+            flags |= WORD_OVERFLOW;
+        return flags | word_flags(out, bits);
+    }
+
+    int n = limbs_of(bits);
+    uint32_t product[2 * WORD_LIMBS] = {0};
+    int na = significant_limbs(a, n), nb = significant_limbs(b, n);
+    if (na && nb)
+        mul_limbs(product, a->limb, na, b->limb, nb);
+
+    // the high half of the signed product is the unsigned one less each operand the other is negative for
+    struct Word high, low;
+    memcpy(low.limb, product, sizeof(low.limb));
+    memcpy(high.limb, product + n, sizeof(high.limb));
+    truncate(&low, bits);
+    truncate(&high, bits);
+    if (!word_is_zero(&high))
+        flags |= WORD_CARRY;
+    if (sign_a)
+        word_sub(&high, &high, b, bits);
+    if (sign_b)
+        word_sub(&high, &high, a, bits);
+
+    struct Word extension = {0};
+    if (sign_of(&low, bits))
+        fill_from(&extension, 0, bits);
+    if (memcmp(&high, &extension, sizeof(high)))
+        flags |= WORD_OVERFLOW;
+
+    *out = low;
+    return flags | word_flags(out, bits);
+}
+
+/// @brief a * factor + addend, for entering a digit.
+/// @return WORD_CARRY when the result does not fit the word, which is then truncated
+uint8_t word_mul_small(struct Word *a, uint16_t factor, uint16_t addend, uint8_t bits)
+{
+    int n = limbs_of(bits);
+    uint32_t carry = addend;
+
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t lo = (a->limb[i] & 0xFFFF) * factor + carry;
+        uint32_t hi = (a->limb[i] >> 16) * factor + (lo >> 16);
+        a->limb[i] = (hi << 16) | (lo & 0xFFFF);
+        carry = hi >> 16;
+    }
+    if (bits < 32)
+        carry = a->limb[0] >> bits;
+    truncate(a, bits);
+    return word_flags(a, bits) | (carry ? WORD_CARRY : 0);
+}
+
+/// @brief Divide in place by a small divisor, a 16-bit digit at a time.
+/// @return remainder, 0 when divisor is 0
+uint16_t word_div_small(struct Word *a, uint16_t divisor, uint8_t bits)
+{
+    uint32_t remainder = 0;
+    if (divisor == 0)
+        return 0;
+
+    for (int i = limbs_of(bits) - 1; i >= 0; i--)
+    {
+        // each partial dividend is below divisor << 16, so it fits the 32-bit divider
+        uint32_t hi = divmod_u32((remainder << 16) | (a->limb[i] >> 16), divisor, &remainder);
+        uint32_t lo = divmod_u32((remainder << 16) | (a->limb[i] & 0xFFFF), divisor, &remainder);
+        a->limb[i] = (hi << 16) | lo;
+    }
+    return remainder;
+}
+
+/// @brief Knuth's algorithm D in 16-bit digits, whose estimates and remainders fit the 32-bit divider.
+/// @param u dividend, m digits
+/// @param v divisor, n >= 2 digits with the top one not zero, m >= n
+/// @param q m - n + 1 quotient digits
+/// @param r n remainder digits
+static void divide_digits(const uint16_t *u, int m, const uint16_t *v, int n, uint16_t *q, uint16_t *r)
+{
+    uint16_t un[2 * WORD_LIMBS + 1];
+    uint16_t vn[2 * WORD_LIMBS];
+    int s = __builtin_clz(v[n - 1]) - 16; // normalise so the top digit of the divisor has its top bit set
+
+    for (int i = n - 1; i > 0; i--)
+        vn[i] = (v[i] << s) | ((uint32_t)v[i - 1] >> (16 - s));
+    vn[0] = v[0] << s;
+    un[m] = (uint32_t)u[m - 1] >> (16 - s);
+    for (int i = m - 1; i > 0; i--)
+        un[i] = (u[i] << s) | ((uint32_t)u[i - 1] >> (16 - s));
+    un[0] = u[0] << s;
+
+    for (int j = m - n; j >= 0; j--)
+    {
+        // estimate from the top two digits, which is at most 2 too large
+        uint32_t rhat;
+        uint32_t qhat = divmod_u32(((uint32_t)un[j + n] << 16) | un[j + n - 1], vn[n - 1], &rhat);
+        while (qhat > 0xFFFF || qhat * vn[n - 2] > ((rhat << 16) | un[j + n - 2]))
+        {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat > 0xFFFF)
+                break;
+        }
+
+        // multiply and subtract
+        int32_t borrow = 0;
+        int32_t t;
+        for (int i = 0; i < n; i++)
+        {
+            uint32_t p = qhat * vn[i];
+            t = (int32_t)un[i + j] - borrow - (int32_t)(p & 0xFFFF);
+            un[i + j] = t;
+            borrow = (int32_t)(p >> 16) - (t >> 16);
+        }
+        t = (int32_t)un[j + n] - borrow;
+        un[j + n] = t;
+
+        q[j] = qhat;
+        if (t < 0)
+        {
+            // the estimate was one too large, add the divisor back
+            q[j]--;
+            uint32_t carry = 0;
+            for (int i = 0; i < n; i++)
+            {
+                uint32_t sum = (uint32_t)un[i + j] + vn[i] + carry;
+                un[i + j] = sum;
+                carry = sum >> 16;
+            }
+            un[j + n] += carry;
+        }
+    }
+
+    for (int i = 0; i < n - 1; i++)
+        r[i] = (un[i] >> s) | ((uint32_t)un[i + 1] << (16 - s));
+    r[n - 1] = un[n - 1] >> s;
+}
+
+static int significant_digits(const uint16_t *digits, int n)
+{
+    while (n > 0 && digits[n - 1] == 0)
+        n--;
+    return n;
+}
+
+/// @brief Unsigned division of n-limb words, b not zero.
+static void divide(struct Word *q, struct Word *r, const struct Word *a, const struct Word *b, int n)
+{
+    int na = significant_limbs(a, n), nb = significant_limbs(b, n);
+    memset(q, 0, sizeof(*q));
+    memset(r, 0, sizeof(*r));
+
+    if (na < nb || (na == nb && a->limb[na - 1] < b->limb[nb - 1]))
+    {
+        *r = *a;
+        return;
+    }
+    if (na == 1)
+    {
+        q->limb[0] = divmod_u32(a->limb[0], b->limb[0], &r->limb[0]);
+        return;
+    }
+
+    uint16_t u[2 * WORD_LIMBS], v[2 * WORD_LIMBS];
+    uint16_t qd[2 * WORD_LIMBS] = {0}, rd[2 * WORD_LIMBS] = {0};
+    for (int i = 0; i < n; i++)
+    {
+        u[2 * i] = a->limb[i];
+        u[2 * i + 1] = a->limb[i] >> 16;
+        v[2 * i] = b->limb[i];
+        v[2 * i + 1] = b->limb[i] >> 16;
+    }
+    int m = significant_digits(u, 2 * na);
+    int nv = significant_digits(v, 2 * nb);
+
+    if (nv == 1)
+    {
+        *q = *a;
+        r->limb[0] = word_div_small(q, v[0], n * 32);
+        return;
+    }
+    divide_digits(u, m, v, nv, qd, rd);
+
+    for (int i = 0; i < n; i++)
+    {
+        q->limb[i] = qd[2 * i] | (uint32_t)qd[2 * i + 1] << 16;
+        r->limb[i] = rd[2 * i] | (uint32_t)rd[2 * i + 1] << 16;
+    }
+}
+
+/// @brief a / b and a % b. Signed division truncates towards zero and the remainder takes the sign of a.
+/// @param quotient may be NULL
+/// @param remainder may be NULL
+/// @return WORD_DIV_ZERO when b is 0 and both results are 0. WORD_OVERFLOW for the most negative word
+/// divided by -1, whose quotient wraps to itself. The other flags are the quotient's.
+uint8_t word_div(struct Word *quotient, struct Word *remainder, const struct Word *a, const struct Word *b, uint8_t bits,
+                 bool is_signed)
+{
+    struct Word x = *a, y = *b, q, r;
+
+    if (word_is_zero(b))
+    {
+        memset(&q, 0, sizeof(q));
+        r = q;
+        if (quotient)
+            *quotient = q;
+        if (remainder)
+            *remainder = r;
+        return WORD_DIV_ZERO | WORD_ZERO;
+    }
+
+    bool negative_a = is_signed && sign_of(a, bits);
+    bool negative_b = is_signed && sign_of(b, bits);
+    if (negative_a)
+        word_neg(&x, &x, bits);
+    if (negative_b)
+        word_neg(&y, &y, bits);
+
+    divide(&q, &r, &x, &y, limbs_of(bits));
+
+    uint8_t flags = 0;
+    if (negative_a != negative_b)
+        word_neg(&q, &q, bits);
+    else if (negative_a && sign_of(&q, bits))
+        flags |= WORD_OVERFLOW;
+    if (negative_a)
+        word_neg(&r, &r, bits);
+
+    if (quotient)
+        *quotient = q;
+    if (remainder)
+        *remainder = r;
+    return flags | word_flags(&q, bits);
+}
+
+uint8_t word_and(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits)
+{
+    for (int i = 0; i < WORD_LIMBS; i++)
+        out->limb[i] = a->limb[i] & b->limb[i];
+    return word_flags(out, bits);
+}
+
+uint8_t word_or(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits)
+{
+    for (int i = 0; i < WORD_LIMBS; i++)
+        out->limb[i] = a->limb[i] | b->limb[i];
+    return word_flags(out, bits);
+}
+
+uint8_t word_xor(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits)
+{
+    for (int i = 0; i < WORD_LIMBS; i++)
+        out->limb[i] = a->limb[i] ^ b->limb[i];
+    return word_flags(out, bits);
+}
+
+uint8_t word_not(struct Word *out, const struct Word *a, uint8_t bits)
+{
+    for (int i = 0; i < WORD_LIMBS; i++)
+        out->limb[i] = ~a->limb[i];
+    truncate(out, bits);
+    return word_flags(out, bits);
+}
+
+/// @brief Shift amount of a word as the right operand of a shift, UINT32_MAX if it does not fit 32 bits.
+uint32_t word_shift_count(const struct Word *a)
+{
+    return a->limb[1] | a->limb[2] | a->limb[3] ? UINT32_MAX : a->limb[0];
+}
+
+/// @brief Shift left by whole limbs and bits, shift below the word size.
+static void shift_left(struct Word *out, const struct Word *a, uint32_t shift, int n)
+{
+    int whole = shift / 32;
+    int part = shift % 32;
+
+    for (int i = n - 1; i >= 0; i--) // downwards, so out may be a
+    {
+        uint32_t value = i >= whole ? a->limb[i - whole] << part : 0;
+        if (part && i > whole)
+            value |= a->limb[i - whole - 1] >> (32 - part);
+        out->limb[i] = value;
+    }
+}
+
+static void shift_right(struct Word *out, const struct Word *a, uint32_t shift, int n)
+{
+    int whole = shift / 32;
+    int part = shift % 32;
+
+    for (int i = 0; i < n; i++) // upwards, so out may be a
+    {
+        uint32_t value = i + whole < n ? a->limb[i + whole] >> part : 0;
+        if (part && i + whole + 1 < n)
+            value |= a->limb[i + whole + 1] << (32 - part);
+        out->limb[i] = value;
+    }
+}
+
+/// @brief a << shift, 0 once shift reaches the word size.
+/// @return WORD_CARRY if the last bit shifted out was set
+uint8_t word_shl(struct Word *out, const struct Word *a, uint32_t shift, uint8_t bits)
+{
+    bool carry = shift > 0 && shift <= bits && word_bit(a, bits - shift);
+    if (shift >= bits)
+        memset(out, 0, sizeof(*out));
+    else
+        shift_left(out, a, shift, limbs_of(bits));
+    truncate(out, bits);
+    return word_flags(out, bits) | (carry ? WORD_CARRY : 0);
+}
+
+/// @brief a >> shift. Arithmetic shifts copy the sign bit in, logical ones zeros.
+/// @return WORD_CARRY if the last bit shifted out was set
+uint8_t word_shr(struct Word *out, const struct Word *a, uint32_t shift, uint8_t bits, bool arithmetic)
+{
+    bool negative = arithmetic && sign_of(a, bits);
+    bool carry = shift > 0 && (shift <= bits ? word_bit(a, shift - 1) : negative);
+
+    if (shift >= bits)
+        memset(out, 0, sizeof(*out));
+    else
+        shift_right(out, a, shift, limbs_of(bits));
+    if (negative && shift > 0)
+        fill_from(out, shift >= bits ? 0 : bits - shift, bits);
+    truncate(out, bits);
+    return word_flags(out, bits) | (carry ? WORD_CARRY : 0);
+}
+
+/// @brief Rotate left by shift modulo the word size.
+/// @return WORD_CARRY if the bit rotated round into bit 0 is set
+uint8_t word_rol(struct Word *out, const struct Word *a, uint32_t shift, uint8_t bits)
+{
+    struct Word high, low;
+    shift &= bits - 1; // word sizes are powers of two
+
+    if (shift == 0)
+    {
+        *out = *a;
+        return word_flags(out, bits);
+    }
+    int n = limbs_of(bits);
+    shift_left(&high, a, shift, n);
+    shift_right(&low, a, bits - shift, n);
+    for (int i = 0; i < n; i++)
+        out->limb[i] = high.limb[i] | low.limb[i];
+    truncate(out, bits);
+    return word_flags(out, bits) | (out->limb[0] & 1 ? WORD_CARRY : 0);
+}
+
+/// @brief Rotate right by shift modulo the word size.
+/// @return WORD_CARRY if the bit rotated round into the top bit is set
+uint8_t word_ror(struct Word *out, const struct Word *a, uint32_t shift, uint8_t bits)
+{
+    shift &= bits - 1;
+    uint8_t flags = word_rol(out, a, (bits - shift) & (bits - 1), bits) & ~WORD_CARRY;
+    return shift && sign_of(out, bits) ? flags | WORD_CARRY : flags;
+}
+
+/// @brief Number of bits set.
+uint8_t word_popcount(const struct Word *a)
+{
+    uint8_t count = 0;
+    for (int i = 0; i < WORD_LIMBS; i++)
+    {
+        uint32_t x = a->limb[i];
+        x = x - ((x >> 1) & 0x55555555);
+        x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+        x = (x + (x >> 4)) & 0x0F0F0F0F;
+        count += (x * 0x01010101) >> 24;
+    }
+    return count;
+}
+
+/// @brief Leading zero bits within the word size, bits for a zero word.
+uint8_t word_clz(const struct Word *a, uint8_t bits)
+{
+    int n = limbs_of(bits);
+    int above = n * 32 - bits; // bits of the top limb that are not in the word
+
+    for (int i = n - 1; i >= 0; i--)
+        if (a->limb[i])
+            return (n - 1 - i) * 32 + __builtin_clz(a->limb[i]) - above;
+    return bits;
+}
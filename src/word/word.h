@@ -0,0 +1,60 @@
+#ifndef WORD_H
+#define WORD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WORD_LIMBS 4                 // 32-bit limbs, least significant first
+#define WORD_BITS_MAX (WORD_LIMBS * 32)
+
+// An integer of 8, 16, 32, 64 or 128 bits, two's complement when signed.
+// Bits above the word size are always zero, so the operations never look at
+// them and a word can be compared limb by limb.
+struct Word
+{
+    uint32_t limb[WORD_LIMBS];
+};
+
+// Condition flags of an operation, as a CPU sets them
+enum WordFlag
+{
+    WORD_CARRY = 1 << 0,    // unsigned result did not fit: carry out, borrow, or the last bit shifted out
+    WORD_OVERFLOW = 1 << 1, // signed result did not fit
+    WORD_SIGN = 1 << 2,     // top bit of the result
+    WORD_ZERO = 1 << 3,     // result is 0
+    WORD_DIV_ZERO = 1 << 4, // division or modulo by zero, the result is 0
+};
+
+bool word_bits_valid(uint8_t bits);
+void word_set(struct Word *out, uint64_t value, uint8_t bits);
+uint8_t word_flags(const struct Word *a, uint8_t bits);
+bool word_is_zero(const struct Word *a);
+bool word_bit(const struct Word *a, uint8_t bit);
+void word_resize(struct Word *a, uint8_t from_bits, uint8_t to_bits, bool is_signed);
+
+uint8_t word_add(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits);
+uint8_t word_sub(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits);
+uint8_t word_neg(struct Word *out, const struct Word *a, uint8_t bits);
+uint8_t word_mul(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits);
+uint8_t word_div(struct Word *quotient, struct Word *remainder, const struct Word *a, const struct Word *b, uint8_t bits,
+                 bool is_signed);
+uint8_t word_mul_small(struct Word *a, uint16_t factor, uint16_t addend, uint8_t bits);
+uint16_t word_div_small(struct Word *a, uint16_t divisor, uint8_t bits);
+
+uint8_t word_and(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits);
+uint8_t word_or(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits);
+uint8_t word_xor(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits);
+uint8_t word_not(struct Word *out, const struct Word *a, uint8_t bits);
+
+uint8_t word_shl(struct Word *out, const struct Word *a, uint32_t shift, uint8_t bits);
+uint8_t word_shr(struct Word *out, const struct Word *a, uint32_t shift, uint8_t bits, bool arithmetic);
+uint8_t word_rol(struct Word *out, const struct Word *a, uint32_t shift, uint8_t bits);
+uint8_t word_ror(struct Word *out, const struct Word *a, uint32_t shift, uint8_t bits);
+uint32_t word_shift_count(const struct Word *a);
+
+uint8_t word_popcount(const struct Word *a);
+uint8_t word_clz(const struct Word *a, uint8_t bits);
+
+void word_benchmark();
+
+#endif
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <string.h>
+#include "word.h"
+#include "pico/stdlib.h"
+#include "cycles.h"
+
+// Cycle counts of every word operation at each word size, against the
+// compiler's uint64_t arithmetic where the word fits it and a bit at a time
+// reference that every result is checked against. Printed over stdio, and
+// only built into the firmware with CALC_BENCHMARKS.
+
+#define BENCH_ITERATIONS 64
+
+enum BenchOp
+{
+    BENCH_ADD,
+    BENCH_SUB,
+    BENCH_MUL,
+    BENCH_DIV,
+    BENCH_SDIV,
+    BENCH_SHL,
+    BENCH_SAR,
+    BENCH_ROL,
+    BENCH_POPCOUNT,
+    BENCH_CLZ,
+    BENCH_OPS,
+};
+
+static const char *const bench_names[BENCH_OPS] = {
+    [BENCH_ADD] = "add", [BENCH_SUB] = "sub", [BENCH_MUL] = "mul", [BENCH_DIV] = "div", [BENCH_SDIV] = "sdiv",
+    [BENCH_SHL] = "shl", [BENCH_SAR] = "sar", [BENCH_ROL] = "rol", [BENCH_POPCOUNT] = "popcnt", [BENCH_CLZ] = "clz",
+};
+
+static uint64_t bench_state = 0x9E3779B97F4A7C15ull;
+
+/// @brief xorshift64
+static uint64_t bench_random()
+{
+    bench_state ^= bench_state << 13;
+    bench_state ^= bench_state >> 7;
+    bench_state ^= bench_state << 17;
+    return bench_state;
+}
+
+/// @brief A random word of random magnitude, so divisions take every path.
+static void bench_operand(struct Word *out, uint8_t bits)
+{
+    for (int i = 0; i < WORD_LIMBS; i++)
+        out->limb[i] = bench_random();
+    word_resize(out, WORD_BITS_MAX, bits, false);
+    word_shr(out, out, bench_random() % bits, bits, false);
+}
+
+// Bit at a time reference, sharing nothing with word.c but word_bit()
+
+static void serial_set(struct Word *a, int bit, bool value)
+{
+    if (value)
+        a->limb[bit / 32] |= 1u << (bit % 32);
+    else
+        a->limb[bit / 32] &= ~(1u << (bit % 32));
+}
+
+static void serial_add(struct Word *out, const struct Word *a, const struct Word *b, int carry, uint8_t bits)
+{
+    struct Word sum = {0};
+    for (int i = 0; i < bits; i++)
+    {
+        int total = word_bit(a, i) + word_bit(b, i) + carry;
+        serial_set(&sum, i, total & 1);
+        carry = total >> 1;
+    }
+    *out = sum;
+}
+
+static void serial_not(struct Word *out, const struct Word *a, uint8_t bits)
+{
+    struct Word result = {0};
+    for (int i = 0; i < bits; i++)
+        serial_set(&result, i, !word_bit(a, i));
+    *out = result;
+}
+
+static void serial_sub(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits)
+{
+    struct Word inverse;
+    serial_not(&inverse, b, bits);
+    serial_add(out, a, &inverse, 1, bits);
+}
+
+static void serial_shift(struct Word *out, const struct Word *a, int shift, uint8_t bits, bool arithmetic)
+{
+    struct Word result = {0};
+    for (int i = 0; i < bits; i++)
+    {
+        int from = i - shift;
+        bool bit = from < 0 ? false : from >= bits ? arithmetic && word_bit(a, bits - 1) : word_bit(a, from);
+        serial_set(&result, i, bit);
+    }
+    *out = result;
+}
+
+static void serial_mul(struct Word *out, const struct Word *a, const struct Word *b, uint8_t bits)
+{
+    struct Word product = {0}, shifted;
+    for (int i = 0; i < bits; i++)
+    {
+        if (!word_bit(b, i))
+            continue;
+        serial_shift(&shifted, a, i, bits, false);
+        serial_add(&product, &product, &shifted, 0, bits);
+    }
+    *out = product;
+}
+
+static bool serial_less(const struct Word *a, const struct Word *b, uint8_t bits)
+{
+    for (int i = bits - 1; i >= 0; i--)
+        if (word_bit(a, i) != word_bit(b, i))
+            return word_bit(b, i);
+    return false;
+}
+
+/// @brief Restoring division, b not zero.
+static void serial_div(struct Word *q, const struct Word *a, const struct Word *b, uint8_t bits)
+{
+    struct Word quotient = {0}, remainder = {0};
+    for (int i = bits - 1; i >= 0; i--)
+    {
+        bool top = word_bit(&remainder, bits - 1); // shifted out, so the remainder is larger than b
+        serial_shift(&remainder, &remainder, 1, bits, false);
+        serial_set(&remainder, 0, word_bit(a, i));
+        if (top || !serial_less(&remainder, b, bits))
+        {
+            serial_sub(&remainder, &remainder, b, bits);
+            serial_set(&quotient, i, true);
+        }
+    }
+    *q = quotient;
+}
+
+static void serial_sdiv(struct Word *q, const struct Word *a, const struct Word *b, uint8_t bits)
+{
+    struct Word x = *a, y = *b, zero = {0};
+    bool negative_a = word_bit(a, bits - 1), negative_b = word_bit(b, bits - 1);
+    if (negative_a)
+        serial_sub(&x, &zero, a, bits);
+    if (negative_b)
+        serial_sub(&y, &zero, b, bits);
+    serial_div(q, &x, &y, bits);
+    if (negative_a != negative_b)
+        serial_sub(q, &zero, q, bits);
+}
+
+/// @brief One operation by the engine, the reference, or uint64_t when native. The result goes to out.
+static void bench_call(enum BenchOp op, int how, struct Word *out, const struct Word *a, const struct Word *b,
+                       uint32_t shift, uint8_t bits)
+{
+    uint64_t x = a->limb[0] | (uint64_t)a->limb[1] << 32;
+    uint64_t y = b->limb[0] | (uint64_t)b->limb[1] << 32;
+    uint64_t mask = bits == 64 ? ~0ull : (1ull << bits) - 1;
+    uint64_t r = 0;
+    int count = 0;
+
+    if (how == 0)
+    {
+        switch (op)
+        {
+        case BENCH_ADD: word_add(out, a, b, bits); break;
+        case BENCH_SUB: word_sub(out, a, b, bits); break;
+        case BENCH_MUL: word_mul(out, a, b, bits); break;
+        case BENCH_DIV: word_div(out, NULL, a, b, bits, false); break;
+        case BENCH_SDIV: word_div(out, NULL, a, b, bits, true); break;
+        case BENCH_SHL: word_shl(out, a, shift, bits); break;
+        case BENCH_SAR: word_shr(out, a, shift, bits, true); break;
+        case BENCH_ROL: word_rol(out, a, shift, bits); break;
+        case BENCH_POPCOUNT: word_set(out, word_popcount(a), bits); break;
+        default: word_set(out, word_clz(a, bits), bits); break;
+        }
+        return;
+    }
+
+    if (how == 1)
+    {
+        int64_t sx = bits == 64 ? (int64_t)x : (int64_t)(x << (64 - bits)) >> (64 - bits);
+        int64_t sy = bits == 64 ? (int64_t)y : (int64_t)(y << (64 - bits)) >> (64 - bits);
+        switch (op)
+        {
+        case BENCH_ADD: r = x + y; break;
+        case BENCH_SUB: r = x - y; break;
+        case BENCH_MUL: r = x * y; break;
+        case BENCH_DIV: r = x / y; break;
+        case BENCH_SDIV: r = sy == -1 ? -(uint64_t)sx : (uint64_t)(sx / sy); break;
+        case BENCH_SHL: r = x << shift; break;
+        case BENCH_SAR: r = (uint64_t)(sx >> shift); break;
+        case BENCH_ROL: shift &= bits - 1; r = shift ? x << shift | x >> (bits - shift) : x; break;
+        case BENCH_POPCOUNT:
+            for (; x; x &= x - 1)
+                count++;
+            r = count;
+            break;
+        default:
+            r = x ? __builtin_clzll(x) - (64 - bits) : bits;
+            break;
+        }
+        word_set(out, r & mask, bits);
+        return;
+    }
+
+    switch (op)
+    {
+    case BENCH_ADD: serial_add(out, a, b, 0, bits); break;
+    case BENCH_SUB: serial_sub(out, a, b, bits); break;
+    case BENCH_MUL: serial_mul(out, a, b, bits); break;
+    case BENCH_DIV: serial_div(out, a, b, bits); break;
+    case BENCH_SDIV: serial_sdiv(out, a, b, bits); break;
+    case BENCH_SHL: serial_shift(out, a, shift, bits, false); break;
+    case BENCH_SAR: serial_shift(out, a, -(int)shift, bits, true); break;
+    case BENCH_ROL:
+    {
+        struct Word high, low;
+        shift &= bits - 1;
+        serial_shift(&high, a, shift, bits, false);
+        serial_shift(&low, a, -(int)(bits - shift), bits, false);
+        for (int i = 0; i < WORD_LIMBS; i++)
+            out->limb[i] = high.limb[i] | low.limb[i];
+        break;
+    }
+    case BENCH_POPCOUNT:
+        for (int i = 0; i < bits; i++)
+            count += word_bit(a, i);
+        word_set(out, count, bits);
+        break;
+    default:
+        while (count < bits && !word_bit(a, bits - 1 - count))
+            count++;
+        word_set(out, count, bits);
+        break;
+    }
+}
+
+/// @brief Time every operation at 8, 16, 32, 64 and 128 bits and print the average cycles per call.
+void word_benchmark()
+{
+    static const uint8_t widths[] = {8, 16, 32, 64, 128};
+
+    cycles_init();
+    printf("word: average cycles per operation over %d operand pairs\n", BENCH_ITERATIONS);
+    printf("op     bits   engine  uint64  serial\n");
+
+    for (int op = 0; op < BENCH_OPS; op++)
+    {
+        for (size_t w = 0; w < sizeof(widths); w++)
+        {
+            uint8_t bits = widths[w];
+            uint32_t cycles[3] = {0};
+            uint32_t mismatches = 0;
+
+            for (int i = 0; i < BENCH_ITERATIONS; i++)
+            {
+                struct Word a, b, results[3];
+                bench_operand(&a, bits);
+                do
+                    bench_operand(&b, bits);
+                while ((op == BENCH_DIV || op == BENCH_SDIV) && word_is_zero(&b));
+                uint32_t shift = bench_random() % bits;
+
+                for (int how = 0; how < 3; how++)
+                {
+                    if (how == 1 && bits > 64)
+                        continue;
+                    uint32_t start = cycles_now();
+                    bench_call(op, how, &results[how], &a, &b, shift, bits);
+                    cycles[how] += cycles_since(start);
+                }
+                if (memcmp(&results[0], &results[2], sizeof(results[0])) ||
+                    (bits <= 64 && memcmp(&results[0], &results[1], sizeof(results[0]))))
+                    mismatches++;
+            }
+
+            printf("%-6s %4u %8lu", bench_names[op], bits, (unsigned long)(cycles[0] / BENCH_ITERATIONS));
+            if (bits <= 64)
+                printf(" %7lu", (unsigned long)(cycles[1] / BENCH_ITERATIONS));
+            else
+                printf(" %7s", "-");
+            printf(" %7lu", (unsigned long)(cycles[2] / BENCH_ITERATIONS));
+            if (mismatches)
+                printf("  %lu MISMATCHES", (unsigned long)mismatches);
+            printf("\n");
+        }
+    }
+}
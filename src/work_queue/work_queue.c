@@ -0,0 +1,69 @@
+#include "work_queue.h"
+#include "pico/stdlib.h"
+#include "pico/sync.h"
+#include "hot_path.h"
+
+// Interrupts post work here and return, the main loop pops and runs it.
+// Posting can happen from any IRQ on either core, so both ends take a
+// critical section; it is only held for a few instructions.
+static struct WorkItem queue[WORK_QUEUE_SIZE];
+static uint32_t queue_head;
+static uint32_t queue_tail;
+static uint32_t dropped;
+static critical_section_t lock;
+
+/// @brief Init the queue. Must be called before any interrupt that posts work is enabled.
+void work_queue_init()
+{
+    critical_section_init(&lock);
+}
+
+/// @brief Queue work for the main loop and wake it. Safe to call from interrupts.
+/// @param type what to do, application defined
+/// @param arg argument for the work
+/// @return false if the queue was full and the work was dropped
+bool HOT_FUNC(work_queue_post)(uint8_t type, uint32_t arg)
+{
+    bool posted = false;
+
+    critical_section_enter_blocking(&lock);
+    if (queue_head - queue_tail < WORK_QUEUE_SIZE)
+    {
+        queue[queue_head % WORK_QUEUE_SIZE] = (struct WorkItem){type, arg};
+        queue_head++;
+        posted = true;
+    }
+    else
+    {
+        dropped++;
+    }
+    critical_section_exit(&lock);
+
+    __sev(); // wake the main loop if it is in __wfe()
+    return posted;
+}
+
+/// @brief Take the oldest work item.
+/// @param out the work item, if there was one
+/// @return false if there is no pending work
+bool HOT_FUNC(work_queue_pop)(struct WorkItem *out)
+{
+    bool popped = false;
+
+    critical_section_enter_blocking(&lock);
+    if (queue_tail != queue_head)
+    {
+        *out = queue[queue_tail % WORK_QUEUE_SIZE];
+        queue_tail++;
+        popped = true;
+    }
+    critical_section_exit(&lock);
+
+    return popped;
+}
+
+/// @brief Number of work items dropped because the queue was full.
+uint32_t work_queue_dropped()
+{
+    return dropped;
+}
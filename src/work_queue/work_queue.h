@@ -0,0 +1,20 @@
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WORK_QUEUE_SIZE 16 // pending work items, must be a power of 2
+
+struct WorkItem
+{
+    uint8_t type; // application defined
+    uint32_t arg;
+};
+
+void work_queue_init();
+bool work_queue_post(uint8_t type, uint32_t arg);
+bool work_queue_pop(struct WorkItem *out);
+uint32_t work_queue_dropped();
+
+#endif
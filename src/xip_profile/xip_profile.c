@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include "xip_profile.h"
+#include "pico/stdlib.h"
+#include "pico/sync.h"
+
+#if XIP_PROFILE_ENABLED
+
+// Totals per span, added to when a span ends. The hit and access counters
+// belong to the XIP block and are shared by both cores, so a span also
+// counts what the other core fetched from flash meanwhile. Key handling and
+// drawing mostly take turns, but compare builds over the same keys.
+//
+// xip_profile_end() runs from SRAM in every build, so ending a span cannot
+// itself miss before the counters are read.
+
+struct XipProfileTotal
+{
+    uint32_t samples;
+    uint32_t dropped; // the counters were cleared while the span was open
+    uint64_t hits;
+    uint64_t accesses;
+    uint64_t us;
+};
+
+static const char *const span_names[XIP_PROFILE_SPAN_COUNT] = {
+    [XIP_PROFILE_IRQ] = "irq",
+    [XIP_PROFILE_DRAIN] = "fifo_drain",
+    [XIP_PROFILE_EVALUATE] = "evaluate",
+    [XIP_PROFILE_LEDS] = "leds",
+    [XIP_PROFILE_DRAW] = "draw",
+    [XIP_PROFILE_FLUSH] = "flush",
+};
+
+static struct XipProfileTotal totals[XIP_PROFILE_SPAN_COUNT];
+static critical_section_t lock;
+
+/// @brief Init the totals and start the counters from zero. Call before any span can end.
+void xip_profile_init()
+{
+    critical_section_init(&lock);
+    xip_profile_clear();
+}
+
+/// @brief Add a span that started at `start`, a value from xip_profile_begin(), and ends now.
+/// @param span enum XipProfileSpan
+/// @param start counters at the start
+void __not_in_flash_func(xip_profile_end)(uint8_t span, struct XipProfileMark start)
+{
+    uint32_t hits = xip_ctrl_hw->ctr_hit;
+    uint32_t accesses = xip_ctrl_hw->ctr_acc;
+    uint64_t now = time_us_64();
+
+    critical_section_enter_blocking(&lock);
+    struct XipProfileTotal *total = &totals[span];
+    if (accesses < start.accesses || hits < start.hits)
+    {
+        total->dropped++;
+    }
+    else
+    {
+        total->samples++;
+        total->hits += hits - start.hits;
+        total->accesses += accesses - start.accesses;
+        total->us += now - start.us;
+    }
+    critical_section_exit(&lock);
+}
+
+/// @brief Zero the totals and the counters.
+void xip_profile_clear()
+{
+    critical_section_enter_blocking(&lock);
+    for (int i = 0; i < XIP_PROFILE_SPAN_COUNT; i++)
+        totals[i] = (struct XipProfileTotal){0};
+    xip_ctrl_hw->ctr_acc = 0;
+    xip_ctrl_hw->ctr_hit = 0;
+    critical_section_exit(&lock);
+}
+
+static uint32_t per(uint64_t value, uint32_t samples)
+{
+    return samples ? (uint32_t)((value + samples / 2) / samples) : 0;
+}
+
+/// @brief Print the totals of every span and the misses per keypress and per frame, over USB stdio.
+void xip_profile_dump()
+{
+    struct XipProfileTotal copy[XIP_PROFILE_SPAN_COUNT];
+    critical_section_enter_blocking(&lock);
+    for (int i = 0; i < XIP_PROFILE_SPAN_COUNT; i++)
+        copy[i] = totals[i];
+    critical_section_exit(&lock);
+
+    printf("%-10s %8s %9s %9s %6s %4s   means per sample\n", "span", "samples", "accesses", "misses", "miss%", "us");
+    for (int i = 0; i < XIP_PROFILE_SPAN_COUNT; i++)
+    {
+        const struct XipProfileTotal *t = &copy[i];
+        uint64_t misses = t->accesses - t->hits;
+        uint32_t tenths = t->accesses ? (uint32_t)((misses * 1000 + t->accesses / 2) / t->accesses) : 0;
+        printf("%-10s %8lu %9lu %9lu %4lu.%lu %4lu", span_names[i], (unsigned long)t->samples,
+               (unsigned long)per(t->accesses, t->samples), (unsigned long)per(misses, t->samples),
+               (unsigned long)(tenths / 10), (unsigned long)(tenths % 10), (unsigned long)per(t->us, t->samples));
+        if (t->dropped)
+            printf("  %lu dropped", (unsigned long)t->dropped);
+        printf("\n");
+    }
+
+    // A keypress is one TCA8418_INT, which may carry more than one key event
+    uint32_t keys = copy[XIP_PROFILE_IRQ].samples;
+    uint64_t key_misses = 0;
+    for (int i = XIP_PROFILE_IRQ; i <= XIP_PROFILE_EVALUATE; i++)
+        key_misses += copy[i].accesses - copy[i].hits;
+    uint32_t frames = copy[XIP_PROFILE_DRAW].samples;
+    uint64_t frame_misses = copy[XIP_PROFILE_DRAW].accesses - copy[XIP_PROFILE_DRAW].hits;
+
+    printf("per keypress: %lu misses over %lu keypresses\n", (unsigned long)per(key_misses, keys), (unsigned long)keys);
+    printf("per frame: %lu misses over %lu frames\n", (unsigned long)per(frame_misses, frames), (unsigned long)frames);
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef XIP_PROFILE_H
+#define XIP_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/time.h"
+
+#if XIP_PROFILE_ENABLED
+#include "hardware/structs/xip_ctrl.h"
+#endif
+
+// Subsystems whose XIP cache accesses are counted. A keypress is the
+// interrupt, the drain and the evaluation; a frame is the draw. The LEDs are
+// counted within evaluate and the flush within draw.
+enum XipProfileSpan
+{
+    XIP_PROFILE_IRQ,      // gpio_callback, from TCA8418_INT
+    XIP_PROFILE_DRAIN,    // reading the TCA8418 FIFO
+    XIP_PROFILE_EVALUATE, // handling the decoded key events
+    XIP_PROFILE_LEDS,     // setting the bit LEDs, within evaluate
+    XIP_PROFILE_DRAW,     // drawing a frame on core 1
+    XIP_PROFILE_FLUSH,    // queueing its bytes for the panel, within draw
+    XIP_PROFILE_SPAN_COUNT
+};
+
+// Cache counters and time at the start of a span
+struct XipProfileMark
+{
+    uint32_t hits;
+    uint32_t accesses;
+    uint64_t us;
+};
+
+#if XIP_PROFILE_ENABLED
+
+/// @brief Counters for the start of a span, pass them to xip_profile_end().
+static inline struct XipProfileMark xip_profile_begin()
+{
+    // The counters saturate, so they are cleared long before. A span open
+    // on the other core across the clear is dropped by xip_profile_end().
+    if (xip_ctrl_hw->ctr_acc & 0x80000000u)
+    {
+        xip_ctrl_hw->ctr_acc = 0;
+        xip_ctrl_hw->ctr_hit = 0;
+    }
+    return (struct XipProfileMark){xip_ctrl_hw->ctr_hit, xip_ctrl_hw->ctr_acc, time_us_64()};
+}
+
+void xip_profile_init();
+void xip_profile_end(uint8_t span, struct XipProfileMark start);
+void xip_profile_clear();
+void xip_profile_dump();
+
+#else
+
+static inline struct XipProfileMark xip_profile_begin()
+{
+    return (struct XipProfileMark){0};
+}
+
+static inline void xip_profile_init()
+{
+}
+
+static inline void xip_profile_end(uint8_t span, struct XipProfileMark start)
+{
+}
+
+static inline void xip_profile_clear()
+{
+}
+
+static inline void xip_profile_dump()
+{
+}
+
+#endif
+
+#endif